@@ -38,6 +38,7 @@
 #include "hw/audiodev.h"
 #include "kvm.h"
 #include "migration.h"
+#include "balloon.h"
 #include "net.h"
 #include "gdbstub.h"
 #include "hw/smbios.h"
@@ -246,6 +247,64 @@ static int ram_save_block(QEMUFile *f)
 
 static uint64_t bytes_transferred;
 
+/*
+ * Free page hinting: during the first pass over RAM the guest may report,
+ * through the balloon device, pages that it does not use.  They are not
+ * sent unless they are dirtied again.  The guest keeps the reported pages
+ * to itself until hinting is stopped, and hints that arrive later are
+ * dropped, so a page cannot be written between being reported and having
+ * its dirty bit cleared here.
+ */
+static bool free_page_hinting;
+static uint64_t bytes_skipped;
+
+void ram_free_page_hint(MemoryRegion *mr, ram_addr_t offset, ram_addr_t len)
+{
+    ram_addr_t end = (offset + len) & TARGET_PAGE_MASK;
+    ram_addr_t run = 0;
+
+    if (!free_page_hinting) {
+        return;
+    }
+
+    /* Clear runs of dirty pages at once: under TCG every reset also
+       resets the dirty state of the TLBs of all CPUs.  */
+    for (offset = TARGET_PAGE_ALIGN(offset); offset < end;
+         offset += TARGET_PAGE_SIZE) {
+        if (memory_region_get_dirty(mr, offset, TARGET_PAGE_SIZE,
+                                    DIRTY_MEMORY_MIGRATION)) {
+            run += TARGET_PAGE_SIZE;
+            continue;
+        }
+        if (run) {
+            memory_region_reset_dirty(mr, offset - run, run,
+                                      DIRTY_MEMORY_MIGRATION);
+            bytes_skipped += run;
+            run = 0;
+        }
+    }
+    if (run) {
+        memory_region_reset_dirty(mr, offset - run, run,
+                                  DIRTY_MEMORY_MIGRATION);
+        bytes_skipped += run;
+    }
+}
+
+/* Hints are only worth it for the first pass: stop them before the dirty
+   bitmap is synced for the first time.  */
+static void free_page_hint_stop(void)
+{
+    if (free_page_hinting) {
+        free_page_hinting = false;
+        qemu_balloon_free_page_stop();
+    }
+}
+
+uint64_t ram_bytes_skipped(void)
+{
+    return bytes_skipped;
+}
+
 static ram_addr_t ram_save_remaining(void)
 {
     return ram_list.dirty_pages;
@@ -303,6 +362,7 @@ static void sort_ram_list(void)
 
 static void migration_end(void)
 {
+    free_page_hint_stop();
     memory_global_dirty_log_stop();
 }
 
@@ -319,6 +379,7 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
     RAMBlock *block;
 
     bytes_transferred = 0;
+    bytes_skipped = 0;
     last_block = NULL;
     last_offset = 0;
     sort_ram_list();
@@ -335,6 +396,9 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
 
     memory_global_dirty_log_start();
 
+    /* ask the guest for its free pages now that writes are tracked */
+    free_page_hinting = qemu_balloon_free_page_start();
+
     qemu_put_be64(f, ram_bytes_total() | RAM_SAVE_FLAG_MEM_SIZE);
 
     QLIST_FOREACH(block, &ram_list.blocks, next) {
@@ -406,6 +470,7 @@ static int ram_save_iterate(QEMUFile *f, void *opaque)
             expected_time, migrate_max_downtime());
 
     if (expected_time <= migrate_max_downtime()) {
+        free_page_hint_stop();
         memory_global_sync_dirty_bitmap(get_system_memory());
         expected_time = ram_save_remaining() * TARGET_PAGE_SIZE / bwidth;
 
@@ -416,6 +481,7 @@ static int ram_save_iterate(QEMUFile *f, void *opaque)
 
 static int ram_save_complete(QEMUFile *f, void *opaque)
 {
+    free_page_hint_stop();
     memory_global_sync_dirty_bitmap(get_system_memory());
 
     /* try transferring iterative blocks of memory */
@@ -34,6 +34,7 @@
 
 static QEMUBalloonEvent *balloon_event_fn;
 static QEMUBalloonStatus *balloon_stat_fn;
+static QEMUBalloonFreePageHint *balloon_free_page_fn;
 static void *balloon_opaque;
 
 int qemu_add_balloon_handler(QEMUBalloonEvent *event_func,
@@ -52,6 +53,16 @@ int qemu_add_balloon_handler(QEMUBalloonEvent *event_func,
     return 0;
 }
 
+/* Must be called after qemu_add_balloon_handler(), with the same opaque */
+void qemu_add_balloon_free_page_handler(QEMUBalloonFreePageHint *hint_func,
+                                        void *opaque)
+{
+    if (balloon_opaque != opaque) {
+        return;
+    }
+    balloon_free_page_fn = hint_func;
+}
+
 void qemu_remove_balloon_handler(void *opaque)
 {
     if (balloon_opaque != opaque) {
@@ -59,9 +70,30 @@ void qemu_remove_balloon_handler(void *opaque)
     }
     balloon_event_fn = NULL;
     balloon_stat_fn = NULL;
+    balloon_free_page_fn = NULL;
     balloon_opaque = NULL;
 }
 
+/*
+ * Ask the guest to report its free pages with ram_free_page_hint(), until
+ * qemu_balloon_free_page_stop().  Returns false if the balloon device or
+ * the guest driver do not support it.
+ */
+bool qemu_balloon_free_page_start(void)
+{
+    if (!balloon_free_page_fn) {
+        return false;
+    }
+    return balloon_free_page_fn(balloon_opaque, true);
+}
+
+void qemu_balloon_free_page_stop(void)
+{
+    if (balloon_free_page_fn) {
+        balloon_free_page_fn(balloon_opaque, false);
+    }
+}
+
 static int qemu_balloon(ram_addr_t target)
 {
     if (!balloon_event_fn) {
@@ -19,11 +19,17 @@
 
 typedef void (QEMUBalloonEvent)(void *opaque, ram_addr_t target);
 typedef void (QEMUBalloonStatus)(void *opaque, BalloonInfo *info);
+typedef bool (QEMUBalloonFreePageHint)(void *opaque, bool start);
 
 int qemu_add_balloon_handler(QEMUBalloonEvent *event_func,
 			     QEMUBalloonStatus *stat_func, void *opaque);
+void qemu_add_balloon_free_page_handler(QEMUBalloonFreePageHint *hint_func,
+                                        void *opaque);
 void qemu_remove_balloon_handler(void *opaque);
 
+bool qemu_balloon_free_page_start(void);
+void qemu_balloon_free_page_stop(void);
+
 void qemu_balloon_changed(int64_t actual);
 
 #endif
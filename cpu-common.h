@@ -47,10 +47,16 @@ void qemu_put_ram_ptr(void *addr);
 /* This should not be used by devices.  */
 int qemu_ram_addr_from_host(void *ptr, ram_addr_t *ram_addr);
 ram_addr_t qemu_ram_addr_from_host_nofail(void *ptr);
+int qemu_ram_get_fd(void *ptr, ram_addr_t *offset, ram_addr_t *avail);
 void qemu_ram_set_idstr(ram_addr_t addr, const char *name, DeviceState *dev);
+void qemu_ram_set_numa_node(ram_addr_t addr, int node);
+void qemu_ram_prealloc_all(void);
 
 void cpu_physical_memory_rw(target_phys_addr_t addr, uint8_t *buf,
                             int len, int is_write);
+bool cpu_physical_memory_rw_nolock(target_phys_addr_t addr, uint8_t *buf,
+                                   int len, int is_write);
+bool cpu_ioport_rw_nolock(uint32_t port, uint8_t *buf, int len, int is_write);
 static inline void cpu_physical_memory_read(target_phys_addr_t addr,
                                             void *buf, int len)
 {
@@ -66,6 +72,7 @@ void *cpu_physical_memory_map(target_phys_addr_t addr,
                               int is_write);
 void cpu_physical_memory_unmap(void *buffer, target_phys_addr_t len,
                                int is_write, target_phys_addr_t access_len);
+void qemu_ram_set_dirty(ram_addr_t addr, ram_addr_t len);
 void *cpu_register_map_client(void *opaque, void (*callback)(void *opaque));
 void cpu_unregister_map_client(void *cookie);
 
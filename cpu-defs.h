@@ -225,6 +225,13 @@ typedef struct CPUWatchpoint {
     struct KVMState *kvm_state;                                         \
     struct kvm_run *kvm_run;                                            \
     int kvm_fd;                                                         \
-    int kvm_vcpu_dirty;
+    int kvm_vcpu_dirty;                                                 \
+                                                                        \
+    /* Userspace halt polling, see qemu_kvm_wait_io_event() */          \
+    int64_t halt_poll_ns;       /* current polling window */            \
+    uint64_t halt_poll_halts;   /* halts seen while polling enabled */  \
+    uint64_t halt_poll_polls;   /* halts that polled */                 \
+    uint64_t halt_poll_hits;    /* polls that saw the wakeup */         \
+    uint64_t halt_poll_spin_ns; /* time spent polling */
 
 #endif
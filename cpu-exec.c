@@ -601,6 +601,23 @@ int cpu_exec(CPUArchState *env)
                     tc_ptr = tb->tc_ptr;
                     /* execute the generated code */
                     next_tb = tcg_qemu_tb_exec(env, tc_ptr);
+                    if (unlikely(tb_profile_enabled)) {
+                        tb_profile_entries++;
+                        if (next_tb & ~3) {
+                            ((TranslationBlock *)(next_tb & ~3))->exit_count++;
+                        }
+                    }
+                    if (unlikely((next_tb & 3) == 3)) {
+                        /* The TB became hot before executing any
+                           instruction: replace it with an optimized
+                           translation.  */
+                        tb = (TranslationBlock *)(next_tb & ~3);
+                        cpu_pc_from_tb(env, tb);
+                        spin_lock(&tb_lock);
+                        tb_retranslate(env, tb);
+                        spin_unlock(&tb_lock);
+                        next_tb = 0;
+                    }
                     if ((next_tb & 3) == 2) {
                         /* Instruction counter expired.  */
                         int insns_left;
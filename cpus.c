@@ -33,6 +33,8 @@
 #include "qmp-commands.h"
 
 #include "qemu-thread.h"
+#include "qemu-barrier.h"
+#include "qemu-config.h"
 #include "cpus.h"
 #include "qtest.h"
 #include "main-loop.h"
@@ -112,6 +114,10 @@ typedef struct TimersState {
 
 TimersState timers_state;
 
+/* Odd while cpu_clock_offset and cpu_ticks_enabled are being changed, so
+ * that cpu_get_clock() can run outside the global mutex.  */
+static unsigned timers_seq;
+
 /* Return the virtual CPU time, based on the instruction counter.  */
 int64_t cpu_get_icount(void)
 {
@@ -153,12 +159,31 @@ int64_t cpu_get_ticks(void)
 int64_t cpu_get_clock(void)
 {
     int64_t ti;
-    if (!timers_state.cpu_ticks_enabled) {
-        return timers_state.cpu_clock_offset;
-    } else {
-        ti = get_clock();
-        return ti + timers_state.cpu_clock_offset;
-    }
+    unsigned seq;
+
+    do {
+        seq = timers_seq;
+        smp_rmb();
+        if (!timers_state.cpu_ticks_enabled) {
+            ti = timers_state.cpu_clock_offset;
+        } else {
+            ti = get_clock() + timers_state.cpu_clock_offset;
+        }
+        smp_rmb();
+    } while ((seq & 1) || seq != *(volatile unsigned *)&timers_seq);
+    return ti;
+}
+
+static void timers_write_begin(void)
+{
+    timers_seq++;
+    smp_wmb();
+}
+
+static void timers_write_end(void)
+{
+    smp_wmb();
+    timers_seq++;
 }
 
 /* enable cpu_get_ticks() */
@@ -166,8 +191,10 @@ void cpu_enable_ticks(void)
 {
     if (!timers_state.cpu_ticks_enabled) {
         timers_state.cpu_ticks_offset -= cpu_get_real_ticks();
+        timers_write_begin();
         timers_state.cpu_clock_offset -= get_clock();
         timers_state.cpu_ticks_enabled = 1;
+        timers_write_end();
     }
 }
 
@@ -176,9 +203,13 @@ void cpu_enable_ticks(void)
 void cpu_disable_ticks(void)
 {
     if (timers_state.cpu_ticks_enabled) {
+        int64_t clock = cpu_get_clock();
+
         timers_state.cpu_ticks_offset = cpu_get_ticks();
-        timers_state.cpu_clock_offset = cpu_get_clock();
+        timers_write_begin();
+        timers_state.cpu_clock_offset = clock;
         timers_state.cpu_ticks_enabled = 0;
+        timers_write_end();
     }
 }
 
@@ -626,6 +657,8 @@ static QemuCond qemu_cpu_cond;
 static QemuCond qemu_pause_cond;
 static QemuCond qemu_work_cond;
 
+static void qemu_kvm_halt_poll_init(void);
+
 void qemu_init_cpu_loop(void)
 {
     qemu_init_sigbus();
@@ -636,6 +669,7 @@ void qemu_init_cpu_loop(void)
     qemu_mutex_init(&qemu_global_mutex);
 
     qemu_thread_get_self(&io_thread);
+    qemu_kvm_halt_poll_init();
 }
 
 void run_on_cpu(CPUArchState *env, void (*func)(void *data), void *data)
@@ -715,16 +749,124 @@ static void qemu_tcg_wait_io_event(void)
     }
 }
 
+/*
+ * Halt polling.  With the irqchip in userspace a halted vCPU sleeps on
+ * halt_cond, and the interrupt that ends the halt has to wake it up
+ * through the scheduler.  If the wakeup tends to come soon after the
+ * halt, spinning for a while first is cheaper.  Each vCPU adapts its
+ * polling window between 0 and halt_poll_max_ns: the window grows when
+ * the wakeup came shortly after the window expired, and shrinks when the
+ * vCPU stayed halted for longer than halt_poll_max_ns.
+ */
+#define HALT_POLL_START_NS 10000
+
+static int64_t halt_poll_max_ns;
+static unsigned int halt_poll_grow = 2;
+static unsigned int halt_poll_shrink;
+
+static void qemu_kvm_halt_poll_init(void)
+{
+    QemuOptsList *list = qemu_find_opts("machine");
+    QemuOpts *opts = QTAILQ_FIRST(&list->head);
+
+    if (!opts) {
+        return;
+    }
+    halt_poll_max_ns = qemu_opt_get_number(opts, "halt_poll_ns", 0);
+    halt_poll_grow = qemu_opt_get_number(opts, "halt_poll_grow", 2);
+    if (halt_poll_grow < 2) {
+        /* the window would never grow past HALT_POLL_START_NS */
+        fprintf(stderr, "qemu: halt_poll_grow must be at least 2\n");
+        exit(1);
+    }
+    halt_poll_shrink = qemu_opt_get_number(opts, "halt_poll_shrink", 0);
+}
+
+/* Spin without the global mutex until @env has work or the polling
+ * window expires.  The check is only a hint; the caller checks again
+ * with the mutex held.
+ */
+static bool qemu_kvm_halt_poll(CPUArchState *env, int64_t start)
+{
+    int64_t deadline = start + env->halt_poll_ns;
+    bool woken;
+
+    qemu_mutex_unlock(&qemu_global_mutex);
+    do {
+        smp_rmb();
+        woken = !cpu_thread_is_idle(env);
+    } while (!woken && get_clock() < deadline);
+    qemu_mutex_lock(&qemu_global_mutex);
+
+    return woken;
+}
+
+static void qemu_kvm_halt_poll_adjust(CPUArchState *env, int64_t block_ns)
+{
+    int64_t val = env->halt_poll_ns;
+
+    if (block_ns > halt_poll_max_ns) {
+        val = halt_poll_shrink ? val / halt_poll_shrink : 0;
+    } else if (val < block_ns) {
+        val = val ? val * halt_poll_grow : HALT_POLL_START_NS;
+        val = MIN(val, halt_poll_max_ns);
+    }
+    env->halt_poll_ns = val;
+}
+
 static void qemu_kvm_wait_io_event(CPUArchState *env)
 {
+    bool halt_poll = false;
+    bool woken = false;
+    int64_t start = 0;
+
+    if (halt_poll_max_ns && env->halted && cpu_thread_is_idle(env) &&
+        !env->stopped && runstate_is_running()) {
+        halt_poll = true;
+        start = get_clock();
+        env->halt_poll_halts++;
+        if (env->halt_poll_ns) {
+            woken = qemu_kvm_halt_poll(env, start);
+            env->halt_poll_polls++;
+            env->halt_poll_hits += woken;
+            env->halt_poll_spin_ns += get_clock() - start;
+        }
+    }
+
     while (cpu_thread_is_idle(env)) {
         qemu_cond_wait(env->halt_cond, &qemu_global_mutex);
     }
 
+    if (halt_poll && !woken) {
+        qemu_kvm_halt_poll_adjust(env, get_clock() - start);
+    }
+
     qemu_kvm_eat_signals(env);
     qemu_wait_io_event_common(env);
 }
 
+void halt_poll_info(fprintf_function cpu_fprintf, void *f)
+{
+    CPUArchState *env;
+
+    if (!halt_poll_max_ns) {
+        cpu_fprintf(f, "halt polling disabled\n");
+        return;
+    }
+    cpu_fprintf(f, "max %" PRId64 " ns, grow %u, shrink %u\n",
+                halt_poll_max_ns, halt_poll_grow, halt_poll_shrink);
+    for (env = first_cpu; env != NULL; env = env->next_cpu) {
+        cpu_fprintf(f, "CPU #%d: window %" PRId64 " ns, %" PRIu64 " halts, %"
+                    PRIu64 " polled, %" PRIu64 " woken while polling "
+                    "(%.1f%%), %" PRIu64 " us spent polling\n",
+                    env->cpu_index, env->halt_poll_ns, env->halt_poll_halts,
+                    env->halt_poll_polls, env->halt_poll_hits,
+                    env->halt_poll_polls ?
+                    100.0 * env->halt_poll_hits / env->halt_poll_polls : 0.0,
+                    env->halt_poll_spin_ns / 1000);
+    }
+}
+
 static void *qemu_kvm_cpu_thread_fn(void *arg)
 {
     CPUArchState *env = arg;
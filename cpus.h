@@ -12,6 +12,7 @@ void cpu_synchronize_all_post_reset(void);
 void cpu_synchronize_all_post_init(void);
 
 void qtest_clock_warp(int64_t dest);
+void halt_poll_info(fprintf_function cpu_fprintf, void *f);
 
 /* vl.c */
 extern int smp_cores;
@@ -19,11 +19,27 @@
 /* we need this function in hmp.c */
 void qmp_dump_guest_memory(bool paging, const char *file, bool has_begin,
                            int64_t begin, bool has_length, int64_t length,
+                           bool has_format, DumpGuestMemoryFormat format,
+                           bool has_detach, bool detach,
+                           bool has_threads, int64_t threads,
                            Error **errp)
 {
     error_set(errp, QERR_UNSUPPORTED);
 }
 
+bool dump_in_progress(void)
+{
+    return false;
+}
+
+DumpQueryResult *qmp_query_dump(Error **errp)
+{
+    DumpQueryResult *result = g_malloc0(sizeof(*result));
+
+    result->status = DUMP_STATUS_NONE;
+    return result;
+}
+
 int cpu_write_elf64_note(write_core_dump_function f,
                                        CPUArchState *env, int cpuid,
                                        void *opaque)
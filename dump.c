@@ -11,6 +11,14 @@
  *
  */
 
+#include <zlib.h>
+#ifdef CONFIG_LZO
+#include <lzo/lzo1x.h>
+#endif
+#ifdef CONFIG_SNAPPY
+#include <snappy-c.h>
+#endif
+
 #include "qemu-common.h"
 #include "elf.h"
 #include "cpu.h"
@@ -24,6 +32,161 @@
 #include "error.h"
 #include "qmp-commands.h"
 #include "gdbstub.h"
+#include "qemu-thread.h"
+#include "event_notifier.h"
+#include "exec-memory.h"
+#include "migration.h"
+
+/*
+ * kdump-compressed format, as written by makedumpfile and read by crash:
+ *
+ *   --------------------------------
+ *   | disk dump header    (block 0) |
+ *   --------------------------------
+ *   | kdump sub header, elf notes   |
+ *   --------------------------------
+ *   | 1st bitmap: RAM pages         |
+ *   --------------------------------
+ *   | 2nd bitmap: dumped pages      |
+ *   --------------------------------
+ *   | page descriptors, pfn order   |
+ *   --------------------------------
+ *   | zero page, page data          |
+ *   --------------------------------
+ *
+ * Page frame numbers are guest-physical addresses, so the RAM is taken
+ * from the memory map rather than from the RAM blocks.
+ *
+ * The headers, the bitmaps and the descriptors are in target endianness.
+ * All pages that only contain zeroes point to the same copy; the others
+ * are compressed independently, so that several threads can compress
+ * chunks of pages at the same time.
+ */
+#define KDUMP_SIGNATURE             "KDUMP   "
+#define KDUMP_SIG_LEN               (sizeof(KDUMP_SIGNATURE) - 1)
+#define KDUMP_HEADER_VERSION        6
+#define DUMP_DH_COMPRESSED_ZLIB     0x1
+#define DUMP_DH_COMPRESSED_LZO      0x2
+#define DUMP_DH_COMPRESSED_SNAPPY   0x4
+
+/*
+ * Flattened format, used when the output is not seekable: every piece of
+ * the file is preceded by its offset and size, "makedumpfile -R" puts
+ * them back into place.  All fields are big endian.
+ */
+#define MAKEDUMPFILE_SIGNATURE      "makedumpfile"
+#define MAKEDUMPFILE_HEADER_SIZE    4096
+#define MAKEDUMPFILE_TYPE_FLAT      1
+#define MAKEDUMPFILE_VERSION_FLAT   1
+#define MAKEDUMPFILE_END_FLAG       -1
+
+#define DUMP_CHUNK_PAGES            256
+#define DUMP_MAX_THREADS            16
+
+typedef struct QEMU_PACKED NewUtsname {
+    char sysname[65];
+    char nodename[65];
+    char release[65];
+    char version[65];
+    char machine[65];
+    char domainname[65];
+} NewUtsname;
+
+/*
+ * The 32-bit and 64-bit headers only differ in the size of the target's
+ * struct timeval and longs; the fields after those are shared.
+ */
+typedef struct QEMU_PACKED DiskDumpHeaderTail {
+    uint32_t status;            /* DUMP_DH_COMPRESSED_* */
+    uint32_t block_size;
+    uint32_t sub_hdr_size;      /* in blocks */
+    uint32_t bitmap_blocks;     /* both bitmaps, in blocks */
+    uint32_t max_mapnr;         /* obsolete in version 6 */
+    uint32_t total_ram_blocks;
+    uint32_t device_blocks;
+    uint32_t written_blocks;
+    uint32_t current_cpu;
+    uint32_t nr_cpus;
+} DiskDumpHeaderTail;
+
+typedef struct QEMU_PACKED DiskDumpHeader32 {
+    char signature[KDUMP_SIG_LEN];
+    uint32_t header_version;
+    NewUtsname utsname;
+    char timestamp[10];         /* struct timeval of the target */
+    DiskDumpHeaderTail tail;
+} DiskDumpHeader32;
+
+typedef struct QEMU_PACKED DiskDumpHeader64 {
+    char signature[KDUMP_SIG_LEN];
+    uint32_t header_version;
+    NewUtsname utsname;
+    char timestamp[22];
+    DiskDumpHeaderTail tail;
+} DiskDumpHeader64;
+
+/*
+ * The sizes are longs of the target but the offsets are always 64-bit, so
+ * the two sub headers have no common tail.
+ */
+typedef struct QEMU_PACKED KdumpSubHeader32 {
+    uint32_t phys_base;
+    uint32_t dump_level;
+    uint32_t split;
+    uint32_t start_pfn;         /* obsolete in version 6 */
+    uint32_t end_pfn;           /* obsolete in version 6 */
+    uint64_t offset_vmcoreinfo;
+    uint32_t size_vmcoreinfo;
+    uint64_t offset_note;
+    uint32_t size_note;
+    uint64_t offset_eraseinfo;
+    uint32_t size_eraseinfo;
+    uint64_t start_pfn_64;
+    uint64_t end_pfn_64;
+    uint64_t max_mapnr_64;
+} KdumpSubHeader32;
+
+typedef struct QEMU_PACKED KdumpSubHeader64 {
+    uint64_t phys_base;
+    uint32_t dump_level;
+    uint32_t split;
+    uint64_t start_pfn;
+    uint64_t end_pfn;
+    uint64_t offset_vmcoreinfo;
+    uint64_t size_vmcoreinfo;
+    uint64_t offset_note;
+    uint64_t size_note;
+    uint64_t offset_eraseinfo;
+    uint64_t size_eraseinfo;
+    uint64_t start_pfn_64;
+    uint64_t end_pfn_64;
+    uint64_t max_mapnr_64;
+} KdumpSubHeader64;
+
+typedef struct QEMU_PACKED PageDescriptor {
+    uint64_t offset;            /* of the page data in the file */
+    uint32_t size;              /* of the page data */
+    uint32_t flags;             /* DUMP_DH_COMPRESSED_*, 0 if stored raw */
+    uint64_t page_flags;
+} PageDescriptor;
+
+typedef struct QEMU_PACKED MakedumpfileHeader {
+    char signature[16];
+    int64_t type;
+    int64_t version;
+} MakedumpfileHeader;
+
+typedef struct QEMU_PACKED MakedumpfileDataHeader {
+    int64_t offset;
+    int64_t buf_size;
+} MakedumpfileDataHeader;
+
+/* guest RAM, contiguous in guest-physical and in host memory */
+typedef struct DumpRange {
+    target_phys_addr_t phys_addr;
+    uint64_t length;
+    uint8_t *host;
+} DumpRange;
 
 static uint16_t cpu_convert_to_target16(uint16_t val, int endian)
 {
@@ -75,13 +238,68 @@ typedef struct DumpState {
     int64_t begin;
     int64_t length;
     Error **errp;
+
+    /* kdump-compressed format */
+    DumpGuestMemoryFormat format;
+    uint32_t compression;       /* DUMP_DH_COMPRESSED_* */
+    bool flat;                  /* output not seekable */
+    DumpRange *ranges;          /* sorted by address */
+    int nr_ranges;
+    uint64_t nr_pages;
+    uint64_t max_mapnr;
+    uint32_t sub_hdr_size;      /* in blocks */
+    size_t bitmap_size;         /* of one bitmap, in bytes */
+    uint8_t *note_buf;
+    size_t note_buf_offset;
+    uint64_t offset_page_desc;
+    uint64_t zero_page_offset;
+    int nr_threads;
+
+    /*
+     * Shared with the compression threads and with query-dump.  Writes to
+     * the file are serialized by the lock as well.
+     */
+    QemuMutex lock;
+    uint64_t next_chunk;
+    uint64_t offset_data;       /* where the next page data is written */
+    bool failed;
+    uint64_t done;              /* bytes of guest memory written */
+    uint64_t total;
+
+    /* detached dump */
+    QemuThread thread;
+    EventNotifier finished;
+    Error *migration_blocker;
+    int ret;
 } DumpState;
 
+typedef struct DumpWorker {
+    DumpState *s;
+    QemuThread thread;
+    uint8_t *data;              /* page data of the current chunk */
+    uint8_t *cbuf;              /* one compressed page */
+    size_t cbuf_size;
+    PageDescriptor desc[DUMP_CHUNK_PAGES];
+    bool zero[DUMP_CHUNK_PAGES];
+#ifdef CONFIG_LZO
+    lzo_bytep wrkmem;
+#endif
+} DumpWorker;
+
+/* The dump running in the background, if any, and the outcome of the last
+   one for query-dump.  */
+static DumpState *dump_running;
+static DumpStatus dump_last_status = DUMP_STATUS_NONE;
+static uint64_t dump_last_done;
+static uint64_t dump_last_total;
+
 static int dump_cleanup(DumpState *s)
 {
     int ret = 0;
 
     memory_mapping_list_free(&s->list);
+    g_free(s->ranges);
+    g_free(s->note_buf);
     if (s->fd != -1) {
         close(s->fd);
     }
@@ -92,9 +310,13 @@ static int dump_cleanup(DumpState *s)
     return ret;
 }
 
+/* Errors are reported once the dump is finished, by its caller or, for a
+   detached dump, through query-dump.  */
 static void dump_error(DumpState *s, const char *reason)
 {
-    dump_cleanup(s);
+    qemu_mutex_lock(&s->lock);
+    s->failed = true;
+    qemu_mutex_unlock(&s->lock);
 }
 
 static int fd_write_vmcore(void *buf, size_t size, void *opaque)
@@ -407,6 +629,10 @@ static int write_memory(DumpState *s, RAMBlock *block, ram_addr_t start,
         if (ret < 0) {
             return ret;
         }
+
+        qemu_mutex_lock(&s->lock);
+        s->done += TARGET_PAGE_SIZE;
+        qemu_mutex_unlock(&s->lock);
     }
 
     if ((size % TARGET_PAGE_SIZE) != 0) {
@@ -415,6 +641,10 @@ static int write_memory(DumpState *s, RAMBlock *block, ram_addr_t start,
         if (ret < 0) {
             return ret;
         }
+
+        qemu_mutex_lock(&s->lock);
+        s->done += size % TARGET_PAGE_SIZE;
+        qemu_mutex_unlock(&s->lock);
     }
 
     return 0;
@@ -591,13 +821,6 @@ static int dump_begin(DumpState *s)
     return 0;
 }
 
-/* write PT_LOAD to vmcore */
-static int dump_completed(DumpState *s)
-{
-    dump_cleanup(s);
-    return 0;
-}
-
 static int get_next_block(DumpState *s, RAMBlock *block)
 {
     while (1) {
@@ -649,16 +872,480 @@ static int dump_iterate(DumpState *s)
 
         ret = get_next_block(s, block);
         if (ret == 1) {
-            dump_completed(s);
             return 0;
         }
     }
 }
 
+/* write 'size' bytes at 'offset' of the kdump-compressed vmcore */
+static int write_kdump_data(DumpState *s, uint64_t offset, void *buf,
+                            size_t size)
+{
+    MakedumpfileDataHeader mdh;
+
+    if (s->flat) {
+        mdh.offset = cpu_to_be64(offset);
+        mdh.buf_size = cpu_to_be64(size);
+        if (fd_write_vmcore(&mdh, sizeof(mdh), s) < 0) {
+            return -1;
+        }
+    } else if ((uint64_t)lseek(s->fd, offset, SEEK_SET) != offset) {
+        return -1;
+    }
+
+    return fd_write_vmcore(buf, size, s);
+}
+
+static int write_makedumpfile_header(DumpState *s)
+{
+    MakedumpfileHeader *mh;
+    int ret;
+
+    mh = g_malloc0(MAKEDUMPFILE_HEADER_SIZE);
+    memcpy(mh->signature, MAKEDUMPFILE_SIGNATURE,
+           strlen(MAKEDUMPFILE_SIGNATURE));
+    mh->type = cpu_to_be64(MAKEDUMPFILE_TYPE_FLAT);
+    mh->version = cpu_to_be64(MAKEDUMPFILE_VERSION_FLAT);
+
+    ret = fd_write_vmcore(mh, MAKEDUMPFILE_HEADER_SIZE, s);
+    g_free(mh);
+
+    return ret;
+}
+
+static int write_makedumpfile_end(DumpState *s)
+{
+    MakedumpfileDataHeader mdh;
+
+    mdh.offset = cpu_to_be64(MAKEDUMPFILE_END_FLAG);
+    mdh.buf_size = cpu_to_be64(MAKEDUMPFILE_END_FLAG);
+
+    return fd_write_vmcore(&mdh, sizeof(mdh), s);
+}
+
+/* collect the elf notes in s->note_buf */
+static int buf_write_note(void *buf, size_t size, void *opaque)
+{
+    DumpState *s = opaque;
+
+    if (s->note_buf_offset + size > s->note_size) {
+        return -1;
+    }
+
+    memcpy(s->note_buf + s->note_buf_offset, buf, size);
+    s->note_buf_offset += size;
+
+    return 0;
+}
+
+static int get_kdump_notes(DumpState *s)
+{
+    CPUArchState *env;
+    int ret;
+
+    s->note_buf = g_malloc0(s->note_size);
+    s->note_buf_offset = 0;
+
+    for (env = first_cpu; env != NULL; env = env->next_cpu) {
+        if (s->dump_info.d_class == ELFCLASS64) {
+            ret = cpu_write_elf64_note(buf_write_note, env, cpu_index(env), s);
+        } else {
+            ret = cpu_write_elf32_note(buf_write_note, env, cpu_index(env), s);
+        }
+        if (ret < 0) {
+            return -1;
+        }
+    }
+
+    for (env = first_cpu; env != NULL; env = env->next_cpu) {
+        if (s->dump_info.d_class == ELFCLASS64) {
+            ret = cpu_write_elf64_qemunote(buf_write_note, env, s);
+        } else {
+            ret = cpu_write_elf32_qemunote(buf_write_note, env, s);
+        }
+        if (ret < 0) {
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+static void fill_kdump_utsname(NewUtsname *utsname)
+{
+    memset(utsname, 0, sizeof(*utsname));
+    pstrcpy(utsname->sysname, sizeof(utsname->sysname), "Linux");
+    pstrcpy(utsname->machine, sizeof(utsname->machine), TARGET_ARCH);
+}
+
+/* write the disk dump header, the sub header and the elf notes */
+static int write_kdump_header(DumpState *s)
+{
+    size_t block_size = TARGET_PAGE_SIZE;
+    size_t sub_size = s->sub_hdr_size * block_size;
+    int endian = s->dump_info.d_endian;
+    DiskDumpHeader32 *dh;
+    DiskDumpHeaderTail *dt;
+    uint8_t *kh;
+    size_t kh_size;
+    int nr_cpus = 0;
+    CPUArchState *env;
+    int ret;
+
+    for (env = first_cpu; env != NULL; env = env->next_cpu) {
+        nr_cpus++;
+    }
+
+    /* the signature, version and utsname are the same in both headers */
+    dh = g_malloc0(block_size);
+    kh = g_malloc0(sub_size);
+    if (s->dump_info.d_class == ELFCLASS64) {
+        KdumpSubHeader64 *kh64 = (KdumpSubHeader64 *)kh;
+
+        dt = &((DiskDumpHeader64 *)dh)->tail;
+        kh_size = sizeof(*kh64);
+        kh64->max_mapnr_64 = cpu_convert_to_target64(s->max_mapnr, endian);
+        kh64->end_pfn_64 = cpu_convert_to_target64(s->max_mapnr, endian);
+        kh64->offset_note = cpu_convert_to_target64(block_size + kh_size,
+                                                    endian);
+        kh64->size_note = cpu_convert_to_target64(s->note_size, endian);
+    } else {
+        KdumpSubHeader32 *kh32 = (KdumpSubHeader32 *)kh;
+
+        dt = &dh->tail;
+        kh_size = sizeof(*kh32);
+        kh32->max_mapnr_64 = cpu_convert_to_target64(s->max_mapnr, endian);
+        kh32->end_pfn_64 = cpu_convert_to_target64(s->max_mapnr, endian);
+        kh32->offset_note = cpu_convert_to_target64(block_size + kh_size,
+                                                    endian);
+        kh32->size_note = cpu_convert_to_target32(s->note_size, endian);
+    }
+
+    memcpy(dh->signature, KDUMP_SIGNATURE, KDUMP_SIG_LEN);
+    dh->header_version = cpu_convert_to_target32(KDUMP_HEADER_VERSION, endian);
+    fill_kdump_utsname(&dh->utsname);
+    dt->status = cpu_convert_to_target32(s->compression, endian);
+    dt->block_size = cpu_convert_to_target32(block_size, endian);
+    dt->sub_hdr_size = cpu_convert_to_target32(s->sub_hdr_size, endian);
+    dt->bitmap_blocks = cpu_convert_to_target32(2 * s->bitmap_size / block_size,
+                                                endian);
+    dt->max_mapnr = cpu_convert_to_target32(MIN(s->max_mapnr, UINT32_MAX),
+                                            endian);
+    dt->nr_cpus = cpu_convert_to_target32(nr_cpus, endian);
+
+    memcpy(kh + kh_size, s->note_buf, s->note_size);
+
+    ret = write_kdump_data(s, 0, dh, block_size);
+    if (ret < 0) {
+        dump_error(s, "dump: failed to write disk dump header.\n");
+    } else {
+        ret = write_kdump_data(s, block_size, kh, sub_size);
+        if (ret < 0) {
+            dump_error(s, "dump: failed to write kdump sub header.\n");
+        }
+    }
+    g_free(dh);
+    g_free(kh);
+
+    return ret < 0 ? -1 : 0;
+}
+
+/*
+ * Both bitmaps have a bit set for every page of guest RAM: all of them are
+ * dumped, those full of zeroes as a reference to the zero page.
+ */
+static int write_kdump_bitmaps(DumpState *s)
+{
+    uint64_t offset = (1 + s->sub_hdr_size) * TARGET_PAGE_SIZE;
+    uint8_t *bitmap;
+    uint64_t pfn, end;
+    int i, ret;
+
+    bitmap = g_malloc0(s->bitmap_size);
+    for (i = 0; i < s->nr_ranges; i++) {
+        pfn = s->ranges[i].phys_addr >> TARGET_PAGE_BITS;
+        end = pfn + (s->ranges[i].length >> TARGET_PAGE_BITS);
+        for (; pfn < end; pfn++) {
+            bitmap[pfn / 8] |= 1 << (pfn % 8);
+        }
+    }
+
+    ret = write_kdump_data(s, offset, bitmap, s->bitmap_size);
+    if (ret == 0) {
+        ret = write_kdump_data(s, offset + s->bitmap_size, bitmap,
+                               s->bitmap_size);
+    }
+    g_free(bitmap);
+    if (ret < 0) {
+        dump_error(s, "dump: failed to write bitmaps.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+/* compress a page into w->cbuf, return 0 if it does not get any smaller */
+static size_t compress_page(DumpWorker *w, uint8_t *page)
+{
+    DumpState *s = w->s;
+
+    switch (s->format) {
+    case DUMP_GUEST_MEMORY_FORMAT_KDUMP_ZLIB: {
+        uLongf len = w->cbuf_size;
+
+        if (compress2(w->cbuf, &len, page, TARGET_PAGE_SIZE,
+                      Z_BEST_SPEED) == Z_OK && len < TARGET_PAGE_SIZE) {
+            return len;
+        }
+        break;
+    }
+#ifdef CONFIG_LZO
+    case DUMP_GUEST_MEMORY_FORMAT_KDUMP_LZO: {
+        lzo_uint len = w->cbuf_size;
+
+        if (lzo1x_1_compress(page, TARGET_PAGE_SIZE, w->cbuf, &len,
+                             w->wrkmem) == LZO_E_OK &&
+            len < TARGET_PAGE_SIZE) {
+            return len;
+        }
+        break;
+    }
+#endif
+#ifdef CONFIG_SNAPPY
+    case DUMP_GUEST_MEMORY_FORMAT_KDUMP_SNAPPY: {
+        size_t len = w->cbuf_size;
+
+        if (snappy_compress((char *)page, TARGET_PAGE_SIZE, (char *)w->cbuf,
+                            &len) == SNAPPY_OK && len < TARGET_PAGE_SIZE) {
+            return len;
+        }
+        break;
+    }
+#endif
+    default:
+        break;
+    }
+
+    return 0;
+}
+
+/*
+ * Compress a chunk of pages, then reserve room for the page data in the
+ * file and write it together with the page descriptors of the chunk.
+ */
+static int write_kdump_chunk(DumpWorker *w, uint64_t chunk)
+{
+    DumpState *s = w->s;
+    int endian = s->dump_info.d_endian;
+    uint64_t first = chunk * DUMP_CHUNK_PAGES;
+    uint64_t nr = MIN(DUMP_CHUNK_PAGES, s->nr_pages - first);
+    uint64_t page = first, base;
+    size_t data_size = 0, len;
+    uint32_t flags;
+    uint8_t *host;
+    int r, i, ret;
+
+    /* find the range of the first page */
+    for (r = 0; page >= s->ranges[r].length >> TARGET_PAGE_BITS; r++) {
+        page -= s->ranges[r].length >> TARGET_PAGE_BITS;
+    }
+
+    for (i = 0; i < nr; i++, page++) {
+        if (page == s->ranges[r].length >> TARGET_PAGE_BITS) {
+            r++;
+            page = 0;
+        }
+        host = s->ranges[r].host + (page << TARGET_PAGE_BITS);
+
+        w->zero[i] = buffer_is_zero(host, TARGET_PAGE_SIZE);
+        if (w->zero[i]) {
+            continue;
+        }
+
+        len = compress_page(w, host);
+        if (len) {
+            memcpy(w->data + data_size, w->cbuf, len);
+            flags = s->compression;
+        } else {
+            len = TARGET_PAGE_SIZE;
+            memcpy(w->data + data_size, host, len);
+            flags = 0;
+        }
+
+        /* offsets are relative to the chunk until it has a place */
+        w->desc[i].offset = data_size;
+        w->desc[i].size = cpu_convert_to_target32(len, endian);
+        w->desc[i].flags = cpu_convert_to_target32(flags, endian);
+        w->desc[i].page_flags = 0;
+        data_size += len;
+    }
+
+    qemu_mutex_lock(&s->lock);
+    base = s->offset_data;
+    s->offset_data += data_size;
+
+    for (i = 0; i < nr; i++) {
+        if (w->zero[i]) {
+            w->desc[i].offset = cpu_convert_to_target64(s->zero_page_offset,
+                                                        endian);
+            w->desc[i].size = cpu_convert_to_target32(TARGET_PAGE_SIZE,
+                                                      endian);
+            w->desc[i].flags = 0;
+            w->desc[i].page_flags = 0;
+        } else {
+            w->desc[i].offset = cpu_convert_to_target64(base +
+                                                        w->desc[i].offset,
+                                                        endian);
+        }
+    }
+
+    ret = 0;
+    if (data_size) {
+        ret = write_kdump_data(s, base, w->data, data_size);
+    }
+    if (ret == 0) {
+        ret = write_kdump_data(s, s->offset_page_desc +
+                               first * sizeof(PageDescriptor),
+                               w->desc, nr * sizeof(PageDescriptor));
+    }
+    if (ret < 0) {
+        s->failed = true;
+    } else {
+        s->done += nr * TARGET_PAGE_SIZE;
+    }
+    qemu_mutex_unlock(&s->lock);
+
+    return ret;
+}
+
+static void *dump_worker_thread(void *opaque)
+{
+    DumpWorker *w = opaque;
+    DumpState *s = w->s;
+    uint64_t nr_chunks = DIV_ROUND_UP(s->nr_pages, DUMP_CHUNK_PAGES);
+    uint64_t chunk;
+
+    for (;;) {
+        qemu_mutex_lock(&s->lock);
+        if (s->failed || s->next_chunk == nr_chunks) {
+            qemu_mutex_unlock(&s->lock);
+            break;
+        }
+        chunk = s->next_chunk++;
+        qemu_mutex_unlock(&s->lock);
+
+        if (write_kdump_chunk(w, chunk) < 0) {
+            break;
+        }
+    }
+
+    return NULL;
+}
+
+static int write_kdump_pages(DumpState *s)
+{
+    DumpWorker *workers;
+    uint8_t *zero_page;
+    int i, ret;
+
+    /* the zero page is the first one of the data area */
+    s->zero_page_offset = s->offset_data;
+    s->offset_data += TARGET_PAGE_SIZE;
+
+    zero_page = g_malloc0(TARGET_PAGE_SIZE);
+    ret = write_kdump_data(s, s->zero_page_offset, zero_page,
+                           TARGET_PAGE_SIZE);
+    g_free(zero_page);
+    if (ret < 0) {
+        dump_error(s, "dump: failed to save memory.\n");
+        return -1;
+    }
+
+    workers = g_new0(DumpWorker, s->nr_threads);
+    for (i = 0; i < s->nr_threads; i++) {
+        DumpWorker *w = &workers[i];
+
+        w->s = s;
+        w->data = g_malloc(DUMP_CHUNK_PAGES * TARGET_PAGE_SIZE);
+        switch (s->format) {
+#ifdef CONFIG_LZO
+        case DUMP_GUEST_MEMORY_FORMAT_KDUMP_LZO:
+            w->cbuf_size = TARGET_PAGE_SIZE + TARGET_PAGE_SIZE / 16 + 64 + 3;
+            w->wrkmem = g_malloc(LZO1X_1_MEM_COMPRESS);
+            break;
+#endif
+#ifdef CONFIG_SNAPPY
+        case DUMP_GUEST_MEMORY_FORMAT_KDUMP_SNAPPY:
+            w->cbuf_size = snappy_max_compressed_length(TARGET_PAGE_SIZE);
+            break;
+#endif
+        default:
+            w->cbuf_size = compressBound(TARGET_PAGE_SIZE);
+            break;
+        }
+        w->cbuf = g_malloc(w->cbuf_size);
+        qemu_thread_create(&w->thread, dump_worker_thread, w,
+                           QEMU_THREAD_JOINABLE);
+    }
+
+    for (i = 0; i < s->nr_threads; i++) {
+        qemu_thread_join(&workers[i].thread);
+        g_free(workers[i].data);
+        g_free(workers[i].cbuf);
+#ifdef CONFIG_LZO
+        g_free(workers[i].wrkmem);
+#endif
+    }
+    g_free(workers);
+
+    if (s->failed) {
+        dump_error(s, "dump: failed to save memory.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+static int create_kdump_vmcore(DumpState *s)
+{
+    if (s->flat && write_makedumpfile_header(s) < 0) {
+        dump_error(s, "dump: failed to write makedumpfile header.\n");
+        return -1;
+    }
+
+    if (get_kdump_notes(s) < 0) {
+        dump_error(s, "dump: failed to write elf notes.\n");
+        return -1;
+    }
+
+    if (write_kdump_header(s) < 0) {
+        return -1;
+    }
+
+    if (write_kdump_bitmaps(s) < 0) {
+        return -1;
+    }
+
+    if (write_kdump_pages(s) < 0) {
+        return -1;
+    }
+
+    if (s->flat && write_makedumpfile_end(s) < 0) {
+        dump_error(s, "dump: failed to write makedumpfile end marker.\n");
+        return -1;
+    }
+
+    return 0;
+}
+
 static int create_vmcore(DumpState *s)
 {
     int ret;
 
+    if (s->format != DUMP_GUEST_MEMORY_FORMAT_ELF) {
+        return create_kdump_vmcore(s);
+    }
+
     ret = dump_begin(s);
     if (ret < 0) {
         return -1;
@@ -700,8 +1387,142 @@ static ram_addr_t get_start_block(DumpState *s)
     return -1;
 }
 
+/* bytes of guest memory written to an elf vmcore */
+static uint64_t get_elf_dump_size(DumpState *s)
+{
+    RAMBlock *block;
+    uint64_t total = 0;
+    int64_t size;
+
+    QLIST_FOREACH(block, &ram_list.blocks, next) {
+        size = block->length;
+        if (s->has_filter) {
+            if (block->offset >= s->begin + s->length ||
+                block->offset + block->length <= s->begin) {
+                continue;
+            }
+            if (s->begin > block->offset) {
+                size -= s->begin - block->offset;
+            }
+            if (s->begin + s->length < block->offset + block->length) {
+                size -= block->offset + block->length - (s->begin + s->length);
+            }
+        }
+        total += size;
+    }
+
+    return total;
+}
+
+/*
+ * The RAM of the board, as opposed to that of devices (video RAM, option
+ * ROMs), which is registered under the qdev path of the device.  ROMs are
+ * mapped read-only.
+ */
+static bool dump_is_guest_ram(MemoryRegionSection *section)
+{
+    RAMBlock *block;
+
+    if (!memory_region_is_ram(section->mr) || section->readonly ||
+        memory_region_is_rom(section->mr)) {
+        return false;
+    }
+    QLIST_FOREACH(block, &ram_list.blocks, next) {
+        if (block->offset == section->mr->ram_addr) {
+            return !strchr(block->idstr, '/');
+        }
+    }
+    return false;
+}
+
+static void dump_add_range(MemoryRegionSection *section, void *opaque)
+{
+    DumpState *s = opaque;
+    target_phys_addr_t start, end;
+    DumpRange *last;
+    uint8_t *host;
+
+    if (!dump_is_guest_ram(section)) {
+        return;
+    }
+    start = TARGET_PAGE_ALIGN(section->offset_within_address_space);
+    end = (section->offset_within_address_space + section->size) &
+          TARGET_PAGE_MASK;
+    if (start >= end) {
+        return;
+    }
+    host = memory_region_get_ram_ptr(section->mr) +
+           section->offset_within_region +
+           (start - section->offset_within_address_space);
+
+    last = s->nr_ranges ? &s->ranges[s->nr_ranges - 1] : NULL;
+    if (last && last->phys_addr + last->length == start &&
+        last->host + last->length == host) {
+        last->length += end - start;
+        return;
+    }
+    s->ranges = g_renew(DumpRange, s->ranges, s->nr_ranges + 1);
+    s->ranges[s->nr_ranges].phys_addr = start;
+    s->ranges[s->nr_ranges].length = end - start;
+    s->ranges[s->nr_ranges].host = host;
+    s->nr_ranges++;
+}
+
+/* lay out the kdump-compressed vmcore, see the top of the file */
+static void kdump_init(DumpState *s)
+{
+    size_t sub_hdr;
+    uint64_t end;
+    int i;
+
+    /* the sections come in address order */
+    s->nr_ranges = 0;
+    memory_region_foreach_section(get_system_memory(), dump_add_range, s);
+
+    s->nr_pages = 0;
+    s->max_mapnr = 0;
+    for (i = 0; i < s->nr_ranges; i++) {
+        s->nr_pages += s->ranges[i].length >> TARGET_PAGE_BITS;
+        end = (s->ranges[i].phys_addr + s->ranges[i].length) >>
+              TARGET_PAGE_BITS;
+        s->max_mapnr = MAX(s->max_mapnr, end);
+    }
+
+    switch (s->format) {
+    case DUMP_GUEST_MEMORY_FORMAT_KDUMP_LZO:
+        s->compression = DUMP_DH_COMPRESSED_LZO;
+        break;
+    case DUMP_GUEST_MEMORY_FORMAT_KDUMP_SNAPPY:
+        s->compression = DUMP_DH_COMPRESSED_SNAPPY;
+        break;
+    default:
+        s->compression = DUMP_DH_COMPRESSED_ZLIB;
+        break;
+    }
+
+    if (s->dump_info.d_class == ELFCLASS64) {
+        sub_hdr = sizeof(KdumpSubHeader64);
+    } else {
+        sub_hdr = sizeof(KdumpSubHeader32);
+    }
+    s->sub_hdr_size = DIV_ROUND_UP(sub_hdr + s->note_size, TARGET_PAGE_SIZE);
+    s->bitmap_size = DIV_ROUND_UP(DIV_ROUND_UP(s->max_mapnr, 8),
+                                  TARGET_PAGE_SIZE) * TARGET_PAGE_SIZE;
+    s->offset_page_desc = (1 + s->sub_hdr_size) * TARGET_PAGE_SIZE +
+                          2 * s->bitmap_size;
+    s->offset_data = s->offset_page_desc +
+                     s->nr_pages * sizeof(PageDescriptor);
+
+    /* pipes and sockets get the flattened format */
+    s->flat = lseek(s->fd, 0, SEEK_SET) != 0;
+
+    s->total = s->nr_pages * TARGET_PAGE_SIZE;
+}
+
 static int dump_init(DumpState *s, int fd, bool paging, bool has_filter,
-                     int64_t begin, int64_t length, Error **errp)
+                     int64_t begin, int64_t length,
+                     DumpGuestMemoryFormat format, int nr_threads,
+                     Error **errp)
 {
     CPUArchState *env;
     int nr_cpus;
@@ -716,6 +1537,8 @@ static int dump_init(DumpState *s, int fd, bool paging, bool has_filter,
 
     s->errp = errp;
     s->fd = fd;
+    s->format = format;
+    s->nr_threads = nr_threads;
     s->has_filter = has_filter;
     s->begin = begin;
     s->length = length;
@@ -754,6 +1577,12 @@ static int dump_init(DumpState *s, int fd, bool paging, bool has_filter,
 
     /* get memory mapping */
     memory_mapping_list_init(&s->list);
+    if (s->format != DUMP_GUEST_MEMORY_FORMAT_ELF) {
+        /* the kdump formats save guest RAM by page frame number */
+        kdump_init(s);
+        return 0;
+    }
+
     if (paging) {
         qemu_get_guest_memory_mapping(&s->list);
     } else {
@@ -806,6 +1635,8 @@ static int dump_init(DumpState *s, int fd, bool paging, bool has_filter,
         }
     }
 
+    s->total = get_elf_dump_size(s);
+
     return 0;
 
 cleanup:
@@ -816,8 +1647,71 @@ cleanup:
     return -1;
 }
 
+/*
+ * While a detached dump runs, the guest stays stopped and the monitor
+ * refuses the commands that would change its memory or end QEMU: cont,
+ * system_reset, device_add, device_del, migrate and quit.
+ */
+bool dump_in_progress(void)
+{
+    return dump_running != NULL;
+}
+
+/* record the outcome for query-dump, close the file and resume the guest */
+static void dump_finish(DumpState *s, int ret)
+{
+    dump_last_status = ret < 0 ? DUMP_STATUS_FAILED : DUMP_STATUS_COMPLETED;
+    dump_last_done = s->done;
+    dump_last_total = s->total;
+    dump_running = NULL;
+    if (s->migration_blocker) {
+        migrate_del_blocker(s->migration_blocker);
+        error_free(s->migration_blocker);
+    }
+
+    dump_cleanup(s);
+    qemu_mutex_destroy(&s->lock);
+    g_free(s);
+}
+
+static void *dump_thread(void *opaque)
+{
+    DumpState *s = opaque;
+
+    s->ret = create_vmcore(s);
+    event_notifier_set(&s->finished);
+
+    return NULL;
+}
+
+static void dump_thread_finished(EventNotifier *e)
+{
+    DumpState *s = container_of(e, DumpState, finished);
+
+    event_notifier_test_and_clear(e);
+    qemu_thread_join(&s->thread);
+    event_notifier_set_handler(e, NULL);
+    event_notifier_cleanup(e);
+
+    dump_finish(s, s->ret);
+}
+
+static int dump_get_nr_threads(void)
+{
+    int n = 1;
+
+#ifdef _SC_NPROCESSORS_ONLN
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+
+    return MAX(1, MIN(n, DUMP_MAX_THREADS));
+}
+
 void qmp_dump_guest_memory(bool paging, const char *file, bool has_begin,
                            int64_t begin, bool has_length, int64_t length,
+                           bool has_format, DumpGuestMemoryFormat format,
+                           bool has_detach, bool detach,
+                           bool has_threads, int64_t threads,
                            Error **errp)
 {
     const char *p;
@@ -834,6 +1728,47 @@ void qmp_dump_guest_memory(bool paging, const char *file, bool has_begin,
         return;
     }
 
+    if (!has_format) {
+        format = DUMP_GUEST_MEMORY_FORMAT_ELF;
+    }
+    if (format != DUMP_GUEST_MEMORY_FORMAT_ELF && (paging || has_begin)) {
+        error_set(errp, QERR_INVALID_PARAMETER_COMBINATION);
+        return;
+    }
+#ifndef CONFIG_LZO
+    if (format == DUMP_GUEST_MEMORY_FORMAT_KDUMP_LZO) {
+        error_set(errp, QERR_INVALID_PARAMETER_VALUE, "format",
+                  "a compression format built into this QEMU");
+        return;
+    }
+#else
+    if (format == DUMP_GUEST_MEMORY_FORMAT_KDUMP_LZO &&
+        lzo_init() != LZO_E_OK) {
+        error_set(errp, QERR_UNSUPPORTED);
+        return;
+    }
+#endif
+#ifndef CONFIG_SNAPPY
+    if (format == DUMP_GUEST_MEMORY_FORMAT_KDUMP_SNAPPY) {
+        error_set(errp, QERR_INVALID_PARAMETER_VALUE, "format",
+                  "a compression format built into this QEMU");
+        return;
+    }
+#endif
+
+    if (!has_threads) {
+        threads = dump_get_nr_threads();
+    } else if (threads < 1 || threads > DUMP_MAX_THREADS) {
+        error_set(errp, QERR_INVALID_PARAMETER_VALUE, "threads",
+                  "a value between 1 and " stringify(DUMP_MAX_THREADS));
+        return;
+    }
+
+    if (dump_running) {
+        error_set(errp, QERR_DEVICE_IN_USE, "dump");
+        return;
+    }
+
 #if !defined(WIN32)
     if (strstart(file, "fd:", &p)) {
         fd = monitor_get_fd(cur_mon, p);
@@ -857,17 +1792,56 @@ void qmp_dump_guest_memory(bool paging, const char *file, bool has_begin,
         return;
     }
 
-    s = g_malloc(sizeof(DumpState));
+    s = g_malloc0(sizeof(DumpState));
+    qemu_mutex_init(&s->lock);
 
-    ret = dump_init(s, fd, paging, has_begin, begin, length, errp);
+    ret = dump_init(s, fd, paging, has_begin, begin, length, format, threads,
+                    errp);
     if (ret < 0) {
+        qemu_mutex_destroy(&s->lock);
         g_free(s);
         return;
     }
 
-    if (create_vmcore(s) < 0 && !error_is_set(s->errp)) {
+    if (has_detach && detach) {
+        if (event_notifier_init(&s->finished, false) < 0) {
+            error_set(errp, QERR_IO_ERROR);
+            dump_finish(s, -1);
+            return;
+        }
+        s->errp = NULL;
+        dump_running = s;
+        error_set(&s->migration_blocker, QERR_DEVICE_IN_USE, "dump");
+        migrate_add_blocker(s->migration_blocker);
+        event_notifier_set_handler(&s->finished, dump_thread_finished);
+        qemu_thread_create(&s->thread, dump_thread, s, QEMU_THREAD_JOINABLE);
+        return;
+    }
+
+    ret = create_vmcore(s);
+    if (ret < 0 && !error_is_set(s->errp)) {
         error_set(errp, QERR_IO_ERROR);
     }
 
-    g_free(s);
+    dump_finish(s, ret);
+}
+
+DumpQueryResult *qmp_query_dump(Error **errp)
+{
+    DumpQueryResult *result = g_malloc0(sizeof(*result));
+    DumpState *s = dump_running;
+
+    if (s) {
+        qemu_mutex_lock(&s->lock);
+        result->status = DUMP_STATUS_ACTIVE;
+        result->completed = s->done;
+        result->total = s->total;
+        qemu_mutex_unlock(&s->lock);
+    } else {
+        result->status = dump_last_status;
+        result->completed = dump_last_done;
+        result->total = dump_last_total;
+    }
+
+    return result;
 }
@@ -123,6 +123,8 @@ static inline void tlb_flush(CPUArchState *env, int flush_global)
 
 #define MIN_CODE_GEN_BUFFER_SIZE     (1024 * 1024)
 
+#define CODE_GEN_PROLOGUE_SIZE 1024
+
 /* estimated block size for TB allocation */
 /* XXX: use a per code average code fragment size and modulate it
    according to the host CPU */
@@ -144,9 +146,11 @@ struct TranslationBlock {
     uint64_t flags; /* flags defining in which context the code was generated */
     uint16_t size;      /* size of target code for this block (1 <=
                            size <= TARGET_PAGE_SIZE) */
-    uint16_t cflags;    /* compile flags */
+    uint32_t cflags;    /* compile flags */
 #define CF_COUNT_MASK  0x7fff
 #define CF_LAST_IO     0x8000 /* Last insn may be an IO access.  */
+#define CF_TIER_COLD  0x10000 /* Unoptimized, counts executions.  */
+#define CF_TIER_HOT   0x20000 /* Retranslation of a hot TB.  */
 
     uint8_t *tc_ptr;    /* pointer to the translated code */
     /* next matching tb for physical address. */
@@ -171,6 +175,9 @@ struct TranslationBlock {
     struct TranslationBlock *jmp_next[2];
     struct TranslationBlock *jmp_first;
     uint32_t icount;
+    /* profiling counters, only updated while tb_profile_enabled is set */
+    uint64_t exec_count; /* number of times the block was entered */
+    uint64_t exit_count; /* number of returns to the main loop from it */
 };
 
 static inline unsigned int tb_jmp_cache_hash_page(target_ulong pc)
@@ -199,8 +206,53 @@ void tb_link_page(TranslationBlock *tb,
                   tb_page_addr_t phys_pc, tb_page_addr_t phys_page2);
 void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr);
 
+#ifdef CONFIG_LINUX_USER
+TranslationBlock *tb_buffer_state(int *nb_blocks, int *max_blocks,
+                                  uint8_t **buffer, size_t *used,
+                                  size_t *size);
+void tb_buffer_reserve(int nb_blocks, size_t used);
+void tb_buffer_unchain(TranslationBlock *tb);
+
+/* linux-user/tbcache.c */
+TranslationBlock *tb_cache_lookup(CPUArchState *env, target_ulong pc,
+                                  target_ulong cs_base, int flags,
+                                  int cflags);
+void tb_cache_translated(TranslationBlock *tb);
+void tb_cache_mark_uncacheable(void);
+void tb_cache_flush(void);
+#else
+static inline TranslationBlock *tb_cache_lookup(CPUArchState *env,
+                                                target_ulong pc,
+                                                target_ulong cs_base,
+                                                int flags, int cflags)
+{
+    return NULL;
+}
+static inline void tb_cache_translated(TranslationBlock *tb)
+{
+}
+static inline void tb_cache_mark_uncacheable(void)
+{
+}
+static inline void tb_cache_flush(void)
+{
+}
+#endif
+
+/* perf-map.c */
+void perf_report_code(TranslationBlock *tb, size_t size);
+void perf_report_flush(void);
+
 extern TranslationBlock *tb_phys_hash[CODE_GEN_PHYS_HASH_SIZE];
 
+/* TB execution profiling: generated code counts the executions of each
+   TB and the calls of each helper, cpu_exec counts the exits.  */
+extern int tb_profile_enabled;
+extern uint64_t tb_profile_entries;
+void tb_profile_set(CPUArchState *env, bool enable);
+
+void tb_retranslate(CPUArchState *env, TranslationBlock *tb);
+
 #if defined(USE_DIRECT_JUMP)
 
 #if defined(CONFIG_TCG_INTERPRETER)
@@ -315,6 +367,11 @@ uint64_t io_mem_read(struct MemoryRegion *mr, target_phys_addr_t addr,
                      unsigned size);
 void io_mem_write(struct MemoryRegion *mr, target_phys_addr_t addr,
                   uint64_t value, unsigned size);
+bool io_mem_has_nolock(struct MemoryRegion *mr);
+bool io_mem_read_nolock(struct MemoryRegion *mr, target_phys_addr_t addr,
+                        uint64_t *value, unsigned size);
+bool io_mem_write_nolock(struct MemoryRegion *mr, target_phys_addr_t addr,
+                         uint64_t value, unsigned size);
 
 void tlb_fill(CPUArchState *env1, target_ulong addr, int is_write, int mmu_idx,
               uintptr_t retaddr);
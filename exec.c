@@ -35,6 +35,7 @@
 #include "qemu-timer.h"
 #include "memory.h"
 #include "exec-memory.h"
+#include "qemu-barrier.h"
 #if defined(CONFIG_USER_ONLY)
 #include <qemu.h>
 #if defined(__FreeBSD__) || defined(__FreeBSD_kernel__)
@@ -58,6 +59,14 @@
 #endif
 
 #include "cputlb.h"
+#include "disas.h"
+#if !defined(CONFIG_USER_ONLY)
+#include "qmp-commands.h"
+#include "sysemu.h"
+#endif
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
 
 #define WANT_EXEC_OBSOLETE
 #include "exec-obsolete.h"
@@ -101,7 +110,7 @@ spinlock_t tb_lock = SPIN_LOCK_UNLOCKED;
     __attribute__((aligned (32)))
 #endif
 
-uint8_t code_gen_prologue[1024] code_gen_section;
+uint8_t code_gen_prologue[CODE_GEN_PROLOGUE_SIZE] code_gen_section;
 static uint8_t *code_gen_buffer;
 static unsigned long code_gen_buffer_size;
 /* threshold to flush the translated code buffer */
@@ -219,6 +228,34 @@ static MemoryRegion io_mem_watch;
 /* statistics */
 static int tb_flush_count;
 static int tb_phys_invalidate_count;
+/* generated code of invalidated TBs, unusable until the next flush */
+static size_t tb_phys_invalidate_bytes;
+
+int tb_profile_enabled;
+uint64_t tb_profile_entries;
+
+int tb_hot_threshold;
+
+/* Set tb_hot_threshold from the argument of -tb-hot-threshold.  Returns -1,
+   leaving it unchanged, unless @str is a whole non-negative int.  */
+int tb_set_hot_threshold(const char *str)
+{
+    char *end;
+    long val;
+
+    errno = 0;
+    val = strtol(str, &end, 0);
+    if (errno || end == str || *end || val < 0 || val > INT_MAX) {
+        return -1;
+    }
+    tb_hot_threshold = val;
+    return 0;
+}
+
+/* translation statistics, indexed by 0 for cold and 1 for hot TBs */
+static int tb_tier_count[2];
+static size_t tb_tier_code_size[2];
+static int64_t tb_tier_ticks[2];
 
 #ifdef _WIN32
 static void map_exec(void *addr, long size)
@@ -508,6 +545,10 @@ bool memory_region_is_unassigned(MemoryRegion *mr)
 #ifdef USE_STATIC_CODE_GEN_BUFFER
 static uint8_t static_code_gen_buffer[DEFAULT_CODE_GEN_BUFFER_SIZE]
                __attribute__((aligned (CODE_GEN_ALIGN)));
+/* Keep the TBs at a fixed address as well: generated code embeds TB
+   pointers, so this is what lets the translation cache reuse it.  */
+static TranslationBlock static_tbs[DEFAULT_CODE_GEN_BUFFER_SIZE /
+                                   CODE_GEN_AVG_BLOCK_SIZE];
 #endif
 
 static void code_gen_alloc(unsigned long tb_size)
@@ -607,7 +648,11 @@ static void code_gen_alloc(unsigned long tb_size)
     code_gen_buffer_max_size = code_gen_buffer_size -
         (TCG_MAX_OP_SIZE * OPC_BUF_SIZE);
     code_gen_max_blocks = code_gen_buffer_size / CODE_GEN_AVG_BLOCK_SIZE;
+#ifdef USE_STATIC_CODE_GEN_BUFFER
+    tbs = static_tbs;
+#else
     tbs = g_malloc(code_gen_max_blocks * sizeof(TranslationBlock));
+#endif
 }
 
 /* Must be called before using the QEMU cpus. 'tb_size' is the size
@@ -726,15 +771,29 @@ static TranslationBlock *tb_alloc(target_ulong pc)
     tb = &tbs[nb_tbs++];
     tb->pc = pc;
     tb->cflags = 0;
+    tb->exec_count = 0;
+    tb->exit_count = 0;
     return tb;
 }
 
+/* Size of the host code of 'tb', including alignment padding.  */
+static size_t tb_host_size(TranslationBlock *tb)
+{
+    if (tb + 1 < &tbs[nb_tbs]) {
+        return tb[1].tc_ptr - tb->tc_ptr;
+    }
+    return code_gen_ptr - tb->tc_ptr;
+}
+
 void tb_free(TranslationBlock *tb)
 {
     /* In practice this is mostly used for single use temporary TB
        Ignore the hard cases and just back up if this TB happens to
        be the last one generated.  */
     if (nb_tbs > 0 && tb == &tbs[nb_tbs - 1]) {
+        /* The code was counted as dead when the TB was invalidated.  */
+        tb_phys_invalidate_bytes -= MIN(tb_phys_invalidate_bytes,
+                                        code_gen_ptr - tb->tc_ptr);
         code_gen_ptr = tb->tc_ptr;
         nb_tbs--;
     }
@@ -807,6 +866,19 @@ void tb_flush(CPUArchState *env1)
     /* XXX: flush processor icache at this point if cache flush is
        expensive */
     tb_flush_count++;
+    tb_phys_invalidate_bytes = 0;
+    tb_cache_flush();
+    perf_report_flush();
+}
+
+/* Start or stop counting TB executions, TB exits and helper calls.  The
+   counters live in the generated code, so start over with a flush.  */
+void tb_profile_set(CPUArchState *env, bool enable)
+{
+    tb_flush(env);
+    tb_profile_enabled = enable;
+    tb_profile_entries = 0;
+    tcg_profile_helpers(&tcg_ctx, enable);
 }
 
 #ifdef DEBUG_TB_CHECK
@@ -915,6 +987,42 @@ static inline void tb_reset_jump(TranslationBlock *tb, int n)
     tb_set_jmp_target(tb, n, (uintptr_t)(tb->tc_ptr + tb->tb_next_offset[n]));
 }
 
+#ifdef CONFIG_LINUX_USER
+/* Expose the translation buffer to the translation cache.  */
+TranslationBlock *tb_buffer_state(int *nb_blocks, int *max_blocks,
+                                  uint8_t **buffer, size_t *used,
+                                  size_t *size)
+{
+    *nb_blocks = nb_tbs;
+    *max_blocks = code_gen_max_blocks;
+    *buffer = code_gen_buffer;
+    *used = code_gen_ptr - code_gen_buffer;
+    *size = code_gen_buffer_max_size;
+    return tbs;
+}
+
+/* Mark the first 'nb_blocks' TBs and 'used' bytes of generated code as
+   allocated.  Only valid on an empty translation buffer.  */
+void tb_buffer_reserve(int nb_blocks, size_t used)
+{
+    assert(nb_tbs == 0 && code_gen_ptr == code_gen_buffer);
+    nb_tbs = nb_blocks;
+    code_gen_ptr = code_gen_buffer + used;
+}
+
+/* Restore the unchained jumps of a TB without touching the lists of
+   the TBs it jumps to.  */
+void tb_buffer_unchain(TranslationBlock *tb)
+{
+    if (tb->tb_next_offset[0] != 0xffff) {
+        tb_reset_jump(tb, 0);
+    }
+    if (tb->tb_next_offset[1] != 0xffff) {
+        tb_reset_jump(tb, 1);
+    }
+}
+#endif
+
 void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
 {
     CPUArchState *env;
@@ -969,6 +1077,7 @@ void tb_phys_invalidate(TranslationBlock *tb, tb_page_addr_t page_addr)
     tb->jmp_first = (TranslationBlock *)((uintptr_t)tb | 2); /* fail safe */
 
     tb_phys_invalidate_count++;
+    tb_phys_invalidate_bytes += tb_host_size(tb);
 }
 
 static inline void set_bits(uint8_t *tab, int start, int len)
@@ -1035,8 +1144,19 @@ TranslationBlock *tb_gen_code(CPUArchState *env,
     tb_page_addr_t phys_pc, phys_page2;
     target_ulong virt_page2;
     int code_gen_size;
+    int64_t ti = 0;
 
     phys_pc = get_page_addr_code(env, pc);
+    tb = tb_cache_lookup(env, pc, cs_base, flags, cflags);
+    if (tb) {
+        goto link;
+    }
+    if (tb_hot_threshold) {
+        if (cflags == 0) {
+            cflags = CF_TIER_COLD;
+        }
+        ti = cpu_get_real_ticks();
+    }
     tb = tb_alloc(pc);
     if (!tb) {
         /* flush must be done */
@@ -1054,7 +1174,16 @@ TranslationBlock *tb_gen_code(CPUArchState *env,
     cpu_gen_code(env, tb, &code_gen_size);
     code_gen_ptr = (void *)(((uintptr_t)code_gen_ptr + code_gen_size +
                              CODE_GEN_ALIGN - 1) & ~(CODE_GEN_ALIGN - 1));
+    if (cflags & (CF_TIER_COLD | CF_TIER_HOT)) {
+        int hot = (cflags & CF_TIER_HOT) != 0;
 
+        tb_tier_count[hot]++;
+        tb_tier_code_size[hot] += code_gen_size;
+        tb_tier_ticks[hot] += cpu_get_real_ticks() - ti;
+    }
+    tb_cache_translated(tb);
+
+ link:
     /* check next page if needed */
     virt_page2 = (pc + tb->size - 1) & TARGET_PAGE_MASK;
     phys_page2 = -1;
@@ -1062,9 +1191,26 @@ TranslationBlock *tb_gen_code(CPUArchState *env,
         phys_page2 = get_page_addr_code(env, virt_page2);
     }
     tb_link_page(tb, phys_pc, phys_page2);
+    perf_report_code(tb, tb_host_size(tb));
     return tb;
 }
 
+/* Replace 'tb', which has been exited from before executing any of its
+   instructions, with a translation using all optimizations.  Callers
+   chain to the new TB again as they find it through tb_phys_hash.  */
+void tb_retranslate(CPUArchState *env, TranslationBlock *tb)
+{
+    target_ulong pc = tb->pc;
+    target_ulong cs_base = tb->cs_base;
+    int flags = tb->flags;
+
+    if (!(tb->cflags & CF_TIER_COLD)) {
+        return;
+    }
+    tb_phys_invalidate(tb, -1);
+    tb_gen_code(env, pc, cs_base, flags, CF_TIER_HOT);
+}
+
 /*
  * Invalidate all TBs which intersect with the target physical address range
  * [start;end[. NOTE: start and end may refer to *different* physical pages.
@@ -2341,9 +2487,286 @@ void qemu_flush_coalesced_mmio_buffer(void)
 #if defined(__linux__) && !defined(TARGET_S390X)
 
 #include <sys/vfs.h>
+#include <setjmp.h>
+#include "qemu-thread.h"
+#include "qemu-tls.h"
 
 #define HUGETLBFS_MAGIC       0x958458f6
 
+/*
+ * -mem-prealloc: touch every page of the file backed RAM blocks from
+ * several threads.  Blocks allocated during machine init are queued and
+ * preallocated together by qemu_ram_prealloc_all(), once their NUMA
+ * policies are known; the threads then run on the CPUs of the host nodes
+ * the memory is bound to.  Running out of hugepages raises SIGBUS in a
+ * thread.  During init QEMU then exits with an error; blocks allocated
+ * later, while the guest runs, fall back to anonymous memory instead.
+ */
+
+#define RAM_PREALLOC_MAX_THREADS 64
+
+typedef struct RAMPrealloc {
+    RAMBlock *block;
+    uint8_t *host;
+    size_t size;
+    size_t pagesize;
+} RAMPrealloc;
+
+typedef struct RAMPreallocThread {
+    QemuThread thread;
+    uint8_t *start;
+    size_t size;
+    size_t pagesize;
+    uint64_t host_nodes;
+} RAMPreallocThread;
+
+static RAMPrealloc *ram_prealloc_queue;
+static int ram_prealloc_queued;
+static bool ram_prealloc_done_init;
+static size_t ram_prealloc_bytes;
+static int ram_prealloc_threads_done;
+static int ram_prealloc_failed;
+static DEFINE_TLS(sigjmp_buf *, ram_prealloc_jmp);
+static struct sigaction ram_prealloc_oldact;
+
+#ifndef BUS_MCEERR_AR
+#define BUS_MCEERR_AR 4
+#endif
+#ifndef BUS_MCEERR_AO
+#define BUS_MCEERR_AO 5
+#endif
+
+/*
+ * Memory hotplug preallocates while the vCPUs run, so the SIGBUS handler
+ * of KVM (hardware memory errors) must keep working: only a fault taken
+ * by a preallocating thread for lack of pages is handled here, anything
+ * else goes to the handler that was installed before.
+ */
+static void ram_prealloc_sigbus(int signal, siginfo_t *info, void *ctx)
+{
+    sigjmp_buf *jmp = tls_var(ram_prealloc_jmp);
+    struct sigaction action;
+
+    if (jmp && info->si_code != BUS_MCEERR_AR &&
+        info->si_code != BUS_MCEERR_AO) {
+        siglongjmp(*jmp, 1);
+    }
+    if (ram_prealloc_oldact.sa_flags & SA_SIGINFO) {
+        ram_prealloc_oldact.sa_sigaction(signal, info, ctx);
+    } else if (ram_prealloc_oldact.sa_handler != SIG_DFL &&
+               ram_prealloc_oldact.sa_handler != SIG_IGN) {
+        ram_prealloc_oldact.sa_handler(signal);
+    } else {
+        /* delivered with the default action once the handler returns */
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = SIG_DFL;
+        sigaction(SIGBUS, &action, NULL);
+        raise(SIGBUS);
+    }
+}
+
+/* Restrict the calling thread to the CPUs of the host nodes in 'nodes'.  */
+static void ram_prealloc_set_affinity(uint64_t nodes)
+{
+    cpu_set_t cpus;
+    bool any = false;
+    int node;
+
+    CPU_ZERO(&cpus);
+    for (node = 0; node < 64; node++) {
+        char path[64], list[1024], *p;
+        FILE *f;
+
+        if (!(nodes & (1ULL << node))) {
+            continue;
+        }
+        snprintf(path, sizeof(path),
+                 "/sys/devices/system/node/node%d/cpulist", node);
+        f = fopen(path, "r");
+        if (!f) {
+            continue;
+        }
+        p = fgets(list, sizeof(list), f);
+        fclose(f);
+        while (p && *p >= '0' && *p <= '9') {
+            unsigned long first, last;
+
+            first = last = strtoul(p, &p, 10);
+            if (*p == '-') {
+                last = strtoul(p + 1, &p, 10);
+            }
+            for (; first <= last && first < CPU_SETSIZE; first++) {
+                CPU_SET(first, &cpus);
+                any = true;
+            }
+            if (*p == ',') {
+                p++;
+            }
+        }
+    }
+    if (any) {
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+}
+
+static void *ram_prealloc_thread(void *opaque)
+{
+    RAMPreallocThread *t = opaque;
+    sigjmp_buf jmp;
+    sigset_t set;
+    size_t offset;
+    volatile size_t pending = 0;
+
+    if (t->host_nodes) {
+        ram_prealloc_set_affinity(t->host_nodes);
+    }
+    sigemptyset(&set);
+    sigaddset(&set, SIGBUS);
+    pthread_sigmask(SIG_UNBLOCK, &set, NULL);
+
+    if (sigsetjmp(jmp, 1)) {
+        ram_prealloc_failed = 1;
+    } else {
+        tls_var(ram_prealloc_jmp) = &jmp;
+        for (offset = 0; offset < t->size && !ram_prealloc_failed;
+             offset += t->pagesize) {
+            volatile uint8_t *p = t->start + offset;
+
+            *p = *p;
+            pending += t->pagesize;
+            if (pending >= 64 * 1024 * 1024) {
+                __sync_fetch_and_add(&ram_prealloc_bytes, pending);
+                pending = 0;
+            }
+        }
+    }
+    pthread_sigmask(SIG_BLOCK, &set, NULL);
+    tls_var(ram_prealloc_jmp) = NULL;
+    __sync_fetch_and_add(&ram_prealloc_bytes, pending);
+    __sync_fetch_and_add(&ram_prealloc_threads_done, 1);
+    return NULL;
+}
+
+static int ram_prealloc_nthreads(void)
+{
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+
+    if (mem_prealloc_threads > 0) {
+        return MIN(mem_prealloc_threads, RAM_PREALLOC_MAX_THREADS);
+    }
+    return cores > 0 ? MIN(cores, RAM_PREALLOC_MAX_THREADS) : 1;
+}
+
+/* Returns the number of bytes that could not be preallocated. */
+static size_t ram_prealloc(RAMPrealloc *queue, int count)
+{
+    RAMPreallocThread *threads;
+    struct sigaction act;
+    size_t total = 0;
+    int64_t start, last;
+    int nthreads = ram_prealloc_nthreads();
+    int i, j, n, started = 0;
+
+    for (i = 0; i < count; i++) {
+        total += queue[i].size;
+    }
+    threads = g_malloc0(count * nthreads * sizeof(*threads));
+    ram_prealloc_bytes = 0;
+    ram_prealloc_threads_done = 0;
+    ram_prealloc_failed = 0;
+
+    memset(&act, 0, sizeof(act));
+    act.sa_flags = SA_SIGINFO;
+    act.sa_sigaction = ram_prealloc_sigbus;
+    sigaction(SIGBUS, &act, &ram_prealloc_oldact);
+
+    for (i = 0; i < count; i++) {
+        RAMPrealloc *r = &queue[i];
+        size_t pages = r->size / r->pagesize;
+        size_t chunk;
+        uint64_t host_nodes = 0;
+
+        if (r->block->numa_node >= 0 &&
+            node_host_policy[r->block->numa_node] != NUMA_HOST_POLICY_DEFAULT) {
+            host_nodes = node_host_nodes[r->block->numa_node];
+        }
+        n = MIN(nthreads, MAX(pages, 1));
+        chunk = (pages + n - 1) / n * r->pagesize;
+        for (j = 0; j < n; j++) {
+            RAMPreallocThread *t = &threads[started];
+
+            t->start = r->host + j * chunk;
+            t->size = MIN(chunk, r->size - j * chunk);
+            t->pagesize = r->pagesize;
+            t->host_nodes = host_nodes;
+            qemu_thread_create(&t->thread, ram_prealloc_thread, t,
+                               QEMU_THREAD_JOINABLE);
+            started++;
+        }
+    }
+
+    start = last = get_clock_realtime();
+    while (ram_prealloc_threads_done < started) {
+        int64_t now;
+
+        usleep(10 * 1000);
+        now = get_clock_realtime();
+        if (now - last >= get_ticks_per_sec()) {
+            fprintf(stderr, "qemu: preallocating guest memory: %d%% "
+                    "(%d threads, %" PRId64 " s)\n",
+                    (int)((uint64_t)ram_prealloc_bytes * 100 / total),
+                    started, (now - start) / get_ticks_per_sec());
+            last = now;
+        }
+    }
+    for (i = 0; i < started; i++) {
+        qemu_thread_join(&threads[i].thread);
+    }
+    sigaction(SIGBUS, &ram_prealloc_oldact, NULL);
+    g_free(threads);
+
+    return ram_prealloc_failed ? total : 0;
+}
+
+/* Returns -1 if @host could not be preallocated right away. */
+static int ram_prealloc_add(RAMBlock *block, void *host, size_t size,
+                            size_t pagesize)
+{
+    RAMPrealloc r = {
+        .block = block,
+        .host = host,
+        .size = size,
+        .pagesize = pagesize,
+    };
+
+    if (ram_prealloc_done_init) {
+        return ram_prealloc(&r, 1) ? -1 : 0;
+    }
+    ram_prealloc_queue = g_renew(RAMPrealloc, ram_prealloc_queue,
+                                 ram_prealloc_queued + 1);
+    ram_prealloc_queue[ram_prealloc_queued++] = r;
+    return 0;
+}
+
+void qemu_ram_prealloc_all(void)
+{
+    size_t failed;
+
+    if (ram_prealloc_queued) {
+        failed = ram_prealloc(ram_prealloc_queue, ram_prealloc_queued);
+        if (failed) {
+            fprintf(stderr, "qemu: unable to preallocate %zd MB of guest "
+                    "memory in %s: not enough free pages\n", failed >> 20,
+                    mem_path);
+            exit(1);
+        }
+    }
+    g_free(ram_prealloc_queue);
+    ram_prealloc_queue = NULL;
+    ram_prealloc_queued = 0;
+    ram_prealloc_done_init = true;
+}
+
 static long gethugepagesize(const char *path)
 {
     struct statfs fs;
@@ -2371,9 +2794,7 @@ static void *file_ram_alloc(RAMBlock *block,
     char *filename;
     void *area;
     int fd;
-#ifdef MAP_POPULATE
     int flags;
-#endif
     unsigned long hpagesize;
 
     hpagesize = gethugepagesize(path);
@@ -2414,24 +2835,43 @@ static void *file_ram_alloc(RAMBlock *block,
     if (ftruncate(fd, memory))
         perror("ftruncate");
 
-#ifdef MAP_POPULATE
-    /* NB: MAP_POPULATE won't exhaustively alloc all phys pages in the case
-     * MAP_PRIVATE is requested.  For mem_prealloc we mmap as MAP_SHARED
-     * to sidestep this quirk.
+    /* NB: for mem_prealloc we mmap as MAP_SHARED so that touching a page
+     * allocates the backing page itself rather than a private copy.  The
+     * pages are touched by ram_prealloc().  With mem_shared, other
+     * processes map the file too and must see the guest's writes.
      */
-    flags = mem_prealloc ? MAP_POPULATE | MAP_SHARED : MAP_PRIVATE;
-    area = mmap(0, memory, PROT_READ | PROT_WRITE, flags, fd, 0);
-#else
-    area = mmap(0, memory, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    flags = mem_shared ? MAP_SHARED : MAP_PRIVATE;
+#ifdef MAP_POPULATE
+    if (mem_prealloc) {
+        flags = MAP_SHARED;
+    }
 #endif
+    area = mmap(0, memory, PROT_READ | PROT_WRITE, flags, fd, 0);
     if (area == MAP_FAILED) {
         perror("file_ram_alloc: can't mmap RAM pages");
         close(fd);
         return (NULL);
     }
+#ifdef MAP_POPULATE
+    /* the guest is already running: let the caller use anonymous memory */
+    if (mem_prealloc && ram_prealloc_add(block, area, memory, hpagesize) < 0) {
+        fprintf(stderr, "qemu: unable to preallocate %zd MB of guest memory "
+                "in %s, using anonymous memory\n", (size_t)memory >> 20, path);
+        munmap(area, memory);
+        close(fd);
+        return NULL;
+    }
+#endif
     block->fd = fd;
+    if (flags & MAP_SHARED) {
+        block->flags |= RAM_SHARED_MASK;
+    }
     return area;
 }
+#else
+void qemu_ram_prealloc_all(void)
+{
+}
 #endif
 
 static ram_addr_t find_ram_offset(ram_addr_t size)
@@ -2520,6 +2960,7 @@ ram_addr_t qemu_ram_alloc_from_ptr(ram_addr_t size, void *host,
 
     new_block->mr = mr;
     new_block->offset = find_ram_offset(size);
+    new_block->numa_node = -1;
     if (host) {
         new_block->host = host;
         new_block->flags |= RAM_PREALLOC_MASK;
@@ -2566,6 +3007,161 @@ ram_addr_t qemu_ram_alloc(ram_addr_t size, MemoryRegion *mr)
     return qemu_ram_alloc_from_ptr(size, NULL, mr);
 }
 
+#if defined(__linux__) && defined(__NR_mbind)
+#define MPOL_DEFAULT     0
+#define MPOL_PREFERRED   1
+#define MPOL_BIND        2
+#define MPOL_INTERLEAVE  3
+#define MPOL_MF_MOVE     (1 << 1)
+
+static const int numa_host_mpol[NUMA_HOST_POLICY_MAX] = {
+    [NUMA_HOST_POLICY_DEFAULT] = MPOL_DEFAULT,
+    [NUMA_HOST_POLICY_PREFERRED] = MPOL_PREFERRED,
+    [NUMA_HOST_POLICY_BIND] = MPOL_BIND,
+    [NUMA_HOST_POLICY_INTERLEAVE] = MPOL_INTERLEAVE,
+};
+
+static int ram_block_mbind(RAMBlock *block, int policy, uint64_t nodes)
+{
+    unsigned long mask[64 / HOST_LONG_BITS];
+    int i;
+
+    if (policy == NUMA_HOST_POLICY_PREFERRED) {
+        /* only the first node counts */
+        nodes &= -nodes;
+    }
+    for (i = 0; i < ARRAY_SIZE(mask); i++) {
+        mask[i] = nodes >> (i * HOST_LONG_BITS);
+    }
+    /* The kernel reads maxnode - 1 bits of the mask.  */
+    if (syscall(__NR_mbind, block->host, block->length, numa_host_mpol[policy],
+                mask, 64 + 1, MPOL_MF_MOVE) < 0) {
+        return -errno;
+    }
+    return 0;
+}
+#else
+static int ram_block_mbind(RAMBlock *block, int policy, uint64_t nodes)
+{
+    return -ENOSYS;
+}
+#endif
+
+/* Apply the host memory policy of guest NUMA node 'node' to the RAM block
+   at 'addr'.  Pages that are already allocated are moved.  */
+void qemu_ram_set_numa_node(ram_addr_t addr, int node)
+{
+    RAMBlock *block;
+    int ret;
+
+    QLIST_FOREACH(block, &ram_list.blocks, next) {
+        if (block->offset == addr) {
+            break;
+        }
+    }
+    assert(block && node >= 0 && node < MAX_NODES);
+
+    block->numa_node = node;
+    if (!block->host || node_host_policy[node] == NUMA_HOST_POLICY_DEFAULT) {
+        return;
+    }
+    ret = ram_block_mbind(block, node_host_policy[node], node_host_nodes[node]);
+    if (ret < 0) {
+        fprintf(stderr, "qemu: cannot set the host memory policy of NUMA "
+                "node %d: %s\n", node, strerror(-ret));
+    }
+}
+
+#if defined(__linux__) && defined(__NR_move_pages)
+#define NUMA_PLACEMENT_SAMPLES 65536
+#define NUMA_PLACEMENT_BATCH   1024
+
+/* Estimate how many bytes of 'block' are on each host node by asking the
+   kernel for the location of a sample of its pages.  */
+static void ram_block_placement(RAMBlock *block, uint64_t *node_bytes,
+                                uint64_t *unallocated)
+{
+    void *pages[NUMA_PLACEMENT_BATCH];
+    int status[NUMA_PLACEMENT_BATCH];
+    ram_addr_t npages = block->length >> TARGET_PAGE_BITS;
+    ram_addr_t step = MAX(npages / NUMA_PLACEMENT_SAMPLES, 1);
+    ram_addr_t sample_size = step << TARGET_PAGE_BITS;
+    ram_addr_t page = 0;
+    int i, n;
+
+    while (page < npages) {
+        for (n = 0; n < NUMA_PLACEMENT_BATCH && page < npages; n++) {
+            pages[n] = block->host + (page << TARGET_PAGE_BITS);
+            page += step;
+        }
+        if (syscall(__NR_move_pages, 0, n, pages, NULL, status, 0) < 0) {
+            *unallocated += n * sample_size;
+            continue;
+        }
+        for (i = 0; i < n; i++) {
+            if (status[i] >= 0 && status[i] < 64) {
+                node_bytes[status[i]] += sample_size;
+            } else {
+                *unallocated += sample_size;
+            }
+        }
+    }
+}
+#else
+static void ram_block_placement(RAMBlock *block, uint64_t *node_bytes,
+                                uint64_t *unallocated)
+{
+}
+#endif
+
+NumaNodeMemoryInfoList *qmp_query_numa_memory(Error **errp)
+{
+    NumaNodeMemoryInfoList *head = NULL, **next = &head;
+    int node, i;
+
+    for (node = 0; node < nb_numa_nodes; node++) {
+        NumaNodeMemoryInfoList *entry;
+        NumaNodeMemoryInfo *info;
+        NumaHostNodeMemoryList **next_host;
+        uint64_t node_bytes[64] = { 0 };
+        uint64_t unallocated = 0;
+        RAMBlock *block;
+
+        QLIST_FOREACH(block, &ram_list.blocks, next) {
+            if (block->numa_node == node && block->host) {
+                ram_block_placement(block, node_bytes, &unallocated);
+            }
+        }
+
+        info = g_malloc0(sizeof(*info));
+        info->node = node;
+        info->size = node_mem[node];
+        info->policy = node_host_policy[node];
+        info->host_nodes = node_host_nodes[node];
+        info->unallocated = unallocated;
+        next_host = &info->placement;
+        for (i = 0; i < 64; i++) {
+            NumaHostNodeMemoryList *host;
+
+            if (!node_bytes[i]) {
+                continue;
+            }
+            host = g_malloc0(sizeof(*host));
+            host->value = g_malloc0(sizeof(*host->value));
+            host->value->host_node = i;
+            host->value->size = node_bytes[i];
+            *next_host = host;
+            next_host = &host->next;
+        }
+
+        entry = g_malloc0(sizeof(*entry));
+        entry->value = info;
+        *next = entry;
+        next = &entry->next;
+    }
+    return head;
+}
+
 void qemu_ram_free_from_ptr(ram_addr_t addr)
 {
     RAMBlock *block;
@@ -2638,11 +3234,10 @@ void qemu_ram_remap(ram_addr_t addr, ram_addr_t length)
 #if defined(__linux__) && !defined(TARGET_S390X)
                     if (block->fd) {
 #ifdef MAP_POPULATE
-                        flags |= mem_prealloc ? MAP_POPULATE | MAP_SHARED :
-                            MAP_PRIVATE;
-#else
-                        flags |= MAP_PRIVATE;
+                        flags |= mem_prealloc ? MAP_POPULATE : 0;
 #endif
+                        flags |= block->flags & RAM_SHARED_MASK ?
+                            MAP_SHARED : MAP_PRIVATE;
                         area = mmap(vaddr, length, PROT_READ | PROT_WRITE,
                                     flags, block->fd, offset);
                     } else {
@@ -2804,6 +3399,33 @@ int qemu_ram_addr_from_host(void *ptr, ram_addr_t *ram_addr)
     return -1;
 }
 
+/* Return the file descriptor of the shared mapping that contains 'ptr',
+   or -1 if the RAM block is private.  '*offset' is set to the offset of
+   'ptr' in the file, '*avail' to the number of bytes of the block that
+   follow it.  */
+int qemu_ram_get_fd(void *ptr, ram_addr_t *offset, ram_addr_t *avail)
+{
+#if defined(__linux__) && !defined(TARGET_S390X)
+    RAMBlock *block;
+    uint8_t *host = ptr;
+
+    QLIST_FOREACH(block, &ram_list.blocks, next) {
+        if (block->host == NULL) {
+            continue;
+        }
+        if (host - block->host < block->length) {
+            if (!block->fd || !(block->flags & RAM_SHARED_MASK)) {
+                return -1;
+            }
+            *offset = host - block->host;
+            *avail = block->length - *offset;
+            return block->fd;
+        }
+    }
+#endif
+    return -1;
+}
+
 /* Some of the softmmu routines need to translate from a host pointer
    (typically a TLB entry) back to a ram offset.  */
 ram_addr_t qemu_ram_addr_from_host_nofail(void *ptr)
@@ -3124,6 +3746,199 @@ static uint16_t dummy_section(MemoryRegion *mr)
     return phys_section_add(&section);
 }
 
+/* Dispatch without the global mutex.
+ *
+ * Regions whose ops have read_nolock/write_nolock handlers are also kept
+ * in a sorted table per address space.  The listeners rebuild the tables
+ * on every topology change and publish them by pointer; vCPU threads look
+ * up accesses there without taking the global mutex.  Readers are counted
+ * in two epochs, as in SRCU, so that the updater knows when the previous
+ * table is no longer in use and can free it.
+ */
+
+enum {
+    NOLOCK_MEMORY,
+    NOLOCK_IO,
+    NOLOCK_NB,
+};
+
+typedef struct NolockRange {
+    target_phys_addr_t start;
+    target_phys_addr_t size;
+    target_phys_addr_t offset_within_region;
+    MemoryRegion *mr;
+} NolockRange;
+
+typedef struct NolockMap {
+    unsigned nr;
+    NolockRange ranges[];
+} NolockMap;
+
+static NolockMap *nolock_map[NOLOCK_NB];
+static NolockRange *nolock_pending[NOLOCK_NB];
+static unsigned nolock_pending_nb[NOLOCK_NB], nolock_pending_alloc[NOLOCK_NB];
+static volatile int nolock_readers[2];
+static unsigned nolock_epoch;
+
+static int nolock_read_lock(void)
+{
+    int idx = nolock_epoch & 1;
+
+    /* Full barrier: the table pointer is loaded after the count is up.  */
+    __sync_fetch_and_add(&nolock_readers[idx], 1);
+    return idx;
+}
+
+static void nolock_read_unlock(int idx)
+{
+    __sync_fetch_and_sub(&nolock_readers[idx], 1);
+}
+
+/* Wait until no reader can still see a table unpublished before the call.
+ * Readers never take the global mutex, so this cannot deadlock with them
+ * as long as memory map changes are not made with a device lock held.
+ */
+static void nolock_synchronize(void)
+{
+    int i, idx;
+
+    for (i = 0; i < 2; i++) {
+        idx = nolock_epoch & 1;
+        __sync_fetch_and_add(&nolock_epoch, 1);
+        while (nolock_readers[idx]) {
+            g_thread_yield();
+        }
+    }
+}
+
+static void nolock_map_begin(int space)
+{
+    nolock_pending_nb[space] = 0;
+}
+
+static void nolock_map_add(int space, MemoryRegionSection *section)
+{
+    NolockRange *r;
+
+    if (!io_mem_has_nolock(section->mr)) {
+        return;
+    }
+    if (nolock_pending_nb[space] == nolock_pending_alloc[space]) {
+        nolock_pending_alloc[space] = MAX(nolock_pending_alloc[space] * 2, 8);
+        nolock_pending[space] = g_renew(NolockRange, nolock_pending[space],
+                                        nolock_pending_alloc[space]);
+    }
+    r = &nolock_pending[space][nolock_pending_nb[space]++];
+    r->start = section->offset_within_address_space;
+    r->size = section->size;
+    r->offset_within_region = section->offset_within_region;
+    r->mr = section->mr;
+}
+
+static int nolock_range_cmp(const void *a, const void *b)
+{
+    const NolockRange *ra = a, *rb = b;
+
+    return ra->start < rb->start ? -1 : ra->start > rb->start;
+}
+
+static void nolock_map_commit(int space)
+{
+    NolockMap *old = nolock_map[space], *map = NULL;
+    unsigned nr = nolock_pending_nb[space];
+
+    if (nr) {
+        map = g_malloc(sizeof(*map) + nr * sizeof(map->ranges[0]));
+        map->nr = nr;
+        memcpy(map->ranges, nolock_pending[space], nr * sizeof(map->ranges[0]));
+        qsort(map->ranges, nr, sizeof(map->ranges[0]), nolock_range_cmp);
+    }
+    if (!old && !map) {
+        return;
+    }
+    smp_wmb();
+    nolock_map[space] = map;
+    nolock_synchronize();
+    g_free(old);
+}
+
+static const NolockRange *nolock_map_find(NolockMap *map,
+                                          target_phys_addr_t addr,
+                                          unsigned len)
+{
+    unsigned lo = 0, hi = map->nr;
+
+    while (lo < hi) {
+        unsigned mid = (lo + hi) / 2;
+        const NolockRange *r = &map->ranges[mid];
+
+        if (addr < r->start) {
+            hi = mid;
+        } else if (addr - r->start >= r->size) {
+            lo = mid + 1;
+        } else {
+            return addr - r->start + len <= r->size ? r : NULL;
+        }
+    }
+    return NULL;
+}
+
+static bool nolock_rw(int space, target_phys_addr_t addr, uint8_t *buf,
+                      int len, int is_write)
+{
+    const NolockRange *r;
+    NolockMap *map;
+    uint64_t val;
+    bool ret = false;
+    int idx;
+
+    if (len != 1 && len != 2 && len != 4) {
+        return false;
+    }
+
+    idx = nolock_read_lock();
+    map = nolock_map[space];
+    r = map ? nolock_map_find(map, addr, len) : NULL;
+    if (r) {
+        addr += r->offset_within_region - r->start;
+        if (is_write) {
+            val = len == 4 ? ldl_p(buf) : len == 2 ? lduw_p(buf) : ldub_p(buf);
+            ret = io_mem_write_nolock(r->mr, addr, val, len);
+        } else if (io_mem_read_nolock(r->mr, addr, &val, len)) {
+            switch (len) {
+            case 1:
+                stb_p(buf, val);
+                break;
+            case 2:
+                stw_p(buf, val);
+                break;
+            case 4:
+                stl_p(buf, val);
+                break;
+            }
+            ret = true;
+        }
+    }
+    nolock_read_unlock(idx);
+    return ret;
+}
+
+/* Perform an MMIO access without the global mutex if the region allows it.
+ * Returns false, without side effects, if the caller must take the global
+ * mutex and use cpu_physical_memory_rw() instead.
+ */
+bool cpu_physical_memory_rw_nolock(target_phys_addr_t addr, uint8_t *buf,
+                                   int len, int is_write)
+{
+    return nolock_rw(NOLOCK_MEMORY, addr, buf, len, is_write);
+}
+
+/* Likewise for a single access to the I/O address space.  */
+bool cpu_ioport_rw_nolock(uint32_t port, uint8_t *buf, int len, int is_write)
+{
+    return nolock_rw(NOLOCK_IO, port, buf, len, is_write);
+}
+
 MemoryRegion *iotlb_to_region(target_phys_addr_t index)
 {
     return phys_sections[index & ~TARGET_PAGE_MASK].mr;
@@ -3152,12 +3967,15 @@ static void core_begin(MemoryListener *listener)
     phys_section_notdirty = dummy_section(&io_mem_notdirty);
     phys_section_rom = dummy_section(&io_mem_rom);
     phys_section_watch = dummy_section(&io_mem_watch);
+    nolock_map_begin(NOLOCK_MEMORY);
 }
 
 static void core_commit(MemoryListener *listener)
 {
     CPUArchState *env;
 
+    nolock_map_commit(NOLOCK_MEMORY);
+
     /* since each CPU stores ram addresses in its TLB cache, we must
        reset the modified entries */
     /* XXX: slow ! */
@@ -3170,6 +3988,7 @@ static void core_region_add(MemoryListener *listener,
                             MemoryRegionSection *section)
 {
     cpu_register_physical_memory_log(section, section->readonly);
+    nolock_map_add(NOLOCK_MEMORY, section);
 }
 
 static void core_region_del(MemoryListener *listener,
@@ -3181,6 +4000,7 @@ static void core_region_nop(MemoryListener *listener,
                             MemoryRegionSection *section)
 {
     cpu_register_physical_memory_log(section, section->readonly);
+    nolock_map_add(NOLOCK_MEMORY, section);
 }
 
 static void core_log_start(MemoryListener *listener,
@@ -3222,10 +4042,12 @@ static void core_eventfd_del(MemoryListener *listener,
 
 static void io_begin(MemoryListener *listener)
 {
+    nolock_map_begin(NOLOCK_IO);
 }
 
 static void io_commit(MemoryListener *listener)
 {
+    nolock_map_commit(NOLOCK_IO);
 }
 
 static void io_region_add(MemoryListener *listener,
@@ -3233,6 +4055,7 @@ static void io_region_add(MemoryListener *listener,
 {
     MemoryRegionIORange *mrio = g_new(MemoryRegionIORange, 1);
 
+    nolock_map_add(NOLOCK_IO, section);
     mrio->mr = section->mr;
     mrio->offset = section->offset_within_region;
     iorange_init(&mrio->iorange, &memory_region_iorange_ops,
@@ -3249,6 +4072,7 @@ static void io_region_del(MemoryListener *listener,
 static void io_region_nop(MemoryListener *listener,
                           MemoryRegionSection *section)
 {
+    nolock_map_add(NOLOCK_IO, section);
 }
 
 static void io_log_start(MemoryListener *listener,
@@ -3613,6 +4437,29 @@ void *cpu_physical_memory_map(target_phys_addr_t addr,
     return ret;
 }
 
+/* Account for a write to guest RAM done through a host pointer: mark
+ * the pages dirty and invalidate the code translated from them.
+ */
+void qemu_ram_set_dirty(ram_addr_t addr, ram_addr_t len)
+{
+    while (len) {
+        ram_addr_t l = TARGET_PAGE_SIZE - (addr & ~TARGET_PAGE_MASK);
+
+        if (l > len) {
+            l = len;
+        }
+        if (!cpu_physical_memory_is_dirty(addr)) {
+            /* invalidate code */
+            tb_invalidate_phys_page_range(addr, addr + l, 0);
+            /* set dirty bit */
+            cpu_physical_memory_set_dirty_flags(
+                addr, (0xff & ~CODE_DIRTY_FLAG));
+        }
+        addr += l;
+        len -= l;
+    }
+}
+
 /* Unmaps a memory region previously mapped by cpu_physical_memory_map().
  * Will also mark the memory as dirty if is_write == 1.  access_len gives
  * the amount of memory that was actually read or written by the caller.
@@ -3622,22 +4469,8 @@ void cpu_physical_memory_unmap(void *buffer, target_phys_addr_t len,
 {
     if (buffer != bounce.buffer) {
         if (is_write) {
-            ram_addr_t addr1 = qemu_ram_addr_from_host_nofail(buffer);
-            while (access_len) {
-                unsigned l;
-                l = TARGET_PAGE_SIZE;
-                if (l > access_len)
-                    l = access_len;
-                if (!cpu_physical_memory_is_dirty(addr1)) {
-                    /* invalidate code */
-                    tb_invalidate_phys_page_range(addr1, addr1 + l, 0);
-                    /* set dirty bit */
-                    cpu_physical_memory_set_dirty_flags(
-                        addr1, (0xff & ~CODE_DIRTY_FLAG));
-                }
-                addr1 += l;
-                access_len -= l;
-            }
+            qemu_ram_set_dirty(qemu_ram_addr_from_host_nofail(buffer),
+                               access_len);
         }
         if (xen_enabled()) {
             xen_invalidate_map_cache_entry(buffer);
@@ -4197,9 +5030,175 @@ void dump_exec_info(FILE *f, fprintf_function cpu_fprintf)
     cpu_fprintf(f, "TB flush count      %d\n", tb_flush_count);
     cpu_fprintf(f, "TB invalidate count %d\n", tb_phys_invalidate_count);
     cpu_fprintf(f, "TLB flush count     %d\n", tlb_flush_count);
+    cpu_fprintf(f, "dead code size      %zd\n", tb_phys_invalidate_bytes);
+    if (tb_hot_threshold) {
+        int i;
+
+        cpu_fprintf(f, "hot TB threshold    %d\n", tb_hot_threshold);
+        for (i = 0; i < 2; i++) {
+            cpu_fprintf(f, "%s TB count        %d, avg host size %zd, "
+                        "avg cycles %" PRId64 "\n", i ? "hot " : "cold",
+                        tb_tier_count[i],
+                        tb_tier_count[i] ?
+                        tb_tier_code_size[i] / tb_tier_count[i] : 0,
+                        tb_tier_count[i] ?
+                        tb_tier_ticks[i] / tb_tier_count[i] : 0);
+        }
+    }
     tcg_dump_info(f, cpu_fprintf);
 }
 
+#define JIT_PROFILE_DEFAULT_BLOCKS 20
+
+static int tb_exec_count_cmp(const void *p1, const void *p2)
+{
+    const TranslationBlock *tb1 = *(TranslationBlock * const *)p1;
+    const TranslationBlock *tb2 = *(TranslationBlock * const *)p2;
+
+    if (tb1->exec_count == tb2->exec_count) {
+        return 0;
+    }
+    return tb1->exec_count > tb2->exec_count ? -1 : 1;
+}
+
+/* Return the executed TBs sorted by decreasing execution count, and the
+   total number of executions in '*total'.  */
+static TranslationBlock **tb_profile_sorted(int *nb, uint64_t *total)
+{
+    TranslationBlock **sorted;
+    int i, n;
+
+    sorted = g_malloc(nb_tbs * sizeof(*sorted));
+    *total = 0;
+    for (i = n = 0; i < nb_tbs; i++) {
+        if (tbs[i].exec_count) {
+            sorted[n++] = &tbs[i];
+            *total += tbs[i].exec_count;
+        }
+    }
+    qsort(sorted, n, sizeof(*sorted), tb_exec_count_cmp);
+    *nb = n;
+    return sorted;
+}
+
+void qmp_jit_profile(bool enable, Error **errp)
+{
+    if (!tcg_enabled()) {
+        error_set(errp, QERR_UNSUPPORTED);
+        return;
+    }
+    tb_profile_set(first_cpu, enable);
+}
+
+JitProfileInfo *qmp_query_jit_profile(bool has_count, int64_t count,
+                                      Error **errp)
+{
+    JitProfileInfo *info;
+    JitBlockInfoList *block, **next_block;
+    JitHelperInfoList *helper, **next_helper;
+    TranslationBlock **sorted;
+    const char *name;
+    uint64_t total, calls;
+    int i, n;
+
+    if (!tcg_enabled()) {
+        error_set(errp, QERR_UNSUPPORTED);
+        return NULL;
+    }
+    if (!has_count) {
+        count = JIT_PROFILE_DEFAULT_BLOCKS;
+    }
+
+    info = g_malloc0(sizeof(*info));
+    info->enabled = tb_profile_enabled;
+    info->code_size = code_gen_ptr - code_gen_buffer;
+    info->code_max_size = code_gen_buffer_max_size;
+    info->dead_code_size = tb_phys_invalidate_bytes;
+    info->tb_count = nb_tbs;
+    info->tb_max_count = code_gen_max_blocks;
+    info->flush_count = tb_flush_count;
+    info->invalidate_count = tb_phys_invalidate_count;
+
+    sorted = tb_profile_sorted(&n, &total);
+    info->executions = total;
+    info->main_loop_entries = tb_profile_entries;
+    info->chained_executions = total > tb_profile_entries ?
+                               total - tb_profile_entries : 0;
+
+    next_block = &info->blocks;
+    for (i = 0; i < n && i < count; i++) {
+        TranslationBlock *tb = sorted[i];
+
+        block = g_malloc0(sizeof(*block));
+        block->value = g_malloc0(sizeof(*block->value));
+        block->value->pc = tb->pc;
+        block->value->cs_base = tb->cs_base;
+        block->value->flags = tb->flags;
+        block->value->size = tb->size;
+        block->value->host_addr = (uintptr_t)tb->tc_ptr;
+        block->value->host_size = tb_host_size(tb);
+        block->value->exec_count = tb->exec_count;
+        block->value->exit_count = tb->exit_count;
+        *next_block = block;
+        next_block = &block->next;
+    }
+    g_free(sorted);
+
+    next_helper = &info->helpers;
+    for (i = 0; tcg_get_helper_count(&tcg_ctx, i, &name, &calls); i++) {
+        if (!calls) {
+            continue;
+        }
+        helper = g_malloc0(sizeof(*helper));
+        helper->value = g_malloc0(sizeof(*helper->value));
+        helper->value->name = g_strdup(name);
+        helper->value->count = calls;
+        *next_helper = helper;
+        next_helper = &helper->next;
+    }
+    return info;
+}
+
+/* Write the profile in the "folded" format used by perf script based
+   tools such as flame graph generators: one line per TB or helper, the
+   frames separated by semicolons followed by the sample count.  */
+void qmp_jit_profile_dump(const char *filename, Error **errp)
+{
+    TranslationBlock **sorted;
+    const char *name;
+    uint64_t total, calls;
+    FILE *f;
+    int i, n;
+
+    if (!tcg_enabled()) {
+        error_set(errp, QERR_UNSUPPORTED);
+        return;
+    }
+    f = fopen(filename, "w");
+    if (!f) {
+        error_set(errp, QERR_OPEN_FILE_FAILED, filename);
+        return;
+    }
+
+    sorted = tb_profile_sorted(&n, &total);
+    for (i = 0; i < n; i++) {
+        TranslationBlock *tb = sorted[i];
+        const char *sym = lookup_symbol(tb->pc);
+
+        fprintf(f, "tb;%s%s" TARGET_FMT_lx " %" PRIu64 "\n",
+                sym[0] ? sym : "", sym[0] ? ";" : "", tb->pc,
+                tb->exec_count);
+    }
+    g_free(sorted);
+
+    for (i = 0; tcg_get_helper_count(&tcg_ctx, i, &name, &calls); i++) {
+        if (calls) {
+            fprintf(f, "helper;%s %" PRIu64 "\n", name, calls);
+        }
+    }
+    fclose(f);
+}
+
 /*
  * A helper function for the _utterly broken_ virtio device model to find out if
  * it's running on a big endian machine. Don't do this at home kids!
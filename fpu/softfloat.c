@@ -38,7 +38,12 @@ these four paragraphs for those parts of this code that are retained.
 /* softfloat (and in particular the code in softfloat-specialize.h) is
  * target-dependent and needs the TARGET_* macros.
  */
+#ifndef SOFTFLOAT_TEST
 #include "config.h"
+#endif
+
+#include <float.h>
+#include <math.h>
 
 #include "softfloat.h"
 
@@ -74,6 +79,237 @@ void set_floatx80_rounding_precision(int val STATUS_PARAM)
     STATUS(floatx80_rounding_precision) = val;
 }
 
+/*----------------------------------------------------------------------------
+| Host FPU fast path for the basic single- and double-precision operations.
+| The host FPU is only used when its result and exception flags are known to
+| match the software implementation exactly: the host evaluates float and
+| double in IEEE single and double precision, the rounding mode is round to
+| nearest even (which is what the host FPU is left in), every input is zero
+| or normal, and the inexact flag is already set so that it does not have to
+| be computed.  Results that are tiny are recomputed in software, since
+| underflow detection and flush-to-zero depend on target settings; overflow
+| to infinity raises the same flags as roundAndPackFloat*().
+*----------------------------------------------------------------------------*/
+#if defined(__STDC_IEC_559__) && defined(FLT_EVAL_METHOD) && FLT_EVAL_METHOD == 0
+#define SOFTFLOAT_HOST_FPU
+#endif
+
+flag float_host_fpu_enabled = 1;
+
+typedef union {
+    float32 s;
+    float h;
+} float32_host;
+
+typedef union {
+    float64 s;
+    double h;
+} float64_host;
+
+INLINE flag float_host_fpu_usable(float_status *status)
+{
+#ifdef SOFTFLOAT_HOST_FPU
+    return float_host_fpu_enabled &&
+           STATUS(float_rounding_mode) == float_round_nearest_even &&
+           (STATUS(float_exception_flags) & float_flag_inexact);
+#else
+    return 0;
+#endif
+}
+
+/*----------------------------------------------------------------------------
+| Stores the host result `r' in `*z' and returns 1, or returns 0 if the
+| operation has to be redone in software.  `zero_exact' tells whether a zero
+| result is known to be exact rather than the result of an underflow.
+*----------------------------------------------------------------------------*/
+
+INLINE flag float32_host_result(float r, flag zero_exact, float32 *z
+                                STATUS_PARAM)
+{
+    float32_host u;
+
+    if (unlikely(fabsf(r) <= FLT_MIN) && !(r == 0 && zero_exact)) {
+        return 0;
+    }
+    if (unlikely(isinf(r))) {
+        float_raise(float_flag_overflow | float_flag_inexact STATUS_VAR);
+    }
+    u.h = r;
+    *z = u.s;
+    return 1;
+}
+
+INLINE flag float64_host_result(double r, flag zero_exact, float64 *z
+                                STATUS_PARAM)
+{
+    float64_host u;
+
+    if (unlikely(fabs(r) <= DBL_MIN) && !(r == 0 && zero_exact)) {
+        return 0;
+    }
+    if (unlikely(isinf(r))) {
+        float_raise(float_flag_overflow | float_flag_inexact STATUS_VAR);
+    }
+    u.h = r;
+    *z = u.s;
+    return 1;
+}
+
+INLINE flag float32_host_addsub(float32 a, float32 b, flag sub, float32 *z
+                                STATUS_PARAM)
+{
+    float32_host ua, ub;
+
+    if (!float_host_fpu_usable(status) ||
+        !float32_is_zero_or_normal(a) || !float32_is_zero_or_normal(b)) {
+        return 0;
+    }
+    ua.s = a;
+    ub.s = b;
+    /* The sum of two zero-or-normal values is zero only if it is exact.  */
+    return float32_host_result(sub ? ua.h - ub.h : ua.h + ub.h, 1, z
+                               STATUS_VAR);
+}
+
+INLINE flag float64_host_addsub(float64 a, float64 b, flag sub, float64 *z
+                                STATUS_PARAM)
+{
+    float64_host ua, ub;
+
+    if (!float_host_fpu_usable(status) ||
+        !float64_is_zero_or_normal(a) || !float64_is_zero_or_normal(b)) {
+        return 0;
+    }
+    ua.s = a;
+    ub.s = b;
+    return float64_host_result(sub ? ua.h - ub.h : ua.h + ub.h, 1, z
+                               STATUS_VAR);
+}
+
+INLINE flag float32_host_mul(float32 a, float32 b, float32 *z STATUS_PARAM)
+{
+    float32_host ua, ub;
+
+    if (!float_host_fpu_usable(status) ||
+        !float32_is_zero_or_normal(a) || !float32_is_zero_or_normal(b)) {
+        return 0;
+    }
+    ua.s = a;
+    ub.s = b;
+    return float32_host_result(ua.h * ub.h,
+                               float32_is_zero(a) || float32_is_zero(b), z
+                               STATUS_VAR);
+}
+
+INLINE flag float64_host_mul(float64 a, float64 b, float64 *z STATUS_PARAM)
+{
+    float64_host ua, ub;
+
+    if (!float_host_fpu_usable(status) ||
+        !float64_is_zero_or_normal(a) || !float64_is_zero_or_normal(b)) {
+        return 0;
+    }
+    ua.s = a;
+    ub.s = b;
+    return float64_host_result(ua.h * ub.h,
+                               float64_is_zero(a) || float64_is_zero(b), z
+                               STATUS_VAR);
+}
+
+INLINE flag float32_host_div(float32 a, float32 b, float32 *z STATUS_PARAM)
+{
+    float32_host ua, ub;
+
+    if (!float_host_fpu_usable(status) || !float32_is_zero_or_normal(a) ||
+        !float32_is_zero_or_normal(b) || float32_is_zero(b)) {
+        return 0;
+    }
+    ua.s = a;
+    ub.s = b;
+    return float32_host_result(ua.h / ub.h, float32_is_zero(a), z
+                               STATUS_VAR);
+}
+
+INLINE flag float64_host_div(float64 a, float64 b, float64 *z STATUS_PARAM)
+{
+    float64_host ua, ub;
+
+    if (!float_host_fpu_usable(status) || !float64_is_zero_or_normal(a) ||
+        !float64_is_zero_or_normal(b) || float64_is_zero(b)) {
+        return 0;
+    }
+    ua.s = a;
+    ub.s = b;
+    return float64_host_result(ua.h / ub.h, float64_is_zero(a), z
+                               STATUS_VAR);
+}
+
+/*----------------------------------------------------------------------------
+| Only the plain fused multiply-add is handled on the host; the negation
+| flags keep going through the software path so that their exact semantics
+| (including the sign of zero results) stay in one place.
+*----------------------------------------------------------------------------*/
+
+INLINE flag float32_host_muladd(float32 a, float32 b, float32 c, int flags,
+                                float32 *z STATUS_PARAM)
+{
+    float32_host ua, ub, uc;
+
+    if (flags || !float_host_fpu_usable(status) ||
+        !float32_is_zero_or_normal(a) || !float32_is_zero_or_normal(b) ||
+        !float32_is_zero_or_normal(c)) {
+        return 0;
+    }
+    ua.s = a;
+    ub.s = b;
+    uc.s = c;
+    return float32_host_result(fmaf(ua.h, ub.h, uc.h),
+                               (float32_is_zero(a) || float32_is_zero(b)) &&
+                               float32_is_zero(c), z STATUS_VAR);
+}
+
+INLINE flag float64_host_muladd(float64 a, float64 b, float64 c, int flags,
+                                float64 *z STATUS_PARAM)
+{
+    float64_host ua, ub, uc;
+
+    if (flags || !float_host_fpu_usable(status) ||
+        !float64_is_zero_or_normal(a) || !float64_is_zero_or_normal(b) ||
+        !float64_is_zero_or_normal(c)) {
+        return 0;
+    }
+    ua.s = a;
+    ub.s = b;
+    uc.s = c;
+    return float64_host_result(fma(ua.h, ub.h, uc.h),
+                               (float64_is_zero(a) || float64_is_zero(b)) &&
+                               float64_is_zero(c), z STATUS_VAR);
+}
+
+INLINE flag float32_host_sqrt(float32 a, float32 *z STATUS_PARAM)
+{
+    float32_host ua;
+
+    if (!float_host_fpu_usable(status) ||
+        !float32_is_zero_or_normal(a) || float32_is_neg(a)) {
+        return 0;
+    }
+    ua.s = a;
+    return float32_host_result(sqrtf(ua.h), 1, z STATUS_VAR);
+}
+
+INLINE flag float64_host_sqrt(float64 a, float64 *z STATUS_PARAM)
+{
+    float64_host ua;
+
+    if (!float_host_fpu_usable(status) ||
+        !float64_is_zero_or_normal(a) || float64_is_neg(a)) {
+        return 0;
+    }
+    ua.s = a;
+    return float64_host_result(sqrt(ua.h), 1, z STATUS_VAR);
+}
+
 /*----------------------------------------------------------------------------
 | Returns the fraction bits of the half-precision floating-point value `a'.
 *----------------------------------------------------------------------------*/
@@ -1851,7 +2087,13 @@ static float32 subFloat32Sigs( float32 a, float32 b, flag zSign STATUS_PARAM)
 
 float32 float32_add( float32 a, float32 b STATUS_PARAM )
 {
+    float32 z;
     flag aSign, bSign;
+
+    if (float32_host_addsub(a, b, 0, &z STATUS_VAR)) {
+        return z;
+    }
+
     a = float32_squash_input_denormal(a STATUS_VAR);
     b = float32_squash_input_denormal(b STATUS_VAR);
 
@@ -1874,7 +2116,13 @@ float32 float32_add( float32 a, float32 b STATUS_PARAM )
 
 float32 float32_sub( float32 a, float32 b STATUS_PARAM )
 {
+    float32 z;
     flag aSign, bSign;
+
+    if (float32_host_addsub(a, b, 1, &z STATUS_VAR)) {
+        return z;
+    }
+
     a = float32_squash_input_denormal(a STATUS_VAR);
     b = float32_squash_input_denormal(b STATUS_VAR);
 
@@ -1897,12 +2145,17 @@ float32 float32_sub( float32 a, float32 b STATUS_PARAM )
 
 float32 float32_mul( float32 a, float32 b STATUS_PARAM )
 {
+    float32 z;
     flag aSign, bSign, zSign;
     int_fast16_t aExp, bExp, zExp;
     uint32_t aSig, bSig;
     uint64_t zSig64;
     uint32_t zSig;
 
+    if (float32_host_mul(a, b, &z STATUS_VAR)) {
+        return z;
+    }
+
     a = float32_squash_input_denormal(a STATUS_VAR);
     b = float32_squash_input_denormal(b STATUS_VAR);
 
@@ -1960,9 +2213,15 @@ float32 float32_mul( float32 a, float32 b STATUS_PARAM )
 
 float32 float32_div( float32 a, float32 b STATUS_PARAM )
 {
+    float32 z;
     flag aSign, bSign, zSign;
     int_fast16_t aExp, bExp, zExp;
     uint32_t aSig, bSig, zSig;
+
+    if (float32_host_div(a, b, &z STATUS_VAR)) {
+        return z;
+    }
+
     a = float32_squash_input_denormal(a STATUS_VAR);
     b = float32_squash_input_denormal(b STATUS_VAR);
 
@@ -2130,6 +2389,7 @@ float32 float32_rem( float32 a, float32 b STATUS_PARAM )
 
 float32 float32_muladd(float32 a, float32 b, float32 c, int flags STATUS_PARAM)
 {
+    float32 z;
     flag aSign, bSign, cSign, zSign;
     int_fast16_t aExp, bExp, cExp, pExp, zExp, expDiff;
     uint32_t aSig, bSig, cSig;
@@ -2139,6 +2399,10 @@ float32 float32_muladd(float32 a, float32 b, float32 c, int flags STATUS_PARAM)
     int shiftcount;
     flag signflip, infzero;
 
+    if (float32_host_muladd(a, b, c, flags, &z STATUS_VAR)) {
+        return z;
+    }
+
     a = float32_squash_input_denormal(a STATUS_VAR);
     b = float32_squash_input_denormal(b STATUS_VAR);
     c = float32_squash_input_denormal(c STATUS_VAR);
@@ -2332,10 +2596,16 @@ float32 float32_muladd(float32 a, float32 b, float32 c, int flags STATUS_PARAM)
 
 float32 float32_sqrt( float32 a STATUS_PARAM )
 {
+    float32 z;
     flag aSign;
     int_fast16_t aExp, zExp;
     uint32_t aSig, zSig;
     uint64_t rem, term;
+
+    if (float32_host_sqrt(a, &z STATUS_VAR)) {
+        return z;
+    }
+
     a = float32_squash_input_denormal(a STATUS_VAR);
 
     aSig = extractFloat32Frac( a );
@@ -3414,7 +3684,13 @@ static float64 subFloat64Sigs( float64 a, float64 b, flag zSign STATUS_PARAM )
 
 float64 float64_add( float64 a, float64 b STATUS_PARAM )
 {
+    float64 z;
     flag aSign, bSign;
+
+    if (float64_host_addsub(a, b, 0, &z STATUS_VAR)) {
+        return z;
+    }
+
     a = float64_squash_input_denormal(a STATUS_VAR);
     b = float64_squash_input_denormal(b STATUS_VAR);
 
@@ -3437,7 +3713,13 @@ float64 float64_add( float64 a, float64 b STATUS_PARAM )
 
 float64 float64_sub( float64 a, float64 b STATUS_PARAM )
 {
+    float64 z;
     flag aSign, bSign;
+
+    if (float64_host_addsub(a, b, 1, &z STATUS_VAR)) {
+        return z;
+    }
+
     a = float64_squash_input_denormal(a STATUS_VAR);
     b = float64_squash_input_denormal(b STATUS_VAR);
 
@@ -3460,10 +3742,15 @@ float64 float64_sub( float64 a, float64 b STATUS_PARAM )
 
 float64 float64_mul( float64 a, float64 b STATUS_PARAM )
 {
+    float64 z;
     flag aSign, bSign, zSign;
     int_fast16_t aExp, bExp, zExp;
     uint64_t aSig, bSig, zSig0, zSig1;
 
+    if (float64_host_mul(a, b, &z STATUS_VAR)) {
+        return z;
+    }
+
     a = float64_squash_input_denormal(a STATUS_VAR);
     b = float64_squash_input_denormal(b STATUS_VAR);
 
@@ -3521,11 +3808,17 @@ float64 float64_mul( float64 a, float64 b STATUS_PARAM )
 
 float64 float64_div( float64 a, float64 b STATUS_PARAM )
 {
+    float64 z;
     flag aSign, bSign, zSign;
     int_fast16_t aExp, bExp, zExp;
     uint64_t aSig, bSig, zSig;
     uint64_t rem0, rem1;
     uint64_t term0, term1;
+
+    if (float64_host_div(a, b, &z STATUS_VAR)) {
+        return z;
+    }
+
     a = float64_squash_input_denormal(a STATUS_VAR);
     b = float64_squash_input_denormal(b STATUS_VAR);
 
@@ -3684,6 +3977,7 @@ float64 float64_rem( float64 a, float64 b STATUS_PARAM )
 
 float64 float64_muladd(float64 a, float64 b, float64 c, int flags STATUS_PARAM)
 {
+    float64 z;
     flag aSign, bSign, cSign, zSign;
     int_fast16_t aExp, bExp, cExp, pExp, zExp, expDiff;
     uint64_t aSig, bSig, cSig;
@@ -3692,6 +3986,10 @@ float64 float64_muladd(float64 a, float64 b, float64 c, int flags STATUS_PARAM)
     int shiftcount;
     flag signflip, infzero;
 
+    if (float64_host_muladd(a, b, c, flags, &z STATUS_VAR)) {
+        return z;
+    }
+
     a = float64_squash_input_denormal(a STATUS_VAR);
     b = float64_squash_input_denormal(b STATUS_VAR);
     c = float64_squash_input_denormal(c STATUS_VAR);
@@ -3899,10 +4197,16 @@ float64 float64_muladd(float64 a, float64 b, float64 c, int flags STATUS_PARAM)
 
 float64 float64_sqrt( float64 a STATUS_PARAM )
 {
+    float64 z;
     flag aSign;
     int_fast16_t aExp, zExp;
     uint64_t aSig, zSig, doubleZSig;
     uint64_t rem0, rem1, term0, term1;
+
+    if (float64_host_sqrt(a, &z STATUS_VAR)) {
+        return z;
+    }
+
     a = float64_squash_input_denormal(a STATUS_VAR);
 
     aSig = extractFloat64Frac( a );
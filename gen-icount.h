@@ -33,6 +33,33 @@ static void gen_icount_end(TranslationBlock *tb, int num_insns)
     }
 }
 
+/* Code emitted at the start of every TB.  A cold TB exits with the low
+   bits set to 3 when it becomes hot, before executing any instruction, so
+   that cpu_exec can retranslate it.  */
+static inline void gen_tb_start(TranslationBlock *tb)
+{
+    int cold = tb->cflags & CF_TIER_COLD;
+
+    if (tb_profile_enabled || cold) {
+        TCGv_ptr ptr = tcg_const_ptr(&tb->exec_count);
+        TCGv_i64 count = tcg_temp_new_i64();
+
+        tcg_gen_ld_i64(count, ptr, 0);
+        tcg_gen_addi_i64(count, count, 1);
+        tcg_gen_st_i64(count, ptr, 0);
+        tcg_temp_free_ptr(ptr);
+        if (cold) {
+            int l1 = gen_new_label();
+
+            tcg_gen_brcondi_i64(TCG_COND_NE, count, tb_hot_threshold, l1);
+            tcg_gen_exit_tb((tcg_target_long)tb + 3);
+            gen_set_label(l1);
+        }
+        tcg_temp_free_i64(count);
+    }
+    gen_icount_start();
+}
+
 static inline void gen_io_start(void)
 {
     TCGv_i32 tmp = tcg_const_i32(1);
@@ -321,6 +321,23 @@ STEXI
 @findex singlestep
 Run the emulation in single step mode.
 If called with option off, the emulation returns to normal mode.
+ETEXI
+
+    {
+        .name       = "msi_timing",
+        .args_type  = "option:s?",
+        .params     = "[on|off]",
+        .help       = "time MSI delivery for 'info msi' or stop timing it",
+        .mhandler.cmd = do_msi_timing,
+    },
+
+STEXI
+@item msi_timing [off]
+@findex msi_timing
+Measure how long each MSI or MSI-X message takes to deliver, as reported
+by @code{info msi}.  Reading the clock adds to the cost of every message,
+so timing is off by default.  If called with option off, only the
+messages are counted again.
 ETEXI
 
     {
@@ -881,9 +898,13 @@ ETEXI
 #if defined(CONFIG_HAVE_CORE_DUMP)
     {
         .name       = "dump-guest-memory",
-        .args_type  = "paging:-p,protocol:s,begin:i?,length:i?",
-        .params     = "[-p] protocol [begin] [length]",
+        .args_type  = "paging:-p,detach:-d,zlib:-z,lzo:-l,snappy:-s,"
+                      "protocol:s,begin:i?,length:i?",
+        .params     = "[-p] [-d] [-z|-l|-s] protocol [begin] [length]",
         .help       = "dump guest memory to file"
+                      "\n\t\t\t -d: write the dump in the background"
+                      "\n\t\t\t -z|-l|-s: kdump-compressed format, with"
+                      "\n\t\t\t zlib, lzo or snappy compression"
                       "\n\t\t\t begin(optional): the starting physical address"
                       "\n\t\t\t length(optional): the memory size, in bytes",
         .user_print = monitor_user_noop,
@@ -892,13 +913,18 @@ ETEXI
 
 
 STEXI
-@item dump-guest-memory [-p] @var{protocol} @var{begin} @var{length}
+@item dump-guest-memory [-p] [-d] [-z|-l|-s] @var{protocol} @var{begin} @var{length}
 @findex dump-guest-memory
 Dump guest memory to @var{protocol}. The file can be processed with crash or
 gdb.
   protocol: destination file(started with "file:") or destination file
             descriptor (started with "fd:")
     paging: do paging to get guest's memory mapping
+    detach: return at once and write the dump in the background; use
+            "info dump" to follow the progress
+  zlib/lzo/snappy: write the kdump-compressed format, compressing pages
+            with zlib (-z), lzo (-l) or snappy (-s). Cannot be combined
+            with paging, begin and length.
      begin: the starting physical address. It's optional, and should be
             specified with length together.
     length: the memory size, in bytes. It's optional, and should be specified
@@ -1058,6 +1084,69 @@ STEXI
 @item netdev_del
 @findex netdev_del
 Remove host network device.
+ETEXI
+
+    {
+        .name       = "net_capture_start",
+        .args_type  = "netdev:s,file:s,filter:s?,snaplen:i?,size:i?,count:i?",
+        .params     = "id file [filter] [snaplen] [size] [count]",
+        .help       = "capture the traffic of a host network device to file",
+        .mhandler.cmd = hmp_net_capture_start,
+    },
+
+STEXI
+@item net_capture_start @var{id} @var{file} [@var{filter}] [@var{snaplen}] [@var{size}] [@var{count}]
+@findex net_capture_start
+Write the packets of host network device @var{id} to the libpcap file
+@var{file}, or to @var{count} files of @var{size} bytes each.  Quote a
+@var{filter} made of several words, as in @code{"tcp and port 80"}; see
+@option{-net dump} for its syntax.
+ETEXI
+
+    {
+        .name       = "net_capture_stop",
+        .args_type  = "netdev:s",
+        .params     = "id",
+        .help       = "stop capturing the traffic of a host network device",
+        .mhandler.cmd = hmp_net_capture_stop,
+    },
+
+STEXI
+@item net_capture_stop @var{id}
+@findex net_capture_stop
+Stop the capture started with @code{net_capture_start}.
+ETEXI
+
+    {
+        .name       = "netdev_set_throttle",
+        .args_type  = "id:s,bps:l,pps:l,bps_burst:l?,pps_burst:l?",
+        .params     = "id bps pps [bps_burst] [pps_burst]",
+        .help       = "limit the traffic of a host network device",
+        .mhandler.cmd = hmp_netdev_set_throttle,
+    },
+
+STEXI
+@item netdev_set_throttle @var{id} @var{bps} @var{pps} [@var{bps_burst}] [@var{pps_burst}]
+@findex netdev_set_throttle
+Limit each direction of host network device @var{id} to @var{bps} bytes and
+@var{pps} packets per second, 0 meaning no limit.  @code{info network} shows
+how many packets were delayed or dropped.
+ETEXI
+
+    {
+        .name       = "netdev_set_rss",
+        .args_type  = "id:s,queues:l,table:s?",
+        .params     = "id queues [table]",
+        .help       = "steer the frames of a tap device to receive queues",
+        .mhandler.cmd = hmp_netdev_set_rss,
+    },
+
+STEXI
+@item netdev_set_rss @var{id} @var{queues} [@var{table}]
+@findex netdev_set_rss
+Steer the frames received by tap device @var{id} to @var{queues} receive
+queues by their flow hash, through the comma-separated queues of
+@var{table}.  @code{info network} shows the frames received on each queue.
 ETEXI
 
 #ifdef CONFIG_SLIRP
@@ -1261,6 +1350,36 @@ STEXI
 Close the file descriptor previously assigned to @var{fdname} using the
 @code{getfd} command. This is only needed if the file descriptor was never
 used by another monitor command.
+ETEXI
+
+    {
+        .name       = "jit_profile",
+        .args_type  = "enable:b",
+        .params     = "on|off",
+        .help       = "start or stop profiling translated code",
+        .mhandler.cmd = hmp_jit_profile,
+    },
+
+STEXI
+@item jit_profile on|off
+@findex jit_profile
+Start or stop counting the executions of translated blocks and helper calls.
+The translation buffer is flushed. The profile is shown by @code{info jit-profile}.
+ETEXI
+
+    {
+        .name       = "jit_profile_dump",
+        .args_type  = "filename:F",
+        .params     = "filename",
+        .help       = "write the translated code profile to a file",
+        .mhandler.cmd = hmp_jit_profile_dump,
+    },
+
+STEXI
+@item jit_profile_dump @var{filename}
+@findex jit_profile_dump
+Write the translated code profile to @var{filename} in the folded stack
+format used by flame graph tools.
 ETEXI
 
     {
@@ -1392,16 +1511,25 @@ show the interrupts statistics (if available)
 show i8259 (PIC) state
 @item info pci
 show emulated PCI device info
+@item info msi
+show how MSI messages were delivered and, with @code{msi_timing}, the
+time taken by each path
 @item info tlb
 show virtual to physical memory mappings (i386, SH4, SPARC, PPC, and Xtensa only)
 @item info mem
 show the active virtual memory mappings (i386 only)
 @item info jit
 show dynamic compiler info
+@item info jit-profile
+show the most executed translated blocks
 @item info numa
 show NUMA information
 @item info kvm
 show KVM information
+@item info halt-poll
+show the halt polling window of each vCPU and how often polling succeeded
+@item info dump
+show the progress of the last guest memory dump
 @item info usb
 show USB devices plugged on the virtual USB hub
 @item info usbhost
@@ -147,6 +147,10 @@ void hmp_info_migrate(Monitor *mon)
                        info->ram->total >> 10);
         monitor_printf(mon, "total time: %" PRIu64 " milliseconds\n",
                        info->ram->total_time);
+        if (info->ram->has_skipped) {
+            monitor_printf(mon, "skipped free ram: %" PRIu64 " kbytes\n",
+                           info->ram->skipped >> 10);
+        }
     }
 
     if (info->has_disk) {
@@ -410,6 +414,14 @@ void hmp_info_balloon(Monitor *mon)
     if (info->has_total_mem) {
         monitor_printf(mon, " total_mem=%" PRId64, info->total_mem);
     }
+    if (info->has_free_page_reported) {
+        monitor_printf(mon, " free_page_reported=%" PRId64,
+                       info->free_page_reported);
+    }
+    if (info->has_free_page_reclaimed) {
+        monitor_printf(mon, " free_page_reclaimed=%" PRId64,
+                       info->free_page_reclaimed);
+    }
 
     monitor_printf(mon, "\n");
 
@@ -555,8 +567,14 @@ void hmp_info_block_jobs(Monitor *mon)
 
 void hmp_quit(Monitor *mon, const QDict *qdict)
 {
+    Error *errp = NULL;
+
+    qmp_quit(&errp);
+    if (error_is_set(&errp)) {
+        hmp_handle_error(mon, &errp);
+        return;
+    }
     monitor_suspend(mon);
-    qmp_quit(NULL);
 }
 
 void hmp_stop(Monitor *mon, const QDict *qdict)
@@ -566,7 +584,10 @@ void hmp_stop(Monitor *mon, const QDict *qdict)
 
 void hmp_system_reset(Monitor *mon, const QDict *qdict)
 {
-    qmp_system_reset(NULL);
+    Error *errp = NULL;
+
+    qmp_system_reset(&errp);
+    hmp_handle_error(mon, &errp);
 }
 
 void hmp_system_powerdown(Monitor *mon, const QDict *qdict)
@@ -957,11 +978,28 @@ void hmp_dump_guest_memory(Monitor *mon, const QDict *qdict)
 {
     Error *errp = NULL;
     int paging = qdict_get_try_bool(qdict, "paging", 0);
+    int detach = qdict_get_try_bool(qdict, "detach", 0);
+    int zlib = qdict_get_try_bool(qdict, "zlib", 0);
+    int lzo = qdict_get_try_bool(qdict, "lzo", 0);
+    int snappy = qdict_get_try_bool(qdict, "snappy", 0);
     const char *file = qdict_get_str(qdict, "protocol");
     bool has_begin = qdict_haskey(qdict, "begin");
     bool has_length = qdict_haskey(qdict, "length");
     int64_t begin = 0;
     int64_t length = 0;
+    DumpGuestMemoryFormat format = DUMP_GUEST_MEMORY_FORMAT_ELF;
+
+    if (zlib + lzo + snappy > 1) {
+        monitor_printf(mon, "only one of '-z|-l|-s' can be set\n");
+        return;
+    }
+    if (zlib) {
+        format = DUMP_GUEST_MEMORY_FORMAT_KDUMP_ZLIB;
+    } else if (lzo) {
+        format = DUMP_GUEST_MEMORY_FORMAT_KDUMP_LZO;
+    } else if (snappy) {
+        format = DUMP_GUEST_MEMORY_FORMAT_KDUMP_SNAPPY;
+    }
 
     if (has_begin) {
         begin = qdict_get_int(qdict, "begin");
@@ -971,10 +1009,26 @@ void hmp_dump_guest_memory(Monitor *mon, const QDict *qdict)
     }
 
     qmp_dump_guest_memory(paging, file, has_begin, begin, has_length, length,
-                          &errp);
+                          true, format, true, detach, false, 0, &errp);
     hmp_handle_error(mon, &errp);
 }
 
+void hmp_info_dump(Monitor *mon)
+{
+    DumpQueryResult *result;
+
+    result = qmp_query_dump(NULL);
+    monitor_printf(mon, "Dump status: %s\n",
+                   DumpStatus_lookup[result->status]);
+    if (result->status != DUMP_STATUS_NONE) {
+        monitor_printf(mon, "completed: %" PRId64 " of %" PRId64
+                       " bytes (%d%%)\n", result->completed, result->total,
+                       result->total ?
+                       (int)(result->completed * 100 / result->total) : 100);
+    }
+    qapi_free_DumpQueryResult(result);
+}
+
 void hmp_netdev_add(Monitor *mon, const QDict *qdict)
 {
     Error *err = NULL;
@@ -1003,6 +1057,59 @@ void hmp_netdev_del(Monitor *mon, const QDict *qdict)
     hmp_handle_error(mon, &err);
 }
 
+void hmp_net_capture_start(Monitor *mon, const QDict *qdict)
+{
+    const char *netdev = qdict_get_str(qdict, "netdev");
+    const char *file = qdict_get_str(qdict, "file");
+    const char *filter = qdict_get_try_str(qdict, "filter");
+    bool has_snaplen = qdict_haskey(qdict, "snaplen");
+    bool has_size = qdict_haskey(qdict, "size");
+    bool has_count = qdict_haskey(qdict, "count");
+    Error *err = NULL;
+
+    qmp_net_capture_start(netdev, file,
+                          has_snaplen, qdict_get_try_int(qdict, "snaplen", 0),
+                          !!filter, filter,
+                          has_size, qdict_get_try_int(qdict, "size", 0),
+                          has_count, qdict_get_try_int(qdict, "count", 0),
+                          false, 0, &err);
+    hmp_handle_error(mon, &err);
+}
+
+void hmp_net_capture_stop(Monitor *mon, const QDict *qdict)
+{
+    const char *netdev = qdict_get_str(qdict, "netdev");
+    Error *err = NULL;
+
+    qmp_net_capture_stop(netdev, &err);
+    hmp_handle_error(mon, &err);
+}
+
+void hmp_netdev_set_throttle(Monitor *mon, const QDict *qdict)
+{
+    Error *err = NULL;
+
+    qmp_netdev_set_throttle(qdict_get_str(qdict, "id"),
+                            qdict_get_int(qdict, "bps"),
+                            qdict_get_int(qdict, "pps"),
+                            qdict_haskey(qdict, "bps_burst"),
+                            qdict_get_try_int(qdict, "bps_burst", 0),
+                            qdict_haskey(qdict, "pps_burst"),
+                            qdict_get_try_int(qdict, "pps_burst", 0), &err);
+    hmp_handle_error(mon, &err);
+}
+
+void hmp_netdev_set_rss(Monitor *mon, const QDict *qdict)
+{
+    const char *table = qdict_get_try_str(qdict, "table");
+    Error *err = NULL;
+
+    qmp_netdev_set_rss(qdict_get_str(qdict, "id"),
+                       qdict_get_int(qdict, "queues"),
+                       false, NULL, !!table, table, &err);
+    hmp_handle_error(mon, &err);
+}
+
 void hmp_getfd(Monitor *mon, const QDict *qdict)
 {
     const char *fdname = qdict_get_str(qdict, "fdname");
@@ -1020,3 +1127,68 @@ void hmp_closefd(Monitor *mon, const QDict *qdict)
     qmp_closefd(fdname, &errp);
     hmp_handle_error(mon, &errp);
 }
+
+void hmp_jit_profile(Monitor *mon, const QDict *qdict)
+{
+    bool enable = qdict_get_bool(qdict, "enable");
+    Error *errp = NULL;
+
+    qmp_jit_profile(enable, &errp);
+    hmp_handle_error(mon, &errp);
+}
+
+void hmp_jit_profile_dump(Monitor *mon, const QDict *qdict)
+{
+    const char *filename = qdict_get_str(qdict, "filename");
+    Error *errp = NULL;
+
+    qmp_jit_profile_dump(filename, &errp);
+    hmp_handle_error(mon, &errp);
+}
+
+void hmp_info_jit_profile(Monitor *mon)
+{
+    JitProfileInfo *info;
+    JitBlockInfoList *block;
+    JitHelperInfoList *helper;
+    Error *err = NULL;
+
+    info = qmp_query_jit_profile(false, 0, &err);
+    if (err) {
+        monitor_printf(mon, "%s\n", error_get_pretty(err));
+        error_free(err);
+        return;
+    }
+
+    monitor_printf(mon, "profiling: %s\n", info->enabled ? "on" : "off");
+    monitor_printf(mon, "code: %" PRId64 "/%" PRId64 " bytes, %" PRId64
+                   " dead\n", info->code_size, info->code_max_size,
+                   info->dead_code_size);
+    monitor_printf(mon, "blocks: %" PRId64 "/%" PRId64 ", %" PRId64
+                   " flushes, %" PRId64 " invalidated\n",
+                   info->tb_count, info->tb_max_count, info->flush_count,
+                   info->invalidate_count);
+    monitor_printf(mon, "executions: %" PRId64 " (%" PRId64
+                   " from main loop, %" PRId64 " chained)\n",
+                   info->executions, info->main_loop_entries,
+                   info->chained_executions);
+
+    if (info->blocks) {
+        monitor_printf(mon, "%-18s %8s %8s %14s %6s\n",
+                       "pc", "size", "host", "count", "exit%");
+    }
+    for (block = info->blocks; block; block = block->next) {
+        JitBlockInfo *b = block->value;
+
+        monitor_printf(mon, "0x%016" PRIx64 " %8" PRId64 " %8" PRId64
+                       " %14" PRId64 " %6.2f\n", b->pc, b->size,
+                       b->host_size, b->exec_count,
+                       100.0 * b->exit_count / b->exec_count);
+    }
+    for (helper = info->helpers; helper; helper = helper->next) {
+        monitor_printf(mon, "helper %-30s %14" PRId64 "\n",
+                       helper->value->name, helper->value->count);
+    }
+
+    qapi_free_JitProfileInfo(info);
+}
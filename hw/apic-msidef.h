@@ -20,6 +20,8 @@
  * Shift/mask fields for msi address
  */
 
+#define MSI_ADDR_BASE                   0xfee00000
+
 #define MSI_ADDR_DEST_MODE_SHIFT        2
 
 #define MSI_ADDR_REDIRECTION_SHIFT      3
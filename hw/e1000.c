@@ -69,6 +69,24 @@ static int debugflags = DBGBIT(TXERR) | DBGBIT(GENERAL);
  */
 enum { E1000_DEVID = E1000_DEV_ID_82540EM };
 
+/*
+ * Interrupt moderation: ITR sets a minimum interval between interrupts,
+ * RDTR/RADV and TIDV/TADV delay the receive and transmit interrupts
+ * (packet timers restarted by every packet, absolute timers started by
+ * the first one).  Disabled for old machine types.
+ */
+#define E1000_FLAG_MIT_BIT 0
+#define E1000_FLAG_MIT     (1 << E1000_FLAG_MIT_BIT)
+
+/* Bit 31 of RDTR and TIDV: flush partial descriptor block */
+#define E1000_DELAY_FPD    0x80000000
+
+typedef struct E1000IntrDelay {
+    QEMUTimer *timer;
+    int64_t abs_deadline;       /* 0 if the absolute timer is not running */
+    uint32_t cause;             /* ICR bits held back */
+} E1000IntrDelay;
+
 /*
  * May need to specify additional MAC-to-PHY entries --
  * Intel's Windows driver refuses to initialize unless they match
@@ -127,6 +145,16 @@ typedef struct E1000State_st {
     } eecd_state;
 
     QEMUTimer *autoneg_timer;
+
+    /* interrupt moderation */
+    uint32_t compat_flags;
+    QEMUTimer *mit_timer;       /* end of the ITR interval */
+    bool mit_timer_on;
+    bool mit_irq_level;
+    E1000IntrDelay rx_delay;
+    E1000IntrDelay tx_delay;
+    uint64_t irq_raised;        /* interrupts delivered */
+    uint64_t irq_coalesced;     /* events merged into a pending interrupt */
 } E1000State;
 
 #define	defreg(x)	x = (E1000_##x>>2)
@@ -141,7 +169,8 @@ enum {
     defreg(TORH),	defreg(TORL),	defreg(TOTH),	defreg(TOTL),
     defreg(TPR),	defreg(TPT),	defreg(TXDCTL),	defreg(WUFC),
     defreg(RA),		defreg(MTA),	defreg(CRCERRS),defreg(VFTA),
-    defreg(VET),
+    defreg(VET),	defreg(ITR),	defreg(RDTR),	defreg(RADV),
+    defreg(TIDV),	defreg(TADV),
 };
 
 static void
@@ -220,16 +249,40 @@ static const uint32_t mac_reg_init[] = {
                 E1000_MANC_RMCP_EN,
 };
 
+static bool
+e1000_mit_enabled(E1000State *s)
+{
+    return s->compat_flags & E1000_FLAG_MIT;
+}
+
 static void
 set_interrupt_cause(E1000State *s, int index, uint32_t val)
 {
+    uint32_t pending;
+
     if (val && (E1000_DEVID >= E1000_DEV_ID_82547EI_MOBILE)) {
         /* Only for 8257x */
         val |= E1000_ICR_INT_ASSERTED;
     }
     s->mac_reg[ICR] = val;
     s->mac_reg[ICS] = val;
-    qemu_set_irq(s->dev.irq[0], (s->mac_reg[IMS] & s->mac_reg[ICR]) != 0);
+
+    pending = s->mac_reg[IMS] & s->mac_reg[ICR];
+    if (pending && !s->mit_irq_level) {
+        /* A rising edge.  Within the ITR interval of the previous one it
+           waits for e1000_mit_timer.  */
+        if (s->mit_timer_on) {
+            return;
+        }
+        if (e1000_mit_enabled(s) && (s->mac_reg[ITR] & 0xffff)) {
+            s->mit_timer_on = true;
+            qemu_mod_timer(s->mit_timer, qemu_get_clock_ns(vm_clock) +
+                           (s->mac_reg[ITR] & 0xffff) * 256);
+        }
+        s->irq_raised++;
+    }
+    s->mit_irq_level = pending != 0;
+    qemu_set_irq(s->dev.irq[0], s->mit_irq_level);
 }
 
 static void
@@ -237,9 +290,83 @@ set_ics(E1000State *s, int index, uint32_t val)
 {
     DBGOUT(INTERRUPT, "set_ics %x, ICR %x, IMR %x\n", val, s->mac_reg[ICR],
         s->mac_reg[IMS]);
+    if ((val & s->mac_reg[IMS]) && s->mit_timer_on && !s->mit_irq_level &&
+        (s->mac_reg[ICR] & s->mac_reg[IMS])) {
+        s->irq_coalesced++;
+    }
     set_interrupt_cause(s, 0, val | s->mac_reg[ICR]);
 }
 
+static void
+e1000_mit_timer(void *opaque)
+{
+    E1000State *s = opaque;
+
+    s->mit_timer_on = false;
+    set_interrupt_cause(s, 0, s->mac_reg[ICR]);
+}
+
+/* Hold 'cause' back for the packet delay 'delay', but no longer than the
+   absolute delay 'abs_delay' after the first event held; both in units
+   of 1.024 us.  */
+static void
+e1000_delay_cause(E1000State *s, E1000IntrDelay *d, uint32_t cause,
+                  uint32_t delay, uint32_t abs_delay)
+{
+    int64_t now = qemu_get_clock_ns(vm_clock);
+    int64_t deadline = now + (delay & 0xffff) * 1024;
+
+    if (d->cause & s->mac_reg[IMS]) {
+        s->irq_coalesced++;
+    }
+    d->cause |= cause;
+    if (!d->abs_deadline && (abs_delay & 0xffff)) {
+        d->abs_deadline = now + (abs_delay & 0xffff) * 1024;
+    }
+    if (d->abs_deadline && d->abs_deadline < deadline) {
+        deadline = d->abs_deadline;
+    }
+    qemu_mod_timer(d->timer, deadline);
+}
+
+/* Stop the delay timers of 'd' and return the causes they held.  */
+static uint32_t
+e1000_delay_take(E1000IntrDelay *d)
+{
+    uint32_t cause = d->cause;
+
+    qemu_del_timer(d->timer);
+    d->abs_deadline = 0;
+    d->cause = 0;
+    return cause;
+}
+
+static void
+e1000_delay_flush(E1000State *s, E1000IntrDelay *d)
+{
+    uint32_t cause = e1000_delay_take(d);
+
+    if (cause) {
+        set_ics(s, 0, cause);
+    }
+}
+
+static void
+e1000_rx_delay_timer(void *opaque)
+{
+    E1000State *s = opaque;
+
+    e1000_delay_flush(s, &s->rx_delay);
+}
+
+static void
+e1000_tx_delay_timer(void *opaque)
+{
+    E1000State *s = opaque;
+
+    e1000_delay_flush(s, &s->tx_delay);
+}
+
 static int
 rxbufsize(uint32_t v)
 {
@@ -268,6 +395,11 @@ static void e1000_reset(void *opaque)
     E1000State *d = opaque;
 
     qemu_del_timer(d->autoneg_timer);
+    qemu_del_timer(d->mit_timer);
+    d->mit_timer_on = false;
+    d->mit_irq_level = false;
+    e1000_delay_take(&d->rx_delay);
+    e1000_delay_take(&d->tx_delay);
     memset(d->phy_reg, 0, sizeof d->phy_reg);
     memmove(d->phy_reg, phy_reg_init, sizeof phy_reg_init);
     memset(d->mac_reg, 0, sizeof d->mac_reg);
@@ -632,6 +764,7 @@ start_xmit(E1000State *s)
     dma_addr_t base;
     struct e1000_tx_desc desc;
     uint32_t tdh_start = s->mac_reg[TDH], cause = E1000_ICS_TXQE;
+    uint32_t delayed = 0;
 
     if (!(s->mac_reg[TCTL] & E1000_TCTL_EN)) {
         DBGOUT(TX, "tx disabled\n");
@@ -648,7 +781,11 @@ start_xmit(E1000State *s)
                desc.upper.data);
 
         process_tx_desc(s, &desc);
-        cause |= txdesc_writeback(s, base, &desc);
+        if (le32_to_cpu(desc.lower.data) & E1000_TXD_CMD_IDE) {
+            delayed |= txdesc_writeback(s, base, &desc);
+        } else {
+            cause |= txdesc_writeback(s, base, &desc);
+        }
 
         if (++s->mac_reg[TDH] * sizeof(desc) >= s->mac_reg[TDLEN])
             s->mac_reg[TDH] = 0;
@@ -663,6 +800,13 @@ start_xmit(E1000State *s)
             break;
         }
     }
+    if (delayed && !(cause & E1000_ICR_TXDW) && e1000_mit_enabled(s) &&
+        (s->mac_reg[TIDV] & 0xffff)) {
+        e1000_delay_cause(s, &s->tx_delay, delayed, s->mac_reg[TIDV],
+                          s->mac_reg[TADV]);
+    } else {
+        cause |= delayed | e1000_delay_take(&s->tx_delay);
+    }
     set_ics(s, 0, cause);
 }
 
@@ -875,6 +1019,14 @@ e1000_receive(VLANClientState *nc, const uint8_t *buf, size_t size)
         s->rxbuf_min_shift)
         n |= E1000_ICS_RXDMT0;
 
+    /* Running out of descriptors is signalled at once.  */
+    if (n == E1000_ICS_RXT0 && e1000_mit_enabled(s) &&
+        (s->mac_reg[RDTR] & 0xffff)) {
+        e1000_delay_cause(s, &s->rx_delay, n, s->mac_reg[RDTR],
+                          s->mac_reg[RADV]);
+        return size;
+    }
+    n |= e1000_delay_take(&s->rx_delay);
     set_ics(s, 0, n);
 
     return size;
@@ -934,6 +1086,24 @@ set_16bit(E1000State *s, int index, uint32_t val)
     s->mac_reg[index] = val & 0xffff;
 }
 
+static void
+set_rdtr(E1000State *s, int index, uint32_t val)
+{
+    s->mac_reg[index] = val & 0xffff;
+    if (val & E1000_DELAY_FPD) {
+        e1000_delay_flush(s, &s->rx_delay);
+    }
+}
+
+static void
+set_tidv(E1000State *s, int index, uint32_t val)
+{
+    s->mac_reg[index] = val & 0xffff;
+    if (val & E1000_DELAY_FPD) {
+        e1000_delay_flush(s, &s->tx_delay);
+    }
+}
+
 static void
 set_dlen(E1000State *s, int index, uint32_t val)
 {
@@ -977,7 +1147,8 @@ static uint32_t (*macreg_readops[])(E1000State *, int) = {
     getreg(TORL),	getreg(TOTL),	getreg(IMS),	getreg(TCTL),
     getreg(RDH),	getreg(RDT),	getreg(VET),	getreg(ICS),
     getreg(TDBAL),	getreg(TDBAH),	getreg(RDBAH),	getreg(RDBAL),
-    getreg(TDLEN),	getreg(RDLEN),
+    getreg(TDLEN),	getreg(RDLEN),	getreg(ITR),	getreg(RDTR),
+    getreg(RADV),	getreg(TIDV),	getreg(TADV),
 
     [TOTH] = mac_read_clr8,	[TORH] = mac_read_clr8,	[GPRC] = mac_read_clr4,
     [GPTC] = mac_read_clr4,	[TPR] = mac_read_clr4,	[TPT] = mac_read_clr4,
@@ -999,6 +1170,8 @@ static void (*macreg_writeops[])(E1000State *, int, uint32_t) = {
     [TDH] = set_16bit,	[RDH] = set_16bit,	[RDT] = set_rdt,
     [IMC] = set_imc,	[IMS] = set_ims,	[ICR] = set_icr,
     [EECD] = set_eecd,	[RCTL] = set_rx_control, [CTRL] = set_ctrl,
+    [ITR] = set_16bit,	[RADV] = set_16bit,	[TADV] = set_16bit,
+    [RDTR] = set_rdtr,	[TIDV] = set_tidv,
     [RA ... RA+31] = &mac_writereg,
     [MTA ... MTA+127] = &mac_writereg,
     [VFTA ... VFTA+127] = &mac_writereg,
@@ -1075,11 +1248,57 @@ static bool is_version_1(void *opaque, int version_id)
     return version_id == 1;
 }
 
+static bool e1000_mit_state_needed(void *opaque)
+{
+    E1000State *s = opaque;
+
+    return e1000_mit_enabled(s);
+}
+
+static int e1000_post_load(void *opaque, int version_id)
+{
+    E1000State *s = opaque;
+    int64_t now = qemu_get_clock_ns(vm_clock);
+
+    /* Deliver what the source held back as soon as the VM runs, and
+       start a new ITR interval then.  */
+    s->mit_irq_level = (s->mac_reg[IMS] & s->mac_reg[ICR]) != 0;
+    s->mit_timer_on = true;
+    qemu_mod_timer(s->mit_timer, now);
+    s->rx_delay.abs_deadline = 0;
+    if (s->rx_delay.cause) {
+        qemu_mod_timer(s->rx_delay.timer, now);
+    }
+    s->tx_delay.abs_deadline = 0;
+    if (s->tx_delay.cause) {
+        qemu_mod_timer(s->tx_delay.timer, now);
+    }
+    return 0;
+}
+
+static const VMStateDescription vmstate_e1000_mit_state = {
+    .name = "e1000/mit_state",
+    .version_id = 1,
+    .minimum_version_id = 1,
+    .minimum_version_id_old = 1,
+    .fields      = (VMStateField[]) {
+        VMSTATE_UINT32(mac_reg[ITR], E1000State),
+        VMSTATE_UINT32(mac_reg[RDTR], E1000State),
+        VMSTATE_UINT32(mac_reg[RADV], E1000State),
+        VMSTATE_UINT32(mac_reg[TIDV], E1000State),
+        VMSTATE_UINT32(mac_reg[TADV], E1000State),
+        VMSTATE_UINT32(rx_delay.cause, E1000State),
+        VMSTATE_UINT32(tx_delay.cause, E1000State),
+        VMSTATE_END_OF_LIST()
+    }
+};
+
 static const VMStateDescription vmstate_e1000 = {
     .name = "e1000",
     .version_id = 2,
     .minimum_version_id = 1,
     .minimum_version_id_old = 1,
+    .post_load = e1000_post_load,
     .fields      = (VMStateField []) {
         VMSTATE_PCI_DEVICE(dev, E1000State),
         VMSTATE_UNUSED_TEST(is_version_1, 4), /* was instance id */
@@ -1150,6 +1369,14 @@ static const VMStateDescription vmstate_e1000 = {
         VMSTATE_UINT32_SUB_ARRAY(mac_reg, E1000State, MTA, 128),
         VMSTATE_UINT32_SUB_ARRAY(mac_reg, E1000State, VFTA, 128),
         VMSTATE_END_OF_LIST()
+    },
+    .subsections = (VMStateSubsection[]) {
+        {
+            .vmsd = &vmstate_e1000_mit_state,
+            .needed = e1000_mit_state_needed,
+        }, {
+            /* empty */
+        }
     }
 };
 
@@ -1172,7 +1399,8 @@ e1000_mmio_setup(E1000State *d)
     int i;
     const uint32_t excluded_regs[] = {
         E1000_MDIC, E1000_ICR, E1000_ICS, E1000_IMS,
-        E1000_IMC, E1000_TCTL, E1000_TDT, PNPMMIO_SIZE
+        E1000_IMC, E1000_TCTL, E1000_RDTR, E1000_TDT,
+        E1000_TIDV, PNPMMIO_SIZE
     };
 
     memory_region_init_io(&d->mmio, &e1000_mmio_ops, d, "e1000-mmio",
@@ -1199,6 +1427,12 @@ pci_e1000_uninit(PCIDevice *dev)
 
     qemu_del_timer(d->autoneg_timer);
     qemu_free_timer(d->autoneg_timer);
+    qemu_del_timer(d->mit_timer);
+    qemu_free_timer(d->mit_timer);
+    qemu_del_timer(d->rx_delay.timer);
+    qemu_free_timer(d->rx_delay.timer);
+    qemu_del_timer(d->tx_delay.timer);
+    qemu_free_timer(d->tx_delay.timer);
     memory_region_destroy(&d->mmio);
     memory_region_destroy(&d->io);
     qemu_del_vlan_client(&d->nic->nc);
@@ -1213,6 +1447,14 @@ static NetClientInfo net_e1000_info = {
     .link_status_changed = e1000_set_link_status,
 };
 
+static void e1000_get_irq_stat(Object *obj, Visitor *v, void *opaque,
+                               const char *name, Error **errp)
+{
+    int64_t value = *(uint64_t *)opaque;
+
+    visit_type_int(v, &value, name, errp);
+}
+
 static int pci_e1000_init(PCIDevice *pci_dev)
 {
     E1000State *d = DO_UPCAST(E1000State, dev, pci_dev);
@@ -1253,6 +1495,15 @@ static int pci_e1000_init(PCIDevice *pci_dev)
     add_boot_device_path(d->conf.bootindex, &pci_dev->qdev, "/ethernet-phy@0");
 
     d->autoneg_timer = qemu_new_timer_ms(vm_clock, e1000_autoneg_timer, d);
+    d->mit_timer = qemu_new_timer_ns(vm_clock, e1000_mit_timer, d);
+    d->rx_delay.timer = qemu_new_timer_ns(vm_clock, e1000_rx_delay_timer, d);
+    d->tx_delay.timer = qemu_new_timer_ns(vm_clock, e1000_tx_delay_timer, d);
+
+    object_property_add(OBJECT(d), "interrupts", "int", e1000_get_irq_stat,
+                        NULL, NULL, &d->irq_raised, NULL);
+    object_property_add(OBJECT(d), "interrupts-coalesced", "int",
+                        e1000_get_irq_stat, NULL, NULL, &d->irq_coalesced,
+                        NULL);
 
     return 0;
 }
@@ -1265,6 +1516,8 @@ static void qdev_e1000_reset(DeviceState *dev)
 
 static Property e1000_properties[] = {
     DEFINE_NIC_PROPERTIES(E1000State, conf),
+    DEFINE_PROP_BIT("mitigation", E1000State, compat_flags,
+                    E1000_FLAG_MIT_BIT, true),
     DEFINE_PROP_END_OF_LIST(),
 };
 
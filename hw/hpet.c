@@ -28,6 +28,7 @@
 #include "pc.h"
 #include "console.h"
 #include "qemu-timer.h"
+#include "qemu-thread.h"
 #include "hpet_emul.h"
 #include "sysbus.h"
 #include "mc146818rtc.h"
@@ -61,6 +62,7 @@ typedef struct HPETTimer {  /* timers */
 typedef struct HPETState {
     SysBusDevice busdev;
     MemoryRegion iomem;
+    QemuMutex lock;             /* config, hpet_offset, hpet_counter */
     uint64_t hpet_offset;
     qemu_irq irqs[HPET_NUM_IRQ_ROUTES];
     uint32_t flags;
@@ -210,7 +212,9 @@ static void hpet_pre_save(void *opaque)
     HPETState *s = opaque;
 
     /* save current counter value */
+    qemu_mutex_lock(&s->lock);
     s->hpet_counter = hpet_get_ticks(s);
+    qemu_mutex_unlock(&s->lock);
 }
 
 static int hpet_pre_load(void *opaque)
@@ -227,7 +231,9 @@ static int hpet_post_load(void *opaque, int version_id)
     HPETState *s = opaque;
 
     /* Recalculate the offset between the main counter and guest time */
+    qemu_mutex_lock(&s->lock);
     s->hpet_offset = ticks_to_ns(s->hpet_counter) - qemu_get_clock_ns(vm_clock);
+    qemu_mutex_unlock(&s->lock);
 
     /* Push number of timers into capability returned via HPET_ID */
     s->capability &= ~HPET_ID_NUM_TIM_MASK;
@@ -455,8 +461,36 @@ static uint64_t hpet_ram_read(void *opaque, target_phys_addr_t addr,
     return 0;
 }
 
-static void hpet_ram_write(void *opaque, target_phys_addr_t addr,
-                           uint64_t value, unsigned size)
+/* Main counter reads, the bulk of HPET accesses when it is the guest
+ * clocksource, do not need the global mutex.  Everything the counter is
+ * derived from, config, hpet_offset and hpet_counter, only changes under
+ * s->lock, and cpu_get_clock() copes with vm_clock being stopped or
+ * started concurrently.  The instruction counter is only consistent
+ * under the global mutex, so with -icount all reads take it.  */
+static bool hpet_ram_read_nolock(void *opaque, target_phys_addr_t addr,
+                                 uint64_t *data, unsigned size)
+{
+    HPETState *s = opaque;
+    uint64_t cur_tick;
+
+    if (use_icount || (addr != HPET_COUNTER && addr != HPET_COUNTER + 4)) {
+        return false;
+    }
+
+    qemu_mutex_lock(&s->lock);
+    if (hpet_enabled(s)) {
+        cur_tick = hpet_get_ticks(s);
+    } else {
+        cur_tick = s->hpet_counter;
+    }
+    qemu_mutex_unlock(&s->lock);
+
+    *data = addr == HPET_COUNTER ? cur_tick : cur_tick >> 32;
+    return true;
+}
+
+static void hpet_ram_do_write(void *opaque, target_phys_addr_t addr,
+                              uint64_t value, unsigned size)
 {
     int i;
     HPETState *s = opaque;
@@ -622,9 +656,20 @@ static void hpet_ram_write(void *opaque, target_phys_addr_t addr,
     }
 }
 
+static void hpet_ram_write(void *opaque, target_phys_addr_t addr,
+                           uint64_t value, unsigned size)
+{
+    HPETState *s = opaque;
+
+    qemu_mutex_lock(&s->lock);
+    hpet_ram_do_write(opaque, addr, value, size);
+    qemu_mutex_unlock(&s->lock);
+}
+
 static const MemoryRegionOps hpet_ram_ops = {
     .read = hpet_ram_read,
     .write = hpet_ram_write,
+    .read_nolock = hpet_ram_read_nolock,
     .valid = {
         .min_access_size = 4,
         .max_access_size = 4,
@@ -653,9 +698,11 @@ static void hpet_reset(DeviceState *d)
     }
 
     qemu_set_irq(s->pit_enabled, 1);
+    qemu_mutex_lock(&s->lock);
     s->hpet_counter = 0ULL;
     s->hpet_offset = 0ULL;
     s->config = 0ULL;
+    qemu_mutex_unlock(&s->lock);
     hpet_cfg.hpet[s->hpet_id].event_timer_block_id = (uint32_t)s->capability;
     hpet_cfg.hpet[s->hpet_id].address = sysbus_from_qdev(d)->mmio[0].addr;
 
@@ -722,6 +769,7 @@ static int hpet_init(SysBusDevice *dev)
     qdev_init_gpio_out(&dev->qdev, &s->pit_enabled, 1);
 
     /* HPET Area */
+    qemu_mutex_init(&s->lock);
     memory_region_init_io(&s->iomem, &hpet_ram_ops, s, "hpet", 0x400);
     sysbus_init_mmio(dev, &s->iomem);
     return 0;
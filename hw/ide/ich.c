@@ -109,7 +109,10 @@ static int pci_ich9_ahci_init(PCIDevice *dev)
     /* XXX Software should program this register */
     d->card.config[0x90]   = 1 << 6; /* Address Map Register - AHCI mode */
 
-    msi_init(dev, 0x50, 1, true, false);
+    if (msi_init(dev, 0x50, 1, true, false) >= 0) {
+        /* Let KVM inject completions asynchronously when it can. */
+        msi_vector_irqfd(dev, 0);
+    }
     d->ahci.irq = d->card.irq[0];
 
     pci_register_bar(&d->card, ICH9_IDP_BAR, PCI_BASE_ADDRESS_SPACE_IO,
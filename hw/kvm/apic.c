@@ -10,6 +10,7 @@
  * See the COPYING file in the top-level directory.
  */
 #include "hw/apic_internal.h"
+#include "hw/apic-msidef.h"
 #include "hw/msi.h"
 #include "kvm.h"
 
@@ -165,6 +166,11 @@ static void kvm_apic_mem_write(void *opaque, target_phys_addr_t addr,
     }
 }
 
+static int kvm_apic_send_msi(MSIMessage msg)
+{
+    return kvm_irqchip_send_msi(kvm_state, msg);
+}
+
 static const MemoryRegionOps kvm_apic_io_ops = {
     .read = kvm_apic_mem_read,
     .write = kvm_apic_mem_write,
@@ -178,6 +184,10 @@ static void kvm_apic_init(APICCommonState *s)
 
     if (kvm_has_gsi_routing()) {
         msi_supported = true;
+        if (kvm_msi_direct_allowed()) {
+            msi_set_direct_delivery(MSI_ADDR_BASE, MSI_SPACE_SIZE,
+                                    kvm_apic_send_msi);
+        }
     }
 }
 
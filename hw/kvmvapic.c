@@ -670,8 +670,17 @@ static void vapic_write(void *opaque, target_phys_addr_t addr, uint64_t data,
     }
 }
 
+/* With the in-kernel irqchip, the IRQ poll hypercall issued on every TPR
+ * access that the patched guest code cannot handle does nothing.  */
+static bool vapic_write_nolock(void *opaque, target_phys_addr_t addr,
+                               uint64_t data, unsigned int size)
+{
+    return size == 4 && kvm_irqchip_in_kernel();
+}
+
 static const MemoryRegionOps vapic_ops = {
     .write = vapic_write,
+    .write_nolock = vapic_write_nolock,
     .endianness = DEVICE_NATIVE_ENDIAN,
 };
 
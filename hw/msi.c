@@ -20,6 +20,8 @@
 
 #include "msi.h"
 #include "range.h"
+#include "kvm.h"
+#include "qemu-timer.h"
 
 /* Eventually those constants should go to Linux pci_regs.h */
 #define PCI_MSI_PENDING_32      0x10
@@ -39,6 +41,248 @@
 /* Flag for interrupt controller to declare MSI/MSI-X support */
 bool msi_supported;
 
+/* How a message reached the interrupt controller, for "info msi".  */
+enum {
+    MSI_PATH_MMIO,
+    MSI_PATH_DIRECT,
+    MSI_PATH_IRQFD,
+    MSI_PATH_MAX
+};
+
+static const char *msi_path_names[MSI_PATH_MAX] = {
+    [MSI_PATH_MMIO] = "memory write",
+    [MSI_PATH_DIRECT] = "direct",
+    [MSI_PATH_IRQFD] = "irqfd",
+};
+
+static struct {
+    uint64_t count;
+    uint64_t timed;     /* messages sent while msi_timing was set */
+    uint64_t ns;
+    uint64_t max_ns;
+} msi_stats[MSI_PATH_MAX];
+
+/* Time each message for "info msi"; reading the clock costs more than
+ * some of the delivery paths, so this is off unless asked for with the
+ * msi_timing monitor command.  */
+static bool msi_timing;
+
+static unsigned int msi_irqfds_kernel;
+static unsigned int msi_irqfds_user;
+
+/* Interrupt controller that takes messages without a memory write. */
+static uint64_t msi_direct_base;
+static uint64_t msi_direct_size;
+static int (*msi_direct_deliver)(MSIMessage msg);
+
+struct MSIVectorIrqfd {
+    EventNotifier notifier;
+    PCIDevice *dev;
+    unsigned int vector;
+    void (*notify)(PCIDevice *dev, unsigned int vector);
+    MSIMessage msg;     /* message routed through virq */
+    int virq;           /* KVM route, negative if none */
+    bool assigned;      /* notifier attached to virq as a KVM irqfd */
+};
+
+/* Returns 0 when the message is not timed. */
+static int64_t msi_account_start(void)
+{
+    return msi_timing ? get_clock() : 0;
+}
+
+static void msi_account(int path, int64_t start)
+{
+    uint64_t ns;
+
+    msi_stats[path].count++;
+    if (!start) {
+        return;
+    }
+    ns = get_clock() - start;
+    msi_stats[path].timed++;
+    msi_stats[path].ns += ns;
+    if (ns > msi_stats[path].max_ns) {
+        msi_stats[path].max_ns = ns;
+    }
+}
+
+void msi_set_timing(bool enable)
+{
+    msi_timing = enable;
+}
+
+/* Called by an interrupt controller that accepts messages directly.  From
+ * then on, messages whose address falls in [base, base + size) are handed
+ * to @deliver instead of being written through the memory core.
+ */
+void msi_set_direct_delivery(uint64_t base, uint64_t size,
+                             int (*deliver)(MSIMessage msg))
+{
+    msi_direct_base = base;
+    msi_direct_size = size;
+    msi_direct_deliver = deliver;
+}
+
+static bool msi_is_direct(MSIMessage msg)
+{
+    return msi_direct_deliver &&
+        msg.address - msi_direct_base < msi_direct_size;
+}
+
+void msi_send_message(MSIMessage msg)
+{
+    int64_t start = msi_account_start();
+    int ret;
+
+    if (msi_is_direct(msg)) {
+        ret = msi_direct_deliver(msg);
+        if (ret < 0) {
+            fprintf(stderr, "MSI: direct delivery failed, MSI lost (%s)\n",
+                    strerror(-ret));
+        }
+        msi_account(MSI_PATH_DIRECT, start);
+    } else {
+        stl_le_phys(msg.address, msg.data);
+        msi_account(MSI_PATH_MMIO, start);
+    }
+}
+
+void msi_info(fprintf_function mon_printf, void *f)
+{
+    int i;
+
+    mon_printf(f, "direct delivery: %s\n",
+               msi_direct_deliver ? "enabled" : "disabled");
+    mon_printf(f, "vector irqfds: %u in kernel, %u in userspace\n",
+               msi_irqfds_kernel, msi_irqfds_user);
+    mon_printf(f, "timing: %s\n", msi_timing ? "on" : "off");
+    for (i = 0; i < MSI_PATH_MAX; i++) {
+        mon_printf(f, "%-12s %10" PRIu64 " messages", msi_path_names[i],
+                   msi_stats[i].count);
+        if (msi_stats[i].timed) {
+            mon_printf(f, ", %" PRIu64 " timed: avg %" PRIu64
+                       " ns, max %" PRIu64 " ns",
+                       msi_stats[i].timed,
+                       msi_stats[i].ns / msi_stats[i].timed,
+                       msi_stats[i].max_ns);
+        }
+        mon_printf(f, "\n");
+    }
+}
+
+/*
+ * Per-vector irqfds.  Setting the notifier raises the vector from any
+ * thread.  While the vector is unmasked and its message goes to an
+ * in-kernel interrupt controller, KVM injects it without returning to
+ * QEMU; otherwise the main loop reads the notifier and calls @notify,
+ * which applies masking and pending bits as usual.
+ */
+static void msi_irqfd_read(EventNotifier *n)
+{
+    MSIVectorIrqfd *irqfd = container_of(n, MSIVectorIrqfd, notifier);
+
+    if (event_notifier_test_and_clear(n)) {
+        irqfd->notify(irqfd->dev, irqfd->vector);
+    }
+}
+
+MSIVectorIrqfd *msi_irqfd_new(PCIDevice *dev, unsigned int vector,
+                              void (*notify)(PCIDevice *dev,
+                                             unsigned int vector))
+{
+    MSIVectorIrqfd *irqfd = g_new0(MSIVectorIrqfd, 1);
+
+    if (event_notifier_init(&irqfd->notifier, 0) < 0) {
+        g_free(irqfd);
+        return NULL;
+    }
+    irqfd->dev = dev;
+    irqfd->vector = vector;
+    irqfd->notify = notify;
+    irqfd->virq = -1;
+    event_notifier_set_handler(&irqfd->notifier, msi_irqfd_read);
+    msi_irqfds_user++;
+    return irqfd;
+}
+
+/* Follow a change of the vector's message or mask state. */
+void msi_irqfd_update(MSIVectorIrqfd *irqfd, bool masked, MSIMessage msg)
+{
+    bool kernel = !masked && kvm_irqchip_in_kernel() && msi_is_direct(msg);
+
+    if (kernel && irqfd->virq >= 0 &&
+        (irqfd->msg.address != msg.address || irqfd->msg.data != msg.data)) {
+        kernel = kvm_irqchip_update_msi_route(kvm_state, irqfd->virq,
+                                              msg) == 0;
+        if (kernel) {
+            irqfd->msg = msg;
+        }
+    }
+    if (kernel && irqfd->virq < 0) {
+        irqfd->virq = kvm_irqchip_add_msi_route(kvm_state, msg);
+        irqfd->msg = msg;
+        kernel = irqfd->virq >= 0;
+    }
+
+    if (kernel && !irqfd->assigned) {
+        event_notifier_set_handler(&irqfd->notifier, NULL);
+        if (kvm_irqchip_add_irq_notifier(kvm_state, &irqfd->notifier,
+                                         irqfd->virq) < 0) {
+            event_notifier_set_handler(&irqfd->notifier, msi_irqfd_read);
+            return;
+        }
+        irqfd->assigned = true;
+        msi_irqfds_user--;
+        msi_irqfds_kernel++;
+    } else if (!kernel && irqfd->assigned) {
+        kvm_irqchip_remove_irq_notifier(kvm_state, &irqfd->notifier,
+                                        irqfd->virq);
+        irqfd->assigned = false;
+        event_notifier_set_handler(&irqfd->notifier, msi_irqfd_read);
+        msi_irqfds_kernel--;
+        msi_irqfds_user++;
+    }
+}
+
+/* Raise the vector through its irqfd if KVM injects it; returns false if
+ * the caller has to deliver the message itself.
+ */
+bool msi_irqfd_send(MSIVectorIrqfd *irqfd)
+{
+    int64_t start;
+
+    if (!irqfd || !irqfd->assigned) {
+        return false;
+    }
+    start = msi_account_start();
+    event_notifier_set(&irqfd->notifier);
+    msi_account(MSI_PATH_IRQFD, start);
+    return true;
+}
+
+EventNotifier *msi_irqfd_notifier(MSIVectorIrqfd *irqfd)
+{
+    return &irqfd->notifier;
+}
+
+void msi_irqfd_free(MSIVectorIrqfd *irqfd)
+{
+    if (irqfd->assigned) {
+        kvm_irqchip_remove_irq_notifier(kvm_state, &irqfd->notifier,
+                                        irqfd->virq);
+        msi_irqfds_kernel--;
+    } else {
+        event_notifier_set_handler(&irqfd->notifier, NULL);
+        msi_irqfds_user--;
+    }
+    if (irqfd->virq >= 0) {
+        kvm_irqchip_release_virq(kvm_state, irqfd->virq);
+    }
+    event_notifier_cleanup(&irqfd->notifier);
+    g_free(irqfd);
+}
+
 /* If we get rid of cap allocator, we won't need this. */
 static inline uint8_t msi_cap_sizeof(uint16_t flags)
 {
@@ -120,6 +364,7 @@ void msi_set_message(PCIDevice *dev, MSIMessage msg)
         pci_set_long(dev->config + msi_address_lo_off(dev), msg.address);
     }
     pci_set_word(dev->config + msi_data_off(dev, msi64bit), msg.data);
+    msi_update_irqfds(dev);
 }
 
 bool msi_enabled(const PCIDevice *dev)
@@ -195,6 +440,15 @@ void msi_uninit(struct PCIDevice *dev)
     if (!msi_present(dev)) {
         return;
     }
+    if (dev->msi_irqfds) {
+        unsigned int vector;
+
+        for (vector = 0; vector < PCI_MSI_VECTORS_MAX; vector++) {
+            msi_vector_irqfd_release(dev, vector);
+        }
+        g_free(dev->msi_irqfds);
+        dev->msi_irqfds = NULL;
+    }
     flags = pci_get_word(dev->config + msi_flags_off(dev));
     cap_size = msi_cap_sizeof(flags);
     pci_del_capability(dev, PCI_CAP_ID_MSI, cap_size);
@@ -226,6 +480,7 @@ void msi_reset(PCIDevice *dev)
         pci_set_long(dev->config + msi_mask_off(dev, msi64bit), 0);
         pci_set_long(dev->config + msi_pending_off(dev, msi64bit), 0);
     }
+    msi_update_irqfds(dev);
     MSI_DEV_PRINTF(dev, "reset\n");
 }
 
@@ -244,13 +499,34 @@ static bool msi_is_masked(const PCIDevice *dev, unsigned int vector)
     return mask & (1U << vector);
 }
 
+static MSIMessage msi_get_message(PCIDevice *dev, unsigned int vector)
+{
+    uint16_t flags = pci_get_word(dev->config + msi_flags_off(dev));
+    bool msi64bit = flags & PCI_MSI_FLAGS_64BIT;
+    unsigned int nr_vectors = msi_nr_vectors(flags);
+    MSIMessage msg;
+
+    if (msi64bit) {
+        msg.address = pci_get_quad(dev->config + msi_address_lo_off(dev));
+    } else {
+        msg.address = pci_get_long(dev->config + msi_address_lo_off(dev));
+    }
+
+    /* upper bit 31:16 is zero */
+    msg.data = pci_get_word(dev->config + msi_data_off(dev, msi64bit));
+    if (nr_vectors > 1) {
+        msg.data &= ~(nr_vectors - 1);
+        msg.data |= vector;
+    }
+    return msg;
+}
+
 void msi_notify(PCIDevice *dev, unsigned int vector)
 {
     uint16_t flags = pci_get_word(dev->config + msi_flags_off(dev));
     bool msi64bit = flags & PCI_MSI_FLAGS_64BIT;
     unsigned int nr_vectors = msi_nr_vectors(flags);
-    uint64_t address;
-    uint32_t data;
+    MSIMessage msg;
 
     assert(vector < nr_vectors);
     if (msi_is_masked(dev, vector)) {
@@ -261,24 +537,70 @@ void msi_notify(PCIDevice *dev, unsigned int vector)
         return;
     }
 
-    if (msi64bit) {
-        address = pci_get_quad(dev->config + msi_address_lo_off(dev));
-    } else {
-        address = pci_get_long(dev->config + msi_address_lo_off(dev));
-    }
-
-    /* upper bit 31:16 is zero */
-    data = pci_get_word(dev->config + msi_data_off(dev, msi64bit));
-    if (nr_vectors > 1) {
-        data &= ~(nr_vectors - 1);
-        data |= vector;
-    }
+    msg = msi_get_message(dev, vector);
 
     MSI_DEV_PRINTF(dev,
                    "notify vector 0x%x"
                    " address: 0x%"PRIx64" data: 0x%"PRIx32"\n",
-                   vector, address, data);
-    stl_le_phys(address, data);
+                   vector, msg.address, msg.data);
+    if (!dev->msi_irqfds || !msi_irqfd_send(dev->msi_irqfds[vector])) {
+        msi_send_message(msg);
+    }
+}
+
+/* Point the irqfds of @dev at the messages and mask state of its vectors,
+ * also after the config space was restored by loadvm.  */
+void msi_update_irqfds(PCIDevice *dev)
+{
+    uint16_t flags = pci_get_word(dev->config + msi_flags_off(dev));
+    unsigned int vector;
+    bool masked;
+
+    if (!dev->msi_irqfds) {
+        return;
+    }
+    for (vector = 0; vector < PCI_MSI_VECTORS_MAX; vector++) {
+        if (!dev->msi_irqfds[vector]) {
+            continue;
+        }
+        masked = !(flags & PCI_MSI_FLAGS_ENABLE) ||
+            vector >= msi_nr_vectors(flags) || msi_is_masked(dev, vector);
+        msi_irqfd_update(dev->msi_irqfds[vector], masked,
+                         msi_get_message(dev, vector));
+    }
+}
+
+/* Return a notifier that raises @vector when set, from any thread.  It
+ * stays valid until msi_vector_irqfd_release() or msi_uninit().
+ */
+EventNotifier *msi_vector_irqfd(PCIDevice *dev, unsigned int vector)
+{
+    MSIVectorIrqfd *irqfd;
+
+    assert(msi_present(dev));
+    assert(vector < msi_nr_vectors_allocated(dev));
+
+    if (!dev->msi_irqfds) {
+        dev->msi_irqfds = g_new0(MSIVectorIrqfd *, PCI_MSI_VECTORS_MAX);
+    }
+    if (!dev->msi_irqfds[vector]) {
+        irqfd = msi_irqfd_new(dev, vector, msi_notify);
+        if (!irqfd) {
+            return NULL;
+        }
+        dev->msi_irqfds[vector] = irqfd;
+        msi_update_irqfds(dev);
+    }
+    return msi_irqfd_notifier(dev->msi_irqfds[vector]);
+}
+
+void msi_vector_irqfd_release(PCIDevice *dev, unsigned int vector)
+{
+    if (!dev->msi_irqfds || !dev->msi_irqfds[vector]) {
+        return;
+    }
+    msi_irqfd_free(dev->msi_irqfds[vector]);
+    dev->msi_irqfds[vector] = NULL;
 }
 
 /* Normally called by pci_default_write_config(). */
@@ -319,6 +641,7 @@ void msi_write_config(PCIDevice *dev, uint32_t addr, uint32_t val, int len)
 #endif
 
     if (!(flags & PCI_MSI_FLAGS_ENABLE)) {
+        msi_update_irqfds(dev);
         return;
     }
 
@@ -350,6 +673,8 @@ void msi_write_config(PCIDevice *dev, uint32_t addr, uint32_t val, int len)
         pci_set_word(dev->config + msi_flags_off(dev), flags);
     }
 
+    msi_update_irqfds(dev);
+
     if (!msi_per_vector_mask) {
         /* if per vector masking isn't supported,
            there is no pending interrupt. */
@@ -22,6 +22,7 @@
 #define QEMU_MSI_H
 
 #include "qemu-common.h"
+#include "event_notifier.h"
 #include "pci.h"
 
 struct MSIMessage {
@@ -29,8 +30,25 @@ struct MSIMessage {
     uint32_t data;
 };
 
+typedef struct MSIVectorIrqfd MSIVectorIrqfd;
+
 extern bool msi_supported;
 
+void msi_set_direct_delivery(uint64_t base, uint64_t size,
+                             int (*deliver)(MSIMessage msg));
+void msi_send_message(MSIMessage msg);
+void msi_set_timing(bool enable);
+void msi_info(fprintf_function mon_printf, void *f);
+
+MSIVectorIrqfd *msi_irqfd_new(PCIDevice *dev, unsigned int vector,
+                              void (*notify)(PCIDevice *dev,
+                                             unsigned int vector));
+void msi_irqfd_update(MSIVectorIrqfd *irqfd, bool masked, MSIMessage msg);
+void msi_update_irqfds(PCIDevice *dev);
+bool msi_irqfd_send(MSIVectorIrqfd *irqfd);
+EventNotifier *msi_irqfd_notifier(MSIVectorIrqfd *irqfd);
+void msi_irqfd_free(MSIVectorIrqfd *irqfd);
+
 void msi_set_message(PCIDevice *dev, MSIMessage msg);
 bool msi_enabled(const PCIDevice *dev);
 int msi_init(struct PCIDevice *dev, uint8_t offset,
@@ -40,6 +58,8 @@ void msi_reset(PCIDevice *dev);
 void msi_notify(PCIDevice *dev, unsigned int vector);
 void msi_write_config(PCIDevice *dev, uint32_t addr, uint32_t val, int len);
 unsigned int msi_nr_vectors_allocated(const PCIDevice *dev);
+EventNotifier *msi_vector_irqfd(PCIDevice *dev, unsigned int vector);
+void msi_vector_irqfd_release(PCIDevice *dev, unsigned int vector);
 
 static inline bool msi_present(const PCIDevice *dev)
 {
@@ -27,6 +27,8 @@
 #define MSIX_ENABLE_MASK (PCI_MSIX_FLAGS_ENABLE >> 8)
 #define MSIX_MASKALL_MASK (PCI_MSIX_FLAGS_MASKALL >> 8)
 
+static void msix_update_irqfd(PCIDevice *dev, int vector);
+
 static MSIMessage msix_get_message(PCIDevice *dev, unsigned vector)
 {
     uint8_t *table_entry = dev->msix_table + vector * PCI_MSIX_ENTRY_SIZE;
@@ -48,6 +50,7 @@ void msix_set_message(PCIDevice *dev, int vector, struct MSIMessage msg)
     pci_set_quad(table_entry + PCI_MSIX_ENTRY_LOWER_ADDR, msg.address);
     pci_set_long(table_entry + PCI_MSIX_ENTRY_DATA, msg.data);
     table_entry[PCI_MSIX_ENTRY_VECTOR_CTRL] &= ~PCI_MSIX_ENTRY_CTRL_MASKBIT;
+    msix_update_irqfd(dev, vector);
 }
 
 static uint8_t msix_pending_mask(int vector)
@@ -104,10 +107,24 @@ static void msix_fire_vector_notifier(PCIDevice *dev,
     }
 }
 
+static void msix_update_irqfd(PCIDevice *dev, int vector)
+{
+    if (!dev->msix_irqfds || !dev->msix_irqfds[vector]) {
+        return;
+    }
+    msi_irqfd_update(dev->msix_irqfds[vector],
+                     msix_is_masked(dev, vector) ||
+                     !dev->msix_entry_used[vector],
+                     msix_get_message(dev, vector));
+}
+
 static void msix_handle_mask_update(PCIDevice *dev, int vector, bool was_masked)
 {
     bool is_masked = msix_is_masked(dev, vector);
 
+    /* The message may have changed even if the mask did not. */
+    msix_update_irqfd(dev, vector);
+
     if (is_masked == was_masked) {
         return;
     }
@@ -337,6 +354,7 @@ static void msix_free_irq_entries(PCIDevice *dev)
     for (vector = 0; vector < dev->msix_entries_nr; ++vector) {
         dev->msix_entry_used[vector] = 0;
         msix_clr_pending(dev, vector);
+        msix_update_irqfd(dev, vector);
     }
 }
 
@@ -349,6 +367,15 @@ void msix_uninit(PCIDevice *dev, MemoryRegion *table_bar, MemoryRegion *pba_bar)
     pci_del_capability(dev, PCI_CAP_ID_MSIX, MSIX_CAP_LENGTH);
     dev->msix_cap = 0;
     msix_free_irq_entries(dev);
+    if (dev->msix_irqfds) {
+        int vector;
+
+        for (vector = 0; vector < dev->msix_entries_nr; vector++) {
+            msix_vector_irqfd_release(dev, vector);
+        }
+        g_free(dev->msix_irqfds);
+        dev->msix_irqfds = NULL;
+    }
     dev->msix_entries_nr = 0;
     memory_region_del_subregion(pba_bar, &dev->msix_pba_mmio);
     memory_region_destroy(&dev->msix_pba_mmio);
@@ -430,9 +457,45 @@ void msix_notify(PCIDevice *dev, unsigned vector)
         return;
     }
 
+    if (dev->msix_irqfds && msi_irqfd_send(dev->msix_irqfds[vector])) {
+        return;
+    }
+
     msg = msix_get_message(dev, vector);
 
-    stl_le_phys(msg.address, msg.data);
+    msi_send_message(msg);
+}
+
+/* Return a notifier that raises @vector when set, from any thread.  It
+ * stays valid until msix_vector_irqfd_release() or msix_uninit().
+ */
+EventNotifier *msix_vector_irqfd(PCIDevice *dev, unsigned vector)
+{
+    MSIVectorIrqfd *irqfd;
+
+    assert(vector < dev->msix_entries_nr);
+
+    if (!dev->msix_irqfds) {
+        dev->msix_irqfds = g_new0(MSIVectorIrqfd *, dev->msix_entries_nr);
+    }
+    if (!dev->msix_irqfds[vector]) {
+        irqfd = msi_irqfd_new(dev, vector, msix_notify);
+        if (!irqfd) {
+            return NULL;
+        }
+        dev->msix_irqfds[vector] = irqfd;
+        msix_update_irqfd(dev, vector);
+    }
+    return msi_irqfd_notifier(dev->msix_irqfds[vector]);
+}
+
+void msix_vector_irqfd_release(PCIDevice *dev, unsigned vector)
+{
+    if (!dev->msix_irqfds || !dev->msix_irqfds[vector]) {
+        return;
+    }
+    msi_irqfd_free(dev->msix_irqfds[vector]);
+    dev->msix_irqfds[vector] = NULL;
 }
 
 void msix_reset(PCIDevice *dev)
@@ -461,7 +524,9 @@ int msix_vector_use(PCIDevice *dev, unsigned vector)
 {
     if (vector >= dev->msix_entries_nr)
         return -EINVAL;
-    dev->msix_entry_used[vector]++;
+    if (!dev->msix_entry_used[vector]++) {
+        msix_update_irqfd(dev, vector);
+    }
     return 0;
 }
 
@@ -475,6 +540,7 @@ void msix_vector_unuse(PCIDevice *dev, unsigned vector)
         return;
     }
     msix_clr_pending(dev, vector);
+    msix_update_irqfd(dev, vector);
 }
 
 void msix_unuse_all_vectors(PCIDevice *dev)
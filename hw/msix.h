@@ -31,6 +31,8 @@ void msix_vector_unuse(PCIDevice *dev, unsigned vector);
 void msix_unuse_all_vectors(PCIDevice *dev);
 
 void msix_notify(PCIDevice *dev, unsigned vector);
+EventNotifier *msix_vector_irqfd(PCIDevice *dev, unsigned vector);
+void msix_vector_irqfd_release(PCIDevice *dev, unsigned vector);
 
 void msix_reset(PCIDevice *dev);
 
@@ -39,6 +39,7 @@
 #include "i8254.h"
 #include "pcspk.h"
 #include "msi.h"
+#include "apic-msidef.h"
 #include "sysbus.h"
 #include "sysemu.h"
 #include "kvm.h"
@@ -72,8 +73,6 @@
 #define FW_CFG_E820_TABLE (FW_CFG_ARCH_LOCAL + 3)
 #define FW_CFG_HPET (FW_CFG_ARCH_LOCAL + 4)
 
-#define MSI_ADDR_BASE 0xfee00000
-
 #define E820_NR_ENTRIES		16
 
 struct e820_entry {
@@ -956,6 +955,28 @@ void pc_cpus_init(const char *cpu_model)
     }
 }
 
+/* With host NUMA policies, each guest node gets a RAM block of its own so
+ * that the policies can be applied separately.  Returns false if the nodes
+ * do not exactly cover the RAM.
+ */
+static bool pc_numa_split_ram(ram_addr_t ram_size)
+{
+    uint64_t total = 0;
+    bool policy = false;
+    int i;
+
+    for (i = 0; i < nb_numa_nodes; i++) {
+        total += node_mem[i];
+        policy |= node_host_policy[i] != NUMA_HOST_POLICY_DEFAULT;
+    }
+    if (policy && total != ram_size) {
+        fprintf(stderr, "qemu: NUMA node memory does not add up to the RAM "
+                "size, ignoring host policies\n");
+        return false;
+    }
+    return policy;
+}
+
 void *pc_memory_init(MemoryRegion *system_memory,
                     const char *kernel_filename,
                     const char *kernel_cmdline,
@@ -977,9 +998,31 @@ void *pc_memory_init(MemoryRegion *system_memory,
      * with older qemus that used qemu_ram_alloc().
      */
     ram = g_malloc(sizeof(*ram));
-    memory_region_init_ram(ram, "pc.ram",
+    if (pc_numa_split_ram(below_4g_mem_size + above_4g_mem_size)) {
+        ram_addr_t offset = 0;
+
+        memory_region_init(ram, "pc.ram",
                            below_4g_mem_size + above_4g_mem_size);
-    vmstate_register_ram_global(ram);
+        for (i = 0; i < nb_numa_nodes; i++) {
+            MemoryRegion *node_ram;
+            char name[32];
+
+            if (!node_mem[i]) {
+                continue;
+            }
+            snprintf(name, sizeof(name), "pc.ram.node%d", i);
+            node_ram = g_malloc(sizeof(*node_ram));
+            memory_region_init_ram(node_ram, name, node_mem[i]);
+            vmstate_register_ram_global(node_ram);
+            memory_region_set_numa_node(node_ram, i);
+            memory_region_add_subregion(ram, offset, node_ram);
+            offset += node_mem[i];
+        }
+    } else {
+        memory_region_init_ram(ram, "pc.ram",
+                               below_4g_mem_size + above_4g_mem_size);
+        vmstate_register_ram_global(ram);
+    }
     *ram_memory = ram;
     ram_below_4g = g_malloc(sizeof(*ram_below_4g));
     memory_region_init_alias(ram_below_4g, "ram-below-4g", ram,
@@ -21,6 +21,7 @@
 #include "sysemu.h"
 #include "monitor.h"
 #include "pci.h"
+#include "msi.h"
 #include "qmp-commands.h"
 
 PciInfoList *qmp_query_pci(Error **errp)
@@ -34,6 +35,15 @@ static void pci_error_message(Monitor *mon)
     monitor_printf(mon, "PCI devices not supported\n");
 }
 
+void msi_set_timing(bool enable)
+{
+}
+
+void msi_info(fprintf_function mon_printf, void *f)
+{
+    mon_printf(f, "PCI devices not supported\n");
+}
+
 void pci_register_bar(PCIDevice *pci_dev, int region_num,
                       uint8_t type, MemoryRegion *memory)
 {
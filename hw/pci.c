@@ -424,11 +424,22 @@ static VMStateInfo vmstate_info_pci_irq_state = {
     .put  = put_pci_irq_state,
 };
 
+/* The MSI messages came with the config space; MSI-X vectors are
+ * refreshed by msix_load().  */
+static int pci_device_post_load(void *opaque, int version_id)
+{
+    PCIDevice *s = opaque;
+
+    msi_update_irqfds(s);
+    return 0;
+}
+
 const VMStateDescription vmstate_pci_device = {
     .name = "PCIDevice",
     .version_id = 2,
     .minimum_version_id = 1,
     .minimum_version_id_old = 1,
+    .post_load = pci_device_post_load,
     .fields      = (VMStateField []) {
         VMSTATE_INT32_LE(version_id, PCIDevice),
         VMSTATE_BUFFER_UNSAFE_INFO(config, PCIDevice, 0,
@@ -446,6 +457,7 @@ const VMStateDescription vmstate_pcie_device = {
     .version_id = 2,
     .minimum_version_id = 1,
     .minimum_version_id_old = 1,
+    .post_load = pci_device_post_load,
     .fields      = (VMStateField []) {
         VMSTATE_INT32_LE(version_id, PCIDevice),
         VMSTATE_BUFFER_UNSAFE_INFO(config, PCIDevice, 0,
@@ -244,11 +244,15 @@ struct PCIDevice {
     unsigned *msix_entry_used;
     /* MSIX function mask set or MSIX disabled */
     bool msix_function_masked;
+    /* Per-vector irqfds, see msix_vector_irqfd() */
+    struct MSIVectorIrqfd **msix_irqfds;
     /* Version id needed for VMState */
     int32_t version_id;
 
     /* Offset of MSI capability in config space */
     uint8_t msi_cap;
+    /* Per-vector irqfds, see msi_vector_irqfd() */
+    struct MSIVectorIrqfd **msi_irqfds;
 
     /* PCI Express */
     PCIExpressDevice exp;
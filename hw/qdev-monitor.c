@@ -21,6 +21,7 @@
 #include "monitor.h"
 #include "qmp-commands.h"
 #include "arch_init.h"
+#include "sysemu.h"
 
 /*
  * Aliases were a bad idea from the start.  Let's keep them
@@ -579,6 +580,12 @@ int do_device_add(Monitor *mon, const QDict *qdict, QObject **ret_data)
     Error *local_err = NULL;
     QemuOpts *opts;
 
+    /* a detached dump is reading guest memory */
+    if (dump_in_progress()) {
+        qerror_report(QERR_DEVICE_IN_USE, "dump");
+        return -1;
+    }
+
     opts = qemu_opts_from_qdict(qemu_find_opts("device"), qdict, &local_err);
     if (error_is_set(&local_err)) {
         qerror_report_err(local_err);
@@ -600,6 +607,11 @@ void qmp_device_del(const char *id, Error **errp)
 {
     DeviceState *dev;
 
+    if (dump_in_progress()) {
+        error_set(errp, QERR_DEVICE_IN_USE, "dump");
+        return;
+    }
+
     dev = qdev_find_recursive(sysbus_get_default(), id);
     if (NULL == dev) {
         error_set(errp, QERR_DEVICE_NOT_FOUND, id);
@@ -0,0 +1,307 @@
+/*
+ * vhost-user: the vhost protocol over a unix socket
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Every request of the /dev/vhost-net ioctl interface becomes a message
+ * to a backend process: a VhostUserMsg header followed by 'size' bytes of
+ * payload.  File descriptors travel as SCM_RIGHTS data of the same
+ * message: the kick and call eventfds of a ring, and the files that back
+ * guest RAM.  The backend maps those files itself, so they must be mapped
+ * shared by QEMU too (-mem-path with -mem-shared).  Only GET_FEATURES and
+ * GET_VRING_BASE are answered.
+ *
+ * The backend cannot log the pages it writes, so there is no
+ * SET_LOG_BASE and no migration.
+ */
+
+#include <sys/socket.h>
+#include <linux/vhost.h>
+#include "vhost.h"
+
+#define VHOST_MEMORY_MAX_NREGIONS   8
+
+typedef enum VhostUserRequest {
+    VHOST_USER_NONE = 0,
+    VHOST_USER_GET_FEATURES = 1,
+    VHOST_USER_SET_FEATURES = 2,
+    VHOST_USER_SET_OWNER = 3,
+    VHOST_USER_RESET_OWNER = 4,
+    VHOST_USER_SET_MEM_TABLE = 5,
+    VHOST_USER_SET_LOG_BASE = 6,
+    VHOST_USER_SET_LOG_FD = 7,
+    VHOST_USER_SET_VRING_NUM = 8,
+    VHOST_USER_SET_VRING_ADDR = 9,
+    VHOST_USER_SET_VRING_BASE = 10,
+    VHOST_USER_GET_VRING_BASE = 11,
+    VHOST_USER_SET_VRING_KICK = 12,
+    VHOST_USER_SET_VRING_CALL = 13,
+    VHOST_USER_SET_VRING_ERR = 14,
+    VHOST_USER_MAX
+} VhostUserRequest;
+
+typedef struct VhostUserMemoryRegion {
+    uint64_t guest_phys_addr;
+    uint64_t memory_size;
+    uint64_t userspace_addr;    /* QEMU's address of the region */
+    uint64_t mmap_offset;       /* offset of the region in its file */
+} VhostUserMemoryRegion;
+
+typedef struct VhostUserMemory {
+    uint32_t nregions;
+    uint32_t padding;
+    VhostUserMemoryRegion regions[VHOST_MEMORY_MAX_NREGIONS];
+} VhostUserMemory;
+
+typedef struct VhostUserMsg {
+    uint32_t request;
+#define VHOST_USER_VERSION_MASK     0x3
+#define VHOST_USER_REPLY_MASK       (0x1 << 2)
+    uint32_t flags;
+    uint32_t size;              /* bytes of payload that follow */
+    union {
+#define VHOST_USER_VRING_IDX_MASK   0xff
+#define VHOST_USER_VRING_NOFD_MASK  (0x1 << 8)
+        uint64_t u64;
+        struct vhost_vring_state state;
+        struct vhost_vring_addr addr;
+        VhostUserMemory memory;
+    } payload;
+} QEMU_PACKED VhostUserMsg;
+
+#define VHOST_USER_HDR_SIZE     offsetof(VhostUserMsg, payload)
+#define VHOST_USER_VERSION      0x1
+
+static int vhost_user_write(int fd, VhostUserMsg *msg, int *fds, int fd_num)
+{
+    char control[CMSG_SPACE(VHOST_MEMORY_MAX_NREGIONS * sizeof(int))];
+    size_t size = VHOST_USER_HDR_SIZE + msg->size;
+    struct iovec iov = {
+        .iov_base = msg,
+        .iov_len = size,
+    };
+    struct msghdr msgh;
+    struct cmsghdr *cmsg;
+    ssize_t r;
+
+    memset(&msgh, 0, sizeof(msgh));
+    msgh.msg_iov = &iov;
+    msgh.msg_iovlen = 1;
+    if (fd_num) {
+        msgh.msg_control = control;
+        msgh.msg_controllen = CMSG_SPACE(fd_num * sizeof(int));
+        cmsg = CMSG_FIRSTHDR(&msgh);
+        cmsg->cmsg_len = CMSG_LEN(fd_num * sizeof(int));
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        memcpy(CMSG_DATA(cmsg), fds, fd_num * sizeof(int));
+    }
+
+    do {
+        r = sendmsg(fd, &msgh, 0);
+    } while (r < 0 && errno == EINTR);
+    if (r < 0) {
+        return -1;
+    }
+    if (r != size) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+static int vhost_user_read_full(int fd, void *buf, size_t size)
+{
+    uint8_t *p = buf;
+    ssize_t r;
+
+    while (size) {
+        r = read(fd, p, size);
+        if (r < 0 && errno == EINTR) {
+            continue;
+        }
+        if (r <= 0) {
+            if (r == 0) {
+                errno = ECONNRESET;
+            }
+            return -1;
+        }
+        p += r;
+        size -= r;
+    }
+    return 0;
+}
+
+static int vhost_user_read(int fd, VhostUserMsg *msg)
+{
+    if (vhost_user_read_full(fd, msg, VHOST_USER_HDR_SIZE) < 0) {
+        return -1;
+    }
+    if ((msg->flags & VHOST_USER_VERSION_MASK) != VHOST_USER_VERSION ||
+        !(msg->flags & VHOST_USER_REPLY_MASK) ||
+        msg->size > sizeof(msg->payload)) {
+        errno = EPROTO;
+        return -1;
+    }
+    return vhost_user_read_full(fd, &msg->payload, msg->size);
+}
+
+/* Describe the regions of 'mem' that the backend can map.  Memory that is
+ * not in a shared file (ROMs smaller than a huge page) is left out; the
+ * rings and packet buffers are never there.
+ */
+static int vhost_user_set_mem_table(VhostUserMsg *msg,
+                                    struct vhost_memory *mem,
+                                    int *fds, int *fd_num)
+{
+    VhostUserMemoryRegion ureg;
+    int i;
+
+    for (i = 0; i < mem->nregions; i++) {
+        struct vhost_memory_region *reg = mem->regions + i;
+        ram_addr_t offset, avail;
+        int fd;
+
+        fd = qemu_ram_get_fd((void *)(uintptr_t)reg->userspace_addr,
+                             &offset, &avail);
+        if (fd < 0) {
+            continue;
+        }
+        if (*fd_num == VHOST_MEMORY_MAX_NREGIONS) {
+            fprintf(stderr, "vhost-user: too many memory regions\n");
+            errno = E2BIG;
+            return -1;
+        }
+        ureg.guest_phys_addr = reg->guest_phys_addr;
+        ureg.memory_size = MIN(reg->memory_size, avail);
+        ureg.userspace_addr = reg->userspace_addr;
+        ureg.mmap_offset = offset;
+        msg->payload.memory.regions[*fd_num] = ureg;
+        fds[(*fd_num)++] = fd;
+    }
+
+    if (!*fd_num) {
+        fprintf(stderr, "vhost-user: guest RAM is not shared, "
+                "use -mem-path with -mem-shared\n");
+        errno = EINVAL;
+        return -1;
+    }
+    msg->payload.memory.nregions = *fd_num;
+    msg->size = offsetof(VhostUserMemory, regions) +
+        *fd_num * sizeof(VhostUserMemoryRegion);
+    return 0;
+}
+
+int vhost_user_call(struct vhost_dev *dev, unsigned long int request,
+                    void *arg)
+{
+    struct vhost_vring_file *file;
+    int fds[VHOST_MEMORY_MAX_NREGIONS];
+    int fd_num = 0;
+    bool need_reply = false;
+    VhostUserMsg msg;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.flags = VHOST_USER_VERSION;
+
+    switch (request) {
+    case VHOST_GET_FEATURES:
+        msg.request = VHOST_USER_GET_FEATURES;
+        need_reply = true;
+        break;
+
+    case VHOST_SET_FEATURES:
+        msg.request = VHOST_USER_SET_FEATURES;
+        msg.payload.u64 = *(uint64_t *)arg;
+        msg.size = sizeof(msg.payload.u64);
+        break;
+
+    case VHOST_SET_OWNER:
+        msg.request = VHOST_USER_SET_OWNER;
+        break;
+
+    case VHOST_RESET_OWNER:
+        msg.request = VHOST_USER_RESET_OWNER;
+        break;
+
+    case VHOST_SET_MEM_TABLE:
+        msg.request = VHOST_USER_SET_MEM_TABLE;
+        if (vhost_user_set_mem_table(&msg, arg, fds, &fd_num) < 0) {
+            return -1;
+        }
+        break;
+
+    case VHOST_SET_VRING_NUM:
+    case VHOST_SET_VRING_BASE:
+    case VHOST_GET_VRING_BASE:
+        if (request == VHOST_SET_VRING_NUM) {
+            msg.request = VHOST_USER_SET_VRING_NUM;
+        } else if (request == VHOST_SET_VRING_BASE) {
+            msg.request = VHOST_USER_SET_VRING_BASE;
+        } else {
+            msg.request = VHOST_USER_GET_VRING_BASE;
+            need_reply = true;
+        }
+        memcpy(&msg.payload.state, arg, sizeof(msg.payload.state));
+        msg.size = sizeof(msg.payload.state);
+        break;
+
+    case VHOST_SET_VRING_ADDR:
+        msg.request = VHOST_USER_SET_VRING_ADDR;
+        memcpy(&msg.payload.addr, arg, sizeof(msg.payload.addr));
+        msg.size = sizeof(msg.payload.addr);
+        break;
+
+    case VHOST_SET_VRING_KICK:
+    case VHOST_SET_VRING_CALL:
+        msg.request = request == VHOST_SET_VRING_KICK ?
+            VHOST_USER_SET_VRING_KICK : VHOST_USER_SET_VRING_CALL;
+        file = arg;
+        msg.payload.u64 = file->index & VHOST_USER_VRING_IDX_MASK;
+        if (file->fd >= 0) {
+            fds[fd_num++] = file->fd;
+        } else {
+            msg.payload.u64 |= VHOST_USER_VRING_NOFD_MASK;
+        }
+        msg.size = sizeof(msg.payload.u64);
+        break;
+
+    default:
+        errno = ENOSYS;
+        return -1;
+    }
+
+    if (vhost_user_write(dev->control, &msg, fds, fd_num) < 0) {
+        return -1;
+    }
+    if (!need_reply) {
+        return 0;
+    }
+
+    request = msg.request;
+    if (vhost_user_read(dev->control, &msg) < 0) {
+        return -1;
+    }
+    if (msg.request != request) {
+        errno = EPROTO;
+        return -1;
+    }
+    switch (msg.request) {
+    case VHOST_USER_GET_FEATURES:
+        if (msg.size != sizeof(msg.payload.u64)) {
+            errno = EPROTO;
+            return -1;
+        }
+        *(uint64_t *)arg = msg.payload.u64;
+        break;
+    case VHOST_USER_GET_VRING_BASE:
+        if (msg.size != sizeof(msg.payload.state)) {
+            errno = EPROTO;
+            return -1;
+        }
+        memcpy(arg, &msg.payload.state, sizeof(msg.payload.state));
+        break;
+    }
+    return 0;
+}
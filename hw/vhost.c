@@ -19,6 +19,20 @@
 #include "range.h"
 #include <linux/vhost.h>
 #include "exec-memory.h"
+#include "migration.h"
+#include "qerror.h"
+
+/* Send a vhost request to the kernel or to a vhost-user backend.  Both
+ * return -1 and set errno on failure.
+ */
+static int vhost_call(struct vhost_dev *dev, unsigned long int request,
+                      void *arg)
+{
+    if (dev->backend_type == VHOST_BACKEND_TYPE_USER) {
+        return vhost_user_call(dev, request, arg);
+    }
+    return ioctl(dev->control, request, arg);
+}
 
 static void vhost_dev_sync_region(struct vhost_dev *dev,
                                   MemoryRegionSection *section,
@@ -275,7 +289,7 @@ static inline void vhost_dev_log_resize(struct vhost_dev* dev, uint64_t size)
         log = NULL;
     }
     log_base = (uint64_t)(unsigned long)log;
-    r = ioctl(dev->control, VHOST_SET_LOG_BASE, &log_base);
+    r = vhost_call(dev, VHOST_SET_LOG_BASE, &log_base);
     assert(r >= 0);
     for (i = 0; i < dev->n_mem_sections; ++i) {
         /* Sync only the range covered by the old log */
@@ -356,6 +370,15 @@ static bool vhost_dev_cmp_memory(struct vhost_dev *dev,
     return uaddr != reg->userspace_addr + start_addr - reg->guest_phys_addr;
 }
 
+/* The backend no longer sees guest memory as it is; with vhost-user it
+ * may simply have exited.  Give up on it rather than on the guest.  */
+static void vhost_set_mem_table_failed(struct vhost_dev *dev)
+{
+    error_report("vhost: updating the memory table failed: %s, "
+                 "stopping vhost", strerror(errno));
+    vhost_dev_stop(dev, dev->vdev);
+}
+
 static void vhost_set_memory(MemoryListener *listener,
                              MemoryRegionSection *section,
                              bool add)
@@ -412,8 +435,10 @@ static void vhost_set_memory(MemoryListener *listener,
     }
 
     if (!dev->log_enabled) {
-        r = ioctl(dev->control, VHOST_SET_MEM_TABLE, dev->mem);
-        assert(r >= 0);
+        r = vhost_call(dev, VHOST_SET_MEM_TABLE, dev->mem);
+        if (r < 0) {
+            vhost_set_mem_table_failed(dev);
+        }
         return;
     }
     log_size = vhost_get_log_size(dev);
@@ -424,8 +449,11 @@ static void vhost_set_memory(MemoryListener *listener,
     if (dev->log_size < log_size) {
         vhost_dev_log_resize(dev, log_size + VHOST_LOG_BUFFER);
     }
-    r = ioctl(dev->control, VHOST_SET_MEM_TABLE, dev->mem);
-    assert(r >= 0);
+    r = vhost_call(dev, VHOST_SET_MEM_TABLE, dev->mem);
+    if (r < 0) {
+        vhost_set_mem_table_failed(dev);
+        return;
+    }
     /* To log less, can only decrease log size after table update. */
     if (dev->log_size > log_size + VHOST_LOG_BUFFER) {
         vhost_dev_log_resize(dev, log_size);
@@ -503,7 +531,7 @@ static int vhost_virtqueue_set_addr(struct vhost_dev *dev,
         .log_guest_addr = vq->used_phys,
         .flags = enable_log ? (1 << VHOST_VRING_F_LOG) : 0,
     };
-    int r = ioctl(dev->control, VHOST_SET_VRING_ADDR, &addr);
+    int r = vhost_call(dev, VHOST_SET_VRING_ADDR, &addr);
     if (r < 0) {
         return -errno;
     }
@@ -517,7 +545,7 @@ static int vhost_dev_set_features(struct vhost_dev *dev, bool enable_log)
     if (enable_log) {
         features |= 0x1 << VHOST_F_LOG_ALL;
     }
-    r = ioctl(dev->control, VHOST_SET_FEATURES, &features);
+    r = vhost_call(dev, VHOST_SET_FEATURES, &features);
     return r < 0 ? -errno : 0;
 }
 
@@ -629,13 +657,13 @@ static int vhost_virtqueue_init(struct vhost_dev *dev,
     struct VirtQueue *vvq = virtio_get_queue(vdev, idx);
 
     vq->num = state.num = virtio_queue_get_num(vdev, idx);
-    r = ioctl(dev->control, VHOST_SET_VRING_NUM, &state);
+    r = vhost_call(dev, VHOST_SET_VRING_NUM, &state);
     if (r) {
         return -errno;
     }
 
     state.num = virtio_queue_get_last_avail_idx(vdev, idx);
-    r = ioctl(dev->control, VHOST_SET_VRING_BASE, &state);
+    r = vhost_call(dev, VHOST_SET_VRING_BASE, &state);
     if (r) {
         return -errno;
     }
@@ -676,14 +704,14 @@ static int vhost_virtqueue_init(struct vhost_dev *dev,
         goto fail_alloc;
     }
     file.fd = event_notifier_get_fd(virtio_queue_get_host_notifier(vvq));
-    r = ioctl(dev->control, VHOST_SET_VRING_KICK, &file);
+    r = vhost_call(dev, VHOST_SET_VRING_KICK, &file);
     if (r) {
         r = -errno;
         goto fail_kick;
     }
 
     file.fd = event_notifier_get_fd(virtio_queue_get_guest_notifier(vvq));
-    r = ioctl(dev->control, VHOST_SET_VRING_CALL, &file);
+    r = vhost_call(dev, VHOST_SET_VRING_CALL, &file);
     if (r) {
         r = -errno;
         goto fail_call;
@@ -718,13 +746,15 @@ static void vhost_virtqueue_cleanup(struct vhost_dev *dev,
         .index = idx,
     };
     int r;
-    r = ioctl(dev->control, VHOST_GET_VRING_BASE, &state);
+    r = vhost_call(dev, VHOST_GET_VRING_BASE, &state);
     if (r < 0) {
         fprintf(stderr, "vhost VQ %d ring restore failed: %d\n", idx, r);
         fflush(stderr);
+        /* The backend is gone, e.g. a vhost-user process that crashed:
+         * resume after the last buffer it gave back to the guest. */
+        state.num = virtio_queue_get_used_idx(vdev, idx);
     }
     virtio_queue_set_last_avail_idx(vdev, idx, state.num);
-    assert (r >= 0);
     cpu_physical_memory_unmap(vq->ring, virtio_queue_get_ring_size(vdev, idx),
                               0, virtio_queue_get_ring_size(vdev, idx));
     cpu_physical_memory_unmap(vq->used, virtio_queue_get_used_size(vdev, idx),
@@ -747,10 +777,15 @@ static void vhost_eventfd_del(MemoryListener *listener,
 {
 }
 
-int vhost_dev_init(struct vhost_dev *hdev, int devfd, bool force)
+int vhost_dev_init(struct vhost_dev *hdev, int devfd,
+                   VhostBackendType backend_type, bool force)
 {
     uint64_t features;
     int r;
+    hdev->backend_type = backend_type;
+    if (backend_type == VHOST_BACKEND_TYPE_USER) {
+        assert(devfd >= 0);
+    }
     if (devfd >= 0) {
         hdev->control = devfd;
     } else {
@@ -759,12 +794,12 @@ int vhost_dev_init(struct vhost_dev *hdev, int devfd, bool force)
             return -errno;
         }
     }
-    r = ioctl(hdev->control, VHOST_SET_OWNER, NULL);
+    r = vhost_call(hdev, VHOST_SET_OWNER, NULL);
     if (r < 0) {
         goto fail;
     }
 
-    r = ioctl(hdev->control, VHOST_GET_FEATURES, &features);
+    r = vhost_call(hdev, VHOST_GET_FEATURES, &features);
     if (r < 0) {
         goto fail;
     }
@@ -794,6 +829,14 @@ int vhost_dev_init(struct vhost_dev *hdev, int devfd, bool force)
     hdev->started = false;
     memory_listener_register(&hdev->memory_listener, NULL);
     hdev->force = force;
+    hdev->migration_blocker = NULL;
+    if (backend_type == VHOST_BACKEND_TYPE_USER) {
+        /* the backend cannot log the pages it dirties */
+        error_set(&hdev->migration_blocker,
+                  QERR_DEVICE_FEATURE_BLOCKS_MIGRATION, "vhost-user",
+                  "dirty page logging");
+        migrate_add_blocker(hdev->migration_blocker);
+    }
     return 0;
 fail:
     r = -errno;
@@ -803,6 +846,10 @@ fail:
 
 void vhost_dev_cleanup(struct vhost_dev *hdev)
 {
+    if (hdev->migration_blocker) {
+        migrate_del_blocker(hdev->migration_blocker);
+        error_free(hdev->migration_blocker);
+    }
     memory_listener_unregister(&hdev->memory_listener);
     g_free(hdev->mem);
     g_free(hdev->mem_sections);
@@ -872,6 +919,7 @@ void vhost_dev_disable_notifiers(struct vhost_dev *hdev, VirtIODevice *vdev)
 /* Host notifiers must be enabled at this point. */
 int vhost_dev_start(struct vhost_dev *hdev, VirtIODevice *vdev)
 {
+    uint64_t log_base;
     int i, r;
     if (!vdev->binding->set_guest_notifiers) {
         fprintf(stderr, "binding does not support guest notifiers\n");
@@ -889,7 +937,7 @@ int vhost_dev_start(struct vhost_dev *hdev, VirtIODevice *vdev)
     if (r < 0) {
         goto fail_features;
     }
-    r = ioctl(hdev->control, VHOST_SET_MEM_TABLE, hdev->mem);
+    r = vhost_call(hdev, VHOST_SET_MEM_TABLE, hdev->mem);
     if (r < 0) {
         r = -errno;
         goto fail_mem;
@@ -908,14 +956,15 @@ int vhost_dev_start(struct vhost_dev *hdev, VirtIODevice *vdev)
         hdev->log_size = vhost_get_log_size(hdev);
         hdev->log = hdev->log_size ?
             g_malloc0(hdev->log_size * sizeof *hdev->log) : NULL;
-        r = ioctl(hdev->control, VHOST_SET_LOG_BASE,
-                  (uint64_t)(unsigned long)hdev->log);
+        log_base = (uint64_t)(unsigned long)hdev->log;
+        r = vhost_call(hdev, VHOST_SET_LOG_BASE, &log_base);
         if (r < 0) {
             r = -errno;
             goto fail_log;
         }
     }
 
+    hdev->vdev = vdev;
     hdev->started = true;
 
     return 0;
@@ -940,6 +989,11 @@ void vhost_dev_stop(struct vhost_dev *hdev, VirtIODevice *vdev)
 {
     int i, r;
 
+    /* already stopped by vhost_set_mem_table_failed() */
+    if (!hdev->started) {
+        return;
+    }
+
     for (i = 0; i < hdev->nvqs; ++i) {
         vhost_virtqueue_cleanup(hdev,
                                 vdev,
@@ -958,6 +1012,7 @@ void vhost_dev_stop(struct vhost_dev *hdev, VirtIODevice *vdev)
     assert (r >= 0);
 
     hdev->started = false;
+    hdev->vdev = NULL;
     g_free(hdev->log);
     hdev->log = NULL;
     hdev->log_size = 0;
@@ -4,6 +4,7 @@
 #include "hw/hw.h"
 #include "hw/virtio.h"
 #include "memory.h"
+#include "error.h"
 
 /* Generic structures common for any vhost based device. */
 struct vhost_virtqueue {
@@ -25,9 +26,15 @@ typedef unsigned long vhost_log_chunk_t;
 #define VHOST_LOG_BITS (8 * sizeof(vhost_log_chunk_t))
 #define VHOST_LOG_CHUNK (VHOST_LOG_PAGE * VHOST_LOG_BITS)
 
+typedef enum VhostBackendType {
+    VHOST_BACKEND_TYPE_KERNEL,  /* control is a /dev/vhost-net fd */
+    VHOST_BACKEND_TYPE_USER,    /* control is a vhost-user socket */
+} VhostBackendType;
+
 struct vhost_memory;
 struct vhost_dev {
     MemoryListener memory_listener;
+    VhostBackendType backend_type;
     int control;
     struct vhost_memory *mem;
     int n_mem_sections;
@@ -42,9 +49,12 @@ struct vhost_dev {
     vhost_log_chunk_t *log;
     unsigned long long log_size;
     bool force;
+    Error *migration_blocker;
+    VirtIODevice *vdev;         /* while started */
 };
 
-int vhost_dev_init(struct vhost_dev *hdev, int devfd, bool force);
+int vhost_dev_init(struct vhost_dev *hdev, int devfd,
+                   VhostBackendType backend_type, bool force);
 void vhost_dev_cleanup(struct vhost_dev *hdev);
 bool vhost_dev_query(struct vhost_dev *hdev, VirtIODevice *vdev);
 int vhost_dev_start(struct vhost_dev *hdev, VirtIODevice *vdev);
@@ -52,4 +62,8 @@ void vhost_dev_stop(struct vhost_dev *hdev, VirtIODevice *vdev);
 int vhost_dev_enable_notifiers(struct vhost_dev *hdev, VirtIODevice *vdev);
 void vhost_dev_disable_notifiers(struct vhost_dev *hdev, VirtIODevice *vdev);
 
+/* vhost-user.c */
+int vhost_user_call(struct vhost_dev *dev, unsigned long int request,
+                    void *arg);
+
 #endif
@@ -15,6 +15,7 @@
 
 #include "net.h"
 #include "net/tap.h"
+#include "net/vhost-user.h"
 
 #include "virtio-net.h"
 #include "vhost_net.h"
@@ -41,7 +42,7 @@
 struct vhost_net {
     struct vhost_dev dev;
     struct vhost_virtqueue vqs[2];
-    int backend;
+    int backend;                /* tap fd, -1 for vhost-user */
     VLANClientState *vc;
 };
 
@@ -94,26 +95,35 @@ static int vhost_net_get_fd(VLANClientState *backend)
 struct vhost_net *vhost_net_init(VLANClientState *backend, int devfd,
                                  bool force)
 {
+    VhostBackendType type = VHOST_BACKEND_TYPE_KERNEL;
     int r;
     struct vhost_net *net = g_malloc(sizeof *net);
     if (!backend) {
         fprintf(stderr, "vhost-net requires backend to be setup\n");
         goto fail;
     }
-    r = vhost_net_get_fd(backend);
-    if (r < 0) {
-        goto fail;
-    }
     net->vc = backend;
-    net->dev.backend_features = tap_has_vnet_hdr(backend) ? 0 :
-        (1 << VHOST_NET_F_VIRTIO_NET_HDR);
-    net->backend = r;
+    if (backend->info->type == NET_CLIENT_OPTIONS_KIND_VHOST_USER) {
+        /* The backend process moves the packets, header included. */
+        type = VHOST_BACKEND_TYPE_USER;
+        net->dev.backend_features = 0;
+        net->backend = -1;
+    } else {
+        r = vhost_net_get_fd(backend);
+        if (r < 0) {
+            goto fail;
+        }
+        net->dev.backend_features = tap_has_vnet_hdr(backend) ? 0 :
+            (1 << VHOST_NET_F_VIRTIO_NET_HDR);
+        net->backend = r;
+    }
 
-    r = vhost_dev_init(&net->dev, devfd, force);
+    r = vhost_dev_init(&net->dev, devfd, type, force);
     if (r < 0) {
         goto fail;
     }
-    if (!tap_has_vnet_hdr_len(backend,
+    if (net->backend >= 0 &&
+        !tap_has_vnet_hdr_len(backend,
                               sizeof(struct virtio_net_hdr_mrg_rxbuf))) {
         net->dev.features &= ~(1 << VIRTIO_NET_F_MRG_RXBUF);
     }
@@ -150,7 +160,8 @@ int vhost_net_start(struct vhost_net *net,
     if (r < 0) {
         goto fail_notifiers;
     }
-    if (net->dev.acked_features & (1 << VIRTIO_NET_F_MRG_RXBUF)) {
+    if (net->backend >= 0 &&
+        (net->dev.acked_features & (1 << VIRTIO_NET_F_MRG_RXBUF))) {
         tap_set_vnet_hdr_len(net->vc,
                              sizeof(struct virtio_net_hdr_mrg_rxbuf));
     }
@@ -159,6 +170,9 @@ int vhost_net_start(struct vhost_net *net,
     if (r < 0) {
         goto fail_start;
     }
+    if (net->backend < 0) {
+        return 0;
+    }
 
     net->vc->info->poll(net->vc, false);
     qemu_set_fd_handler(net->backend, NULL, NULL, NULL);
@@ -179,10 +193,11 @@ fail:
     }
     net->vc->info->poll(net->vc, true);
     vhost_dev_stop(&net->dev, dev);
-    if (net->dev.acked_features & (1 << VIRTIO_NET_F_MRG_RXBUF)) {
+fail_start:
+    if (net->backend >= 0 &&
+        (net->dev.acked_features & (1 << VIRTIO_NET_F_MRG_RXBUF))) {
         tap_set_vnet_hdr_len(net->vc, sizeof(struct virtio_net_hdr));
     }
-fail_start:
     vhost_dev_disable_notifiers(&net->dev, dev);
 fail_notifiers:
     return r;
@@ -193,6 +208,11 @@ void vhost_net_stop(struct vhost_net *net,
 {
     struct vhost_vring_file file = { .fd = -1 };
 
+    if (net->backend < 0) {
+        vhost_dev_stop(&net->dev, dev);
+        vhost_dev_disable_notifiers(&net->dev, dev);
+        return;
+    }
     for (file.index = 0; file.index < net->dev.nvqs; ++file.index) {
         int r = ioctl(net->dev.control, VHOST_NET_SET_BACKEND, &file);
         assert(r >= 0);
@@ -208,11 +228,29 @@ void vhost_net_stop(struct vhost_net *net,
 void vhost_net_cleanup(struct vhost_net *net)
 {
     vhost_dev_cleanup(&net->dev);
-    if (net->dev.acked_features & (1 << VIRTIO_NET_F_MRG_RXBUF)) {
+    if (net->backend >= 0 &&
+        (net->dev.acked_features & (1 << VIRTIO_NET_F_MRG_RXBUF))) {
         tap_set_vnet_hdr_len(net->vc, sizeof(struct virtio_net_hdr));
     }
     g_free(net);
 }
+
+VHostNetState *get_vhost_net(VLANClientState *nc)
+{
+    if (!nc) {
+        return NULL;
+    }
+    switch (nc->info->type) {
+    case NET_CLIENT_OPTIONS_KIND_TAP:
+        return tap_get_vhost_net(nc);
+#ifdef CONFIG_LINUX
+    case NET_CLIENT_OPTIONS_KIND_VHOST_USER:
+        return vhost_user_get_vhost_net(nc);
+#endif
+    default:
+        return NULL;
+    }
+}
 #else
 struct vhost_net *vhost_net_init(VLANClientState *backend, int devfd,
                                  bool force)
@@ -247,4 +285,9 @@ unsigned vhost_net_get_features(struct vhost_net *net, unsigned features)
 void vhost_net_ack_features(struct vhost_net *net, unsigned features)
 {
 }
+
+VHostNetState *get_vhost_net(VLANClientState *nc)
+{
+    return NULL;
+}
 #endif
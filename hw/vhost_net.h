@@ -17,4 +17,7 @@ void vhost_net_cleanup(VHostNetState *net);
 unsigned vhost_net_get_features(VHostNetState *net, unsigned features);
 void vhost_net_ack_features(VHostNetState *net, unsigned features);
 
+/* the vhost-net instance of a tap or vhost-user peer, or NULL */
+VHostNetState *get_vhost_net(VLANClientState *nc);
+
 #endif
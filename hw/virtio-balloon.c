@@ -22,6 +22,8 @@
 #include "virtio-balloon.h"
 #include "kvm.h"
 #include "exec-memory.h"
+#include "migration.h"
+#include "qemu-timer.h"
 
 #if defined(__linux__)
 #include <sys/mman.h>
@@ -30,9 +32,18 @@
 typedef struct VirtIOBalloon
 {
     VirtIODevice vdev;
-    VirtQueue *ivq, *dvq, *svq;
+    VirtQueue *ivq, *dvq, *svq, *fpvq, *rvq;
     uint32_t num_pages;
     uint32_t actual;
+    uint32_t free_page_cmd_id;
+    bool free_page_hinting;     /* the host wants hints */
+    bool free_page_reporting;   /* the guest acknowledged free_page_cmd_id */
+    VirtIOBalloonConf conf;
+    QEMUTimer *report_timer;
+    int64_t report_slice_start;
+    uint64_t report_slice_bytes;
+    uint64_t free_page_reported;
+    uint64_t free_page_reclaimed;
     uint64_t stats[VIRTIO_BALLOON_S_NR];
     VirtQueueElement stats_vq_elem;
     size_t stats_vq_offset;
@@ -53,6 +64,29 @@ static void balloon_page(void *addr, int deflate)
 #endif
 }
 
+/*
+ * Give a range reported free by the guest back to the host, return the
+ * number of bytes actually released.  MADV_FREE only reclaims the pages
+ * under memory pressure, which is cheaper if the guest reuses them soon.
+ */
+static size_t balloon_release(uint8_t *addr, size_t len)
+{
+#if defined(__linux__)
+    uintptr_t start = QEMU_ALIGN_UP((uintptr_t)addr, qemu_real_host_page_size);
+    uintptr_t end = QEMU_ALIGN_DOWN((uintptr_t)addr + len,
+                                    qemu_real_host_page_size);
+
+    if (end <= start || (kvm_enabled() && !kvm_has_sync_mmu())) {
+        return 0;
+    }
+    if (qemu_madvise((void *)start, end - start, QEMU_MADV_FREE) == 0 ||
+        qemu_madvise((void *)start, end - start, QEMU_MADV_DONTNEED) == 0) {
+        return end - start;
+    }
+#endif
+    return 0;
+}
+
 /*
  * reset_stats - Mark all items in the stats array as unset
  *
@@ -130,6 +164,165 @@ static void virtio_balloon_receive_stats(VirtIODevice *vdev, VirtQueue *vq)
     s->stats_vq_offset = offset;
 }
 
+/*
+ * The guest first sends the current command id in an output buffer, then
+ * each free range as an empty input buffer that covers it.  The ranges
+ * stay allocated in the guest until the host sets the command id to
+ * VIRTIO_BALLOON_CMD_ID_DONE.
+ */
+static void virtio_balloon_handle_free_page(VirtIODevice *vdev, VirtQueue *vq)
+{
+    VirtIOBalloon *s = to_virtio_balloon(vdev);
+    VirtQueueElement elem;
+    MemoryRegionSection section;
+    uint32_t id;
+    int i;
+
+    while (virtqueue_pop(vq, &elem)) {
+        if (iov_to_buf(elem.out_sg, elem.out_num, 0, &id, 4) == 4) {
+            id = ldl_p(&id);
+            s->free_page_reporting = s->free_page_hinting &&
+                                     id == s->free_page_cmd_id;
+        }
+
+        for (i = 0; s->free_page_reporting && i < elem.in_num; i++) {
+            section = memory_region_find(get_system_memory(),
+                                         elem.in_addr[i],
+                                         elem.in_sg[i].iov_len);
+            if (!section.size || !memory_region_is_ram(section.mr)) {
+                continue;
+            }
+            ram_free_page_hint(section.mr, section.offset_within_region,
+                               section.size);
+        }
+
+        /* nothing was written, so the pages are not dirtied on unmap */
+        virtqueue_push(vq, &elem, 0);
+        virtio_notify(vdev, vq);
+    }
+}
+
+/* Guest memory reported in one element, merging contiguous ranges.  */
+static void virtio_balloon_report(VirtIOBalloon *s, VirtQueueElement *elem)
+{
+    MemoryRegionSection section;
+    uint8_t *start = NULL;
+    size_t len = 0;
+    int i;
+
+    for (i = 0; i < elem->in_num; i++) {
+        uint8_t *addr;
+
+        section = memory_region_find(get_system_memory(), elem->in_addr[i],
+                                     elem->in_sg[i].iov_len);
+        if (!section.size || !memory_region_is_ram(section.mr)) {
+            continue;
+        }
+        addr = memory_region_get_ram_ptr(section.mr) +
+               section.offset_within_region;
+
+        s->free_page_reported += section.size;
+        s->report_slice_bytes += section.size;
+        if (start && start + len == addr) {
+            len += section.size;
+            continue;
+        }
+        if (start) {
+            s->free_page_reclaimed += balloon_release(start, len);
+        }
+        start = addr;
+        len = section.size;
+    }
+    if (start) {
+        s->free_page_reclaimed += balloon_release(start, len);
+    }
+}
+
+/*
+ * Each element holds chunks freed by the guest as input buffers, which the
+ * guest does not reuse until they are returned.  Past report_rate in the
+ * current time slice, elements are left in the ring until the next slice,
+ * which throttles the guest as well.  The slices follow vm_clock, so that
+ * the timer that resumes the ring does not fire while the VM is stopped;
+ * the timer is not migrated, so loading the device state re-arms it.
+ */
+#define BALLOON_REPORT_SLICE_MS 100
+
+static void virtio_balloon_handle_report(VirtIODevice *vdev, VirtQueue *vq)
+{
+    VirtIOBalloon *s = to_virtio_balloon(vdev);
+    VirtQueueElement elem;
+    uint64_t limit = (uint64_t)s->conf.report_rate * 1024 * 1024 *
+                     BALLOON_REPORT_SLICE_MS / 1000;
+    int64_t now = qemu_get_clock_ms(vm_clock);
+
+    /* the timer may fire after a reset, before the guest set up the ring */
+    if (!virtio_queue_ready(vq)) {
+        return;
+    }
+    if (now >= s->report_slice_start + BALLOON_REPORT_SLICE_MS) {
+        s->report_slice_start = now;
+        s->report_slice_bytes = 0;
+    }
+
+    while (!limit || s->report_slice_bytes < limit) {
+        if (!virtqueue_pop(vq, &elem)) {
+            return;
+        }
+        virtio_balloon_report(s, &elem);
+
+        /* nothing was written, so the pages are not dirtied on unmap */
+        virtqueue_push(vq, &elem, 0);
+        virtio_notify(vdev, vq);
+    }
+
+    qemu_mod_timer(s->report_timer,
+                   s->report_slice_start + BALLOON_REPORT_SLICE_MS);
+}
+
+static void virtio_balloon_report_timer(void *opaque)
+{
+    VirtIOBalloon *s = opaque;
+
+    virtio_balloon_handle_report(&s->vdev, s->rvq);
+}
+
+static void virtio_balloon_reset(VirtIODevice *vdev)
+{
+    VirtIOBalloon *s = to_virtio_balloon(vdev);
+
+    qemu_del_timer(s->report_timer);
+    s->report_slice_start = 0;
+    s->report_slice_bytes = 0;
+}
+
+static bool virtio_balloon_free_page_hint(void *opaque, bool start)
+{
+    VirtIOBalloon *s = opaque;
+
+    if (start) {
+        uint32_t features = s->vdev.guest_features;
+
+        if (!(features & (1 << VIRTIO_BALLOON_F_FREE_PAGE_HINT))) {
+            return false;
+        }
+        /* ids below VIRTIO_BALLOON_CMD_ID_DONE are reserved */
+        s->free_page_cmd_id = MAX(s->free_page_cmd_id + 1,
+                                  VIRTIO_BALLOON_CMD_ID_DONE + 1);
+        s->free_page_hinting = true;
+    } else {
+        if (!s->free_page_hinting) {
+            return false;
+        }
+        s->free_page_cmd_id = VIRTIO_BALLOON_CMD_ID_DONE;
+        s->free_page_hinting = false;
+    }
+    s->free_page_reporting = false;
+    virtio_notify_config(&s->vdev);
+
+    return true;
+}
+
 static void virtio_balloon_get_config(VirtIODevice *vdev, uint8_t *config_data)
 {
     VirtIOBalloon *dev = to_virtio_balloon(vdev);
@@ -137,8 +330,9 @@ static void virtio_balloon_get_config(VirtIODevice *vdev, uint8_t *config_data)
 
     config.num_pages = cpu_to_le32(dev->num_pages);
     config.actual = cpu_to_le32(dev->actual);
+    config.free_page_hint_cmd_id = cpu_to_le32(dev->free_page_cmd_id);
 
-    memcpy(config_data, &config, 8);
+    memcpy(config_data, &config, vdev->config_len);
 }
 
 static void virtio_balloon_set_config(VirtIODevice *vdev,
@@ -147,7 +341,7 @@ static void virtio_balloon_set_config(VirtIODevice *vdev,
     VirtIOBalloon *dev = to_virtio_balloon(vdev);
     struct virtio_balloon_config config;
     uint32_t oldactual = dev->actual;
-    memcpy(&config, config_data, 8);
+    memcpy(&config, config_data, vdev->config_len);
     dev->actual = le32_to_cpu(config.actual);
     if (dev->actual != oldactual) {
         qemu_balloon_changed(ram_size -
@@ -157,7 +351,11 @@ static void virtio_balloon_set_config(VirtIODevice *vdev,
 
 static uint32_t virtio_balloon_get_features(VirtIODevice *vdev, uint32_t f)
 {
+    VirtIOBalloon *s = to_virtio_balloon(vdev);
+
     f |= (1 << VIRTIO_BALLOON_F_STATS_VQ);
+    f |= s->conf.features & (1 << VIRTIO_BALLOON_F_FREE_PAGE_HINT);
+    f |= s->conf.features & (1 << VIRTIO_BALLOON_F_REPORTING);
     return f;
 }
 
@@ -188,6 +386,13 @@ static void virtio_balloon_stat(void *opaque, BalloonInfo *info)
 
     info->actual = ram_size - ((uint64_t) dev->actual <<
                                VIRTIO_BALLOON_PFN_SHIFT);
+
+    if (dev->vdev.guest_features & (1 << VIRTIO_BALLOON_F_REPORTING)) {
+        info->has_free_page_reported = true;
+        info->free_page_reported = dev->free_page_reported;
+        info->has_free_page_reclaimed = true;
+        info->free_page_reclaimed = dev->free_page_reclaimed;
+    }
 }
 
 static void virtio_balloon_to_target(void *opaque, ram_addr_t target)
@@ -228,21 +433,32 @@ static int virtio_balloon_load(QEMUFile *f, void *opaque, int version_id)
 
     s->num_pages = qemu_get_be32(f);
     s->actual = qemu_get_be32(f);
+
+    /* reports held back on the source wait for the timer */
+    if (s->rvq) {
+        qemu_mod_timer(s->report_timer, qemu_get_clock_ms(vm_clock));
+    }
     return 0;
 }
 
-VirtIODevice *virtio_balloon_init(DeviceState *dev)
+VirtIODevice *virtio_balloon_init(DeviceState *dev, VirtIOBalloonConf *conf)
 {
     VirtIOBalloon *s;
+    size_t config_size = sizeof(struct virtio_balloon_config);
     int ret;
 
-    s = (VirtIOBalloon *)virtio_common_init("virtio-balloon",
-                                            VIRTIO_ID_BALLOON,
-                                            8, sizeof(VirtIOBalloon));
+    /* without free page hinting the config is what it was in QEMU 1.1 */
+    if (!(conf->features & (1 << VIRTIO_BALLOON_F_FREE_PAGE_HINT))) {
+        config_size = offsetof(struct virtio_balloon_config,
+                               free_page_hint_cmd_id);
+    }
+    s = (VirtIOBalloon *)virtio_common_init("virtio-balloon", VIRTIO_ID_BALLOON,
+                                     config_size, sizeof(VirtIOBalloon));
 
     s->vdev.get_config = virtio_balloon_get_config;
     s->vdev.set_config = virtio_balloon_set_config;
     s->vdev.get_features = virtio_balloon_get_features;
+    s->vdev.reset = virtio_balloon_reset;
 
     ret = qemu_add_balloon_handler(virtio_balloon_to_target,
                                    virtio_balloon_stat, s);
@@ -250,10 +466,23 @@ VirtIODevice *virtio_balloon_init(DeviceState *dev)
         virtio_cleanup(&s->vdev);
         return NULL;
     }
+    qemu_add_balloon_free_page_handler(virtio_balloon_free_page_hint, s);
 
     s->ivq = virtio_add_queue(&s->vdev, 128, virtio_balloon_handle_output);
     s->dvq = virtio_add_queue(&s->vdev, 128, virtio_balloon_handle_output);
     s->svq = virtio_add_queue(&s->vdev, 128, virtio_balloon_receive_stats);
+    if (conf->features & (1 << VIRTIO_BALLOON_F_FREE_PAGE_HINT)) {
+        s->fpvq = virtio_add_queue(&s->vdev, 128,
+                                   virtio_balloon_handle_free_page);
+    }
+    if (conf->features & (1 << VIRTIO_BALLOON_F_REPORTING)) {
+        s->rvq = virtio_add_queue(&s->vdev, 32,
+                                  virtio_balloon_handle_report);
+    }
+
+    s->conf = *conf;
+    s->report_timer = qemu_new_timer_ms(vm_clock,
+                                        virtio_balloon_report_timer, s);
 
     reset_stats(s);
 
@@ -268,6 +497,8 @@ void virtio_balloon_exit(VirtIODevice *vdev)
 {
     VirtIOBalloon *s = DO_UPCAST(VirtIOBalloon, vdev, vdev);
 
+    qemu_del_timer(s->report_timer);
+    qemu_free_timer(s->report_timer);
     qemu_remove_balloon_handler(s);
     unregister_savevm(s->qdev, "virtio-balloon", s);
     virtio_cleanup(vdev);
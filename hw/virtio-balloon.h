@@ -26,6 +26,12 @@
 /* The feature bitmap for virtio balloon */
 #define VIRTIO_BALLOON_F_MUST_TELL_HOST 0 /* Tell before reclaiming pages */
 #define VIRTIO_BALLOON_F_STATS_VQ 1       /* Memory stats virtqueue */
+#define VIRTIO_BALLOON_F_FREE_PAGE_HINT 3 /* Report free pages to the host */
+#define VIRTIO_BALLOON_F_REPORTING 5      /* Report freed chunks continuously */
+
+/* Special values of free_page_hint_cmd_id */
+#define VIRTIO_BALLOON_CMD_ID_STOP 0      /* Guest: no more hints */
+#define VIRTIO_BALLOON_CMD_ID_DONE 1      /* Host: stop hinting */
 
 /* Size of a PFN in the balloon interface. */
 #define VIRTIO_BALLOON_PFN_SHIFT 12
@@ -36,6 +42,8 @@ struct virtio_balloon_config
     uint32_t num_pages;
     /* Number of pages we've actually got in balloon. */
     uint32_t actual;
+    /* Free page hinting command, echoed by the guest before its hints. */
+    uint32_t free_page_hint_cmd_id;
 };
 
 /* Memory Statistics */
@@ -52,4 +60,11 @@ typedef struct VirtIOBalloonStat {
     uint64_t val;
 } QEMU_PACKED VirtIOBalloonStat;
 
+struct VirtIOBalloonConf {
+    /* MB/s of reported free memory returned to the host, 0 = no limit */
+    uint32_t report_rate;
+    /* optional features offered to the guest, off for old machine types */
+    uint32_t features;
+};
+
 #endif
@@ -15,7 +15,6 @@
 #include "virtio.h"
 #include "net.h"
 #include "net/checksum.h"
-#include "net/tap.h"
 #include "qemu-error.h"
 #include "qemu-timer.h"
 #include "virtio-net.h"
@@ -40,6 +39,16 @@ typedef struct VirtIONet
     uint32_t tx_timeout;
     int32_t tx_burst;
     int tx_waiting;
+    /* tx=adaptive */
+    bool tx_adaptive;
+    int32_t tx_inline_burst;
+    uint32_t tx_depth_avg;      /* 8 times the average depth at notifies */
+    struct {
+        uint64_t notifications;
+        uint64_t bursts;
+        uint64_t inline_bursts;
+        uint64_t packets;
+    } tx_stats;
     uint32_t has_vnet_hdr;
     uint8_t has_ufo;
     struct {
@@ -105,14 +114,9 @@ static bool virtio_net_started(VirtIONet *n, uint8_t status)
 
 static void virtio_net_vhost_status(VirtIONet *n, uint8_t status)
 {
-    if (!n->nic->nc.peer) {
-        return;
-    }
-    if (n->nic->nc.peer->info->type != NET_CLIENT_OPTIONS_KIND_TAP) {
-        return;
-    }
+    VHostNetState *net = get_vhost_net(n->nic->nc.peer);
 
-    if (!tap_get_vhost_net(n->nic->nc.peer)) {
+    if (!net) {
         return;
     }
     if (!!n->vhost_started == virtio_net_started(n, status) &&
@@ -121,10 +125,10 @@ static void virtio_net_vhost_status(VirtIONet *n, uint8_t status)
     }
     if (!n->vhost_started) {
         int r;
-        if (!vhost_net_query(tap_get_vhost_net(n->nic->nc.peer), &n->vdev)) {
+        if (!vhost_net_query(net, &n->vdev)) {
             return;
         }
-        r = vhost_net_start(tap_get_vhost_net(n->nic->nc.peer), &n->vdev);
+        r = vhost_net_start(net, &n->vdev);
         if (r < 0) {
             error_report("unable to start vhost net: %d: "
                          "falling back on userspace virtio", -r);
@@ -132,7 +136,7 @@ static void virtio_net_vhost_status(VirtIONet *n, uint8_t status)
             n->vhost_started = 1;
         }
     } else {
-        vhost_net_stop(tap_get_vhost_net(n->nic->nc.peer), &n->vdev);
+        vhost_net_stop(net, &n->vdev);
         n->vhost_started = 0;
     }
 }
@@ -205,10 +209,7 @@ static int peer_has_vnet_hdr(VirtIONet *n)
     if (!n->nic->nc.peer)
         return 0;
 
-    if (n->nic->nc.peer->info->type != NET_CLIENT_OPTIONS_KIND_TAP)
-        return 0;
-
-    n->has_vnet_hdr = tap_has_vnet_hdr(n->nic->nc.peer);
+    n->has_vnet_hdr = qemu_has_vnet_hdr(n->nic->nc.peer);
 
     return n->has_vnet_hdr;
 }
@@ -218,7 +219,7 @@ static int peer_has_ufo(VirtIONet *n)
     if (!peer_has_vnet_hdr(n))
         return 0;
 
-    n->has_ufo = tap_has_ufo(n->nic->nc.peer);
+    n->has_ufo = qemu_has_ufo(n->nic->nc.peer);
 
     return n->has_ufo;
 }
@@ -230,7 +231,7 @@ static uint32_t virtio_net_get_features(VirtIODevice *vdev, uint32_t features)
     features |= (1 << VIRTIO_NET_F_MAC);
 
     if (peer_has_vnet_hdr(n)) {
-        tap_using_vnet_hdr(n->nic->nc.peer, 1);
+        qemu_using_vnet_hdr(n->nic->nc.peer, 1);
     } else {
         features &= ~(0x1 << VIRTIO_NET_F_CSUM);
         features &= ~(0x1 << VIRTIO_NET_F_HOST_TSO4);
@@ -248,14 +249,10 @@ static uint32_t virtio_net_get_features(VirtIODevice *vdev, uint32_t features)
         features &= ~(0x1 << VIRTIO_NET_F_HOST_UFO);
     }
 
-    if (!n->nic->nc.peer ||
-        n->nic->nc.peer->info->type != NET_CLIENT_OPTIONS_KIND_TAP) {
-        return features;
-    }
-    if (!tap_get_vhost_net(n->nic->nc.peer)) {
+    if (!get_vhost_net(n->nic->nc.peer)) {
         return features;
     }
-    return vhost_net_get_features(tap_get_vhost_net(n->nic->nc.peer), features);
+    return vhost_net_get_features(get_vhost_net(n->nic->nc.peer), features);
 }
 
 static uint32_t virtio_net_bad_features(VirtIODevice *vdev)
@@ -280,21 +277,17 @@ static void virtio_net_set_features(VirtIODevice *vdev, uint32_t features)
     n->mergeable_rx_bufs = !!(features & (1 << VIRTIO_NET_F_MRG_RXBUF));
 
     if (n->has_vnet_hdr) {
-        tap_set_offload(n->nic->nc.peer,
-                        (features >> VIRTIO_NET_F_GUEST_CSUM) & 1,
-                        (features >> VIRTIO_NET_F_GUEST_TSO4) & 1,
-                        (features >> VIRTIO_NET_F_GUEST_TSO6) & 1,
-                        (features >> VIRTIO_NET_F_GUEST_ECN)  & 1,
-                        (features >> VIRTIO_NET_F_GUEST_UFO)  & 1);
+        qemu_set_offload(n->nic->nc.peer,
+                         (features >> VIRTIO_NET_F_GUEST_CSUM) & 1,
+                         (features >> VIRTIO_NET_F_GUEST_TSO4) & 1,
+                         (features >> VIRTIO_NET_F_GUEST_TSO6) & 1,
+                         (features >> VIRTIO_NET_F_GUEST_ECN)  & 1,
+                         (features >> VIRTIO_NET_F_GUEST_UFO)  & 1);
     }
-    if (!n->nic->nc.peer ||
-        n->nic->nc.peer->info->type != NET_CLIENT_OPTIONS_KIND_TAP) {
+    if (!get_vhost_net(n->nic->nc.peer)) {
         return;
     }
-    if (!tap_get_vhost_net(n->nic->nc.peer)) {
-        return;
-    }
-    vhost_net_ack_features(tap_get_vhost_net(n->nic->nc.peer), features);
+    vhost_net_ack_features(get_vhost_net(n->nic->nc.peer), features);
 }
 
 static int virtio_net_handle_rx_mode(VirtIONet *n, uint8_t cmd,
@@ -498,46 +491,44 @@ static int virtio_net_has_buffers(VirtIONet *n, int bufsize)
  * checksums.  This is terrible but it's better than hacking the guest
  * kernels.
  *
- * N.B. if we introduce a zero-copy API, this operation is no longer free so
- * we should provide a mechanism to disable it to avoid polluting the host
- * cache.
+ * Only the headers are looked at in place; a packet that needs the fix
+ * is first gathered into a buffer of its own.
  */
-static void work_around_broken_dhclient(struct virtio_net_hdr *hdr,
-                                        const uint8_t *buf, size_t size)
+static int is_broken_dhclient_packet(const struct virtio_net_hdr *hdr,
+                                     const uint8_t *buf, size_t size)
 {
-    if ((hdr->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) && /* missing csum */
+    return (hdr->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) && /* missing csum */
         (size > 27 && size < 1500) && /* normal sized MTU */
         (buf[12] == 0x08 && buf[13] == 0x00) && /* ethertype == IPv4 */
         (buf[23] == 17) && /* ip.protocol == UDP */
-        (buf[34] == 0 && buf[35] == 67)) { /* udp.srcport == bootps */
-        /* FIXME this cast is evil */
-        net_checksum_calculate((uint8_t *)buf, size);
-        hdr->flags &= ~VIRTIO_NET_HDR_F_NEEDS_CSUM;
-    }
+        (buf[34] == 0 && buf[35] == 67); /* udp.srcport == bootps */
+}
+
+static void work_around_broken_dhclient(struct virtio_net_hdr *hdr,
+                                        uint8_t *buf, size_t size)
+{
+    net_checksum_calculate(buf, size);
+    hdr->flags &= ~VIRTIO_NET_HDR_F_NEEDS_CSUM;
 }
 
-static int receive_header(VirtIONet *n, struct iovec *iov, int iovcnt,
-                          const void *buf, size_t size, size_t hdr_len)
+static void receive_header(VirtIONet *n, struct iovec *iov, int iovcnt,
+                           const struct virtio_net_hdr *host_hdr,
+                           size_t hdr_len)
 {
     struct virtio_net_hdr *hdr = (struct virtio_net_hdr *)iov[0].iov_base;
-    int offset = 0;
 
     hdr->flags = 0;
     hdr->gso_type = VIRTIO_NET_HDR_GSO_NONE;
 
     if (n->has_vnet_hdr) {
-        memcpy(hdr, buf, sizeof(*hdr));
-        offset = sizeof(*hdr);
-        work_around_broken_dhclient(hdr, buf + offset, size - offset);
+        memcpy(hdr, host_hdr, sizeof(*hdr));
     }
 
-    /* We only ever receive a struct virtio_net_hdr from the tapfd,
+    /* We only ever receive a struct virtio_net_hdr from the peer,
      * but we may be passing along a larger header to the guest.
      */
     iov[0].iov_base += hdr_len;
     iov[0].iov_len  -= hdr_len;
-
-    return offset;
 }
 
 static int receive_filter(VirtIONet *n, const uint8_t *buf, int size)
@@ -593,11 +584,36 @@ static int receive_filter(VirtIONet *n, const uint8_t *buf, int size)
     return 0;
 }
 
-static ssize_t virtio_net_receive(VLANClientState *nc, const uint8_t *buf, size_t size)
+/* Copy the packet in 'iov' from 'offset' on into the guest buffers 'sg' */
+static size_t receive_copy(struct iovec *sg, int sg_num,
+                           const struct iovec *iov, int iovcnt, size_t offset)
+{
+    size_t done = 0, len;
+    int j;
+
+    for (j = 0; j < sg_num; j++) {
+        len = iov_to_buf(iov, iovcnt, offset + done,
+                         sg[j].iov_base, sg[j].iov_len);
+        done += len;
+        if (len < sg[j].iov_len) {
+            break;
+        }
+    }
+    return done;
+}
+
+static ssize_t virtio_net_receive_iov(VLANClientState *nc,
+                                      const struct iovec *iov, int iovcnt)
 {
     VirtIONet *n = DO_UPCAST(NICState, nc, nc)->opaque;
     struct virtio_net_hdr_mrg_rxbuf *mhdr = NULL;
     size_t guest_hdr_len, offset, i, host_hdr_len;
+    size_t size = iov_size(iov, iovcnt);
+    /* the vnet header and as much of the frame as the filters look at */
+    uint8_t head[sizeof(struct virtio_net_hdr) + 36];
+    struct virtio_net_hdr host_hdr;
+    uint8_t dhcp_buf[sizeof(struct virtio_net_hdr) + 1500];
+    struct iovec dhcp_iov;
 
     if (!virtio_net_can_receive(&n->nic->nc))
         return -1;
@@ -611,9 +627,25 @@ static ssize_t virtio_net_receive(VLANClientState *nc, const uint8_t *buf, size_
     if (!virtio_net_has_buffers(n, size + guest_hdr_len - host_hdr_len))
         return 0;
 
-    if (!receive_filter(n, buf, size))
+    memset(head, 0, sizeof(head));
+    iov_to_buf(iov, iovcnt, 0, head, sizeof(head));
+    memcpy(&host_hdr, head, sizeof(host_hdr));
+
+    if (!receive_filter(n, head, size))
         return size;
 
+    if (n->has_vnet_hdr &&
+        is_broken_dhclient_packet(&host_hdr, head + host_hdr_len,
+                                  size - host_hdr_len)) {
+        iov_to_buf(iov, iovcnt, 0, dhcp_buf, size);
+        work_around_broken_dhclient(&host_hdr, dhcp_buf + host_hdr_len,
+                                    size - host_hdr_len);
+        dhcp_iov.iov_base = dhcp_buf;
+        dhcp_iov.iov_len = size;
+        iov = &dhcp_iov;
+        iovcnt = 1;
+    }
+
     offset = i = 0;
 
     while (offset < size) {
@@ -650,14 +682,13 @@ static ssize_t virtio_net_receive(VLANClientState *nc, const uint8_t *buf, size_
             if (n->mergeable_rx_bufs)
                 mhdr = (struct virtio_net_hdr_mrg_rxbuf *)sg[0].iov_base;
 
-            offset += receive_header(n, sg, elem.in_num,
-                                     buf + offset, size - offset, guest_hdr_len);
+            receive_header(n, sg, elem.in_num, &host_hdr, guest_hdr_len);
+            offset += host_hdr_len;
             total += guest_hdr_len;
         }
 
         /* copy in packet.  ugh */
-        len = iov_from_buf(sg, elem.in_num, 0,
-                           buf + offset, size - offset);
+        len = receive_copy(sg, elem.in_num, iov, iovcnt, offset);
         total += len;
         offset += len;
         /* If buffers can't be merged, at this point we
@@ -688,11 +719,23 @@ static ssize_t virtio_net_receive(VLANClientState *nc, const uint8_t *buf, size_
     return size;
 }
 
-static int32_t virtio_net_flush_tx(VirtIONet *n, VirtQueue *vq);
+static ssize_t virtio_net_receive(VLANClientState *nc, const uint8_t *buf, size_t size)
+{
+    struct iovec iov = {
+        .iov_base = (uint8_t *)buf,
+        .iov_len = size,
+    };
+
+    return virtio_net_receive_iov(nc, &iov, 1);
+}
+
+static int32_t virtio_net_flush_tx(VirtIONet *n, VirtQueue *vq,
+                                   int32_t burst);
 
 static void virtio_net_tx_complete(VLANClientState *nc, ssize_t len)
 {
     VirtIONet *n = DO_UPCAST(NICState, nc, nc)->opaque;
+    int32_t ret;
 
     virtqueue_push(n->tx_vq, &n->async_tx.elem, n->async_tx.len);
     virtio_notify(&n->vdev, n->tx_vq);
@@ -700,11 +743,19 @@ static void virtio_net_tx_complete(VLANClientState *nc, ssize_t len)
     n->async_tx.elem.out_num = n->async_tx.len = 0;
 
     virtio_queue_set_notification(n->tx_vq, 1);
-    virtio_net_flush_tx(n, n->tx_vq);
+    ret = virtio_net_flush_tx(n, n->tx_vq, n->tx_burst);
+
+    /* the guest may not notify again for what is left */
+    if (n->tx_adaptive && ret >= n->tx_burst && !n->tx_waiting) {
+        virtio_queue_set_notification(n->tx_vq, 0);
+        n->tx_waiting = 1;
+        qemu_bh_schedule(n->tx_bh);
+    }
 }
 
 /* TX */
-static int32_t virtio_net_flush_tx(VirtIONet *n, VirtQueue *vq)
+static int32_t virtio_net_flush_tx(VirtIONet *n, VirtQueue *vq,
+                                   int32_t burst)
 {
     VirtQueueElement elem;
     int32_t num_packets = 0;
@@ -749,6 +800,10 @@ static int32_t virtio_net_flush_tx(VirtIONet *n, VirtQueue *vq)
 
         ret = qemu_sendv_packet_async(&n->nic->nc, out_sg, out_num,
                                       virtio_net_tx_complete);
+        if (num_packets == 0) {
+            n->tx_stats.bursts++;
+        }
+        n->tx_stats.packets++;
         if (ret == 0) {
             virtio_queue_set_notification(n->tx_vq, 0);
             n->async_tx.elem = elem;
@@ -761,7 +816,7 @@ static int32_t virtio_net_flush_tx(VirtIONet *n, VirtQueue *vq)
         virtqueue_push(vq, &elem, len);
         virtio_notify(&n->vdev, vq);
 
-        if (++num_packets >= n->tx_burst) {
+        if (++num_packets >= burst) {
             break;
         }
     }
@@ -772,6 +827,8 @@ static void virtio_net_handle_tx_timer(VirtIODevice *vdev, VirtQueue *vq)
 {
     VirtIONet *n = to_virtio_net(vdev);
 
+    n->tx_stats.notifications++;
+
     /* This happens when device was stopped but VCPU wasn't. */
     if (!n->vdev.vm_running) {
         n->tx_waiting = 1;
@@ -782,7 +839,7 @@ static void virtio_net_handle_tx_timer(VirtIODevice *vdev, VirtQueue *vq)
         virtio_queue_set_notification(vq, 1);
         qemu_del_timer(n->tx_timer);
         n->tx_waiting = 0;
-        virtio_net_flush_tx(n, vq);
+        virtio_net_flush_tx(n, vq, n->tx_burst);
     } else {
         qemu_mod_timer(n->tx_timer,
                        qemu_get_clock_ns(vm_clock) + n->tx_timeout);
@@ -795,6 +852,7 @@ static void virtio_net_handle_tx_bh(VirtIODevice *vdev, VirtQueue *vq)
 {
     VirtIONet *n = to_virtio_net(vdev);
 
+    n->tx_stats.notifications++;
     if (unlikely(n->tx_waiting)) {
         return;
     }
@@ -807,6 +865,54 @@ static void virtio_net_handle_tx_bh(VirtIODevice *vdev, VirtQueue *vq)
     qemu_bh_schedule(n->tx_bh);
 }
 
+/*
+ * Follow the depth of the queue at notifies with a moving average, and
+ * let the notify flush twice that.  Request/response traffic, which
+ * queues a packet or two, is then sent without leaving the notify, while
+ * the vCPU is held up for a bounded number of packets at most.
+ */
+static void virtio_net_tune_tx_burst(VirtIONet *n, int depth)
+{
+    int32_t burst;
+
+    n->tx_depth_avg += depth - (n->tx_depth_avg >> 3);
+    burst = MAX(n->tx_depth_avg >> 2, TX_INLINE_BURST_MIN);
+    n->tx_inline_burst = MIN(burst, MIN(TX_INLINE_BURST_MAX, n->tx_burst));
+}
+
+static void virtio_net_handle_tx_adaptive(VirtIODevice *vdev, VirtQueue *vq)
+{
+    VirtIONet *n = to_virtio_net(vdev);
+    int32_t ret;
+
+    n->tx_stats.notifications++;
+    if (unlikely(n->tx_waiting)) {
+        return;
+    }
+    /* This happens when device was stopped but VCPU wasn't. */
+    if (!n->vdev.vm_running) {
+        n->tx_waiting = 1;
+        return;
+    }
+
+    virtio_net_tune_tx_burst(n, virtqueue_avail_count(vq));
+    ret = virtio_net_flush_tx(n, vq, n->tx_inline_burst);
+    if (ret == -EBUSY) {
+        return; /* Notification re-enable handled by tx_complete */
+    }
+    if (ret > 0) {
+        n->tx_stats.inline_bursts++;
+    }
+
+    /* More than a burst was queued: the guest is streaming, so batch the
+     * rest in the bottom half until the queue drains */
+    if (ret >= n->tx_inline_burst) {
+        virtio_queue_set_notification(vq, 0);
+        n->tx_waiting = 1;
+        qemu_bh_schedule(n->tx_bh);
+    }
+}
+
 static void virtio_net_tx_timer(void *opaque)
 {
     VirtIONet *n = opaque;
@@ -819,7 +925,7 @@ static void virtio_net_tx_timer(void *opaque)
         return;
 
     virtio_queue_set_notification(n->tx_vq, 1);
-    virtio_net_flush_tx(n, n->tx_vq);
+    virtio_net_flush_tx(n, n->tx_vq, n->tx_burst);
 }
 
 static void virtio_net_tx_bh(void *opaque)
@@ -835,7 +941,7 @@ static void virtio_net_tx_bh(void *opaque)
     if (unlikely(!(n->vdev.status & VIRTIO_CONFIG_S_DRIVER_OK)))
         return;
 
-    ret = virtio_net_flush_tx(n, n->tx_vq);
+    ret = virtio_net_flush_tx(n, n->tx_vq, n->tx_burst);
     if (ret == -EBUSY) {
         return; /* Notification re-enable handled by tx_complete */
     }
@@ -852,7 +958,7 @@ static void virtio_net_tx_bh(void *opaque)
      * anything that may have come in while we weren't looking.  If
      * we find something, assume the guest is still active and reschedule */
     virtio_queue_set_notification(n->tx_vq, 1);
-    if (virtio_net_flush_tx(n, n->tx_vq) > 0) {
+    if (virtio_net_flush_tx(n, n->tx_vq, n->tx_burst) > 0) {
         virtio_queue_set_notification(n->tx_vq, 0);
         qemu_bh_schedule(n->tx_bh);
         n->tx_waiting = 1;
@@ -941,8 +1047,8 @@ static int virtio_net_load(QEMUFile *f, void *opaque, int version_id)
         }
 
         if (n->has_vnet_hdr) {
-            tap_using_vnet_hdr(n->nic->nc.peer, 1);
-            tap_set_offload(n->nic->nc.peer,
+            qemu_using_vnet_hdr(n->nic->nc.peer, 1);
+            qemu_set_offload(n->nic->nc.peer,
                     (n->vdev.guest_features >> VIRTIO_NET_F_GUEST_CSUM) & 1,
                     (n->vdev.guest_features >> VIRTIO_NET_F_GUEST_TSO4) & 1,
                     (n->vdev.guest_features >> VIRTIO_NET_F_GUEST_TSO6) & 1,
@@ -992,10 +1098,43 @@ static NetClientInfo net_virtio_info = {
     .size = sizeof(NICState),
     .can_receive = virtio_net_can_receive,
     .receive = virtio_net_receive,
+    .receive_iov = virtio_net_receive_iov,
         .cleanup = virtio_net_cleanup,
     .link_status_changed = virtio_net_set_link_status,
 };
 
+static void virtio_net_get_tx_stat(Object *obj, Visitor *v, void *opaque,
+                                   const char *name, Error **errp)
+{
+    int64_t value = *(uint64_t *)opaque;
+
+    visit_type_int(v, &value, name, errp);
+}
+
+static void virtio_net_get_tx_packets_per_burst(Object *obj, Visitor *v,
+                                                void *opaque,
+                                                const char *name,
+                                                Error **errp)
+{
+    VirtIONet *n = opaque;
+    int64_t value = 0;
+
+    if (n->tx_stats.bursts) {
+        value = n->tx_stats.packets / n->tx_stats.bursts;
+    }
+    visit_type_int(v, &value, name, errp);
+}
+
+static void virtio_net_get_tx_inline_burst(Object *obj, Visitor *v,
+                                           void *opaque, const char *name,
+                                           Error **errp)
+{
+    VirtIONet *n = opaque;
+    int64_t value = n->tx_adaptive ? n->tx_inline_burst : 0;
+
+    visit_type_int(v, &value, name, errp);
+}
+
 VirtIODevice *virtio_net_init(DeviceState *dev, NICConf *conf,
                               virtio_net_conf *net)
 {
@@ -1014,9 +1153,10 @@ VirtIODevice *virtio_net_init(DeviceState *dev, NICConf *conf,
     n->vdev.set_status = virtio_net_set_status;
     n->rx_vq = virtio_add_queue(&n->vdev, 256, virtio_net_handle_rx);
 
-    if (net->tx && strcmp(net->tx, "timer") && strcmp(net->tx, "bh")) {
-        error_report("virtio-net: "
-                     "Unknown option tx=%s, valid options: \"timer\" \"bh\"",
+    if (net->tx && strcmp(net->tx, "timer") && strcmp(net->tx, "bh") &&
+        strcmp(net->tx, "adaptive")) {
+        error_report("virtio-net: Unknown option tx=%s, "
+                     "valid options: \"timer\" \"bh\" \"adaptive\"",
                      net->tx);
         error_report("Defaulting to \"bh\"");
     }
@@ -1025,6 +1165,11 @@ VirtIODevice *virtio_net_init(DeviceState *dev, NICConf *conf,
         n->tx_vq = virtio_add_queue(&n->vdev, 256, virtio_net_handle_tx_timer);
         n->tx_timer = qemu_new_timer_ns(vm_clock, virtio_net_tx_timer, n);
         n->tx_timeout = net->txtimer;
+    } else if (net->tx && !strcmp(net->tx, "adaptive")) {
+        n->tx_vq = virtio_add_queue(&n->vdev, 256,
+                                    virtio_net_handle_tx_adaptive);
+        n->tx_bh = qemu_bh_new(virtio_net_tx_bh, n);
+        n->tx_adaptive = true;
     } else {
         n->tx_vq = virtio_add_queue(&n->vdev, 256, virtio_net_handle_tx_bh);
         n->tx_bh = qemu_bh_new(virtio_net_tx_bh, n);
@@ -1040,6 +1185,7 @@ VirtIODevice *virtio_net_init(DeviceState *dev, NICConf *conf,
 
     n->tx_waiting = 0;
     n->tx_burst = net->txburst;
+    virtio_net_tune_tx_burst(n, 0);
     n->mergeable_rx_bufs = 0;
     n->promisc = 1; /* for compatibility */
 
@@ -1053,6 +1199,24 @@ VirtIODevice *virtio_net_init(DeviceState *dev, NICConf *conf,
 
     add_boot_device_path(conf->bootindex, dev, "/ethernet-phy@0");
 
+    object_property_add(OBJECT(dev), "tx-notifications", "int",
+                        virtio_net_get_tx_stat, NULL, NULL,
+                        &n->tx_stats.notifications, NULL);
+    object_property_add(OBJECT(dev), "tx-bursts", "int",
+                        virtio_net_get_tx_stat, NULL, NULL,
+                        &n->tx_stats.bursts, NULL);
+    object_property_add(OBJECT(dev), "tx-inline-bursts", "int",
+                        virtio_net_get_tx_stat, NULL, NULL,
+                        &n->tx_stats.inline_bursts, NULL);
+    object_property_add(OBJECT(dev), "tx-packets", "int",
+                        virtio_net_get_tx_stat, NULL, NULL,
+                        &n->tx_stats.packets, NULL);
+    object_property_add(OBJECT(dev), "tx-packets-per-burst", "int",
+                        virtio_net_get_tx_packets_per_burst, NULL, NULL,
+                        n, NULL);
+    object_property_add(OBJECT(dev), "tx-inline-burst", "int",
+                        virtio_net_get_tx_inline_burst, NULL, NULL, n, NULL);
+
     return &n->vdev;
 }
 
@@ -1067,6 +1231,13 @@ void virtio_net_exit(VirtIODevice *vdev)
 
     unregister_savevm(n->qdev, "virtio-net", n);
 
+    object_property_del(OBJECT(n->qdev), "tx-notifications", NULL);
+    object_property_del(OBJECT(n->qdev), "tx-bursts", NULL);
+    object_property_del(OBJECT(n->qdev), "tx-inline-bursts", NULL);
+    object_property_del(OBJECT(n->qdev), "tx-packets", NULL);
+    object_property_del(OBJECT(n->qdev), "tx-packets-per-burst", NULL);
+    object_property_del(OBJECT(n->qdev), "tx-inline-burst", NULL);
+
     g_free(n->mac_table.macs);
     g_free(n->vlans);
 
@@ -56,6 +56,12 @@
  * and latency. */
 #define TX_BURST 256
 
+/* With tx=adaptive the notify flushes up to twice the average depth of
+ * the TX queue itself, within these bounds and x-txburst.  A full inline
+ * burst hands the queue to the bottom half until it drains. */
+#define TX_INLINE_BURST_MIN 8
+#define TX_INLINE_BURST_MAX 64
+
 typedef struct virtio_net_conf
 {
     uint32_t txtimer;
@@ -123,6 +123,19 @@ static void virtio_pci_save_queue(void * opaque, int n, QEMUFile *f)
         qemu_put_be16(f, virtio_queue_vector(proxy->vdev, n));
 }
 
+/* Mark @vector as used and give it an irqfd, so that KVM injects the
+ * vectors raised by the device model without a synchronous ioctl.  Only
+ * the vectors that the guest assigns cost a descriptor and a route.  */
+static int virtio_pci_vector_use(VirtIOPCIProxy *proxy, unsigned vector)
+{
+    int ret = msix_vector_use(&proxy->pci_dev, vector);
+
+    if (ret == 0) {
+        msix_vector_irqfd(&proxy->pci_dev, vector);
+    }
+    return ret;
+}
+
 static int virtio_pci_load_config(void * opaque, QEMUFile *f)
 {
     VirtIOPCIProxy *proxy = opaque;
@@ -138,7 +151,7 @@ static int virtio_pci_load_config(void * opaque, QEMUFile *f)
         proxy->vdev->config_vector = VIRTIO_NO_VECTOR;
     }
     if (proxy->vdev->config_vector != VIRTIO_NO_VECTOR) {
-        return msix_vector_use(&proxy->pci_dev, proxy->vdev->config_vector);
+        return virtio_pci_vector_use(proxy, proxy->vdev->config_vector);
     }
     return 0;
 }
@@ -154,7 +167,7 @@ static int virtio_pci_load_queue(void * opaque, int n, QEMUFile *f)
     }
     virtio_queue_set_vector(proxy->vdev, n, vector);
     if (vector != VIRTIO_NO_VECTOR) {
-        return msix_vector_use(&proxy->pci_dev, vector);
+        return virtio_pci_vector_use(proxy, vector);
     }
     return 0;
 }
@@ -205,7 +218,9 @@ static void virtio_pci_start_ioeventfd(VirtIOPCIProxy *proxy)
             goto assign_error;
         }
     }
+    qemu_mutex_lock(&proxy->notify_lock);
     proxy->ioeventfd_started = true;
+    qemu_mutex_unlock(&proxy->notify_lock);
     return;
 
 assign_error:
@@ -230,6 +245,11 @@ static void virtio_pci_stop_ioeventfd(VirtIOPCIProxy *proxy)
         return;
     }
 
+    /* No lockless notify may use the notifiers once they are released. */
+    qemu_mutex_lock(&proxy->notify_lock);
+    proxy->ioeventfd_started = false;
+    qemu_mutex_unlock(&proxy->notify_lock);
+
     for (n = 0; n < VIRTIO_PCI_QUEUE_MAX; n++) {
         if (!virtio_queue_get_num(proxy->vdev, n)) {
             continue;
@@ -238,7 +258,6 @@ static void virtio_pci_stop_ioeventfd(VirtIOPCIProxy *proxy)
         r = virtio_pci_set_host_notifier_internal(proxy, n, false);
         assert(r >= 0);
     }
-    proxy->ioeventfd_started = false;
 }
 
 void virtio_pci_reset(DeviceState *d)
@@ -309,7 +328,7 @@ static void virtio_ioport_write(void *opaque, uint32_t addr, uint32_t val)
     case VIRTIO_MSI_CONFIG_VECTOR:
         msix_vector_unuse(&proxy->pci_dev, vdev->config_vector);
         /* Make it possible for guest to discover an error took place. */
-        if (msix_vector_use(&proxy->pci_dev, val) < 0)
+        if (virtio_pci_vector_use(proxy, val) < 0)
             val = VIRTIO_NO_VECTOR;
         vdev->config_vector = val;
         break;
@@ -317,7 +336,7 @@ static void virtio_ioport_write(void *opaque, uint32_t addr, uint32_t val)
         msix_vector_unuse(&proxy->pci_dev,
                           virtio_queue_vector(vdev, vdev->queue_sel));
         /* Make it possible for guest to discover an error took place. */
-        if (msix_vector_use(&proxy->pci_dev, val) < 0)
+        if (virtio_pci_vector_use(proxy, val) < 0)
             val = VIRTIO_NO_VECTOR;
         virtio_queue_set_vector(vdev, vdev->queue_sel, val);
         break;
@@ -469,8 +488,34 @@ static const MemoryRegionPortio virtio_portio[] = {
     PORTIO_END_OF_LIST()
 };
 
+/* Queue notifies that reach userspace while ioeventfd is active, for
+ * example when the guest uses an access size the kernel does not match,
+ * only need to signal the host notifier.  */
+static bool virtio_pci_config_write_nolock(void *opaque,
+                                           target_phys_addr_t addr,
+                                           uint64_t val, unsigned size)
+{
+    VirtIOPCIProxy *proxy = opaque;
+    bool ret = false;
+
+    if (addr != VIRTIO_PCI_QUEUE_NOTIFY || val >= VIRTIO_PCI_QUEUE_MAX) {
+        return false;
+    }
+
+    qemu_mutex_lock(&proxy->notify_lock);
+    if (proxy->ioeventfd_started && virtio_queue_get_num(proxy->vdev, val)) {
+        VirtQueue *vq = virtio_get_queue(proxy->vdev, val);
+
+        event_notifier_set(virtio_queue_get_host_notifier(vq));
+        ret = true;
+    }
+    qemu_mutex_unlock(&proxy->notify_lock);
+    return ret;
+}
+
 static const MemoryRegionOps virtio_pci_config_ops = {
     .old_portio = virtio_portio,
+    .write_nolock = virtio_pci_config_write_nolock,
     .endianness = DEVICE_LITTLE_ENDIAN,
 };
 
@@ -722,6 +767,7 @@ void virtio_init_pci(VirtIOPCIProxy *proxy, VirtIODevice *vdev)
     uint32_t size;
 
     proxy->vdev = vdev;
+    qemu_mutex_init(&proxy->notify_lock);
 
     config = proxy->pci_dev.config;
 
@@ -861,7 +907,7 @@ static int virtio_balloon_init_pci(PCIDevice *pci_dev)
         proxy->class_code = PCI_CLASS_OTHERS;
     }
 
-    vdev = virtio_balloon_init(&pci_dev->qdev);
+    vdev = virtio_balloon_init(&pci_dev->qdev, &proxy->balloon);
     if (!vdev) {
         return -1;
     }
@@ -982,6 +1028,12 @@ static TypeInfo virtio_serial_info = {
 static Property virtio_balloon_properties[] = {
     DEFINE_VIRTIO_COMMON_FEATURES(VirtIOPCIProxy, host_features),
     DEFINE_PROP_HEX32("class", VirtIOPCIProxy, class_code, 0),
+    DEFINE_PROP_UINT32("free-page-report-rate", VirtIOPCIProxy,
+                       balloon.report_rate, 1024),
+    DEFINE_PROP_BIT("free-page-hint", VirtIOPCIProxy, balloon.features,
+                    VIRTIO_BALLOON_F_FREE_PAGE_HINT, true),
+    DEFINE_PROP_BIT("free-page-reporting", VirtIOPCIProxy, balloon.features,
+                    VIRTIO_BALLOON_F_REPORTING, true),
     DEFINE_PROP_END_OF_LIST(),
 };
 
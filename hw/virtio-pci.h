@@ -19,6 +19,8 @@
 #include "virtio-net.h"
 #include "virtio-serial.h"
 #include "virtio-scsi.h"
+#include "virtio-balloon.h"
+#include "qemu-thread.h"
 
 /* Performance improves when virtqueue kick processing is decoupled from the
  * vcpu thread using ioeventfd for some devices. */
@@ -46,8 +48,10 @@ typedef struct {
     virtio_serial_conf serial;
     virtio_net_conf net;
     VirtIOSCSIConf scsi;
+    VirtIOBalloonConf balloon;
     bool ioeventfd_disabled;
     bool ioeventfd_started;
+    QemuMutex notify_lock;  /* ioeventfd_started vs. lockless notifies */
     VirtIOIRQFD *vector_irqfd;
 } VirtIOPCIProxy;
 
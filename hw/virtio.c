@@ -17,6 +17,9 @@
 #include "qemu-error.h"
 #include "virtio.h"
 #include "qemu-barrier.h"
+#include "memory.h"
+#include "exec-memory.h"
+#include "xen.h"
 
 /* The alignment to use between consumer and producer parts of vring.
  * x86 pagesize again. */
@@ -58,9 +61,22 @@ typedef struct VRing
     target_phys_addr_t used;
 } VRing;
 
+/* Host mappings of the rings, NULL for parts that are not plain RAM.  They
+ * are valid as long as gen matches vring_map_gen, which changes with the
+ * memory topology.  */
+typedef struct VRingMap
+{
+    unsigned int gen;
+    VRingDesc *desc;
+    VRingAvail *avail;
+    VRingUsed *used;
+    ram_addr_t used_ram_addr;
+} VRingMap;
+
 struct VirtQueue
 {
     VRing vring;
+    VRingMap map;
     target_phys_addr_t pa;
     uint16_t last_avail_idx;
     /* Last used index value we have signalled on */
@@ -81,63 +97,159 @@ struct VirtQueue
     EventNotifier host_notifier;
 };
 
-/* virt queue functions */
-static void virtqueue_init(VirtQueue *vq)
+static unsigned int vring_map_gen = 1;
+static bool vring_map_registered;
+
+static void vring_map_invalidate(MemoryListener *listener,
+                                 MemoryRegionSection *section)
 {
-    target_phys_addr_t pa = vq->pa;
+    if (++vring_map_gen == 0) {
+        vring_map_gen = 1;
+    }
+}
 
-    vq->vring.desc = pa;
-    vq->vring.avail = pa + vq->vring.num * sizeof(VRingDesc);
-    vq->vring.used = vring_align(vq->vring.avail +
-                                 offsetof(VRingAvail, ring[vq->vring.num]),
-                                 VIRTIO_PCI_VRING_ALIGN);
+static void vring_map_nop(MemoryListener *listener)
+{
 }
 
-static inline uint64_t vring_desc_addr(target_phys_addr_t desc_pa, int i)
+static void vring_map_section_nop(MemoryListener *listener,
+                                  MemoryRegionSection *section)
 {
-    target_phys_addr_t pa;
-    pa = desc_pa + sizeof(VRingDesc) * i + offsetof(VRingDesc, addr);
-    return ldq_phys(pa);
 }
 
-static inline uint32_t vring_desc_len(target_phys_addr_t desc_pa, int i)
+static void vring_map_eventfd_nop(MemoryListener *listener,
+                                  MemoryRegionSection *section,
+                                  bool match_data, uint64_t data,
+                                  EventNotifier *e)
 {
-    target_phys_addr_t pa;
-    pa = desc_pa + sizeof(VRingDesc) * i + offsetof(VRingDesc, len);
-    return ldl_phys(pa);
 }
 
-static inline uint16_t vring_desc_flags(target_phys_addr_t desc_pa, int i)
+static MemoryListener vring_map_listener = {
+    .begin = vring_map_nop,
+    .commit = vring_map_nop,
+    .region_add = vring_map_invalidate,
+    .region_del = vring_map_invalidate,
+    .region_nop = vring_map_section_nop,
+    .log_start = vring_map_section_nop,
+    .log_stop = vring_map_section_nop,
+    .log_sync = vring_map_section_nop,
+    .log_global_start = vring_map_nop,
+    .log_global_stop = vring_map_nop,
+    .eventfd_add = vring_map_eventfd_nop,
+    .eventfd_del = vring_map_eventfd_nop,
+    .priority = 10,
+};
+
+/* Host pointer to len bytes of guest RAM at pa, or NULL.  */
+static void *vring_map_range(target_phys_addr_t pa, target_phys_addr_t len,
+                             bool is_write, ram_addr_t *ram_addr)
 {
-    target_phys_addr_t pa;
-    pa = desc_pa + sizeof(VRingDesc) * i + offsetof(VRingDesc, flags);
-    return lduw_phys(pa);
+    MemoryRegionSection section;
+
+    if (xen_enabled()) {
+        return NULL;
+    }
+    section = memory_region_find(get_system_memory(), pa, len);
+    if (!section.size || section.size != len ||
+        !memory_region_is_ram(section.mr) ||
+        (is_write && section.readonly)) {
+        return NULL;
+    }
+    if (ram_addr) {
+        *ram_addr = memory_region_get_ram_addr(section.mr) +
+                    section.offset_within_region;
+    }
+    return memory_region_get_ram_ptr(section.mr) +
+           section.offset_within_region;
 }
 
-static inline uint16_t vring_desc_next(target_phys_addr_t desc_pa, int i)
+static VRingMap *vring_map(VirtQueue *vq)
 {
-    target_phys_addr_t pa;
-    pa = desc_pa + sizeof(VRingDesc) * i + offsetof(VRingDesc, next);
-    return lduw_phys(pa);
+    VRingMap *map = &vq->map;
+    unsigned int num = vq->vring.num;
+
+    if (likely(map->gen == vring_map_gen)) {
+        return map;
+    }
+
+    map->gen = vring_map_gen;
+    map->desc = vring_map_range(vq->vring.desc, num * sizeof(VRingDesc),
+                                false, NULL);
+    /* the avail ring is followed by used_event, the used ring by
+     * avail_event */
+    map->avail = vring_map_range(vq->vring.avail,
+                                 offsetof(VRingAvail, ring[num + 1]),
+                                 false, NULL);
+    map->used = vring_map_range(vq->vring.used,
+                                offsetof(VRingUsed, ring[num]) +
+                                sizeof(uint16_t),
+                                true, &map->used_ram_addr);
+    return map;
+}
+
+/* virt queue functions */
+static void virtqueue_init(VirtQueue *vq)
+{
+    target_phys_addr_t pa = vq->pa;
+
+    vq->vring.desc = pa;
+    vq->vring.avail = pa + vq->vring.num * sizeof(VRingDesc);
+    vq->vring.used = vring_align(vq->vring.avail +
+                                 offsetof(VRingAvail, ring[vq->vring.num]),
+                                 VIRTIO_PCI_VRING_ALIGN);
+    vq->map.gen = 0;
+}
+
+/* Read descriptor i of the table at desc_pa, mapped at table if not NULL.
+ * The whole descriptor is copied at once, so the guest cannot change it
+ * while it is being parsed.  */
+static void vring_desc_read(VRingDesc *table, target_phys_addr_t desc_pa,
+                            int i, VRingDesc *desc)
+{
+    if (likely(table)) {
+        *desc = table[i];
+    } else {
+        cpu_physical_memory_read(desc_pa + sizeof(VRingDesc) * i,
+                                 desc, sizeof(VRingDesc));
+    }
+    desc->addr = tswap64(desc->addr);
+    desc->len = tswap32(desc->len);
+    desc->flags = tswap16(desc->flags);
+    desc->next = tswap16(desc->next);
 }
 
 static inline uint16_t vring_avail_flags(VirtQueue *vq)
 {
+    VRingMap *map = vring_map(vq);
     target_phys_addr_t pa;
+
+    if (likely(map->avail)) {
+        return lduw_p(&map->avail->flags);
+    }
     pa = vq->vring.avail + offsetof(VRingAvail, flags);
     return lduw_phys(pa);
 }
 
 static inline uint16_t vring_avail_idx(VirtQueue *vq)
 {
+    VRingMap *map = vring_map(vq);
     target_phys_addr_t pa;
+
+    if (likely(map->avail)) {
+        return lduw_p(&map->avail->idx);
+    }
     pa = vq->vring.avail + offsetof(VRingAvail, idx);
     return lduw_phys(pa);
 }
 
 static inline uint16_t vring_avail_ring(VirtQueue *vq, int i)
 {
+    VRingMap *map = vring_map(vq);
     target_phys_addr_t pa;
+
+    if (likely(map->avail)) {
+        return lduw_p(&map->avail->ring[i]);
+    }
     pa = vq->vring.avail + offsetof(VRingAvail, ring[i]);
     return lduw_phys(pa);
 }
@@ -147,56 +259,87 @@ static inline uint16_t vring_used_event(VirtQueue *vq)
     return vring_avail_ring(vq, vq->vring.num);
 }
 
-static inline void vring_used_ring_id(VirtQueue *vq, int i, uint32_t val)
+static inline void vring_used_ring_write(VirtQueue *vq, int i,
+                                         uint32_t id, uint32_t len)
 {
+    VRingMap *map = vring_map(vq);
     target_phys_addr_t pa;
+
+    if (likely(map->used)) {
+        stl_p(&map->used->ring[i].id, id);
+        stl_p(&map->used->ring[i].len, len);
+        qemu_ram_set_dirty(map->used_ram_addr +
+                           offsetof(VRingUsed, ring[i]),
+                           sizeof(VRingUsedElem));
+        return;
+    }
     pa = vq->vring.used + offsetof(VRingUsed, ring[i].id);
-    stl_phys(pa, val);
+    stl_phys(pa, id);
+    pa = vq->vring.used + offsetof(VRingUsed, ring[i].len);
+    stl_phys(pa, len);
 }
 
-static inline void vring_used_ring_len(VirtQueue *vq, int i, uint32_t val)
+static uint16_t vring_used_idx(VirtQueue *vq)
 {
+    VRingMap *map = vring_map(vq);
     target_phys_addr_t pa;
-    pa = vq->vring.used + offsetof(VRingUsed, ring[i].len);
-    stl_phys(pa, val);
+
+    if (likely(map->used)) {
+        return lduw_p(&map->used->idx);
+    }
+    pa = vq->vring.used + offsetof(VRingUsed, idx);
+    return lduw_phys(pa);
 }
 
-static uint16_t vring_used_idx(VirtQueue *vq)
+/* Store a 16-bit field at offset of the used ring.  */
+static inline void vring_used_stw(VirtQueue *vq, target_phys_addr_t offset,
+                                  uint16_t val)
+{
+    VRingMap *map = vring_map(vq);
+
+    if (likely(map->used)) {
+        stw_p((uint8_t *)map->used + offset, val);
+        qemu_ram_set_dirty(map->used_ram_addr + offset, sizeof(uint16_t));
+        return;
+    }
+    stw_phys(vq->vring.used + offset, val);
+}
+
+static inline uint16_t vring_used_flags(VirtQueue *vq)
 {
+    VRingMap *map = vring_map(vq);
     target_phys_addr_t pa;
-    pa = vq->vring.used + offsetof(VRingUsed, idx);
+
+    if (likely(map->used)) {
+        return lduw_p(&map->used->flags);
+    }
+    pa = vq->vring.used + offsetof(VRingUsed, flags);
     return lduw_phys(pa);
 }
 
 static inline void vring_used_idx_set(VirtQueue *vq, uint16_t val)
 {
-    target_phys_addr_t pa;
-    pa = vq->vring.used + offsetof(VRingUsed, idx);
-    stw_phys(pa, val);
+    vring_used_stw(vq, offsetof(VRingUsed, idx), val);
 }
 
 static inline void vring_used_flags_set_bit(VirtQueue *vq, int mask)
 {
-    target_phys_addr_t pa;
-    pa = vq->vring.used + offsetof(VRingUsed, flags);
-    stw_phys(pa, lduw_phys(pa) | mask);
+    vring_used_stw(vq, offsetof(VRingUsed, flags),
+                   vring_used_flags(vq) | mask);
 }
 
 static inline void vring_used_flags_unset_bit(VirtQueue *vq, int mask)
 {
-    target_phys_addr_t pa;
-    pa = vq->vring.used + offsetof(VRingUsed, flags);
-    stw_phys(pa, lduw_phys(pa) & ~mask);
+    vring_used_stw(vq, offsetof(VRingUsed, flags),
+                   vring_used_flags(vq) & ~mask);
 }
 
 static inline void vring_avail_event(VirtQueue *vq, uint16_t val)
 {
-    target_phys_addr_t pa;
     if (!vq->notification) {
         return;
     }
-    pa = vq->vring.used + offsetof(VRingUsed, ring[vq->vring.num]);
-    stw_phys(pa, val);
+    vring_used_stw(vq, offsetof(VRingUsed, ring[vq->vring.num]), val);
 }
 
 void virtio_queue_set_notification(VirtQueue *vq, int enable)
@@ -252,8 +395,7 @@ void virtqueue_fill(VirtQueue *vq, const VirtQueueElement *elem,
     idx = (idx + vring_used_idx(vq)) % vq->vring.num;
 
     /* Get a pointer to the next entry in the used ring. */
-    vring_used_ring_id(vq, idx, elem->index);
-    vring_used_ring_len(vq, idx, len);
+    vring_used_ring_write(vq, idx, elem->index, len);
 }
 
 void virtqueue_flush(VirtQueue *vq, unsigned int count)
@@ -296,6 +438,12 @@ static int virtqueue_num_heads(VirtQueue *vq, unsigned int idx)
     return num_heads;
 }
 
+/* Number of elements the guest has made available and we have not popped */
+int virtqueue_avail_count(VirtQueue *vq)
+{
+    return virtqueue_num_heads(vq, vq->last_avail_idx);
+}
+
 static unsigned int virtqueue_get_head(VirtQueue *vq, unsigned int idx)
 {
     unsigned int head;
@@ -313,20 +461,16 @@ static unsigned int virtqueue_get_head(VirtQueue *vq, unsigned int idx)
     return head;
 }
 
-static unsigned virtqueue_next_desc(target_phys_addr_t desc_pa,
-                                    unsigned int i, unsigned int max)
+static unsigned virtqueue_next_desc(VRingDesc *desc, unsigned int max)
 {
     unsigned int next;
 
     /* If this descriptor says it doesn't chain, we're done. */
-    if (!(vring_desc_flags(desc_pa, i) & VRING_DESC_F_NEXT))
+    if (!(desc->flags & VRING_DESC_F_NEXT))
         return max;
 
     /* Check they're not leading us off end of descriptors. */
-    next = vring_desc_next(desc_pa, i);
-    /* Make sure compiler knows to grab that: we don't want it changing! */
-    smp_wmb();
-
+    next = desc->next;
     if (next >= max) {
         error_report("Desc next is %u", next);
         exit(1);
@@ -335,6 +479,22 @@ static unsigned virtqueue_next_desc(target_phys_addr_t desc_pa,
     return next;
 }
 
+/* Switch to the indirect table of desc, returning its number of entries.
+ * The table is mapped as a whole when it lies in RAM.  */
+static unsigned int virtqueue_indirect_table(VRingDesc *desc,
+                                             target_phys_addr_t *desc_pa,
+                                             VRingDesc **table)
+{
+    if (desc->len % sizeof(VRingDesc)) {
+        error_report("Invalid size for indirect buffer table");
+        exit(1);
+    }
+
+    *desc_pa = desc->addr;
+    *table = vring_map_range(desc->addr, desc->len, false, NULL);
+    return desc->len / sizeof(VRingDesc);
+}
+
 int virtqueue_avail_bytes(VirtQueue *vq, int in_bytes, int out_bytes)
 {
     unsigned int idx;
@@ -346,19 +506,18 @@ int virtqueue_avail_bytes(VirtQueue *vq, int in_bytes, int out_bytes)
     while (virtqueue_num_heads(vq, idx)) {
         unsigned int max, num_bufs, indirect = 0;
         target_phys_addr_t desc_pa;
+        VRingDesc *table;
+        VRingDesc desc;
         int i;
 
         max = vq->vring.num;
         num_bufs = total_bufs;
         i = virtqueue_get_head(vq, idx++);
         desc_pa = vq->vring.desc;
+        table = vring_map(vq)->desc;
+        vring_desc_read(table, desc_pa, i, &desc);
 
-        if (vring_desc_flags(desc_pa, i) & VRING_DESC_F_INDIRECT) {
-            if (vring_desc_len(desc_pa, i) % sizeof(VRingDesc)) {
-                error_report("Invalid size for indirect buffer table");
-                exit(1);
-            }
-
+        if (desc.flags & VRING_DESC_F_INDIRECT) {
             /* If we've got too many, that implies a descriptor loop. */
             if (num_bufs >= max) {
                 error_report("Looped descriptor");
@@ -367,28 +526,29 @@ int virtqueue_avail_bytes(VirtQueue *vq, int in_bytes, int out_bytes)
 
             /* loop over the indirect descriptor table */
             indirect = 1;
-            max = vring_desc_len(desc_pa, i) / sizeof(VRingDesc);
+            max = virtqueue_indirect_table(&desc, &desc_pa, &table);
             num_bufs = i = 0;
-            desc_pa = vring_desc_addr(desc_pa, i);
         }
 
         do {
+            vring_desc_read(table, desc_pa, i, &desc);
+
             /* If we've got too many, that implies a descriptor loop. */
             if (++num_bufs > max) {
                 error_report("Looped descriptor");
                 exit(1);
             }
 
-            if (vring_desc_flags(desc_pa, i) & VRING_DESC_F_WRITE) {
+            if (desc.flags & VRING_DESC_F_WRITE) {
                 if (in_bytes > 0 &&
-                    (in_total += vring_desc_len(desc_pa, i)) >= in_bytes)
+                    (in_total += desc.len) >= in_bytes)
                     return 1;
             } else {
                 if (out_bytes > 0 &&
-                    (out_total += vring_desc_len(desc_pa, i)) >= out_bytes)
+                    (out_total += desc.len) >= out_bytes)
                     return 1;
             }
-        } while ((i = virtqueue_next_desc(desc_pa, i, max)) != max);
+        } while ((i = virtqueue_next_desc(&desc, max)) != max);
 
         if (!indirect)
             total_bufs = num_bufs;
@@ -419,6 +579,8 @@ int virtqueue_pop(VirtQueue *vq, VirtQueueElement *elem)
 {
     unsigned int i, head, max;
     target_phys_addr_t desc_pa = vq->vring.desc;
+    VRingDesc *table;
+    VRingDesc desc;
 
     if (!virtqueue_num_heads(vq, vq->last_avail_idx))
         return 0;
@@ -433,15 +595,11 @@ int virtqueue_pop(VirtQueue *vq, VirtQueueElement *elem)
         vring_avail_event(vq, vring_avail_idx(vq));
     }
 
-    if (vring_desc_flags(desc_pa, i) & VRING_DESC_F_INDIRECT) {
-        if (vring_desc_len(desc_pa, i) % sizeof(VRingDesc)) {
-            error_report("Invalid size for indirect buffer table");
-            exit(1);
-        }
-
+    table = vring_map(vq)->desc;
+    vring_desc_read(table, desc_pa, i, &desc);
+    if (desc.flags & VRING_DESC_F_INDIRECT) {
         /* loop over the indirect descriptor table */
-        max = vring_desc_len(desc_pa, i) / sizeof(VRingDesc);
-        desc_pa = vring_desc_addr(desc_pa, i);
+        max = virtqueue_indirect_table(&desc, &desc_pa, &table);
         i = 0;
     }
 
@@ -449,30 +607,32 @@ int virtqueue_pop(VirtQueue *vq, VirtQueueElement *elem)
     do {
         struct iovec *sg;
 
-        if (vring_desc_flags(desc_pa, i) & VRING_DESC_F_WRITE) {
+        vring_desc_read(table, desc_pa, i, &desc);
+
+        if (desc.flags & VRING_DESC_F_WRITE) {
             if (elem->in_num >= ARRAY_SIZE(elem->in_sg)) {
                 error_report("Too many write descriptors in indirect table");
                 exit(1);
             }
-            elem->in_addr[elem->in_num] = vring_desc_addr(desc_pa, i);
+            elem->in_addr[elem->in_num] = desc.addr;
             sg = &elem->in_sg[elem->in_num++];
         } else {
             if (elem->out_num >= ARRAY_SIZE(elem->out_sg)) {
                 error_report("Too many read descriptors in indirect table");
                 exit(1);
             }
-            elem->out_addr[elem->out_num] = vring_desc_addr(desc_pa, i);
+            elem->out_addr[elem->out_num] = desc.addr;
             sg = &elem->out_sg[elem->out_num++];
         }
 
-        sg->iov_len = vring_desc_len(desc_pa, i);
+        sg->iov_len = desc.len;
 
         /* If we've got too many, that implies a descriptor loop. */
         if ((elem->in_num + elem->out_num) > max) {
             error_report("Looped descriptor");
             exit(1);
         }
-    } while ((i = virtqueue_next_desc(desc_pa, i, max)) != max);
+    } while ((i = virtqueue_next_desc(&desc, max)) != max);
 
     /* Now map what we have collected */
     virtqueue_map_sg(elem->in_sg, elem->in_addr, elem->in_num, 1);
@@ -530,6 +690,7 @@ void virtio_reset(void *opaque)
         vdev->vq[i].vring.desc = 0;
         vdev->vq[i].vring.avail = 0;
         vdev->vq[i].vring.used = 0;
+        vdev->vq[i].map.gen = 0;
         vdev->vq[i].last_avail_idx = 0;
         vdev->vq[i].pa = 0;
         vdev->vq[i].vector = VIRTIO_NO_VECTOR;
@@ -893,6 +1054,11 @@ VirtIODevice *virtio_common_init(const char *name, uint16_t device_id,
     VirtIODevice *vdev;
     int i;
 
+    if (!vring_map_registered) {
+        memory_listener_register(&vring_map_listener, get_system_memory());
+        vring_map_registered = true;
+    }
+
     vdev = g_malloc0(struct_size);
 
     vdev->device_id = device_id;
@@ -979,6 +1145,11 @@ void virtio_queue_set_last_avail_idx(VirtIODevice *vdev, int n, uint16_t idx)
     vdev->vq[n].last_avail_idx = idx;
 }
 
+uint16_t virtio_queue_get_used_idx(VirtIODevice *vdev, int n)
+{
+    return vring_used_idx(&vdev->vq[n]);
+}
+
 VirtQueue *virtio_get_queue(VirtIODevice *vdev, int n)
 {
     return vdev->vq + n;
@@ -85,6 +85,8 @@ struct KVMState
     int xsave, xcrs;
     int many_ioeventfds;
     int intx_set_mask;
+    bool lockless_io;
+    bool msi_direct;
     /* The man page (and posix) say ioctl numbers are signed int, but
      * they're not.  Linux, glibc and *BSD all treat ioctl numbers as
      * unsigned, and treating them as signed here can break things */
@@ -1118,6 +1120,25 @@ int kvm_irqchip_add_msi_route(KVMState *s, MSIMessage msg)
     return virq;
 }
 
+int kvm_irqchip_update_msi_route(KVMState *s, int virq, MSIMessage msg)
+{
+    struct kvm_irq_routing_entry *e;
+    int i;
+
+    for (i = 0; i < s->irq_routes->nr; i++) {
+        e = &s->irq_routes->entries[i];
+        if (e->gsi == virq) {
+            assert(e->type == KVM_IRQ_ROUTING_MSI);
+            e->u.msi.address_lo = (uint32_t)msg.address;
+            e->u.msi.address_hi = msg.address >> 32;
+            e->u.msi.data = msg.data;
+            kvm_irqchip_commit_routes(s);
+            return 0;
+        }
+    }
+    return -ESRCH;
+}
+
 static int kvm_irqchip_assign_irqfd(KVMState *s, int fd, int virq, bool assign)
 {
     struct kvm_irqfd irqfd = {
@@ -1158,6 +1179,11 @@ int kvm_irqchip_add_msi_route(KVMState *s, MSIMessage msg)
     return -ENOSYS;
 }
 
+int kvm_irqchip_update_msi_route(KVMState *s, int virq, MSIMessage msg)
+{
+    return -ENOSYS;
+}
+
 static int kvm_irqchip_assign_irqfd(KVMState *s, int fd, int virq, bool assign)
 {
     abort();
@@ -1220,6 +1246,7 @@ int kvm_init(void)
         "(see http://sourceforge.net/projects/kvm).\n";
     KVMState *s;
     const KVMCapabilityInfo *missing_cap;
+    QemuOptsList *list;
     int ret;
     int i;
 
@@ -1331,6 +1358,15 @@ int kvm_init(void)
         goto err;
     }
 
+    /* Without the in-kernel irqchip, every exit has to go through
+     * kvm_arch_pre_run() to inject interrupts.  */
+    list = qemu_find_opts("machine");
+    s->lockless_io = kvm_irqchip_in_kernel() &&
+        (QTAILQ_EMPTY(&list->head) ||
+         qemu_opt_get_bool(QTAILQ_FIRST(&list->head), "lockless_io", true));
+    s->msi_direct = QTAILQ_EMPTY(&list->head) ||
+        qemu_opt_get_bool(QTAILQ_FIRST(&list->head), "msi_direct", true);
+
     kvm_state = s;
     memory_listener_register(&kvm_memory_listener, NULL);
 
@@ -1391,6 +1427,35 @@ static void kvm_handle_io(uint16_t port, void *data, int direction, int size,
     }
 }
 
+/* Complete an MMIO or PIO exit without the global mutex if the device
+ * allows it.  Returns false if the exit must be handled the usual way.
+ */
+static bool kvm_handle_io_nolock(KVMState *s, struct kvm_run *run)
+{
+    struct kvm_coalesced_mmio_ring *ring = s->coalesced_mmio_ring;
+
+    /* Coalesced writes must reach their devices first. */
+    if (ring && ring->first != ring->last) {
+        return false;
+    }
+
+    switch (run->exit_reason) {
+    case KVM_EXIT_MMIO:
+        return cpu_physical_memory_rw_nolock(run->mmio.phys_addr,
+                                             run->mmio.data,
+                                             run->mmio.len,
+                                             run->mmio.is_write);
+    case KVM_EXIT_IO:
+        return run->io.count == 1 &&
+            cpu_ioport_rw_nolock(run->io.port,
+                                 (uint8_t *)run + run->io.data_offset,
+                                 run->io.size,
+                                 run->io.direction == KVM_EXIT_IO_OUT);
+    default:
+        return false;
+    }
+}
+
 static int kvm_handle_internal_error(CPUArchState *env, struct kvm_run *run)
 {
     fprintf(stderr, "KVM internal error.");
@@ -1503,7 +1568,13 @@ int kvm_cpu_exec(CPUArchState *env)
         }
         qemu_mutex_unlock_iothread();
 
-        run_ret = kvm_vcpu_ioctl(env, KVM_RUN, 0);
+        /* Exits to devices that do their own locking are completed right
+         * away; pending signals make KVM_RUN return immediately, so
+         * exit_request is still honoured.  */
+        do {
+            run_ret = kvm_vcpu_ioctl(env, KVM_RUN, 0);
+        } while (run_ret == 0 && kvm_state->lockless_io &&
+                 kvm_handle_io_nolock(kvm_state, run));
 
         qemu_mutex_lock_iothread();
         kvm_arch_post_run(env, run);
@@ -1685,6 +1756,11 @@ int kvm_allows_irq0_override(void)
     return !kvm_irqchip_in_kernel() || kvm_has_gsi_routing();
 }
 
+bool kvm_msi_direct_allowed(void)
+{
+    return kvm_state->msi_direct;
+}
+
 void *kvm_vmalloc(ram_addr_t size)
 {
 #ifdef TARGET_S390X
@@ -66,6 +66,7 @@ unsigned long reserved_va;
 static void usage(void);
 
 static const char *interp_prefix = CONFIG_QEMU_INTERP_PREFIX;
+static const char *tb_cache_dir;
 const char *qemu_uname_release = CONFIG_UNAME_RELEASE;
 
 /* XXX: on x86 MAP_GROWSDOWN only works if ESP <= address + 32, so
@@ -254,6 +255,13 @@ void cpu_list_unlock(void)
 }
 #endif
 
+/* Stop the other guest threads for good, before the process exits.  They
+   wait in cpu_exec_start/cpu_exec_end until exit_group kills them.  */
+void stop_other_cpus(void)
+{
+    start_exclusive();
+}
+
 
 #ifdef TARGET_I386
 /***********************************************************/
@@ -3195,6 +3203,25 @@ static void handle_arg_reserved_va(const char *arg)
 }
 #endif
 
+static void handle_arg_perfmap(const char *arg)
+{
+    perf_enable_perfmap();
+}
+
+static void handle_arg_jitdump(const char *arg)
+{
+    perf_enable_jitdump();
+}
+
+static void handle_arg_tb_hot_threshold(const char *arg)
+{
+    if (tb_set_hot_threshold(arg) < 0) {
+        fprintf(stderr, "qemu: invalid -tb-hot-threshold value "
+                "'%s', expected a non-negative integer\n", arg);
+        exit(1);
+    }
+}
+
 static void handle_arg_singlestep(const char *arg)
 {
     singlestep = 1;
@@ -3205,6 +3232,23 @@ static void handle_arg_strace(const char *arg)
     do_strace = 1;
 }
 
+static void handle_arg_tb_cache(const char *arg)
+{
+#ifdef PIE
+    /* the saved code holds absolute addresses of this binary, which moves
+       on every run of a position independent build */
+    fprintf(stderr, "qemu: warning: -tb-cache needs a QEMU built with "
+            "--disable-pie, ignoring it\n");
+#else
+    tb_cache_dir = strdup(arg);
+#endif
+}
+
+static void handle_arg_tb_cache_stats(const char *arg)
+{
+    tb_cache_stats = 1;
+}
+
 static void handle_arg_version(const char *arg)
 {
     printf("qemu-" TARGET_ARCH " version " QEMU_VERSION QEMU_PKGVERSION
@@ -3252,10 +3296,23 @@ struct qemu_argument arg_table[] = {
      "logfile",     "override default logfile location"},
     {"p",          "QEMU_PAGESIZE",    true,  handle_arg_pagesize,
      "pagesize",   "set the host page size to 'pagesize'"},
+    {"perfmap",    "QEMU_PERFMAP",     false, handle_arg_perfmap,
+     "",           "write /tmp/perf-<pid>.map for Linux perf"},
+    {"jitdump",    "QEMU_JITDUMP",     false, handle_arg_jitdump,
+     "",           "write /tmp/jit-<pid>.dump for Linux perf"},
     {"singlestep", "QEMU_SINGLESTEP",  false, handle_arg_singlestep,
      "",           "run in singlestep mode"},
     {"strace",     "QEMU_STRACE",      false, handle_arg_strace,
      "",           "log system calls"},
+    {"tb-hot-threshold", "QEMU_TB_HOT_THRESHOLD", true,
+     handle_arg_tb_hot_threshold,
+     "n",          "optimize translated blocks after n executions"},
+    {"tb-cache",   "QEMU_TB_CACHE",    true,  handle_arg_tb_cache,
+     "dir",        "keep translated code across runs in 'dir' "
+     "(not in PIE builds)"},
+    {"tb-cache-stats", "QEMU_TB_CACHE_STATS", false,
+     handle_arg_tb_cache_stats,
+     "",           "report translation cache statistics on exit"},
     {"version",    "QEMU_VERSION",     false, handle_arg_version,
      "",           "display version information and exit"},
     {NULL, NULL, false, NULL, NULL, NULL}
@@ -3643,6 +3700,10 @@ int main(int argc, char **argv, char **envp)
     tcg_prologue_init(&tcg_ctx);
 #endif
 
+    if (tb_cache_dir) {
+        tb_cache_init(tb_cache_dir, filename, cpu_model);
+    }
+
 #if defined(TARGET_I386)
     cpu_x86_set_cpl(env, 3);
 
@@ -203,6 +203,7 @@ char *target_strerror(int err);
 int get_osversion(void);
 void fork_start(void);
 void fork_end(int child);
+void stop_other_cpus(void);
 
 /* Return true if the proposed guest_base is suitable for the guest.
  * The guest code may leave a page mapped and populate it if the
@@ -242,6 +243,12 @@ void sparc64_set_context(CPUSPARCState *env);
 void sparc64_get_context(CPUSPARCState *env);
 #endif
 
+/* tbcache.c */
+void tb_cache_init(const char *dir, const char *filename,
+                   const char *cpu_model);
+void tb_cache_save(void);
+extern int tb_cache_stats;
+
 /* mmap.c */
 int target_mprotect(abi_ulong start, abi_ulong len, int prot);
 abi_long target_mmap(abi_ulong start, abi_ulong len, int prot,
@@ -5094,6 +5094,8 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
         _mcleanup();
 #endif
         gdb_exit(cpu_env, arg1);
+        tb_cache_save();
+        perf_exit();
         _exit(arg1);
         ret = 0; /* avoid warning */
         break;
@@ -6837,6 +6839,8 @@ abi_long do_syscall(void *cpu_env, int num, abi_long arg1,
         _mcleanup();
 #endif
         gdb_exit(cpu_env, arg1);
+        tb_cache_save();
+        perf_exit();
         ret = get_errno(exit_group(arg1));
         break;
 #endif
@@ -0,0 +1,465 @@
+/*
+ *  Persistent translation block cache for user mode emulation
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The generated code of a process is saved on exit together with the
+ * description of its TBs, and loaded back into the translation buffer at
+ * the same place on the next run of the same guest program.  Generated
+ * code embeds absolute addresses of helpers, of the prologue and of the
+ * TBs themselves, so the cache is only used when all of them are at the
+ * same address as when it was written, which rules out PIE builds (see
+ * handle_arg_tb_cache).
+ *
+ * Loaded TBs are not reachable until a lookup for the same pc, cs_base
+ * and flags finds that the guest code still has the same contents; they
+ * are then linked into the physical page tables like a fresh translation.
+ */
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "qemu.h"
+#include "qemu-common.h"
+#include "tcg.h"
+
+#define TB_CACHE_MAGIC      "QEMUTBC1"
+#define TB_CACHE_VERSION    1
+#define TB_CACHE_HASH_BITS  12
+#define TB_CACHE_HASH_SIZE  (1 << TB_CACHE_HASH_BITS)
+
+typedef struct TBCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nb_entries;
+    uint64_t code_size;
+    /* Everything the generated code may refer to by absolute address.  */
+    uint64_t code_gen_buffer;
+    uint64_t tbs;
+    uint64_t code_gen_prologue;
+    uint64_t text_anchor;
+    uint64_t guest_base;
+    /* Identity of the qemu binary and of the emulated CPU.  */
+    uint64_t exe_size;
+    uint64_t exe_mtime;
+    char cpu_model[64];
+} TBCacheHeader;
+
+typedef struct TBCacheEntry {
+    uint64_t pc;
+    uint64_t cs_base;
+    uint64_t flags;
+    uint64_t code_hash;
+    uint64_t tc_offset;
+    uint64_t tb_next[2];
+    uint16_t size;
+    uint16_t cflags;
+    uint16_t tb_next_offset[2];
+    uint16_t tb_jmp_offset[2];
+    uint32_t valid;
+} TBCacheEntry;
+
+enum {
+    TB_STATE_NONE,        /* not cacheable */
+    TB_STATE_TRANSLATED,  /* translated in this run */
+    TB_STATE_LOADED,      /* loaded from the cache, not yet used */
+    TB_STATE_ADOPTED,     /* loaded from the cache and linked */
+};
+
+static char *tb_cache_file;
+static const char *tb_cache_cpu_model;
+int tb_cache_stats;
+
+/* Per-TB state, indexed like the tbs array.  */
+static uint8_t *tb_state;
+static uint64_t *tb_code_hash;
+static int *tb_hash_next;
+static int tb_hash_head[TB_CACHE_HASH_SIZE];
+static int tb_nb_loaded;
+static bool tb_uncacheable;
+
+static int64_t tb_translate_start;
+static int64_t tb_translate_ns;
+static uint64_t tb_nb_translated;
+static uint64_t tb_nb_hits;
+static uint64_t tb_nb_stale;
+
+static int64_t tb_cache_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static inline unsigned int tb_cache_hash_func(target_ulong pc)
+{
+    return (pc ^ (pc >> TB_CACHE_HASH_BITS)) & (TB_CACHE_HASH_SIZE - 1);
+}
+
+/* FNV-1a over the guest code of a TB.  */
+static uint64_t tb_cache_code_hash(target_ulong pc, int size)
+{
+    const uint8_t *p = g2h(pc);
+    uint64_t h = 0xcbf29ce484222325ULL;
+    int i;
+
+    for (i = 0; i < size; i++) {
+        h = (h ^ p[i]) * 0x100000001b3ULL;
+    }
+    return h;
+}
+
+static bool tb_cache_code_valid(target_ulong pc, int size)
+{
+    target_ulong last = pc + size - 1;
+
+    return (page_get_flags(pc) & PAGE_VALID) &&
+           (page_get_flags(last) & PAGE_VALID);
+}
+
+static void tb_cache_fill_header(TBCacheHeader *hdr, int nb_entries,
+                                 size_t code_size)
+{
+    TranslationBlock *tbs;
+    uint8_t *buffer;
+    size_t used, size;
+    int nb, max;
+    struct stat st;
+
+    tbs = tb_buffer_state(&nb, &max, &buffer, &used, &size);
+    memset(hdr, 0, sizeof(*hdr));
+    memcpy(hdr->magic, TB_CACHE_MAGIC, sizeof(hdr->magic));
+    hdr->version = TB_CACHE_VERSION;
+    hdr->nb_entries = nb_entries;
+    hdr->code_size = code_size;
+    hdr->code_gen_buffer = (uintptr_t)buffer;
+    hdr->tbs = (uintptr_t)tbs;
+    hdr->code_gen_prologue = (uintptr_t)code_gen_prologue;
+    hdr->text_anchor = (uintptr_t)&tb_cache_lookup;
+    hdr->guest_base = GUEST_BASE;
+    if (stat("/proc/self/exe", &st) == 0) {
+        hdr->exe_size = st.st_size;
+        hdr->exe_mtime = st.st_mtime;
+    }
+    pstrcpy(hdr->cpu_model, sizeof(hdr->cpu_model), tb_cache_cpu_model);
+}
+
+static void tb_cache_alloc(void)
+{
+    uint8_t *buffer;
+    size_t used, size;
+    int nb, max;
+
+    tb_buffer_state(&nb, &max, &buffer, &used, &size);
+    tb_state = g_malloc0(max * sizeof(*tb_state));
+    tb_code_hash = g_malloc0(max * sizeof(*tb_code_hash));
+    tb_hash_next = g_malloc(max * sizeof(*tb_hash_next));
+    memset(tb_hash_head, -1, sizeof(tb_hash_head));
+}
+
+static void tb_cache_load_file(void)
+{
+    TBCacheHeader hdr, cur;
+    TBCacheEntry *entries;
+    TranslationBlock *tbs;
+    uint8_t *buffer, *map;
+    size_t used, size, map_size;
+    struct stat st;
+    int nb, max, fd, i;
+
+    fd = open(tb_cache_file, O_RDONLY);
+    if (fd < 0) {
+        return;
+    }
+    if (fstat(fd, &st) < 0 || st.st_size < sizeof(hdr)) {
+        close(fd);
+        return;
+    }
+    map_size = st.st_size;
+    map = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return;
+    }
+
+    memcpy(&hdr, map, sizeof(hdr));
+    tb_cache_fill_header(&cur, hdr.nb_entries, hdr.code_size);
+    tbs = tb_buffer_state(&nb, &max, &buffer, &used, &size);
+    if (memcmp(&hdr, &cur, sizeof(hdr)) != 0 ||
+        hdr.nb_entries > max || hdr.code_size > size ||
+        sizeof(hdr) + hdr.nb_entries * sizeof(TBCacheEntry) +
+        hdr.code_size != map_size) {
+        fprintf(stderr, "qemu: warning: ignoring translation cache %s, "
+                "it was written by a different binary or CPU model\n",
+                tb_cache_file);
+        goto out;
+    }
+
+    entries = (TBCacheEntry *)(map + sizeof(hdr));
+    for (i = 0; i < hdr.nb_entries; i++) {
+        if (entries[i].tc_offset >= hdr.code_size) {
+            goto out;
+        }
+    }
+
+    for (i = 0; i < hdr.nb_entries; i++) {
+        TBCacheEntry *e = &entries[i];
+        TranslationBlock *tb = &tbs[i];
+        unsigned int h;
+
+        memset(tb, 0, sizeof(*tb));
+        /* TBs that could not be cached still occupy their slot, so that
+           the tbs array stays sorted by tc_ptr.  */
+        tb->tc_ptr = buffer + e->tc_offset;
+        if (!e->valid) {
+            continue;
+        }
+        tb->pc = e->pc;
+        tb->cs_base = e->cs_base;
+        tb->flags = e->flags;
+        tb->size = e->size;
+        tb->cflags = e->cflags;
+        tb->tb_next_offset[0] = e->tb_next_offset[0];
+        tb->tb_next_offset[1] = e->tb_next_offset[1];
+#ifdef USE_DIRECT_JUMP
+        tb->tb_jmp_offset[0] = e->tb_jmp_offset[0];
+        tb->tb_jmp_offset[1] = e->tb_jmp_offset[1];
+#else
+        tb->tb_next[0] = e->tb_next[0];
+        tb->tb_next[1] = e->tb_next[1];
+#endif
+        tb_state[i] = TB_STATE_LOADED;
+        tb_code_hash[i] = e->code_hash;
+        h = tb_cache_hash_func(tb->pc);
+        tb_hash_next[i] = tb_hash_head[h];
+        tb_hash_head[h] = i;
+    }
+    memcpy(buffer, map + sizeof(hdr) + hdr.nb_entries * sizeof(TBCacheEntry),
+           hdr.code_size);
+    flush_icache_range((uintptr_t)buffer, (uintptr_t)buffer + hdr.code_size);
+    tb_buffer_reserve(hdr.nb_entries, hdr.code_size);
+    tb_nb_loaded = hdr.nb_entries;
+    qemu_log("tb-cache: loaded %d TBs, %" PRIu64 " bytes of code from %s\n",
+             tb_nb_loaded, hdr.code_size, tb_cache_file);
+out:
+    munmap(map, map_size);
+}
+
+/* Enable the cache for the guest program 'filename'.  Must be called
+   before any code is translated, once GUEST_BASE is final.  */
+void tb_cache_init(const char *dir, const char *filename,
+                   const char *cpu_model)
+{
+    char *path, *name;
+    uint32_t h = 5381;
+    const char *p;
+
+    path = realpath(filename, NULL);
+    if (!path) {
+        path = g_strdup(filename);
+    }
+    for (p = path; *p; p++) {
+        h = h * 33 + *p;
+    }
+    for (p = cpu_model; *p; p++) {
+        h = h * 33 + *p;
+    }
+    name = g_strdup(basename(path));
+    tb_cache_file = g_strdup_printf("%s/%s-" TARGET_ARCH "-%08x.tbc",
+                                    dir, name, h);
+    tb_cache_cpu_model = cpu_model;
+    g_free(name);
+    free(path);
+
+    tb_cache_alloc();
+    tb_cache_load_file();
+}
+
+TranslationBlock *tb_cache_lookup(CPUArchState *env, target_ulong pc,
+                                  target_ulong cs_base, int flags,
+                                  int cflags)
+{
+    TranslationBlock *tbs, *tb;
+    uint8_t *buffer;
+    size_t used, size;
+    int nb, max, i;
+
+    if (!tb_cache_file) {
+        return NULL;
+    }
+    tb_uncacheable = false;
+    tb_translate_start = tb_cache_clock();
+    if (cflags || !tb_nb_loaded) {
+        return NULL;
+    }
+
+    tbs = tb_buffer_state(&nb, &max, &buffer, &used, &size);
+    for (i = tb_hash_head[tb_cache_hash_func(pc)]; i >= 0;
+         i = tb_hash_next[i]) {
+        tb = &tbs[i];
+        if (tb_state[i] != TB_STATE_LOADED || tb->pc != pc ||
+            tb->cs_base != cs_base || tb->flags != flags) {
+            continue;
+        }
+        if (!tb_cache_code_valid(pc, tb->size) ||
+            tb_cache_code_hash(pc, tb->size) != tb_code_hash[i]) {
+            tb_nb_stale++;
+            continue;
+        }
+        tb_state[i] = TB_STATE_ADOPTED;
+        tb_nb_hits++;
+        return tb;
+    }
+    return NULL;
+}
+
+void tb_cache_translated(TranslationBlock *tb)
+{
+    TranslationBlock *tbs;
+    uint8_t *buffer;
+    size_t used, size;
+    int nb, max, i;
+
+    if (!tb_cache_file) {
+        return;
+    }
+    tbs = tb_buffer_state(&nb, &max, &buffer, &used, &size);
+    i = tb - tbs;
+    tb_translate_ns += tb_cache_clock() - tb_translate_start;
+    tb_nb_translated++;
+    if (tb_uncacheable || tb->cflags ||
+        !tb_cache_code_valid(tb->pc, tb->size)) {
+        tb_state[i] = TB_STATE_NONE;
+        return;
+    }
+    tb_state[i] = TB_STATE_TRANSLATED;
+    tb_code_hash[i] = tb_cache_code_hash(tb->pc, tb->size);
+}
+
+/* Called by translators that embed pointers to heap objects in the
+   generated code of the TB being translated.  */
+void tb_cache_mark_uncacheable(void)
+{
+    tb_uncacheable = true;
+}
+
+void tb_cache_flush(void)
+{
+    if (!tb_cache_file) {
+        return;
+    }
+    tb_nb_loaded = 0;
+    memset(tb_hash_head, -1, sizeof(tb_hash_head));
+}
+
+static void tb_cache_report(void)
+{
+    uint64_t lookups = tb_nb_hits + tb_nb_translated;
+    int64_t avg = tb_nb_translated ? tb_translate_ns / tb_nb_translated : 0;
+
+    fprintf(stderr, "tb-cache: %" PRIu64 " hits, %" PRIu64 " translations, "
+            "%" PRIu64 " stale, hit rate %.1f%%\n",
+            tb_nb_hits, tb_nb_translated, tb_nb_stale,
+            lookups ? 100.0 * tb_nb_hits / lookups : 0.0);
+    fprintf(stderr, "tb-cache: %" PRId64 " ms translating, "
+            "about %" PRId64 " ms saved\n",
+            tb_translate_ns / 1000000, avg * tb_nb_hits / 1000000);
+}
+
+/* Write the translation buffer out.  Called on process exit; the other
+   threads are stopped first, so that nothing runs the translated code
+   while it is unchained, and tb_lock is held while walking the TBs.  */
+void tb_cache_save(void)
+{
+    TBCacheHeader hdr;
+    TBCacheEntry *entries;
+    TranslationBlock *tbs;
+    uint8_t *buffer;
+    size_t used, size;
+    char *tmp;
+    int nb, max, fd, i;
+    bool ok;
+
+    if (!tb_cache_file) {
+        return;
+    }
+    if (tb_cache_stats) {
+        tb_cache_report();
+    }
+
+    stop_other_cpus();
+    spin_lock(&tb_lock);
+    tbs = tb_buffer_state(&nb, &max, &buffer, &used, &size);
+    if (nb == 0) {
+        spin_unlock(&tb_lock);
+        return;
+    }
+    entries = g_malloc0(nb * sizeof(*entries));
+    for (i = 0; i < nb; i++) {
+        TranslationBlock *tb = &tbs[i];
+        TBCacheEntry *e = &entries[i];
+
+        e->tc_offset = tb->tc_ptr - buffer;
+        if (tb_state[i] == TB_STATE_NONE) {
+            continue;
+        }
+        e->valid = 1;
+        e->pc = tb->pc;
+        e->cs_base = tb->cs_base;
+        e->flags = tb->flags;
+        e->code_hash = tb_code_hash[i];
+        e->size = tb->size;
+        e->cflags = tb->cflags;
+        e->tb_next_offset[0] = tb->tb_next_offset[0];
+        e->tb_next_offset[1] = tb->tb_next_offset[1];
+#ifdef USE_DIRECT_JUMP
+        e->tb_jmp_offset[0] = tb->tb_jmp_offset[0];
+        e->tb_jmp_offset[1] = tb->tb_jmp_offset[1];
+#else
+        e->tb_next[0] = tb->tb_next[0];
+        e->tb_next[1] = tb->tb_next[1];
+#endif
+        /* Store the code unchained; direct jumps are patched again
+           when the TB is linked.  */
+        tb_buffer_unchain(tb);
+    }
+    tb_cache_fill_header(&hdr, nb, used);
+
+    /* Several processes may run the same program; replace the file
+       atomically so that readers never see a partial cache.  */
+    tmp = g_strdup_printf("%s.XXXXXX", tb_cache_file);
+    fd = mkstemp(tmp);
+    if (fd >= 0) {
+        ok = qemu_write_full(fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+             qemu_write_full(fd, entries, nb * sizeof(*entries)) ==
+             nb * sizeof(*entries) &&
+             qemu_write_full(fd, buffer, used) == used;
+        close(fd);
+        if (!ok || rename(tmp, tb_cache_file) < 0) {
+            unlink(tmp);
+        }
+    }
+    spin_unlock(&tb_lock);
+    g_free(tmp);
+    g_free(entries);
+}
@@ -18,8 +18,12 @@
 #include "ioport.h"
 #include "bitops.h"
 #include "kvm.h"
+#include "qemu-timer.h"
+#include "trace.h"
 #include <assert.h>
 
+//#define DEBUG_RENDER_DIRTY
+
 #define WANT_EXEC_OBSOLETE
 #include "exec-obsolete.h"
 
@@ -227,8 +231,17 @@ struct AddressSpace {
     FlatView current_map;
     int ioeventfd_nb;
     MemoryRegionIoeventfd *ioeventfds;
+    /* Parts of current_map to render again at the next update */
+    AddrRange *dirty;
+    unsigned dirty_nr, dirty_nr_allocated;
+    bool dirty_all;
 };
 
+/* Statistics, shown by "info mtree" */
+static uint64_t topology_updates;
+static uint64_t topology_updates_full;
+static int64_t topology_update_ns;
+
 #define FOR_EACH_FLAT_RANGE(var, view)          \
     for (var = (view)->ranges; var < (view)->ranges + (view)->nr; ++var)
 
@@ -538,12 +551,13 @@ static void render_memory_region(FlatView *view,
             offset_in_region += int128_get64(now);
             int128_subfrom(&remain, now);
         }
-        if (int128_eq(base, view->ranges[i].addr.start)) {
-            now = int128_min(remain, view->ranges[i].addr.size);
-            int128_addto(&base, now);
-            offset_in_region += int128_get64(now);
-            int128_subfrom(&remain, now);
-        }
+        /* Skip the obscuring range, which may start before @base. */
+        now = int128_sub(int128_min(int128_add(base, remain),
+                                    addrrange_end(view->ranges[i].addr)),
+                         base);
+        int128_addto(&base, now);
+        offset_in_region += int128_get64(now);
+        int128_subfrom(&remain, now);
     }
     if (int128_nz(remain)) {
         fr.mr = mr;
@@ -713,10 +727,205 @@ static void address_space_update_topology_pass(AddressSpace *as,
 }
 
 
+static void address_space_mark_dirty(AddressSpace *as, AddrRange range)
+{
+    if (as->dirty_all) {
+        return;
+    }
+    if (as->dirty_nr == as->dirty_nr_allocated) {
+        as->dirty_nr_allocated = MAX(2 * as->dirty_nr_allocated, 8);
+        as->dirty = g_renew(AddrRange, as->dirty, as->dirty_nr_allocated);
+    }
+    as->dirty[as->dirty_nr++] = range;
+}
+
+/* Mark @range, relative to the start of @mr, wherever @mr is visible in
+ * @as: through its parents up to the root, and through every alias of @mr
+ * or of one of its parents.
+ */
+static void address_space_mark_region(AddressSpace *as, MemoryRegion *mr,
+                                      AddrRange range)
+{
+    AddrRange whole = addrrange_make(int128_zero(), mr->size);
+    MemoryRegion *alias;
+
+    if (!addrrange_intersects(range, whole)) {
+        return;
+    }
+    range = addrrange_intersection(range, whole);
+
+    if (mr == as->root) {
+        address_space_mark_dirty(as,
+                                 addrrange_shift(range,
+                                                 int128_make64(mr->addr)));
+    }
+    if (mr->parent) {
+        address_space_mark_region(as, mr->parent,
+                                  addrrange_shift(range,
+                                                  int128_make64(mr->addr)));
+    }
+    QTAILQ_FOREACH(alias, &mr->aliases, aliases_link) {
+        Int128 offset = int128_make64(alias->alias_offset);
+
+        address_space_mark_region(as, alias,
+                                  addrrange_shift(range, int128_neg(offset)));
+    }
+}
+
+/* Note that the rendering of @mr, or of everything if @mr is NULL, must be
+ * redone at the next topology update.  Call while @mr is still mapped when
+ * it is being removed.
+ */
+static void memory_region_mark_dirty(MemoryRegion *mr)
+{
+    AddressSpace *spaces[] = { &address_space_memory, &address_space_io };
+    unsigned i;
+
+    for (i = 0; i < ARRAY_SIZE(spaces); i++) {
+        if (!spaces[i]->root) {
+            continue;
+        }
+        if (!mr) {
+            spaces[i]->dirty_all = true;
+        } else {
+            address_space_mark_region(spaces[i], mr,
+                                      addrrange_make(int128_zero(), mr->size));
+        }
+    }
+}
+
+static int cmp_addrrange(const void *a_, const void *b_)
+{
+    const AddrRange *a = a_, *b = b_;
+
+    if (int128_lt(a->start, b->start)) {
+        return -1;
+    }
+    return int128_gt(a->start, b->start);
+}
+
+/* Sort the dirty ranges and merge those that touch or overlap. */
+static void address_space_merge_dirty(AddressSpace *as)
+{
+    unsigned i, j;
+
+    qsort(as->dirty, as->dirty_nr, sizeof(*as->dirty), cmp_addrrange);
+    for (i = 0, j = 1; j < as->dirty_nr; j++) {
+        AddrRange *last = &as->dirty[i];
+
+        if (int128_le(as->dirty[j].start, addrrange_end(*last))) {
+            Int128 end = int128_max(addrrange_end(*last),
+                                    addrrange_end(as->dirty[j]));
+            last->size = int128_sub(end, last->start);
+        } else {
+            as->dirty[++i] = as->dirty[j];
+        }
+    }
+    if (as->dirty_nr) {
+        as->dirty_nr = i + 1;
+    }
+}
+
+/* Append the part of @fr between @start and @end to @view. */
+static void flatview_append_clipped(FlatView *view, FlatRange *fr,
+                                    Int128 start, Int128 end)
+{
+    FlatRange piece = *fr;
+
+    start = int128_max(start, fr->addr.start);
+    end = int128_min(end, addrrange_end(fr->addr));
+    if (int128_ge(start, end)) {
+        return;
+    }
+    piece.offset_in_region += int128_get64(int128_sub(start, fr->addr.start));
+    piece.addr = addrrange_make(start, int128_sub(end, start));
+    flatview_insert(view, view->nr, &piece);
+}
+
+static int cmp_flatrange_start(const void *a_, const void *b_)
+{
+    const FlatRange *a = a_, *b = b_;
+
+    return cmp_addrrange(&a->addr, &b->addr);
+}
+
+/* Build the new view of @as from the current one, rendering only the dirty
+ * ranges again.  The result is the same as generate_memory_topology(),
+ * because a simplified view is the unique coarsest partition of the
+ * address space into mergeable ranges.
+ */
+static FlatView address_space_render_dirty(AddressSpace *as)
+{
+    FlatView *old_view = &as->current_map;
+    FlatView view;
+    FlatRange *fr;
+    unsigned i, k = 0;
+
+    address_space_merge_dirty(as);
+
+    flatview_init(&view);
+    for (i = 0; i < as->dirty_nr; i++) {
+        render_memory_region(&view, as->root, int128_zero(),
+                             as->dirty[i], false);
+    }
+
+    /* Keep everything outside the dirty ranges. */
+    FOR_EACH_FLAT_RANGE(fr, old_view) {
+        Int128 start = fr->addr.start;
+        Int128 end = addrrange_end(fr->addr);
+
+        while (k < as->dirty_nr
+               && int128_le(addrrange_end(as->dirty[k]), start)) {
+            ++k;
+        }
+        for (i = k; i < as->dirty_nr
+                 && int128_lt(as->dirty[i].start, end); i++) {
+            flatview_append_clipped(&view, fr, start, as->dirty[i].start);
+            start = int128_max(start, addrrange_end(as->dirty[i]));
+        }
+        flatview_append_clipped(&view, fr, start, end);
+    }
+
+    qsort(view.ranges, view.nr, sizeof(*view.ranges), cmp_flatrange_start);
+    flatview_simplify(&view);
+    return view;
+}
+
+#ifdef DEBUG_RENDER_DIRTY
+/* Abort if @view differs from a full rendering of @root. */
+static void flatview_check_equal(FlatView *view, MemoryRegion *root)
+{
+    FlatView full = generate_memory_topology(root);
+    unsigned i;
+
+    assert(view->nr == full.nr);
+    for (i = 0; i < full.nr; i++) {
+        assert(flatrange_equal(&view->ranges[i], &full.ranges[i]));
+        assert(view->ranges[i].dirty_log_mask == full.ranges[i].dirty_log_mask);
+    }
+    flatview_destroy(&full);
+}
+#endif
+
 static void address_space_update_topology(AddressSpace *as)
 {
     FlatView old_view = as->current_map;
-    FlatView new_view = generate_memory_topology(as->root);
+    FlatView new_view;
+
+    if (as->dirty_all) {
+        new_view = generate_memory_topology(as->root);
+    } else if (as->dirty_nr) {
+        new_view = address_space_render_dirty(as);
+#ifdef DEBUG_RENDER_DIRTY
+        flatview_check_equal(&new_view, as->root);
+#endif
+    } else {
+        new_view.nr = new_view.nr_allocated = old_view.nr;
+        new_view.ranges = g_memdup(old_view.ranges,
+                                   old_view.nr * sizeof(*old_view.ranges));
+    }
+    as->dirty_nr = 0;
+    as->dirty_all = false;
 
     address_space_update_topology_pass(as, old_view, new_view, false);
     address_space_update_topology_pass(as, old_view, new_view, true);
@@ -726,16 +935,17 @@ static void address_space_update_topology(AddressSpace *as)
     address_space_update_ioeventfds(as);
 }
 
-static void memory_region_update_topology(MemoryRegion *mr)
+static void memory_region_commit_topology(void)
 {
-    if (memory_region_transaction_depth) {
-        memory_region_update_pending |= !mr || mr->enabled;
-        return;
-    }
+    bool full = address_space_memory.dirty_all || address_space_io.dirty_all;
+    unsigned dirty = address_space_memory.dirty_nr + address_space_io.dirty_nr;
+    int64_t start;
 
-    if (mr && !mr->enabled) {
+    if (memory_region_transaction_depth) {
+        memory_region_update_pending = true;
         return;
     }
+    start = get_clock();
 
     MEMORY_LISTENER_CALL_GLOBAL(begin, Forward);
 
@@ -749,6 +959,28 @@ static void memory_region_update_topology(MemoryRegion *mr)
     MEMORY_LISTENER_CALL_GLOBAL(commit, Forward);
 
     memory_region_update_pending = false;
+
+    start = get_clock() - start;
+    topology_updates++;
+    topology_updates_full += full;
+    topology_update_ns += start;
+    trace_memory_region_update_topology(full, dirty,
+                                        address_space_memory.current_map.nr,
+                                        start);
+}
+
+/* Update the topology after a change to @mr, or to everything if @mr is
+ * NULL.  Only the parts of the address spaces where @mr is visible are
+ * rendered again.
+ */
+static void memory_region_update_topology(MemoryRegion *mr)
+{
+    if (mr && !mr->enabled) {
+        return;
+    }
+
+    memory_region_mark_dirty(mr);
+    memory_region_commit_topology();
 }
 
 void memory_region_transaction_begin(void)
@@ -761,7 +993,7 @@ void memory_region_transaction_commit(void)
     assert(memory_region_transaction_depth);
     --memory_region_transaction_depth;
     if (!memory_region_transaction_depth && memory_region_update_pending) {
-        memory_region_update_topology(NULL);
+        memory_region_commit_topology();
     }
 }
 
@@ -819,6 +1051,7 @@ void memory_region_init(MemoryRegion *mr,
     mr->priority = 0;
     mr->may_overlap = false;
     mr->alias = NULL;
+    QTAILQ_INIT(&mr->aliases);
     QTAILQ_INIT(&mr->subregions);
     memset(&mr->subregions_link, 0, sizeof mr->subregions_link);
     QTAILQ_INIT(&mr->coalesced);
@@ -975,6 +1208,7 @@ void memory_region_init_alias(MemoryRegion *mr,
     memory_region_init(mr, name, size);
     mr->alias = orig;
     mr->alias_offset = offset;
+    QTAILQ_INSERT_TAIL(&orig->aliases, mr, aliases_link);
 }
 
 void memory_region_init_rom_device(MemoryRegion *mr,
@@ -1030,7 +1264,19 @@ void memory_region_init_reservation(MemoryRegion *mr,
 
 void memory_region_destroy(MemoryRegion *mr)
 {
+    MemoryRegion *alias, *next;
+
     assert(QTAILQ_EMPTY(&mr->subregions));
+    /* Devices do not always destroy their aliases first.  Unlink those
+     * that are left, so that destroying them later does not touch @mr.
+     */
+    QTAILQ_FOREACH_SAFE(alias, &mr->aliases, aliases_link, next) {
+        QTAILQ_REMOVE(&mr->aliases, alias, aliases_link);
+        alias->aliases_link.tqe_prev = NULL;
+    }
+    if (mr->alias && mr->aliases_link.tqe_prev) {
+        QTAILQ_REMOVE(&mr->alias->aliases, mr, aliases_link);
+    }
     mr->destructor(mr);
     memory_region_clear_coalescing(mr);
     g_free((char *)mr->name);
@@ -1288,7 +1534,9 @@ static void memory_region_add_subregion_common(MemoryRegion *mr,
     }
     QTAILQ_INSERT_TAIL(&mr->subregions, subregion, subregions_link);
 done:
-    memory_region_update_topology(mr);
+    if (mr->enabled) {
+        memory_region_update_topology(subregion);
+    }
 }
 
 
@@ -1315,9 +1563,14 @@ void memory_region_del_subregion(MemoryRegion *mr,
                                  MemoryRegion *subregion)
 {
     assert(subregion->parent == mr);
+    if (mr->enabled && subregion->enabled) {
+        memory_region_mark_dirty(subregion);
+    }
     subregion->parent = NULL;
     QTAILQ_REMOVE(&mr->subregions, subregion, subregions_link);
-    memory_region_update_topology(mr);
+    if (mr->enabled && subregion->enabled) {
+        memory_region_commit_topology();
+    }
 }
 
 void memory_region_set_enabled(MemoryRegion *mr, bool enabled)
@@ -1326,7 +1579,8 @@ void memory_region_set_enabled(MemoryRegion *mr, bool enabled)
         return;
     }
     mr->enabled = enabled;
-    memory_region_update_topology(NULL);
+    memory_region_mark_dirty(mr);
+    memory_region_commit_topology();
 }
 
 void memory_region_set_address(MemoryRegion *mr, target_phys_addr_t addr)
@@ -1364,6 +1618,12 @@ void memory_region_set_alias_offset(MemoryRegion *mr, target_phys_addr_t offset)
     memory_region_update_topology(mr);
 }
 
+void memory_region_set_numa_node(MemoryRegion *mr, int node)
+{
+    assert(mr->terminates && mr->ram);
+    qemu_ram_set_numa_node(mr->ram_addr, node);
+}
+
 ram_addr_t memory_region_get_ram_addr(MemoryRegion *mr)
 {
     return mr->ram_addr;
@@ -1427,6 +1687,28 @@ void memory_global_sync_dirty_bitmap(MemoryRegion *address_space)
     }
 }
 
+void memory_region_foreach_section(MemoryRegion *address_space,
+                                   void (*fn)(MemoryRegionSection *section,
+                                              void *opaque),
+                                   void *opaque)
+{
+    AddressSpace *as = memory_region_to_address_space(address_space);
+    FlatRange *fr;
+
+    FOR_EACH_FLAT_RANGE(fr, &as->current_map) {
+        MemoryRegionSection section = {
+            .mr = fr->mr,
+            .address_space = as->root,
+            .offset_within_region = fr->offset_in_region,
+            .size = int128_get64(fr->addr.size),
+            .offset_within_address_space = int128_get64(fr->addr.start),
+            .readonly = fr->readonly,
+        };
+
+        fn(&section, opaque);
+    }
+}
+
 void memory_global_dirty_log_start(void)
 {
     global_dirty_log = true;
@@ -1514,6 +1796,34 @@ void io_mem_write(MemoryRegion *mr, target_phys_addr_t addr,
     memory_region_dispatch_write(mr, addr, val, size);
 }
 
+bool io_mem_has_nolock(MemoryRegion *mr)
+{
+    return mr->ops && (mr->ops->read_nolock || mr->ops->write_nolock);
+}
+
+bool io_mem_read_nolock(MemoryRegion *mr, target_phys_addr_t addr,
+                        uint64_t *val, unsigned size)
+{
+    if (!mr->ops->read_nolock
+        || !memory_region_access_valid(mr, addr, size, false)
+        || !mr->ops->read_nolock(mr->opaque, addr, val, size)) {
+        return false;
+    }
+    adjust_endianness(mr, val, size);
+    return true;
+}
+
+bool io_mem_write_nolock(MemoryRegion *mr, target_phys_addr_t addr,
+                         uint64_t val, unsigned size)
+{
+    if (!mr->ops->write_nolock
+        || !memory_region_access_valid(mr, addr, size, true)) {
+        return false;
+    }
+    adjust_endianness(mr, &val, size);
+    return mr->ops->write_nolock(mr->opaque, addr, val, size);
+}
+
 typedef struct MemoryRegionList MemoryRegionList;
 
 struct MemoryRegionList {
@@ -1641,6 +1951,12 @@ void mtree_info(fprintf_function mon_printf, void *f)
         }
     }
 
+    mon_printf(f, "topology updates: %" PRIu64 " (%" PRIu64 " full), "
+               "%" PRId64 " us total, %u memory ranges\n",
+               topology_updates, topology_updates_full,
+               topology_update_ns / 1000,
+               address_space_memory.current_map.nr);
+
     QTAILQ_FOREACH_SAFE(ml, &ml_head, queue, ml2) {
         g_free(ml);
     }
@@ -111,6 +111,21 @@ struct MemoryRegionOps {
      * backwards compatibility with old mmio registration
      */
     const MemoryRegionMmio old_mmio;
+
+    /* Optional handlers called by vCPU threads without the global mutex
+     * held.  They may only touch state protected by the device's own lock,
+     * and return %false to have the access retried under the global mutex
+     * through @read or @write.  @addr is relative to @mr; @size is in bytes
+     * and is checked against @valid.
+     */
+    bool (*read_nolock)(void *opaque,
+                        target_phys_addr_t addr,
+                        uint64_t *data,
+                        unsigned size);
+    bool (*write_nolock)(void *opaque,
+                         target_phys_addr_t addr,
+                         uint64_t data,
+                         unsigned size);
 };
 
 typedef struct CoalescedMemoryRange CoalescedMemoryRange;
@@ -135,6 +150,8 @@ struct MemoryRegion {
     bool warning_printed; /* For reservations */
     MemoryRegion *alias;
     target_phys_addr_t alias_offset;
+    QTAILQ_HEAD(aliases, MemoryRegion) aliases;
+    QTAILQ_ENTRY(MemoryRegion) aliases_link;
     unsigned priority;
     bool may_overlap;
     QTAILQ_HEAD(subregions, MemoryRegion) subregions;
@@ -317,8 +334,8 @@ void memory_region_init_reservation(MemoryRegion *mr,
  * memory_region_destroy: Destroy a memory region and reclaim all resources.
  *
  * @mr: the region to be destroyed.  May not currently be a subregion
- *      (see memory_region_add_subregion()) or referenced in an alias
- *      (see memory_region_init_alias()).
+ *      (see memory_region_add_subregion()), or be referenced by an alias
+ *      that is still mapped (see memory_region_init_alias()).
  */
 void memory_region_destroy(MemoryRegion *mr);
 
@@ -601,6 +618,18 @@ void memory_region_add_subregion_overlap(MemoryRegion *mr,
                                          MemoryRegion *subregion,
                                          unsigned priority);
 
+/**
+ * memory_region_set_numa_node: Apply the host memory policy of a guest NUMA
+ *                              node to a RAM region.
+ *
+ * Pages of the region that are already allocated are moved to the host
+ * nodes given by the -numa host-nodes and policy options of the node.
+ *
+ * @mr: the RAM memory region
+ * @node: the guest NUMA node
+ */
+void memory_region_set_numa_node(MemoryRegion *mr, int node);
+
 /**
  * memory_region_get_ram_addr: Get the ram address associated with a memory
  *                             region
@@ -706,6 +735,21 @@ memory_region_section_addr(MemoryRegionSection *section,
  */
 void memory_global_sync_dirty_bitmap(MemoryRegion *address_space);
 
+/**
+ * memory_region_foreach_section: iterate over the memory map
+ *
+ * Calls @fn for each section of the current flat view of an address space,
+ * in ascending address order.
+ *
+ * @address_space: a top-level (i.e. parentless) region
+ * @fn: the function called for each section
+ * @opaque: passed to @fn
+ */
+void memory_region_foreach_section(MemoryRegion *address_space,
+                                   void (*fn)(MemoryRegionSection *section,
+                                              void *opaque),
+                                   void *opaque);
+
 /**
  * memory_region_transaction_begin: Start a transaction.
  *
@@ -133,6 +133,8 @@ MigrationInfo *qmp_query_migrate(Error **errp)
         info->ram->total = ram_bytes_total();
         info->ram->total_time = qemu_get_clock_ms(rt_clock)
             - s->total_time;
+        info->ram->has_skipped = true;
+        info->ram->skipped = ram_bytes_skipped();
 
         if (blk_mig_active()) {
             info->has_disk = true;
@@ -152,6 +154,8 @@ MigrationInfo *qmp_query_migrate(Error **errp)
         info->ram->remaining = 0;
         info->ram->total = ram_bytes_total();
         info->ram->total_time = s->total_time;
+        info->ram->has_skipped = true;
+        info->ram->skipped = ram_bytes_skipped();
         break;
     case MIG_STATE_ERROR:
         info->has_status = true;
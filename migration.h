@@ -81,6 +81,9 @@ bool migration_has_failed(MigrationState *);
 uint64_t ram_bytes_remaining(void);
 uint64_t ram_bytes_transferred(void);
 uint64_t ram_bytes_total(void);
+uint64_t ram_bytes_skipped(void);
+void ram_free_page_hint(struct MemoryRegion *mr, ram_addr_t offset,
+                        ram_addr_t len);
 
 extern SaveVMHandlers savevm_ram_handlers;
 
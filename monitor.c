@@ -28,6 +28,8 @@
 #include "hw/pcmcia.h"
 #include "hw/pc.h"
 #include "hw/pci.h"
+#include "hw/msi.h"
+#include "cpus.h"
 #include "hw/watchdog.h"
 #include "hw/loader.h"
 #include "gdbstub.h"
@@ -1080,6 +1082,18 @@ static void do_singlestep(Monitor *mon, const QDict *qdict)
     }
 }
 
+static void do_msi_timing(Monitor *mon, const QDict *qdict)
+{
+    const char *option = qdict_get_try_str(qdict, "option");
+    if (!option || !strcmp(option, "on")) {
+        msi_set_timing(true);
+    } else if (!strcmp(option, "off")) {
+        msi_set_timing(false);
+    } else {
+        monitor_printf(mon, "unexpected option %s\n", option);
+    }
+}
+
 static void do_gdbserver(Monitor *mon, const QDict *qdict)
 {
     const char *device = qdict_get_try_str(qdict, "device");
@@ -2089,13 +2103,28 @@ static void do_info_mtree(Monitor *mon)
     mtree_info((fprintf_function)monitor_printf, mon);
 }
 
+static void do_info_halt_poll(Monitor *mon)
+{
+    halt_poll_info((fprintf_function)monitor_printf, mon);
+}
+
+static void do_info_msi(Monitor *mon)
+{
+    msi_info((fprintf_function)monitor_printf, mon);
+}
+
 static void do_info_numa(Monitor *mon)
 {
     int i;
     CPUArchState *env;
+    NumaNodeMemoryInfoList *mem_list, *mem;
 
     monitor_printf(mon, "%d nodes\n", nb_numa_nodes);
-    for (i = 0; i < nb_numa_nodes; i++) {
+    mem_list = qmp_query_numa_memory(NULL);
+    for (i = 0, mem = mem_list; i < nb_numa_nodes; i++, mem = mem->next) {
+        NumaNodeMemoryInfo *info = mem->value;
+        NumaHostNodeMemoryList *host;
+
         monitor_printf(mon, "node %d cpus:", i);
         for (env = first_cpu; env != NULL; env = env->next_cpu) {
             if (env->numa_node == i) {
@@ -2105,7 +2134,23 @@ static void do_info_numa(Monitor *mon)
         monitor_printf(mon, "\n");
         monitor_printf(mon, "node %d size: %" PRId64 " MB\n", i,
             node_mem[i] >> 20);
+        if (info->policy != NUMA_HOST_POLICY_DEFAULT) {
+            monitor_printf(mon, "node %d host policy: %s, host nodes 0x%"
+                           PRIx64 "\n", i, NumaHostPolicy_lookup[info->policy],
+                           info->host_nodes);
+        }
+        if (info->placement || info->unallocated) {
+            monitor_printf(mon, "node %d host placement:", i);
+            for (host = info->placement; host; host = host->next) {
+                monitor_printf(mon, " %" PRId64 ": %" PRId64 " MB",
+                               host->value->host_node,
+                               host->value->size >> 20);
+            }
+            monitor_printf(mon, " unallocated: %" PRId64 " MB\n",
+                           info->unallocated >> 20);
+        }
     }
+    qapi_free_NumaNodeMemoryInfoList(mem_list);
 }
 
 #ifdef CONFIG_PROFILER
@@ -2543,6 +2588,27 @@ static mon_cmd_t info_cmds[] = {
         .help       = "show memory tree",
         .mhandler.info = do_info_mtree,
     },
+    {
+        .name       = "msi",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show MSI delivery statistics",
+        .mhandler.info = do_info_msi,
+    },
+    {
+        .name       = "halt-poll",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show vCPU halt polling statistics",
+        .mhandler.info = do_info_halt_poll,
+    },
+    {
+        .name       = "dump",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show the progress of the last guest memory dump",
+        .mhandler.info = hmp_info_dump,
+    },
     {
         .name       = "jit",
         .args_type  = "",
@@ -2550,6 +2616,13 @@ static mon_cmd_t info_cmds[] = {
         .help       = "show dynamic compiler info",
         .mhandler.info = do_info_jit,
     },
+    {
+        .name       = "jit-profile",
+        .args_type  = "",
+        .params     = "",
+        .help       = "show the most executed translated blocks",
+        .mhandler.info = hmp_info_jit_profile,
+    },
     {
         .name       = "kvm",
         .args_type  = "",
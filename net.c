@@ -28,8 +28,10 @@
 #include "net/tap.h"
 #include "net/socket.h"
 #include "net/dump.h"
+#include "net/rss.h"
 #include "net/slirp.h"
 #include "net/vde.h"
+#include "net/vhost-user.h"
 #include "net/util.h"
 #include "monitor.h"
 #include "qemu-common.h"
@@ -37,6 +39,7 @@
 #include "qmp-commands.h"
 #include "hw/qdev.h"
 #include "iov.h"
+#include "qemu-timer.h"
 #include "qapi-visit.h"
 #include "qapi/opts-visitor.h"
 #include "qapi/qapi-dealloc-visitor.h"
@@ -192,6 +195,7 @@ static ssize_t qemu_deliver_packet_iov(VLANClientState *sender,
                                        const struct iovec *iov,
                                        int iovcnt,
                                        void *opaque);
+static void net_throttle_free(VLANClientState *vc);
 
 VLANClientState *qemu_new_net_client(NetClientInfo *info,
                                      VLANState *vlan,
@@ -265,6 +269,18 @@ static void qemu_cleanup_vlan_client(VLANClientState *vc)
     if (vc->info->cleanup) {
         vc->info->cleanup(vc);
     }
+
+    if (vc->capture) {
+        net_capture_free(vc->capture);
+        vc->capture = NULL;
+    }
+    if (vc->throttle) {
+        net_throttle_free(vc);
+    }
+    if (vc->rss) {
+        net_rss_free(vc->rss);
+        vc->rss = NULL;
+    }
 }
 
 static void qemu_free_vlan_client(VLANClientState *vc)
@@ -358,11 +374,426 @@ void qemu_foreach_nic(qemu_nic_foreach func, void *opaque)
     }
 }
 
+int qemu_has_ufo(VLANClientState *vc)
+{
+    if (!vc || !vc->info->has_ufo) {
+        return 0;
+    }
+    return vc->info->has_ufo(vc);
+}
+
+int qemu_has_vnet_hdr(VLANClientState *vc)
+{
+    if (!vc || !vc->info->has_vnet_hdr) {
+        return 0;
+    }
+    return vc->info->has_vnet_hdr(vc);
+}
+
+void qemu_using_vnet_hdr(VLANClientState *vc, int enable)
+{
+    if (!vc || !vc->info->using_vnet_hdr) {
+        return;
+    }
+    vc->info->using_vnet_hdr(vc, enable);
+    vc->using_vnet_hdr = enable;
+}
+
+void qemu_set_offload(VLANClientState *vc, int csum, int tso4, int tso6,
+                      int ecn, int ufo)
+{
+    if (!vc || !vc->info->set_offload) {
+        return;
+    }
+    vc->info->set_offload(vc, csum, tso4, tso6, ecn, ufo);
+}
+
+/*
+ * The receive queue that the peer of a NIC steered the frame being
+ * delivered to it to, and the hash of the frame; -1 if the peer does not
+ * steer frames.  A backend steers each frame just before sending it and
+ * reads no further until it has been delivered, so the answer holds in the
+ * receive callbacks of the NIC.
+ */
+int qemu_get_rx_queue(VLANClientState *vc, uint32_t *hash)
+{
+    NetRss *rss = vc->peer ? vc->peer->rss : NULL;
+
+    if (!rss) {
+        return -1;
+    }
+    if (hash) {
+        *hash = rss->hash;
+    }
+    return rss->queue;
+}
+
+void qmp_netdev_set_rss(const char *id, int64_t queues,
+                        bool has_key, const char *key,
+                        bool has_table, const char *table, Error **errp)
+{
+    VLANClientState *vc;
+    uint8_t rss_key[NET_RSS_KEY_SIZE], rss_table[NET_RSS_TABLE_SIZE];
+    const char *p;
+    char *end;
+    long val;
+    int i, n;
+
+    vc = qemu_find_netdev(id);
+    if (!vc) {
+        error_set(errp, QERR_DEVICE_NOT_FOUND, id);
+        return;
+    }
+    if (vc->info->type != NET_CLIENT_OPTIONS_KIND_TAP) {
+        error_set(errp, QERR_NOT_SUPPORTED);
+        return;
+    }
+    if (queues < 0 || queues > NET_RSS_QUEUES_MAX) {
+        error_set(errp, QERR_INVALID_PARAMETER_VALUE, "queues",
+                  "a number of queues up to 16, or 0 to stop");
+        return;
+    }
+
+    if (has_key) {
+        for (i = 0; i < NET_RSS_KEY_SIZE; i++) {
+            if (!qemu_isxdigit(key[2 * i]) || !qemu_isxdigit(key[2 * i + 1])) {
+                break;
+            }
+            sscanf(key + 2 * i, "%2hhx", &rss_key[i]);
+        }
+        if (i < NET_RSS_KEY_SIZE || key[2 * i]) {
+            error_set(errp, QERR_INVALID_PARAMETER_VALUE, "key",
+                      "80 hexadecimal digits");
+            return;
+        }
+    }
+
+    /* a shorter table repeats to fill the 128 entries */
+    if (has_table) {
+        p = table;
+        n = 0;
+        do {
+            val = strtol(p, &end, 10);
+            if (end == p || val < 0 || val >= queues ||
+                n == NET_RSS_TABLE_SIZE) {
+                n = 0;
+                break;
+            }
+            rss_table[n++] = val;
+            p = end;
+        } while (*p++ == ',');
+        if (n == 0 || p[-1] || NET_RSS_TABLE_SIZE % n) {
+            error_set(errp, QERR_INVALID_PARAMETER_VALUE, "table",
+                      "a list of queues whose length divides 128");
+            return;
+        }
+        for (i = n; i < NET_RSS_TABLE_SIZE; i++) {
+            rss_table[i] = rss_table[i - n];
+        }
+    }
+
+    if (vc->rss) {
+        net_rss_free(vc->rss);
+        vc->rss = NULL;
+    }
+    if (queues) {
+        vc->rss = net_rss_new(queues, has_key ? rss_key : NULL,
+                              has_table ? rss_table : NULL);
+    }
+}
+
+NetdevRssInfoList *qmp_query_netdev_rss(Error **errp)
+{
+    NetdevRssInfoList *head = NULL, *entry;
+    NetdevRssQueueInfoList *queues, *qentry;
+    NetdevRssQueueInfo *qinfo;
+    NetdevRssInfo *info;
+    VLANClientState *vc;
+    NetRss *rss;
+    GString *str;
+    int i;
+
+    QTAILQ_FOREACH(vc, &non_vlan_clients, next) {
+        rss = vc->rss;
+        if (!rss) {
+            continue;
+        }
+        info = g_new0(NetdevRssInfo, 1);
+        info->id = g_strdup(vc->name);
+        info->unhashed = rss->unhashed;
+
+        str = g_string_new(NULL);
+        for (i = 0; i < NET_RSS_KEY_SIZE; i++) {
+            g_string_append_printf(str, "%02x", rss->key[i]);
+        }
+        info->key = g_string_free(str, false);
+
+        str = g_string_new(NULL);
+        for (i = 0; i < NET_RSS_TABLE_SIZE; i++) {
+            g_string_append_printf(str, i ? ",%d" : "%d", rss->table[i]);
+        }
+        info->table = g_string_free(str, false);
+
+        queues = NULL;
+        for (i = rss->queues - 1; i >= 0; i--) {
+            qinfo = g_new0(NetdevRssQueueInfo, 1);
+            qinfo->queue = i;
+            qinfo->rx_packets = rss->stats[i].packets;
+            qinfo->rx_bytes = rss->stats[i].bytes;
+
+            qentry = g_new0(NetdevRssQueueInfoList, 1);
+            qentry->value = qinfo;
+            qentry->next = queues;
+            queues = qentry;
+        }
+        info->queues = queues;
+
+        entry = g_new0(NetdevRssInfoList, 1);
+        entry->value = info;
+        entry->next = head;
+        head = entry;
+    }
+    return head;
+}
+
+/* Traffic shaping of a netdev
+ *
+ * Each direction has a token bucket for bytes and one for packets, filled
+ * at the configured rate up to the burst size.  A packet may pass when
+ * the byte bucket is not in debt and the packet bucket holds a token; it
+ * then takes its tokens, possibly driving the byte bucket negative.
+ * Otherwise qemu_deliver_packet() returns 0, so that the packet stays in
+ * the receiver's queue, and a timer flushes the queue once the debt is
+ * paid.  Packets from senders that do not wait for the queue are dropped
+ * once NET_THROTTLE_QUEUE_MAX of them are waiting.
+ */
+
+#define NET_THROTTLE_QUEUE_MAX  256
+
+typedef struct NetThrottleBucket {
+    struct NetThrottle *throttle;
+    double bytes;
+    double packets;
+    int64_t last;
+    bool waiting;
+    QEMUTimer *timer;
+    uint64_t delayed;
+    uint64_t dropped;
+} NetThrottleBucket;
+
+typedef struct NetThrottle {
+    VLANClientState *vc;
+    int64_t bps, pps;
+    int64_t bps_burst, pps_burst;
+    NetThrottleBucket tx;   /* from the guest, to the netdev */
+    NetThrottleBucket rx;   /* from the netdev, to the guest */
+} NetThrottle;
+
+/* the queue of the packets that go through bucket 'b' */
+static NetQueue *net_throttle_queue(NetThrottleBucket *b)
+{
+    VLANClientState *vc = b->throttle->vc;
+
+    if (b == &b->throttle->rx) {
+        vc = vc->peer;
+    }
+    return vc ? vc->send_queue : NULL;
+}
+
+static void net_throttle_timer(void *opaque)
+{
+    NetThrottleBucket *b = opaque;
+    NetQueue *queue = net_throttle_queue(b);
+
+    b->waiting = false;
+    if (queue) {
+        qemu_net_queue_flush(queue);
+    }
+}
+
+static void net_throttle_refill(NetThrottleBucket *b, int64_t now)
+{
+    NetThrottle *t = b->throttle;
+    double elapsed = (double)(now - b->last) / get_ticks_per_sec();
+
+    if (t->bps) {
+        b->bytes = MIN(b->bytes + elapsed * t->bps, t->bps_burst);
+    }
+    if (t->pps) {
+        b->packets = MIN(b->packets + elapsed * t->pps, t->pps_burst);
+    }
+    b->last = now;
+}
+
+/* Nanoseconds until a packet may pass bucket 'b' */
+static int64_t net_throttle_wait(NetThrottleBucket *b)
+{
+    NetThrottle *t = b->throttle;
+    double wait = 0;
+
+    if (t->bps && b->bytes < 0) {
+        wait = MAX(wait, -b->bytes / t->bps);
+    }
+    if (t->pps && b->packets < 1) {
+        wait = MAX(wait, (1 - b->packets) / t->pps);
+    }
+    return wait ? wait * get_ticks_per_sec() + 1 : 0;
+}
+
+/* Returns 0 if a packet of 'size' bytes from 'sender' may be delivered to
+ * 'vc' now, 1 if it has to wait in the queue and -1 if it is dropped.
+ * A packet is counted as delayed only the first time it is held back, not
+ * again when a flush of the queue finds the bucket still empty.
+ */
+static int net_throttle_packet(VLANClientState *sender, VLANClientState *vc,
+                               unsigned flags, size_t size)
+{
+    NetThrottleBucket *b;
+    int64_t now, wait;
+
+    if (vc->throttle) {
+        b = &vc->throttle->tx;
+    } else if (sender->throttle) {
+        b = &sender->throttle->rx;
+    } else {
+        return 0;
+    }
+
+    if (!b->waiting) {
+        now = qemu_get_clock_ns(vm_clock);
+        net_throttle_refill(b, now);
+        wait = net_throttle_wait(b);
+        if (!wait) {
+            b->bytes -= b->throttle->bps ? size : 0;
+            b->packets -= b->throttle->pps ? 1 : 0;
+            return 0;
+        }
+        b->waiting = true;
+        qemu_mod_timer(b->timer, now + wait);
+    }
+
+    if (flags & QEMU_NET_PACKET_FLAG_DELAYED) {
+        return 1;
+    }
+    if (qemu_net_queue_length(vc->send_queue) >= NET_THROTTLE_QUEUE_MAX) {
+        b->dropped++;
+        return -1;
+    }
+    b->delayed++;
+    return 1;
+}
+
+static void net_throttle_init_bucket(NetThrottle *t, NetThrottleBucket *b)
+{
+    b->throttle = t;
+    b->bytes = t->bps_burst;
+    b->packets = t->pps_burst;
+    b->last = qemu_get_clock_ns(vm_clock);
+    b->timer = qemu_new_timer_ns(vm_clock, net_throttle_timer, b);
+}
+
+static void net_throttle_free(VLANClientState *vc)
+{
+    NetThrottle *t = vc->throttle;
+
+    qemu_del_timer(t->tx.timer);
+    qemu_free_timer(t->tx.timer);
+    qemu_del_timer(t->rx.timer);
+    qemu_free_timer(t->rx.timer);
+    g_free(t);
+    vc->throttle = NULL;
+}
+
+void qmp_netdev_set_throttle(const char *id, int64_t bps, int64_t pps,
+                             bool has_bps_burst, int64_t bps_burst,
+                             bool has_pps_burst, int64_t pps_burst,
+                             Error **errp)
+{
+    VLANClientState *vc;
+    NetThrottle *t;
+
+    vc = qemu_find_netdev(id);
+    if (!vc) {
+        error_set(errp, QERR_DEVICE_NOT_FOUND, id);
+        return;
+    }
+    if (bps < 0 || pps < 0) {
+        error_set(errp, QERR_INVALID_PARAMETER_VALUE, bps < 0 ? "bps" : "pps",
+                  "a positive rate, or 0 for no limit");
+        return;
+    }
+    if ((has_bps_burst && bps_burst <= 0) ||
+        (has_pps_burst && pps_burst <= 0)) {
+        error_set(errp, QERR_INVALID_PARAMETER_VALUE,
+                  has_bps_burst && bps_burst <= 0 ? "bps_burst" : "pps_burst",
+                  "a positive size");
+        return;
+    }
+
+    if (vc->throttle) {
+        net_throttle_free(vc);
+    }
+
+    if (bps || pps) {
+        /* by default, allow a tenth of a second worth of traffic at once */
+        t = g_new0(NetThrottle, 1);
+        t->vc = vc;
+        t->bps = bps;
+        t->pps = pps;
+        t->bps_burst = has_bps_burst ? bps_burst : MAX(bps / 10, 1);
+        t->pps_burst = has_pps_burst ? pps_burst : MAX(pps / 10, 1);
+        net_throttle_init_bucket(t, &t->tx);
+        net_throttle_init_bucket(t, &t->rx);
+        vc->throttle = t;
+    }
+
+    /* what the old limits held back goes through the new ones */
+    qemu_net_queue_flush(vc->send_queue);
+    if (vc->peer) {
+        qemu_net_queue_flush(vc->peer->send_queue);
+    }
+}
+
+NetdevThrottleInfoList *qmp_query_netdev_throttle(Error **errp)
+{
+    NetdevThrottleInfoList *head = NULL, *entry;
+    NetdevThrottleInfo *info;
+    VLANClientState *vc;
+    NetThrottle *t;
+
+    QTAILQ_FOREACH(vc, &non_vlan_clients, next) {
+        t = vc->throttle;
+        if (!t) {
+            continue;
+        }
+        info = g_new0(NetdevThrottleInfo, 1);
+        info->id = g_strdup(vc->name);
+        info->bps = t->bps;
+        info->pps = t->pps;
+        info->bps_burst = t->bps_burst;
+        info->pps_burst = t->pps_burst;
+        info->tx_delayed = t->tx.delayed;
+        info->tx_dropped = t->tx.dropped;
+        info->rx_delayed = t->rx.delayed;
+        info->rx_dropped = t->rx.dropped;
+
+        entry = g_new0(NetdevThrottleInfoList, 1);
+        entry->value = info;
+        entry->next = head;
+        head = entry;
+    }
+    return head;
+}
+
 int qemu_can_send_packet(VLANClientState *sender)
 {
     VLANState *vlan = sender->vlan;
     VLANClientState *vc;
 
+    if (sender->throttle && sender->throttle->rx.waiting) {
+        return 0;
+    }
+
     if (sender->peer) {
         if (sender->peer->receive_disabled) {
             return 0;
@@ -408,6 +839,13 @@ static ssize_t qemu_deliver_packet(VLANClientState *sender,
         return 0;
     }
 
+    switch (net_throttle_packet(sender, vc, flags, size)) {
+    case 1:
+        return 0;
+    case -1:
+        return size;
+    }
+
     if (flags & QEMU_NET_PACKET_FLAG_RAW && vc->info->receive_raw) {
         ret = vc->info->receive_raw(vc, data, size);
     } else {
@@ -497,6 +935,19 @@ void qemu_flush_queued_packets(VLANClientState *vc)
     qemu_net_queue_flush(queue);
 }
 
+/* Show a packet sent by or to a netdev to the capture running on it */
+static void qemu_net_capture(VLANClientState *sender, unsigned flags,
+                             const struct iovec *iov, int iovcnt)
+{
+    VLANClientState *vc = sender->capture ? sender : sender->peer;
+
+    if (vc && vc->capture) {
+        net_capture_packet(vc->capture, iov, iovcnt,
+                           vc->using_vnet_hdr &&
+                           !(flags & QEMU_NET_PACKET_FLAG_RAW));
+    }
+}
+
 static ssize_t qemu_send_packet_async_with_flags(VLANClientState *sender,
                                                  unsigned flags,
                                                  const uint8_t *buf, int size,
@@ -513,6 +964,15 @@ static ssize_t qemu_send_packet_async_with_flags(VLANClientState *sender,
         return size;
     }
 
+    if (sender->capture || (sender->peer && sender->peer->capture)) {
+        struct iovec iov = {
+            .iov_base = (uint8_t *)buf,
+            .iov_len = size,
+        };
+
+        qemu_net_capture(sender, flags, &iov, 1);
+    }
+
     if (sender->peer) {
         queue = sender->peer->send_queue;
     } else {
@@ -564,6 +1024,13 @@ static ssize_t qemu_deliver_packet_iov(VLANClientState *sender,
         return iov_size(iov, iovcnt);
     }
 
+    switch (net_throttle_packet(sender, vc, flags, iov_size(iov, iovcnt))) {
+    case 1:
+        return 0;
+    case -1:
+        return iov_size(iov, iovcnt);
+    }
+
     if (vc->info->receive_iov) {
         return vc->info->receive_iov(vc, iov, iovcnt);
     } else {
@@ -617,6 +1084,10 @@ ssize_t qemu_sendv_packet_async(VLANClientState *sender,
         return iov_size(iov, iovcnt);
     }
 
+    if (sender->capture || (sender->peer && sender->peer->capture)) {
+        qemu_net_capture(sender, QEMU_NET_PACKET_FLAG_NONE, iov, iovcnt);
+    }
+
     if (sender->peer) {
         queue = sender->peer->send_queue;
     } else {
@@ -829,6 +1300,9 @@ static int (* const net_client_init_fun[NET_CLIENT_OPTIONS_KIND_MAX])(
 #ifdef CONFIG_NET_BRIDGE
         [NET_CLIENT_OPTIONS_KIND_BRIDGE] = net_init_bridge,
 #endif
+#ifdef CONFIG_LINUX
+        [NET_CLIENT_OPTIONS_KIND_VHOST_USER] = net_init_vhost_user,
+#endif
 };
 
 
@@ -857,6 +1331,9 @@ static int net_client_init1(const void *object, int is_netdev, Error **errp)
 #endif
 #ifdef CONFIG_NET_BRIDGE
         case NET_CLIENT_OPTIONS_KIND_BRIDGE:
+#endif
+#ifdef CONFIG_LINUX
+        case NET_CLIENT_OPTIONS_KIND_VHOST_USER:
 #endif
             break;
 
@@ -1053,6 +1530,28 @@ static void print_net_client(Monitor *mon, VLANClientState *vc)
 {
     monitor_printf(mon, "%s: type=%s,%s\n", vc->name,
                    NetClientOptionsKind_lookup[vc->info->type], vc->info_str);
+    if (vc->capture) {
+        net_capture_print(mon, vc->capture);
+    }
+    if (vc->throttle) {
+        NetThrottle *t = vc->throttle;
+
+        monitor_printf(mon, "    throttle: bps=%" PRId64 " pps=%" PRId64
+                       " (delayed tx %" PRIu64 " rx %" PRIu64
+                       ", dropped tx %" PRIu64 " rx %" PRIu64 ")\n",
+                       t->bps, t->pps, t->tx.delayed, t->rx.delayed,
+                       t->tx.dropped, t->rx.dropped);
+    }
+    if (vc->rss) {
+        NetRss *rss = vc->rss;
+        int i;
+
+        monitor_printf(mon, "    rss: %d queues, rx packets", rss->queues);
+        for (i = 0; i < rss->queues; i++) {
+            monitor_printf(mon, " %" PRIu64, rss->stats[i].packets);
+        }
+        monitor_printf(mon, " (unhashed %" PRIu64 ")\n", rss->unhashed);
+    }
 }
 
 void do_info_network(Monitor *mon)
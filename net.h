@@ -36,6 +36,10 @@ typedef ssize_t (NetReceive)(VLANClientState *, const uint8_t *, size_t);
 typedef ssize_t (NetReceiveIOV)(VLANClientState *, const struct iovec *, int);
 typedef void (NetCleanup) (VLANClientState *);
 typedef void (LinkStatusChanged)(VLANClientState *);
+typedef int (HasUfo)(VLANClientState *);
+typedef int (HasVnetHdr)(VLANClientState *);
+typedef void (UsingVnetHdr)(VLANClientState *, int);
+typedef void (SetOffload)(VLANClientState *, int, int, int, int, int);
 
 typedef struct NetClientInfo {
     NetClientOptionsKind type;
@@ -47,6 +51,11 @@ typedef struct NetClientInfo {
     NetCleanup *cleanup;
     LinkStatusChanged *link_status_changed;
     NetPoll *poll;
+    /* backends that exchange packets with a struct virtio_net_hdr */
+    HasUfo *has_ufo;
+    HasVnetHdr *has_vnet_hdr;
+    UsingVnetHdr *using_vnet_hdr;
+    SetOffload *set_offload;
 } NetClientInfo;
 
 struct VLANClientState {
@@ -60,6 +69,10 @@ struct VLANClientState {
     char *name;
     char info_str[256];
     unsigned receive_disabled : 1;
+    int using_vnet_hdr;
+    struct NetCapture *capture;
+    struct NetThrottle *throttle;
+    struct NetRss *rss;
 };
 
 typedef struct NICState {
@@ -102,6 +115,12 @@ void qemu_send_packet(VLANClientState *vc, const uint8_t *buf, int size);
 ssize_t qemu_send_packet_raw(VLANClientState *vc, const uint8_t *buf, int size);
 ssize_t qemu_send_packet_async(VLANClientState *vc, const uint8_t *buf,
                                int size, NetPacketSent *sent_cb);
+int qemu_has_ufo(VLANClientState *vc);
+int qemu_has_vnet_hdr(VLANClientState *vc);
+void qemu_using_vnet_hdr(VLANClientState *vc, int enable);
+void qemu_set_offload(VLANClientState *vc, int csum, int tso4, int tso6,
+                      int ecn, int ufo);
+int qemu_get_rx_queue(VLANClientState *vc, uint32_t *hash);
 void qemu_purge_queued_packets(VLANClientState *vc);
 void qemu_flush_queued_packets(VLANClientState *vc);
 void qemu_format_nic_info_str(VLANClientState *vc, uint8_t macaddr[6]);
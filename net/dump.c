@@ -27,13 +27,33 @@
 #include "qemu-error.h"
 #include "qemu-log.h"
 #include "qemu-timer.h"
+#include "qemu-thread.h"
+#include "qemu-queue.h"
+#include "qemu_socket.h"
+#include "qerror.h"
+#include "monitor.h"
+#include "iov.h"
+#include "hw/virtio-net.h"
+#include "qmp-commands.h"
 
-typedef struct DumpState {
-    VLANClientState nc;
-    int64_t start_ts;
-    int fd;
-    int pcap_caplen;
-} DumpState;
+/*
+ * Packets are captured into an in-memory buffer of chunks on the thread
+ * that sends them; a full chunk, or one that has been pending for
+ * CAPTURE_FLUSH_MS, is handed to a writer thread.  When no free chunk is
+ * left the packet is dropped from the capture, never delayed.
+ *
+ * Records never straddle chunks, so the producer also decides where a
+ * file ends when rotating: a chunk flagged 'rotate' starts a new file.
+ */
+
+#define CAPTURE_CHUNK_SIZE      (256 * 1024)
+#define CAPTURE_BUFFER_SIZE     (4 * 1024 * 1024)
+#define CAPTURE_FLUSH_MS        500
+#define CAPTURE_SNAPLEN         65535
+
+/* bytes of each packet that the filter looks at */
+#define CAPTURE_FILTER_HEAD     128
+#define CAPTURE_FILTER_MAX      64
 
 #define PCAP_MAGIC 0xa1b2c3d4
 
@@ -56,61 +76,322 @@ struct pcap_sf_pkthdr {
     uint32_t len;
 };
 
-static ssize_t dump_receive(VLANClientState *nc, const uint8_t *buf, size_t size)
+typedef enum CaptureFilterOp {
+    FILTER_ETHERTYPE,
+    FILTER_IPPROTO,
+    FILTER_HOST,
+    FILTER_PORT,
+    FILTER_AND,
+    FILTER_OR,
+    FILTER_NOT,
+} CaptureFilterOp;
+
+#define FILTER_SRC  1
+#define FILTER_DST  2
+
+typedef struct CaptureFilterInsn {
+    CaptureFilterOp op;
+    int dir;
+    uint32_t arg;
+} CaptureFilterInsn;
+
+/* a filter expression, compiled to postfix order */
+typedef struct CaptureFilter {
+    int len;
+    CaptureFilterInsn insn[CAPTURE_FILTER_MAX];
+} CaptureFilter;
+
+typedef struct CaptureChunk {
+    QSIMPLEQ_ENTRY(CaptureChunk) next;
+    bool rotate;
+    size_t len;
+    uint8_t data[CAPTURE_CHUNK_SIZE];
+} CaptureChunk;
+
+struct NetCapture {
+    char *filename;
+    int snaplen;
+    int64_t file_size;
+    int file_count;
+    int64_t start_ts;
+    CaptureFilter *filter;
+
+    /* producer side */
+    CaptureChunk *cur;
+    bool rotate;
+    int64_t file_bytes;
+    QEMUTimer *flush_timer;
+    uint64_t packets;
+    uint64_t dropped;
+
+    /* writer thread */
+    int fd;
+    int file_index;
+    QemuThread thread;
+
+    QemuMutex lock;
+    QemuCond cond;
+    QSIMPLEQ_HEAD(, CaptureChunk) free;
+    QSIMPLEQ_HEAD(, CaptureChunk) full;
+    bool stopping;
+};
+
+typedef struct DumpState {
+    VLANClientState nc;
+    NetCapture *capture;
+} DumpState;
+
+/* filter expressions */
+
+typedef struct FilterParser {
+    char **tok;
+    int pos;
+    CaptureFilter *f;
+} FilterParser;
+
+static bool filter_accept(FilterParser *p, const char *a, const char *b)
 {
-    DumpState *s = DO_UPCAST(DumpState, nc, nc);
-    struct pcap_sf_pkthdr hdr;
-    int64_t ts;
-    int caplen;
+    const char *t = p->tok[p->pos];
 
-    /* Early return in case of previous error. */
-    if (s->fd < 0) {
-        return size;
+    if (t && (!strcmp(t, a) || (b && !strcmp(t, b)))) {
+        p->pos++;
+        return true;
     }
+    return false;
+}
 
-    ts = muldiv64(qemu_get_clock_ns(vm_clock), 1000000, get_ticks_per_sec());
-    caplen = size > s->pcap_caplen ? s->pcap_caplen : size;
+static bool filter_emit(FilterParser *p, CaptureFilterOp op, int dir,
+                        uint32_t arg)
+{
+    CaptureFilterInsn *insn;
 
-    hdr.ts.tv_sec = ts / 1000000 + s->start_ts;
-    hdr.ts.tv_usec = ts % 1000000;
-    hdr.caplen = caplen;
-    hdr.len = size;
-    if (write(s->fd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
-        write(s->fd, buf, caplen) != caplen) {
-        qemu_log("-net dump write error - stop dump\n");
-        close(s->fd);
-        s->fd = -1;
+    if (p->f->len == CAPTURE_FILTER_MAX) {
+        return false;
     }
+    insn = &p->f->insn[p->f->len++];
+    insn->op = op;
+    insn->dir = dir;
+    insn->arg = arg;
+    return true;
+}
+
+static bool filter_parse_or(FilterParser *p);
 
-    return size;
+static bool filter_parse_primitive(FilterParser *p)
+{
+    int dir = FILTER_SRC | FILTER_DST;
+    struct in_addr addr;
+    unsigned long val;
+    const char *t;
+    char *end;
+
+    if (filter_accept(p, "not", "!")) {
+        return filter_parse_primitive(p) && filter_emit(p, FILTER_NOT, 0, 0);
+    }
+    if (filter_accept(p, "(", NULL)) {
+        return filter_parse_or(p) && filter_accept(p, ")", NULL);
+    }
+
+    if (filter_accept(p, "ip", NULL)) {
+        return filter_emit(p, FILTER_ETHERTYPE, 0, 0x0800);
+    } else if (filter_accept(p, "arp", NULL)) {
+        return filter_emit(p, FILTER_ETHERTYPE, 0, 0x0806);
+    } else if (filter_accept(p, "ip6", NULL)) {
+        return filter_emit(p, FILTER_ETHERTYPE, 0, 0x86dd);
+    } else if (filter_accept(p, "icmp", NULL)) {
+        return filter_emit(p, FILTER_IPPROTO, 0, 1);
+    } else if (filter_accept(p, "tcp", NULL)) {
+        return filter_emit(p, FILTER_IPPROTO, 0, 6);
+    } else if (filter_accept(p, "udp", NULL)) {
+        return filter_emit(p, FILTER_IPPROTO, 0, 17);
+    } else if (filter_accept(p, "ether", NULL)) {
+        if (!filter_accept(p, "proto", NULL) || !(t = p->tok[p->pos++])) {
+            return false;
+        }
+        val = strtoul(t, &end, 0);
+        return !*end && val <= 0xffff &&
+            filter_emit(p, FILTER_ETHERTYPE, 0, val);
+    }
+
+    if (filter_accept(p, "src", NULL)) {
+        dir = FILTER_SRC;
+    } else if (filter_accept(p, "dst", NULL)) {
+        dir = FILTER_DST;
+    }
+    if (filter_accept(p, "host", NULL)) {
+        t = p->tok[p->pos++];
+        return t && inet_aton(t, &addr) &&
+            filter_emit(p, FILTER_HOST, dir, ntohl(addr.s_addr));
+    } else if (filter_accept(p, "port", NULL)) {
+        if (!(t = p->tok[p->pos++])) {
+            return false;
+        }
+        val = strtoul(t, &end, 10);
+        return !*end && val <= 0xffff && filter_emit(p, FILTER_PORT, dir, val);
+    }
+    return false;
 }
 
-static void dump_cleanup(VLANClientState *nc)
+static bool filter_parse_and(FilterParser *p)
 {
-    DumpState *s = DO_UPCAST(DumpState, nc, nc);
+    if (!filter_parse_primitive(p)) {
+        return false;
+    }
+    while (filter_accept(p, "and", "&&")) {
+        if (!filter_parse_primitive(p) || !filter_emit(p, FILTER_AND, 0, 0)) {
+            return false;
+        }
+    }
+    return true;
+}
 
-    close(s->fd);
+static bool filter_parse_or(FilterParser *p)
+{
+    if (!filter_parse_and(p)) {
+        return false;
+    }
+    while (filter_accept(p, "or", "||")) {
+        if (!filter_parse_and(p) || !filter_emit(p, FILTER_OR, 0, 0)) {
+            return false;
+        }
+    }
+    return true;
 }
 
-static NetClientInfo net_dump_info = {
-    .type = NET_CLIENT_OPTIONS_KIND_DUMP,
-    .size = sizeof(DumpState),
-    .receive = dump_receive,
-    .cleanup = dump_cleanup,
-};
+/* Split 'str' into words, with parentheses as words of their own */
+static char **filter_tokenize(const char *str)
+{
+    GString *spaced = g_string_new(NULL);
+    char **words, **tok;
+    int i, n;
+
+    for (; *str; str++) {
+        if (*str == '(' || *str == ')') {
+            g_string_append_printf(spaced, " %c ", *str);
+        } else {
+            g_string_append_c(spaced, *str);
+        }
+    }
+    words = g_strsplit_set(spaced->str, " \t\n", -1);
+    g_string_free(spaced, true);
+
+    /* drop the empty strings between consecutive separators */
+    tok = g_new0(char *, g_strv_length(words) + 1);
+    for (i = n = 0; words[i]; i++) {
+        if (*words[i]) {
+            tok[n++] = words[i];
+        } else {
+            g_free(words[i]);
+        }
+    }
+    g_free(words);
+    return tok;
+}
+
+static CaptureFilter *capture_filter_compile(const char *str, Error **errp)
+{
+    FilterParser p = {
+        .tok = filter_tokenize(str),
+        .f = g_new0(CaptureFilter, 1),
+    };
+
+    if (!filter_parse_or(&p) || p.tok[p.pos]) {
+        error_set(errp, QERR_INVALID_PARAMETER_VALUE, "filter",
+                  "a filter expression such as 'tcp and port 80'");
+        g_free(p.f);
+        p.f = NULL;
+    }
+    g_strfreev(p.tok);
+    return p.f;
+}
+
+static bool capture_filter_match(const CaptureFilter *f,
+                                 const uint8_t *buf, size_t len)
+{
+    bool stack[CAPTURE_FILTER_MAX];
+    const CaptureFilterInsn *insn;
+    uint16_t ethertype = 0, sport = 0, dport = 0;
+    uint32_t saddr = 0, daddr = 0;
+    bool ipv4 = false, ports = false;
+    uint8_t proto = 0;
+    size_t off = 14;
+    int i, sp = 0;
+
+    if (len >= off) {
+        ethertype = lduw_be_p(buf + 12);
+        if (ethertype == 0x8100 && len >= off + 4) {
+            ethertype = lduw_be_p(buf + 16);
+            off += 4;
+        }
+    }
+    if (ethertype == 0x0800 && len >= off + 20) {
+        const uint8_t *ip = buf + off;
+
+        ipv4 = true;
+        proto = ip[9];
+        saddr = ldl_be_p(ip + 12);
+        daddr = ldl_be_p(ip + 16);
+        off += (ip[0] & 0xf) * 4;
+        /* ports are only in the first fragment */
+        if ((proto == 6 || proto == 17) && !(lduw_be_p(ip + 6) & 0x1fff) &&
+            len >= off + 4) {
+            ports = true;
+            sport = lduw_be_p(buf + off);
+            dport = lduw_be_p(buf + off + 2);
+        }
+    }
+
+    for (i = 0; i < f->len; i++) {
+        insn = &f->insn[i];
+        switch (insn->op) {
+        case FILTER_ETHERTYPE:
+            stack[sp++] = ethertype == insn->arg;
+            break;
+        case FILTER_IPPROTO:
+            stack[sp++] = ipv4 && proto == insn->arg;
+            break;
+        case FILTER_HOST:
+            stack[sp++] = ipv4 &&
+                (((insn->dir & FILTER_SRC) && saddr == insn->arg) ||
+                 ((insn->dir & FILTER_DST) && daddr == insn->arg));
+            break;
+        case FILTER_PORT:
+            stack[sp++] = ports &&
+                (((insn->dir & FILTER_SRC) && sport == insn->arg) ||
+                 ((insn->dir & FILTER_DST) && dport == insn->arg));
+            break;
+        case FILTER_AND:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] && stack[sp];
+            break;
+        case FILTER_OR:
+            sp--;
+            stack[sp - 1] = stack[sp - 1] || stack[sp];
+            break;
+        case FILTER_NOT:
+            stack[sp - 1] = !stack[sp - 1];
+            break;
+        }
+    }
+    return stack[0];
+}
 
-static int net_dump_init(VLANState *vlan, const char *device,
-                         const char *name, const char *filename, int len)
+/* writer thread */
+
+static int capture_open_file(NetCapture *c)
 {
     struct pcap_file_hdr hdr;
-    VLANClientState *nc;
-    DumpState *s;
-    struct tm tm;
+    char *filename;
     int fd;
 
+    if (c->file_size) {
+        filename = g_strdup_printf("%s.%d", c->filename, c->file_index);
+    } else {
+        filename = g_strdup(c->filename);
+    }
     fd = open(filename, O_CREAT | O_TRUNC | O_WRONLY | O_BINARY, 0644);
+    g_free(filename);
     if (fd < 0) {
-        error_report("-net dump: can't open %s", filename);
         return -1;
     }
 
@@ -119,31 +400,351 @@ static int net_dump_init(VLANState *vlan, const char *device,
     hdr.version_minor = 4;
     hdr.thiszone = 0;
     hdr.sigfigs = 0;
-    hdr.snaplen = len;
+    hdr.snaplen = c->snaplen;
     hdr.linktype = 1;
 
-    if (write(fd, &hdr, sizeof(hdr)) < sizeof(hdr)) {
-        error_report("-net dump write error: %s", strerror(errno));
+    if (qemu_write_full(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
         close(fd);
         return -1;
     }
+    return fd;
+}
 
-    nc = qemu_new_net_client(&net_dump_info, vlan, NULL, device, name);
+static void capture_write_chunk(NetCapture *c, CaptureChunk *chunk)
+{
+    if (chunk->rotate && c->fd >= 0) {
+        close(c->fd);
+        c->file_index++;
+        if (c->file_count && c->file_index == c->file_count) {
+            c->file_index = 0;
+        }
+        c->fd = capture_open_file(c);
+        if (c->fd < 0) {
+            qemu_log("-net dump can't open the next file - stop dump\n");
+        }
+    }
 
-    snprintf(nc->info_str, sizeof(nc->info_str),
-             "dump to %s (len=%d)", filename, len);
+    /* Early return in case of previous error. */
+    if (c->fd < 0) {
+        return;
+    }
+    if (qemu_write_full(c->fd, chunk->data, chunk->len) != chunk->len) {
+        qemu_log("-net dump write error - stop dump\n");
+        close(c->fd);
+        c->fd = -1;
+    }
+}
+
+static void *capture_thread(void *opaque)
+{
+    NetCapture *c = opaque;
+    CaptureChunk *chunk;
+
+    qemu_mutex_lock(&c->lock);
+    for (;;) {
+        while (QSIMPLEQ_EMPTY(&c->full) && !c->stopping) {
+            qemu_cond_wait(&c->cond, &c->lock);
+        }
+        chunk = QSIMPLEQ_FIRST(&c->full);
+        if (!chunk) {
+            break;
+        }
+        QSIMPLEQ_REMOVE_HEAD(&c->full, next);
+        qemu_mutex_unlock(&c->lock);
 
-    s = DO_UPCAST(DumpState, nc, nc);
+        capture_write_chunk(c, chunk);
+        chunk->len = 0;
+        chunk->rotate = false;
 
-    s->fd = fd;
-    s->pcap_caplen = len;
+        qemu_mutex_lock(&c->lock);
+        QSIMPLEQ_INSERT_TAIL(&c->free, chunk, next);
+    }
+    qemu_mutex_unlock(&c->lock);
+
+    return NULL;
+}
+
+/* producer side */
+
+static void capture_submit(NetCapture *c)
+{
+    qemu_mutex_lock(&c->lock);
+    QSIMPLEQ_INSERT_TAIL(&c->full, c->cur, next);
+    qemu_cond_signal(&c->cond);
+    qemu_mutex_unlock(&c->lock);
+    c->cur = NULL;
+}
+
+static void capture_flush_timer(void *opaque)
+{
+    NetCapture *c = opaque;
+
+    if (c->cur) {
+        capture_submit(c);
+    }
+}
+
+void net_capture_packet(NetCapture *c, const struct iovec *iov, int iovcnt,
+                        bool vnet_hdr)
+{
+    uint8_t head[CAPTURE_FILTER_HEAD];
+    struct pcap_sf_pkthdr hdr;
+    size_t offset = 0, size, caplen, reclen;
+    int64_t ts;
+
+    if (vnet_hdr) {
+        offset = sizeof(struct virtio_net_hdr);
+    }
+    size = iov_size(iov, iovcnt);
+    if (size <= offset) {
+        return;
+    }
+    size -= offset;
+
+    if (c->filter &&
+        !capture_filter_match(c->filter, head,
+                              iov_to_buf(iov, iovcnt, offset,
+                                         head, sizeof(head)))) {
+        return;
+    }
+
+    caplen = MIN(size, c->snaplen);
+    caplen = MIN(caplen, CAPTURE_CHUNK_SIZE - sizeof(hdr));
+    reclen = sizeof(hdr) + caplen;
+
+    if (c->file_size && c->file_bytes > sizeof(struct pcap_file_hdr) &&
+        c->file_bytes + reclen > c->file_size) {
+        if (c->cur) {
+            capture_submit(c);
+        }
+        c->rotate = true;
+        c->file_bytes = sizeof(struct pcap_file_hdr);
+    } else if (c->cur && c->cur->len + reclen > CAPTURE_CHUNK_SIZE) {
+        capture_submit(c);
+    }
+
+    if (!c->cur) {
+        qemu_mutex_lock(&c->lock);
+        c->cur = QSIMPLEQ_FIRST(&c->free);
+        if (c->cur) {
+            QSIMPLEQ_REMOVE_HEAD(&c->free, next);
+        }
+        qemu_mutex_unlock(&c->lock);
+        if (!c->cur) {
+            c->dropped++;
+            return;
+        }
+        c->cur->rotate = c->rotate;
+        c->rotate = false;
+        qemu_mod_timer(c->flush_timer,
+                       qemu_get_clock_ms(rt_clock) + CAPTURE_FLUSH_MS);
+    }
+
+    ts = muldiv64(qemu_get_clock_ns(vm_clock), 1000000, get_ticks_per_sec());
+    hdr.ts.tv_sec = ts / 1000000 + c->start_ts;
+    hdr.ts.tv_usec = ts % 1000000;
+    hdr.caplen = caplen;
+    hdr.len = size;
+
+    memcpy(c->cur->data + c->cur->len, &hdr, sizeof(hdr));
+    iov_to_buf(iov, iovcnt, offset,
+               c->cur->data + c->cur->len + sizeof(hdr), caplen);
+    c->cur->len += reclen;
+    c->file_bytes += reclen;
+    c->packets++;
+}
+
+NetCapture *net_capture_new(const char *filename, int64_t snaplen,
+                            const char *filter, int64_t file_size,
+                            int64_t file_count, int64_t buffer_size,
+                            Error **errp)
+{
+    NetCapture *c;
+    CaptureChunk *chunk;
+    struct tm tm;
+    int i, nchunks;
+
+    if (snaplen <= 0 || snaplen > INT_MAX) {
+        error_set(errp, QERR_INVALID_PARAMETER_VALUE, "snaplen",
+                  "a positive size");
+        return NULL;
+    }
+    if (file_size < 0 || file_count < 0 || file_count > INT_MAX ||
+        buffer_size < 0) {
+        error_set(errp, QERR_INVALID_PARAMETER_VALUE,
+                  file_size < 0 ? "file-size" :
+                  buffer_size < 0 ? "buffer-size" : "file-count",
+                  "a positive number");
+        return NULL;
+    }
+
+    c = g_new0(NetCapture, 1);
+    c->filename = g_strdup(filename);
+    c->snaplen = snaplen;
+    c->file_size = file_size;
+    c->file_count = file_count;
+    c->file_bytes = sizeof(struct pcap_file_hdr);
+
+    if (filter) {
+        c->filter = capture_filter_compile(filter, errp);
+        if (!c->filter) {
+            goto fail;
+        }
+    }
+
+    c->fd = capture_open_file(c);
+    if (c->fd < 0) {
+        error_set(errp, QERR_OPEN_FILE_FAILED, filename);
+        goto fail;
+    }
 
     qemu_get_timedate(&tm, 0);
-    s->start_ts = mktime(&tm);
+    c->start_ts = mktime(&tm);
 
-    return 0;
+    qemu_mutex_init(&c->lock);
+    qemu_cond_init(&c->cond);
+    QSIMPLEQ_INIT(&c->free);
+    QSIMPLEQ_INIT(&c->full);
+    nchunks = MAX(buffer_size / CAPTURE_CHUNK_SIZE, 2);
+    for (i = 0; i < nchunks; i++) {
+        chunk = g_malloc(sizeof(*chunk));
+        chunk->len = 0;
+        chunk->rotate = false;
+        QSIMPLEQ_INSERT_TAIL(&c->free, chunk, next);
+    }
+
+    c->flush_timer = qemu_new_timer_ms(rt_clock, capture_flush_timer, c);
+    qemu_thread_create(&c->thread, capture_thread, c, QEMU_THREAD_JOINABLE);
+
+    return c;
+
+fail:
+    g_free(c->filter);
+    g_free(c->filename);
+    g_free(c);
+    return NULL;
+}
+
+void net_capture_free(NetCapture *c)
+{
+    CaptureChunk *chunk;
+
+    qemu_del_timer(c->flush_timer);
+    qemu_free_timer(c->flush_timer);
+    if (c->cur) {
+        capture_submit(c);
+    }
+
+    qemu_mutex_lock(&c->lock);
+    c->stopping = true;
+    qemu_cond_signal(&c->cond);
+    qemu_mutex_unlock(&c->lock);
+    qemu_thread_join(&c->thread);
+
+    if (c->fd >= 0) {
+        close(c->fd);
+    }
+    while ((chunk = QSIMPLEQ_FIRST(&c->free))) {
+        QSIMPLEQ_REMOVE_HEAD(&c->free, next);
+        g_free(chunk);
+    }
+    qemu_mutex_destroy(&c->lock);
+    qemu_cond_destroy(&c->cond);
+    g_free(c->filter);
+    g_free(c->filename);
+    g_free(c);
+}
+
+void net_capture_print(Monitor *mon, NetCapture *c)
+{
+    monitor_printf(mon, "    capture to %s: %" PRIu64 " packets, %" PRIu64
+                   " dropped\n", c->filename, c->packets, c->dropped);
+}
+
+void qmp_net_capture_start(const char *netdev, const char *file,
+                           bool has_snaplen, int64_t snaplen,
+                           bool has_filter, const char *filter,
+                           bool has_file_size, int64_t file_size,
+                           bool has_file_count, int64_t file_count,
+                           bool has_buffer_size, int64_t buffer_size,
+                           Error **errp)
+{
+    VLANClientState *vc;
+
+    vc = qemu_find_netdev(netdev);
+    if (!vc) {
+        error_set(errp, QERR_DEVICE_NOT_FOUND, netdev);
+        return;
+    }
+    if (vc->capture) {
+        error_set(errp, QERR_DEVICE_IN_USE, netdev);
+        return;
+    }
+
+    vc->capture = net_capture_new(file,
+                                  has_snaplen ? snaplen : CAPTURE_SNAPLEN,
+                                  has_filter ? filter : NULL,
+                                  has_file_size ? file_size : 0,
+                                  has_file_count ? file_count : 0,
+                                  has_buffer_size ? buffer_size :
+                                  CAPTURE_BUFFER_SIZE, errp);
+}
+
+void qmp_net_capture_stop(const char *netdev, Error **errp)
+{
+    VLANClientState *vc;
+
+    vc = qemu_find_netdev(netdev);
+    if (!vc) {
+        error_set(errp, QERR_DEVICE_NOT_FOUND, netdev);
+        return;
+    }
+    if (!vc->capture) {
+        error_set(errp, QERR_DEVICE_NOT_ACTIVE, netdev);
+        return;
+    }
+
+    net_capture_free(vc->capture);
+    vc->capture = NULL;
+}
+
+/* -net dump */
+
+static ssize_t dump_receive_iov(VLANClientState *nc, const struct iovec *iov,
+                                int iovcnt)
+{
+    DumpState *s = DO_UPCAST(DumpState, nc, nc);
+
+    net_capture_packet(s->capture, iov, iovcnt, false);
+
+    return iov_size(iov, iovcnt);
+}
+
+static ssize_t dump_receive(VLANClientState *nc, const uint8_t *buf, size_t size)
+{
+    struct iovec iov = {
+        .iov_base = (uint8_t *)buf,
+        .iov_len = size,
+    };
+
+    return dump_receive_iov(nc, &iov, 1);
 }
 
+static void dump_cleanup(VLANClientState *nc)
+{
+    DumpState *s = DO_UPCAST(DumpState, nc, nc);
+
+    net_capture_free(s->capture);
+}
+
+static NetClientInfo net_dump_info = {
+    .type = NET_CLIENT_OPTIONS_KIND_DUMP,
+    .size = sizeof(DumpState),
+    .receive = dump_receive,
+    .receive_iov = dump_receive_iov,
+    .cleanup = dump_cleanup,
+};
+
 int net_init_dump(const NetClientOptions *opts, const char *name,
                   VLANState *vlan)
 {
@@ -151,6 +752,9 @@ int net_init_dump(const NetClientOptions *opts, const char *name,
     const char *file;
     char def_file[128];
     const NetdevDumpOptions *dump;
+    VLANClientState *nc;
+    NetCapture *capture;
+    Error *err = NULL;
 
     assert(opts->kind == NET_CLIENT_OPTIONS_KIND_DUMP);
     dump = opts->dump;
@@ -174,5 +778,30 @@ int net_init_dump(const NetClientOptions *opts, const char *name,
         len = 65536;
     }
 
-    return net_dump_init(vlan, "dump", name, file, len);
+    if ((dump->has_file_size && dump->file_size > INT64_MAX) ||
+        (dump->has_buffer_size && dump->buffer_size > INT64_MAX)) {
+        error_report("invalid size");
+        return -1;
+    }
+
+    capture = net_capture_new(file, len,
+                              dump->has_filter ? dump->filter : NULL,
+                              dump->has_file_size ? dump->file_size : 0,
+                              dump->has_file_count ? dump->file_count : 0,
+                              dump->has_buffer_size ? dump->buffer_size :
+                              CAPTURE_BUFFER_SIZE, &err);
+    if (!capture) {
+        error_report("-net dump: %s", error_get_pretty(err));
+        error_free(err);
+        return -1;
+    }
+
+    nc = qemu_new_net_client(&net_dump_info, vlan, NULL, "dump", name);
+
+    snprintf(nc->info_str, sizeof(nc->info_str),
+             "dump to %s (len=%d)", file, len);
+
+    DO_UPCAST(DumpState, nc, nc)->capture = capture;
+
+    return 0;
 }
@@ -27,7 +27,18 @@
 #include "net.h"
 #include "qapi-types.h"
 
+typedef struct NetCapture NetCapture;
+
 int net_init_dump(const NetClientOptions *opts, const char *name,
                   VLANState *vlan);
 
+NetCapture *net_capture_new(const char *filename, int64_t snaplen,
+                            const char *filter, int64_t file_size,
+                            int64_t file_count, int64_t buffer_size,
+                            Error **errp);
+void net_capture_packet(NetCapture *c, const struct iovec *iov, int iovcnt,
+                        bool vnet_hdr);
+void net_capture_print(Monitor *mon, NetCapture *c);
+void net_capture_free(NetCapture *c);
+
 #endif /* QEMU_NET_DUMP_H */
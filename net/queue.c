@@ -53,6 +53,7 @@ struct NetQueue {
     void *opaque;
 
     QTAILQ_HEAD(packets, NetPacket) packets;
+    int nq_count;
 
     unsigned delivering : 1;
 };
@@ -105,6 +106,7 @@ static ssize_t qemu_net_queue_append(NetQueue *queue,
     memcpy(packet->data, buf, size);
 
     QTAILQ_INSERT_TAIL(&queue->packets, packet, entry);
+    queue->nq_count++;
 
     return size;
 }
@@ -138,6 +140,7 @@ static ssize_t qemu_net_queue_append_iov(NetQueue *queue,
     }
 
     QTAILQ_INSERT_TAIL(&queue->packets, packet, entry);
+    queue->nq_count++;
 
     return packet->size;
 }
@@ -187,7 +190,9 @@ ssize_t qemu_net_queue_send(NetQueue *queue,
 
     ret = qemu_net_queue_deliver(queue, sender, flags, data, size);
     if (ret == 0) {
-        qemu_net_queue_append(queue, sender, flags, data, size, sent_cb);
+        qemu_net_queue_append(queue, sender,
+                              flags | QEMU_NET_PACKET_FLAG_DELAYED,
+                              data, size, sent_cb);
         return 0;
     }
 
@@ -211,7 +216,9 @@ ssize_t qemu_net_queue_send_iov(NetQueue *queue,
 
     ret = qemu_net_queue_deliver_iov(queue, sender, flags, iov, iovcnt);
     if (ret == 0) {
-        qemu_net_queue_append_iov(queue, sender, flags, iov, iovcnt, sent_cb);
+        qemu_net_queue_append_iov(queue, sender,
+                                  flags | QEMU_NET_PACKET_FLAG_DELAYED,
+                                  iov, iovcnt, sent_cb);
         return 0;
     }
 
@@ -227,6 +234,7 @@ void qemu_net_queue_purge(NetQueue *queue, VLANClientState *from)
     QTAILQ_FOREACH_SAFE(packet, &queue->packets, entry, next) {
         if (packet->sender == from) {
             QTAILQ_REMOVE(&queue->packets, packet, entry);
+            queue->nq_count--;
             g_free(packet);
         }
     }
@@ -240,6 +248,7 @@ void qemu_net_queue_flush(NetQueue *queue)
 
         packet = QTAILQ_FIRST(&queue->packets);
         QTAILQ_REMOVE(&queue->packets, packet, entry);
+        queue->nq_count--;
 
         ret = qemu_net_queue_deliver(queue,
                                      packet->sender,
@@ -247,7 +256,9 @@ void qemu_net_queue_flush(NetQueue *queue)
                                      packet->data,
                                      packet->size);
         if (ret == 0) {
+            packet->flags |= QEMU_NET_PACKET_FLAG_DELAYED;
             QTAILQ_INSERT_HEAD(&queue->packets, packet, entry);
+            queue->nq_count++;
             break;
         }
 
@@ -258,3 +269,8 @@ void qemu_net_queue_flush(NetQueue *queue)
         g_free(packet);
     }
 }
+
+int qemu_net_queue_length(NetQueue *queue)
+{
+    return queue->nq_count;
+}
@@ -45,6 +45,8 @@ typedef ssize_t (NetPacketDeliverIOV) (VLANClientState *sender,
 
 #define QEMU_NET_PACKET_FLAG_NONE  0
 #define QEMU_NET_PACKET_FLAG_RAW  (1<<0)
+/* the receiver already refused the packet once, it comes from the queue */
+#define QEMU_NET_PACKET_FLAG_DELAYED  (1<<1)
 
 NetQueue *qemu_new_net_queue(NetPacketDeliver *deliver,
                              NetPacketDeliverIOV *deliver_iov,
@@ -67,5 +69,6 @@ ssize_t qemu_net_queue_send_iov(NetQueue *queue,
 
 void qemu_net_queue_purge(NetQueue *queue, VLANClientState *from);
 void qemu_net_queue_flush(NetQueue *queue);
+int qemu_net_queue_length(NetQueue *queue);
 
 #endif /* QEMU_NET_QUEUE_H */
@@ -0,0 +1,137 @@
+/*
+ * Receive-side scaling for network backends
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * A backend that steers its frames hashes the IP addresses and the TCP or
+ * UDP ports of each one with the Toeplitz function of the Microsoft RSS
+ * specification, so that the hash matches the one a physical NIC computes
+ * with the same key.  The low bits of the hash index an indirection table,
+ * which gives the receive queue; all frames of a flow thus go to the same
+ * queue, and rewriting the table moves flows between queues.
+ */
+#include "net/rss.h"
+
+#define ETH_P_IP        0x0800
+#define ETH_P_IPV6      0x86dd
+#define ETH_P_VLAN      0x8100
+
+#define PROTO_TCP       6
+#define PROTO_UDP       17
+
+/* the key of the RSS specification, which NICs default to as well */
+const uint8_t net_rss_default_key[NET_RSS_KEY_SIZE] = {
+    0x6d, 0x5a, 0x56, 0xda, 0x25, 0x5b, 0x0e, 0xc2,
+    0x41, 0x67, 0x25, 0x3d, 0x43, 0xa3, 0x8f, 0xb0,
+    0xd0, 0xca, 0x2b, 0xcb, 0xae, 0x7b, 0x30, 0xb4,
+    0x77, 0xcb, 0x2d, 0xa3, 0x80, 0x30, 0xf2, 0x0c,
+    0x6a, 0x42, 0xb7, 0x3b, 0xbe, 0xac, 0x01, 0xfa,
+};
+
+/* For each bit set in data, xor in the 32 bits of key that start there */
+uint32_t net_rss_toeplitz(const uint8_t *key, const uint8_t *data, size_t len)
+{
+    uint32_t hash = 0;
+    uint32_t v = key[0] << 24 | key[1] << 16 | key[2] << 8 | key[3];
+    size_t i;
+    int b;
+
+    assert(len + 4 <= NET_RSS_KEY_SIZE);
+
+    for (i = 0; i < len; i++) {
+        for (b = 7; b >= 0; b--) {
+            if (data[i] & (1 << b)) {
+                hash ^= v;
+            }
+            v = v << 1 | ((key[i + 4] >> b) & 1);
+        }
+    }
+    return hash;
+}
+
+/*
+ * Hash the addresses of an IPv4 or IPv6 frame, followed by the ports if it
+ * carries TCP or UDP and is not a fragment.  Returns false for other frames.
+ */
+bool net_rss_hash(const uint8_t *key, const uint8_t *frame, size_t size,
+                  uint32_t *hash)
+{
+    uint8_t input[36];
+    size_t l3 = 14, l4, len;
+    int type, proto;
+
+    if (size < l3) {
+        return false;
+    }
+    type = frame[12] << 8 | frame[13];
+    if (type == ETH_P_VLAN && size >= 18) {
+        l3 = 18;
+        type = frame[16] << 8 | frame[17];
+    }
+
+    if (type == ETH_P_IP && size >= l3 + 20 && frame[l3] >> 4 == 4) {
+        memcpy(input, frame + l3 + 12, 8);
+        len = 8;
+        proto = frame[l3 + 9];
+        l4 = l3 + (frame[l3] & 0xf) * 4;
+        if ((frame[l3 + 6] & 0x3f) || frame[l3 + 7]) {
+            proto = -1;                         /* MF or fragment offset */
+        }
+    } else if (type == ETH_P_IPV6 && size >= l3 + 40 &&
+               frame[l3] >> 4 == 6) {
+        memcpy(input, frame + l3 + 8, 32);
+        len = 32;
+        proto = frame[l3 + 6];
+        l4 = l3 + 40;
+    } else {
+        return false;
+    }
+
+    if ((proto == PROTO_TCP || proto == PROTO_UDP) && size >= l4 + 4) {
+        memcpy(input + len, frame + l4, 4);
+        len += 4;
+    }
+
+    *hash = net_rss_toeplitz(key, input, len);
+    return true;
+}
+
+NetRss *net_rss_new(int queues, const uint8_t *key, const uint8_t *table)
+{
+    NetRss *rss = g_new0(NetRss, 1);
+    int i;
+
+    assert(queues > 0 && queues <= NET_RSS_QUEUES_MAX);
+
+    rss->queues = queues;
+    memcpy(rss->key, key ? key : net_rss_default_key, NET_RSS_KEY_SIZE);
+    for (i = 0; i < NET_RSS_TABLE_SIZE; i++) {
+        rss->table[i] = table ? table[i] : i % queues;
+        assert(rss->table[i] < queues);
+    }
+    return rss;
+}
+
+/* Pick the receive queue of a frame and account it there */
+int net_rss_steer(NetRss *rss, const uint8_t *frame, size_t size)
+{
+    int queue;
+
+    if (!net_rss_hash(rss->key, frame, size, &rss->hash)) {
+        rss->hash = 0;
+        rss->unhashed++;
+    }
+
+    queue = rss->table[rss->hash % NET_RSS_TABLE_SIZE];
+    rss->stats[queue].packets++;
+    rss->stats[queue].bytes += size;
+    rss->queue = queue;
+
+    return queue;
+}
+
+void net_rss_free(NetRss *rss)
+{
+    g_free(rss);
+}
@@ -0,0 +1,43 @@
+/*
+ * Receive-side scaling for network backends
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#ifndef QEMU_NET_RSS_H
+#define QEMU_NET_RSS_H
+
+#include "qemu-common.h"
+
+#define NET_RSS_KEY_SIZE        40
+#define NET_RSS_TABLE_SIZE      128
+#define NET_RSS_QUEUES_MAX      16
+
+typedef struct NetRssQueueStats {
+    uint64_t packets;
+    uint64_t bytes;
+} NetRssQueueStats;
+
+typedef struct NetRss {
+    uint8_t key[NET_RSS_KEY_SIZE];
+    uint8_t table[NET_RSS_TABLE_SIZE];
+    int queues;
+    NetRssQueueStats stats[NET_RSS_QUEUES_MAX];
+    uint64_t unhashed;
+
+    /* the last frame steered */
+    uint32_t hash;
+    int queue;
+} NetRss;
+
+extern const uint8_t net_rss_default_key[NET_RSS_KEY_SIZE];
+
+uint32_t net_rss_toeplitz(const uint8_t *key, const uint8_t *data, size_t len);
+bool net_rss_hash(const uint8_t *key, const uint8_t *frame, size_t size,
+                  uint32_t *hash);
+
+NetRss *net_rss_new(int queues, const uint8_t *key, const uint8_t *table);
+int net_rss_steer(NetRss *rss, const uint8_t *frame, size_t size);
+void net_rss_free(NetRss *rss);
+
+#endif /* QEMU_NET_RSS_H */
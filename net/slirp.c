@@ -32,6 +32,8 @@
 #include "net.h"
 #include "monitor.h"
 #include "qemu_socket.h"
+#include "iov.h"
+#include "hw/virtio-net.h"
 #include "slirp/libslirp.h"
 
 static int get_str_sep(char *buf, int buf_size, const char **pp, int sep)
@@ -70,6 +72,8 @@ typedef struct SlirpState {
     VLANClientState nc;
     QTAILQ_ENTRY(SlirpState) entry;
     Slirp *slirp;
+    int vnet_hdr;
+    int using_vnet_hdr;
 #ifndef _WIN32
     char smb_dir[128];
 #endif
@@ -104,21 +108,103 @@ int slirp_can_output(void *opaque)
 }
 
 void slirp_output(void *opaque, const uint8_t *pkt, int pkt_len)
+{
+    struct iovec iov = {
+        .iov_base = (uint8_t *)pkt,
+        .iov_len = pkt_len,
+    };
+
+    slirp_output_iov(opaque, &iov, 1);
+}
+
+void slirp_output_iov(void *opaque, const struct iovec *iov, int iovcnt)
 {
     SlirpState *s = opaque;
+    struct virtio_net_hdr hdr;
+    struct iovec vec[4];
 
-    qemu_send_packet(&s->nc, pkt, pkt_len);
+    if (!s->using_vnet_hdr) {
+        qemu_sendv_packet(&s->nc, iov, iovcnt);
+        return;
+    }
+
+    /* slirp fills in all checksums, there is nothing for the NIC to do */
+    assert(iovcnt < ARRAY_SIZE(vec));
+    memset(&hdr, 0, sizeof(hdr));
+    vec[0].iov_base = &hdr;
+    vec[0].iov_len = sizeof(hdr);
+    memcpy(&vec[1], iov, iovcnt * sizeof(*iov));
+    qemu_sendv_packet(&s->nc, vec, iovcnt + 1);
 }
 
-static ssize_t net_slirp_receive(VLANClientState *nc, const uint8_t *buf, size_t size)
+static ssize_t net_slirp_receive_iov(VLANClientState *nc,
+                                     const struct iovec *iov, int iovcnt)
 {
     SlirpState *s = DO_UPCAST(SlirpState, nc, nc);
+    size_t size = iov_size(iov, iovcnt);
+    struct virtio_net_hdr hdr;
+    size_t offset = 0;
+    int flags = 0;
+
+    if (s->using_vnet_hdr) {
+        if (iov_to_buf(iov, iovcnt, 0, &hdr, sizeof(hdr)) < sizeof(hdr)) {
+            return size;
+        }
+        offset = sizeof(hdr);
+
+        /* slirp terminates TCP, so a TSO frame needs no segmentation: it
+         * goes up the stack as one large segment.  UFO is not offered and
+         * there is no IPv6.
+         */
+        switch (hdr.gso_type & ~VIRTIO_NET_HDR_GSO_ECN) {
+        case VIRTIO_NET_HDR_GSO_NONE:
+        case VIRTIO_NET_HDR_GSO_TCPV4:
+            break;
+        default:
+            return size;
+        }
+        if (hdr.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
+            flags |= SLIRP_INPUT_CSUM_PARTIAL;
+        }
+    }
 
-    slirp_input(s->slirp, buf, size);
+    slirp_input_iov(s->slirp, iov, iovcnt, offset, flags);
 
     return size;
 }
 
+static ssize_t net_slirp_receive(VLANClientState *nc, const uint8_t *buf, size_t size)
+{
+    struct iovec iov = {
+        .iov_base = (uint8_t *)buf,
+        .iov_len = size,
+    };
+
+    return net_slirp_receive_iov(nc, &iov, 1);
+}
+
+/* Offloads change the features virtio-net offers and what it migrates,
+   so they are only enabled on request.  */
+static int net_slirp_has_vnet_hdr(VLANClientState *nc)
+{
+    SlirpState *s = DO_UPCAST(SlirpState, nc, nc);
+
+    return s->vnet_hdr;
+}
+
+static void net_slirp_using_vnet_hdr(VLANClientState *nc, int using_vnet_hdr)
+{
+    SlirpState *s = DO_UPCAST(SlirpState, nc, nc);
+
+    s->using_vnet_hdr = using_vnet_hdr;
+}
+
+static void net_slirp_set_offload(VLANClientState *nc, int csum, int tso4,
+                                  int tso6, int ecn, int ufo)
+{
+    /* the frames slirp sends are complete, whatever the guest accepts */
+}
+
 static void net_slirp_cleanup(VLANClientState *nc)
 {
     SlirpState *s = DO_UPCAST(SlirpState, nc, nc);
@@ -132,7 +218,11 @@ static NetClientInfo net_slirp_info = {
     .type = NET_CLIENT_OPTIONS_KIND_USER,
     .size = sizeof(SlirpState),
     .receive = net_slirp_receive,
+    .receive_iov = net_slirp_receive_iov,
     .cleanup = net_slirp_cleanup,
+    .has_vnet_hdr = net_slirp_has_vnet_hdr,
+    .using_vnet_hdr = net_slirp_using_vnet_hdr,
+    .set_offload = net_slirp_set_offload,
 };
 
 static int net_slirp_init(VLANState *vlan, const char *model,
@@ -141,7 +231,7 @@ static int net_slirp_init(VLANState *vlan, const char *model,
                           const char *vhostname, const char *tftp_export,
                           const char *bootfile, const char *vdhcp_start,
                           const char *vnameserver, const char *smb_export,
-                          const char *vsmbserver)
+                          const char *vsmbserver, int vnet_hdr)
 {
     /* default settings according to historic slirp */
     struct in_addr net  = { .s_addr = htonl(0x0a000200) }; /* 10.0.2.0 */
@@ -245,6 +335,7 @@ static int net_slirp_init(VLANState *vlan, const char *model,
              restricted ? "on" : "off");
 
     s = DO_UPCAST(SlirpState, nc, nc);
+    s->vnet_hdr = vnet_hdr;
 
     s->slirp = slirp_init(restricted, net, mask, host, vhostname,
                           tftp_export, bootfile, dhcp, dns, s);
@@ -725,7 +816,7 @@ int net_init_slirp(const NetClientOptions *opts, const char *name,
     ret = net_slirp_init(vlan, "user", name, user->restrict, vnet, user->host,
                          user->hostname, user->tftp, user->bootfile,
                          user->dhcpstart, user->dns, user->smb,
-                         user->smbserver);
+                         user->smbserver, user->vnet_hdr);
 
     while (slirp_configs) {
         config = slirp_configs;
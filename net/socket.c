@@ -26,12 +26,24 @@
 #include "config-host.h"
 
 #include "net.h"
+#include "net/checksum.h"
 #include "monitor.h"
 #include "qemu-char.h"
 #include "qemu-common.h"
 #include "qemu-error.h"
 #include "qemu-option.h"
 #include "qemu_socket.h"
+#include "iov.h"
+#include "hw/virtio-net.h"
+
+/* room for a 64k GSO frame and its virtio_net_hdr */
+#define NET_SOCKET_BUFSIZE (4096 + 65536)
+
+/* largest payload of an IPv4 UDP datagram */
+#define NET_SOCKET_DGRAM_MAX (65535 - 20 - 8)
+
+/* longest Ethernet, IP and TCP headers that GSO frames are cut after */
+#define NET_SOCKET_GSO_HEAD_MAX 256
 
 typedef struct NetSocketState {
     VLANClientState nc;
@@ -39,8 +51,16 @@ typedef struct NetSocketState {
     int state; /* 0 = getting length, 1 = getting data */
     unsigned int index;
     unsigned int packet_len;
-    uint8_t buf[4096];
+    uint8_t buf[NET_SOCKET_BUFSIZE];
     struct sockaddr_in dgram_dst; /* contains inet host and port destination iff connectionless (SOCK_DGRAM) */
+    bool vnet_hdr;          /* frames on the socket carry a virtio_net_hdr */
+    int using_vnet_hdr;     /* ... and so do those exchanged with the peer */
+    int offload_csum;       /* offloads the peer accepts, see set_offload */
+    int offload_tso4;
+    int offload_tso6;
+    int offload_ecn;
+    uint8_t tx_buf[4 + NET_SOCKET_BUFSIZE];
+    uint8_t *gso_buf;
 } NetSocketState;
 
 typedef struct NetSocketListenState {
@@ -48,23 +68,285 @@ typedef struct NetSocketListenState {
     char *model;
     char *name;
     int fd;
+    bool vnet_hdr;
 } NetSocketListenState;
 
+typedef void (NetSocketOutput)(NetSocketState *, const struct iovec *, int);
+
+/*
+ * Cut the TCP GSO frame in buf into frames of at most max bytes, or of one
+ * MSS if max is 0, and pass each to out after a virtio_net_hdr.  Frames of
+ * one MSS get complete checksums; longer ones stay GSO frames whose TCP
+ * checksum holds the pseudo-header sum, as the guest would have sent them.
+ */
+static int net_socket_gso(NetSocketState *s, const struct virtio_net_hdr *hdr,
+                          const uint8_t *buf, size_t size, size_t max,
+                          NetSocketOutput *out)
+{
+    struct virtio_net_hdr seg_hdr;
+    uint8_t head[NET_SOCKET_GSO_HEAD_MAX];
+    struct iovec iov[3];
+    uint8_t *ip, *th;
+    size_t l3, l4, hlen, off, chunk, seg, mss = hdr->gso_size;
+    bool v6 = (hdr->gso_type & ~VIRTIO_NET_HDR_GSO_ECN) ==
+              VIRTIO_NET_HDR_GSO_TCPV6;
+    uint32_t seq, sum;
+    uint16_t id, csum;
+
+    if (size < 18 || !(hdr->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) || !mss) {
+        return -1;
+    }
+    l3 = (buf[12] << 8 | buf[13]) == 0x8100 ? 18 : 14;
+    l4 = hdr->csum_start;
+    if (l4 < l3 + (v6 ? 40 : 20) || l4 + 20 > size ||
+        buf[l3] >> 4 != (v6 ? 6 : 4)) {
+        return -1;
+    }
+    hlen = l4 + (buf[l4 + 12] >> 4) * 4;
+    if (hlen > sizeof(head) || hlen >= size) {
+        return -1;
+    }
+
+    seg = max > hlen + mss ? (max - hlen) / mss * mss : mss;
+    memcpy(head, buf, hlen);
+    ip = head + l3;
+    th = head + l4;
+    seq = be32_to_cpupu((uint32_t *)(th + 4));
+    id = ip[4] << 8 | ip[5];
+
+    iov[0].iov_base = &seg_hdr;
+    iov[0].iov_len = sizeof(seg_hdr);
+    iov[1].iov_base = head;
+    iov[1].iov_len = hlen;
+
+    for (off = hlen; off < size; off += chunk) {
+        chunk = MIN(seg, size - off);
+
+        if (v6) {
+            cpu_to_be16wu((uint16_t *)(ip + 4), hlen - l3 - 40 + chunk);
+            sum = net_checksum_add(32, ip + 8);
+        } else {
+            cpu_to_be16wu((uint16_t *)(ip + 2), hlen - l3 + chunk);
+            cpu_to_be16wu((uint16_t *)(ip + 4), id++);
+            ip[10] = ip[11] = 0;
+            csum = net_checksum_finish(net_checksum_add((ip[0] & 0xf) * 4, ip));
+            cpu_to_be16wu((uint16_t *)(ip + 10), csum);
+            sum = net_checksum_add(8, ip + 12);
+        }
+
+        cpu_to_be32wu((uint32_t *)(th + 4), seq + (off - hlen));
+        th[13] = buf[l4 + 13];
+        if (off != hlen) {
+            th[13] &= ~0x80;                    /* CWR */
+        }
+        if (off + chunk < size) {
+            th[13] &= ~0x09;                    /* PSH, FIN */
+        }
+        th[16] = th[17] = 0;
+        sum += IPPROTO_TCP + hlen - l4 + chunk;
+
+        if (chunk > mss) {
+            seg_hdr = *hdr;
+            csum = ~net_checksum_finish(sum);
+        } else {
+            memset(&seg_hdr, 0, sizeof(seg_hdr));
+            sum += net_checksum_add(hlen - l4, th);
+            sum += net_checksum_add(chunk, (uint8_t *)buf + off);
+            csum = net_checksum_finish(sum);
+        }
+        cpu_to_be16wu((uint16_t *)(th + 16), csum);
+
+        iov[2].iov_base = (uint8_t *)buf + off;
+        iov[2].iov_len = chunk;
+        out(s, iov, 3);
+    }
+    return 0;
+}
+
+/* Complete the checksum that a frame with VIRTIO_NET_HDR_F_NEEDS_CSUM left */
+static int net_socket_csum(const struct virtio_net_hdr *hdr,
+                           uint8_t *buf, size_t size)
+{
+    size_t start = hdr->csum_start, off = start + hdr->csum_offset;
+    uint16_t csum;
+
+    if (start > size || off + 2 > size) {
+        return -1;
+    }
+    csum = net_checksum_finish(net_checksum_add(size - start, buf + start));
+    cpu_to_be16wu((uint16_t *)(buf + off), csum ? csum : 0xffff);
+    return 0;
+}
+
+static void net_socket_output_peer(NetSocketState *s,
+                                   const struct iovec *iov, int iovcnt)
+{
+    if (s->using_vnet_hdr) {
+        qemu_sendv_packet(&s->nc, iov, iovcnt);
+    } else {
+        qemu_sendv_packet(&s->nc, iov + 1, iovcnt - 1);
+    }
+}
+
+/*
+ * Pass a frame read from the socket to the peer.  With vnet_hdr=on the
+ * frame starts with a virtio_net_hdr, which goes through to a peer that
+ * accepts the offloads it asks for; for any other peer the checksum is
+ * completed and the GSO frame cut into MSS-sized frames here.
+ */
+static void net_socket_deliver(NetSocketState *s, uint8_t *buf, size_t size)
+{
+    struct virtio_net_hdr hdr;
+    size_t hdr_len = sizeof(hdr);
+    int offloaded;
+
+    if (!s->vnet_hdr) {
+        qemu_send_packet(&s->nc, buf, size);
+        return;
+    }
+    if (size < hdr_len) {
+        return;
+    }
+    memcpy(&hdr, buf, hdr_len);
+
+    switch (hdr.gso_type & ~VIRTIO_NET_HDR_GSO_ECN) {
+    case VIRTIO_NET_HDR_GSO_NONE:
+        offloaded = !(hdr.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) ||
+                    s->offload_csum;
+        break;
+    case VIRTIO_NET_HDR_GSO_TCPV4:
+        offloaded = s->offload_tso4;
+        break;
+    case VIRTIO_NET_HDR_GSO_TCPV6:
+        offloaded = s->offload_tso6;
+        break;
+    default:
+        /* UFO is not advertised */
+        return;
+    }
+    if ((hdr.gso_type & VIRTIO_NET_HDR_GSO_ECN) && !s->offload_ecn) {
+        offloaded = 0;
+    }
+
+    if (s->using_vnet_hdr && offloaded) {
+        qemu_send_packet(&s->nc, buf, size);
+        return;
+    }
+
+    if (hdr.gso_type != VIRTIO_NET_HDR_GSO_NONE) {
+        net_socket_gso(s, &hdr, buf + hdr_len, size - hdr_len, 0,
+                       net_socket_output_peer);
+        return;
+    }
+    if ((hdr.flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) &&
+        net_socket_csum(&hdr, buf + hdr_len, size - hdr_len) < 0) {
+        return;
+    }
+    if (s->using_vnet_hdr) {
+        memset(buf, 0, hdr_len);
+        qemu_send_packet(&s->nc, buf, size);
+    } else {
+        qemu_send_packet(&s->nc, buf + hdr_len, size - hdr_len);
+    }
+}
+
+/* length of the virtio_net_hdr to add in front of frames from the peer */
+static size_t net_socket_tx_hdr_len(NetSocketState *s)
+{
+    return s->vnet_hdr && !s->using_vnet_hdr ? sizeof(struct virtio_net_hdr)
+                                             : 0;
+}
+
 /* XXX: we consider we can send the whole packet without blocking */
-static ssize_t net_socket_receive(VLANClientState *nc, const uint8_t *buf, size_t size)
+static ssize_t net_socket_receive_iov(VLANClientState *nc,
+                                      const struct iovec *iov, int iovcnt)
 {
     NetSocketState *s = DO_UPCAST(NetSocketState, nc, nc);
+    size_t hdr_len = net_socket_tx_hdr_len(s);
+    size_t size = iov_size(iov, iovcnt);
     uint32_t len;
-    len = htonl(size);
+    int ret;
+
+    if (hdr_len + size > NET_SOCKET_BUFSIZE) {
+        return size;
+    }
+
+    /* length, header and frame go out in a single write */
+    len = htonl(hdr_len + size);
+    memcpy(s->tx_buf, &len, sizeof(len));
+    memset(s->tx_buf + sizeof(len), 0, hdr_len);
+    iov_to_buf(iov, iovcnt, 0, s->tx_buf + sizeof(len) + hdr_len, size);
+
+    ret = send_all(s->fd, s->tx_buf, sizeof(len) + hdr_len + size);
+    return ret < 0 ? ret : size;
+}
 
-    send_all(s->fd, (const uint8_t *)&len, sizeof(len));
-    return send_all(s->fd, buf, size);
+static ssize_t net_socket_receive(VLANClientState *nc, const uint8_t *buf, size_t size)
+{
+    struct iovec iov = {
+        .iov_base = (uint8_t *)buf,
+        .iov_len = size,
+    };
+
+    return net_socket_receive_iov(nc, &iov, 1);
+}
+
+static void net_socket_output_dgram(NetSocketState *s,
+                                    const struct iovec *iov, int iovcnt)
+{
+    size_t size = iov_to_buf(iov, iovcnt, 0, s->tx_buf, sizeof(s->tx_buf));
+
+    sendto(s->fd, (const void *)s->tx_buf, size, 0,
+           (struct sockaddr *)&s->dgram_dst, sizeof(s->dgram_dst));
+}
+
+static ssize_t net_socket_receive_dgram_iov(VLANClientState *nc,
+                                            const struct iovec *iov,
+                                            int iovcnt)
+{
+    NetSocketState *s = DO_UPCAST(NetSocketState, nc, nc);
+    size_t hdr_len = net_socket_tx_hdr_len(s);
+    size_t size = iov_size(iov, iovcnt);
+    struct virtio_net_hdr hdr;
+
+    if (hdr_len + size > NET_SOCKET_BUFSIZE) {
+        return size;
+    }
+
+    if (hdr_len + size > NET_SOCKET_DGRAM_MAX) {
+        /* only a GSO frame can be this long: cut it into some that fit */
+        if (!s->using_vnet_hdr) {
+            return size;
+        }
+        if (!s->gso_buf) {
+            s->gso_buf = g_malloc(NET_SOCKET_BUFSIZE);
+        }
+        iov_to_buf(iov, iovcnt, 0, s->gso_buf, size);
+        memcpy(&hdr, s->gso_buf, sizeof(hdr));
+        net_socket_gso(s, &hdr, s->gso_buf + sizeof(hdr), size - sizeof(hdr),
+                       NET_SOCKET_DGRAM_MAX - sizeof(hdr),
+                       net_socket_output_dgram);
+        return size;
+    }
+
+    memset(s->tx_buf, 0, hdr_len);
+    iov_to_buf(iov, iovcnt, 0, s->tx_buf + hdr_len, size);
+
+    return sendto(s->fd, (const void *)s->tx_buf, hdr_len + size, 0,
+                  (struct sockaddr *)&s->dgram_dst, sizeof(s->dgram_dst));
 }
 
 static ssize_t net_socket_receive_dgram(VLANClientState *nc, const uint8_t *buf, size_t size)
 {
     NetSocketState *s = DO_UPCAST(NetSocketState, nc, nc);
+    struct iovec iov = {
+        .iov_base = (uint8_t *)buf,
+        .iov_len = size,
+    };
 
+    if (s->vnet_hdr) {
+        return net_socket_receive_dgram_iov(nc, &iov, 1);
+    }
     return sendto(s->fd, (const void *)buf, size, 0,
                   (struct sockaddr *)&s->dgram_dst, sizeof(s->dgram_dst));
 }
@@ -77,7 +359,15 @@ static void net_socket_send(void *opaque)
     uint8_t buf1[4096];
     const uint8_t *buf;
 
-    size = qemu_recv(s->fd, buf1, sizeof(buf1), 0);
+    if (s->state == 1) {
+        /* the length is known, read the rest of the packet in place */
+        buf = NULL;
+        size = qemu_recv(s->fd, s->buf + s->index,
+                         s->packet_len - s->index, 0);
+    } else {
+        buf = buf1;
+        size = qemu_recv(s->fd, buf1, sizeof(buf1), 0);
+    }
     if (size < 0) {
         err = socket_error();
         if (err != EWOULDBLOCK)
@@ -89,7 +379,18 @@ static void net_socket_send(void *opaque)
         closesocket(s->fd);
         return;
     }
-    buf = buf1;
+    if (size < 0) {
+        return;
+    }
+    if (!buf) {
+        s->index += size;
+        if (s->index >= s->packet_len) {
+            net_socket_deliver(s, s->buf, s->packet_len);
+            s->index = 0;
+            s->state = 0;
+        }
+        return;
+    }
     while (size > 0) {
         /* reassemble a packet from the network */
         switch(s->state) {
@@ -106,6 +407,17 @@ static void net_socket_send(void *opaque)
                 s->packet_len = ntohl(*(uint32_t *)s->buf);
                 s->index = 0;
                 s->state = 1;
+                if (s->packet_len > sizeof(s->buf)) {
+                    fprintf(stderr, "serious error: oversized packet received,"
+                        "connection terminated.\n");
+                    s->state = 0;
+                    goto eoc;
+                }
+                if (s->packet_len == 0) {
+                    /* nothing to read in place */
+                    net_socket_deliver(s, s->buf, 0);
+                    s->state = 0;
+                }
             }
             break;
         case 1:
@@ -125,7 +437,7 @@ static void net_socket_send(void *opaque)
             buf += l;
             size -= l;
             if (s->index >= s->packet_len) {
-                qemu_send_packet(&s->nc, s->buf, s->packet_len);
+                net_socket_deliver(s, s->buf, s->packet_len);
                 s->index = 0;
                 s->state = 0;
             }
@@ -147,7 +459,7 @@ static void net_socket_send_dgram(void *opaque)
         qemu_set_fd_handler(s->fd, NULL, NULL, NULL);
         return;
     }
-    qemu_send_packet(&s->nc, s->buf, size);
+    net_socket_deliver(s, s->buf, size);
 }
 
 static int net_socket_mcast_create(struct sockaddr_in *mcastaddr, struct in_addr *localaddr)
@@ -236,19 +548,51 @@ static void net_socket_cleanup(VLANClientState *nc)
     NetSocketState *s = DO_UPCAST(NetSocketState, nc, nc);
     qemu_set_fd_handler(s->fd, NULL, NULL, NULL);
     close(s->fd);
+    g_free(s->gso_buf);
+}
+
+static int net_socket_has_vnet_hdr(VLANClientState *nc)
+{
+    NetSocketState *s = DO_UPCAST(NetSocketState, nc, nc);
+
+    return s->vnet_hdr;
+}
+
+static void net_socket_using_vnet_hdr(VLANClientState *nc, int using_vnet_hdr)
+{
+    NetSocketState *s = DO_UPCAST(NetSocketState, nc, nc);
+
+    assert(s->vnet_hdr);
+    s->using_vnet_hdr = using_vnet_hdr;
+}
+
+static void net_socket_set_offload(VLANClientState *nc, int csum, int tso4,
+                                   int tso6, int ecn, int ufo)
+{
+    NetSocketState *s = DO_UPCAST(NetSocketState, nc, nc);
+
+    s->offload_csum = csum;
+    s->offload_tso4 = tso4;
+    s->offload_tso6 = tso6;
+    s->offload_ecn = ecn;
 }
 
 static NetClientInfo net_dgram_socket_info = {
     .type = NET_CLIENT_OPTIONS_KIND_SOCKET,
     .size = sizeof(NetSocketState),
     .receive = net_socket_receive_dgram,
+    .receive_iov = net_socket_receive_dgram_iov,
     .cleanup = net_socket_cleanup,
+    .has_vnet_hdr = net_socket_has_vnet_hdr,
+    .using_vnet_hdr = net_socket_using_vnet_hdr,
+    .set_offload = net_socket_set_offload,
 };
 
 static NetSocketState *net_socket_fd_init_dgram(VLANState *vlan,
                                                 const char *model,
                                                 const char *name,
-                                                int fd, int is_connected)
+                                                int fd, int is_connected,
+                                                bool vnet_hdr)
 {
     struct sockaddr_in saddr;
     int newfd;
@@ -297,6 +641,7 @@ static NetSocketState *net_socket_fd_init_dgram(VLANState *vlan,
     s = DO_UPCAST(NetSocketState, nc, nc);
 
     s->fd = fd;
+    s->vnet_hdr = vnet_hdr;
 
     qemu_set_fd_handler(s->fd, net_socket_send_dgram, NULL, s);
 
@@ -320,13 +665,18 @@ static NetClientInfo net_socket_info = {
     .type = NET_CLIENT_OPTIONS_KIND_SOCKET,
     .size = sizeof(NetSocketState),
     .receive = net_socket_receive,
+    .receive_iov = net_socket_receive_iov,
     .cleanup = net_socket_cleanup,
+    .has_vnet_hdr = net_socket_has_vnet_hdr,
+    .using_vnet_hdr = net_socket_using_vnet_hdr,
+    .set_offload = net_socket_set_offload,
 };
 
 static NetSocketState *net_socket_fd_init_stream(VLANState *vlan,
                                                  const char *model,
                                                  const char *name,
-                                                 int fd, int is_connected)
+                                                 int fd, int is_connected,
+                                                 bool vnet_hdr)
 {
     VLANClientState *nc;
     NetSocketState *s;
@@ -338,6 +688,7 @@ static NetSocketState *net_socket_fd_init_stream(VLANState *vlan,
     s = DO_UPCAST(NetSocketState, nc, nc);
 
     s->fd = fd;
+    s->vnet_hdr = vnet_hdr;
 
     if (is_connected) {
         net_socket_connect(s);
@@ -349,7 +700,8 @@ static NetSocketState *net_socket_fd_init_stream(VLANState *vlan,
 
 static NetSocketState *net_socket_fd_init(VLANState *vlan,
                                           const char *model, const char *name,
-                                          int fd, int is_connected)
+                                          int fd, int is_connected,
+                                          bool vnet_hdr)
 {
     int so_type = -1, optlen=sizeof(so_type);
 
@@ -362,13 +714,16 @@ static NetSocketState *net_socket_fd_init(VLANState *vlan,
     }
     switch(so_type) {
     case SOCK_DGRAM:
-        return net_socket_fd_init_dgram(vlan, model, name, fd, is_connected);
+        return net_socket_fd_init_dgram(vlan, model, name, fd, is_connected,
+                                        vnet_hdr);
     case SOCK_STREAM:
-        return net_socket_fd_init_stream(vlan, model, name, fd, is_connected);
+        return net_socket_fd_init_stream(vlan, model, name, fd, is_connected,
+                                         vnet_hdr);
     default:
         /* who knows ... this could be a eg. a pty, do warn and continue as stream */
         fprintf(stderr, "qemu: warning: socket type=%d for fd=%d is not SOCK_DGRAM or SOCK_STREAM\n", so_type, fd);
-        return net_socket_fd_init_stream(vlan, model, name, fd, is_connected);
+        return net_socket_fd_init_stream(vlan, model, name, fd, is_connected,
+                                         vnet_hdr);
     }
     return NULL;
 }
@@ -390,7 +745,7 @@ static void net_socket_accept(void *opaque)
             break;
         }
     }
-    s1 = net_socket_fd_init(s->vlan, s->model, s->name, fd, 1);
+    s1 = net_socket_fd_init(s->vlan, s->model, s->name, fd, 1, s->vnet_hdr);
     if (s1) {
         snprintf(s1->nc.info_str, sizeof(s1->nc.info_str),
                  "socket: connection from %s:%d",
@@ -401,7 +756,8 @@ static void net_socket_accept(void *opaque)
 static int net_socket_listen_init(VLANState *vlan,
                                   const char *model,
                                   const char *name,
-                                  const char *host_str)
+                                  const char *host_str,
+                                  bool vnet_hdr)
 {
     NetSocketListenState *s;
     int fd, val, ret;
@@ -442,6 +798,7 @@ static int net_socket_listen_init(VLANState *vlan,
     s->model = g_strdup(model);
     s->name = name ? g_strdup(name) : NULL;
     s->fd = fd;
+    s->vnet_hdr = vnet_hdr;
     qemu_set_fd_handler(fd, net_socket_accept, NULL, s);
     return 0;
 }
@@ -449,7 +806,8 @@ static int net_socket_listen_init(VLANState *vlan,
 static int net_socket_connect_init(VLANState *vlan,
                                    const char *model,
                                    const char *name,
-                                   const char *host_str)
+                                   const char *host_str,
+                                   bool vnet_hdr)
 {
     NetSocketState *s;
     int fd, connected, ret, err;
@@ -487,7 +845,7 @@ static int net_socket_connect_init(VLANState *vlan,
             break;
         }
     }
-    s = net_socket_fd_init(vlan, model, name, fd, connected);
+    s = net_socket_fd_init(vlan, model, name, fd, connected, vnet_hdr);
     if (!s)
         return -1;
     snprintf(s->nc.info_str, sizeof(s->nc.info_str),
@@ -500,7 +858,8 @@ static int net_socket_mcast_init(VLANState *vlan,
                                  const char *model,
                                  const char *name,
                                  const char *host_str,
-                                 const char *localaddr_str)
+                                 const char *localaddr_str,
+                                 bool vnet_hdr)
 {
     NetSocketState *s;
     int fd;
@@ -522,7 +881,7 @@ static int net_socket_mcast_init(VLANState *vlan,
     if (fd < 0)
         return -1;
 
-    s = net_socket_fd_init(vlan, model, name, fd, 0);
+    s = net_socket_fd_init(vlan, model, name, fd, 0, vnet_hdr);
     if (!s)
         return -1;
 
@@ -539,7 +898,8 @@ static int net_socket_udp_init(VLANState *vlan,
                                  const char *model,
                                  const char *name,
                                  const char *rhost,
-                                 const char *lhost)
+                                 const char *lhost,
+                                 bool vnet_hdr)
 {
     NetSocketState *s;
     int fd, val, ret;
@@ -573,7 +933,7 @@ static int net_socket_udp_init(VLANState *vlan,
         return -1;
     }
 
-    s = net_socket_fd_init(vlan, model, name, fd, 0);
+    s = net_socket_fd_init(vlan, model, name, fd, 0, vnet_hdr);
     if (!s) {
         return -1;
     }
@@ -590,9 +950,11 @@ int net_init_socket(const NetClientOptions *opts, const char *name,
                     VLANState *vlan)
 {
     const NetdevSocketOptions *sock;
+    bool vnet_hdr;
 
     assert(opts->kind == NET_CLIENT_OPTIONS_KIND_SOCKET);
     sock = opts->socket;
+    vnet_hdr = sock->has_vnet_hdr && sock->vnet_hdr;
 
     if (sock->has_fd + sock->has_listen + sock->has_connect + sock->has_mcast +
         sock->has_udp != 1) {
@@ -610,22 +972,24 @@ int net_init_socket(const NetClientOptions *opts, const char *name,
         int fd;
 
         fd = net_handle_fd_param(cur_mon, sock->fd);
-        if (fd == -1 || !net_socket_fd_init(vlan, "socket", name, fd, 1)) {
+        if (fd == -1 ||
+            !net_socket_fd_init(vlan, "socket", name, fd, 1, vnet_hdr)) {
             return -1;
         }
         return 0;
     }
 
     if (sock->has_listen) {
-        if (net_socket_listen_init(vlan, "socket", name, sock->listen) == -1) {
+        if (net_socket_listen_init(vlan, "socket", name, sock->listen,
+                                   vnet_hdr) == -1) {
             return -1;
         }
         return 0;
     }
 
     if (sock->has_connect) {
-        if (net_socket_connect_init(vlan, "socket", name, sock->connect) ==
-            -1) {
+        if (net_socket_connect_init(vlan, "socket", name, sock->connect,
+                                    vnet_hdr) == -1) {
             return -1;
         }
         return 0;
@@ -635,7 +999,7 @@ int net_init_socket(const NetClientOptions *opts, const char *name,
         /* if sock->localaddr is missing, it has been initialized to "all bits
          * zero" */
         if (net_socket_mcast_init(vlan, "socket", name, sock->mcast,
-            sock->localaddr) == -1) {
+            sock->localaddr, vnet_hdr) == -1) {
             return -1;
         }
         return 0;
@@ -646,8 +1010,8 @@ int net_init_socket(const NetClientOptions *opts, const char *name,
         error_report("localaddr= is mandatory with udp=");
         return -1;
     }
-    if (net_socket_udp_init(vlan, "udp", name, sock->udp, sock->localaddr) ==
-        -1) {
+    if (net_socket_udp_init(vlan, "udp", name, sock->udp, sock->localaddr,
+                            vnet_hdr) == -1) {
         return -1;
     }
     return 0;
@@ -34,6 +34,7 @@
 #include <net/if.h>
 
 #include "net.h"
+#include "net/rss.h"
 #include "monitor.h"
 #include "sysemu.h"
 #include "qemu-char.h"
@@ -207,6 +208,12 @@ static void tap_send(void *opaque)
             size -= s->host_vnet_hdr_len;
         }
 
+        if (s->nc.rss) {
+            int hdr_len = s->using_vnet_hdr ? s->host_vnet_hdr_len : 0;
+
+            net_rss_steer(s->nc.rss, buf + hdr_len, size - hdr_len);
+        }
+
         size = qemu_send_packet_async(&s->nc, buf, size, tap_send_completed);
         if (size == 0) {
             tap_read_poll(s, 0);
@@ -320,6 +327,10 @@ static NetClientInfo net_tap_info = {
     .receive_iov = tap_receive_iov,
     .poll = tap_poll,
     .cleanup = tap_cleanup,
+    .has_ufo = tap_has_ufo,
+    .has_vnet_hdr = tap_has_vnet_hdr,
+    .using_vnet_hdr = tap_using_vnet_hdr,
+    .set_offload = tap_set_offload,
 };
 
 static TAPState *net_tap_fd_init(VLANState *vlan,
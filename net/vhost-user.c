@@ -0,0 +1,95 @@
+/*
+ * vhost-user network backend
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * The netdev only carries the vhost-user socket: once the guest driver is
+ * ready, the virtio-net rings are handed to the process at the other end
+ * of the socket (see hw/vhost-user.c), which then sends and receives the
+ * packets without going through QEMU.  There is no packet path through
+ * QEMU, so whatever virtio-net passes here before vhost is started is
+ * dropped.
+ */
+#include "net/vhost-user.h"
+
+#include "net.h"
+#include "qemu-common.h"
+#include "qemu-error.h"
+#include "qemu_socket.h"
+#include "hw/vhost_net.h"
+
+typedef struct VhostUserState {
+    VLANClientState nc;
+    struct vhost_net *vhost_net;
+} VhostUserState;
+
+static ssize_t vhost_user_receive(VLANClientState *nc, const uint8_t *buf,
+                                  size_t size)
+{
+    return size;
+}
+
+static void vhost_user_cleanup(VLANClientState *nc)
+{
+    VhostUserState *s = DO_UPCAST(VhostUserState, nc, nc);
+
+    if (s->vhost_net) {
+        /* closes the socket */
+        vhost_net_cleanup(s->vhost_net);
+        s->vhost_net = NULL;
+    }
+}
+
+static NetClientInfo net_vhost_user_info = {
+    .type = NET_CLIENT_OPTIONS_KIND_VHOST_USER,
+    .size = sizeof(VhostUserState),
+    .receive = vhost_user_receive,
+    .cleanup = vhost_user_cleanup,
+};
+
+struct vhost_net *vhost_user_get_vhost_net(VLANClientState *nc)
+{
+    VhostUserState *s = DO_UPCAST(VhostUserState, nc, nc);
+    assert(nc->info->type == NET_CLIENT_OPTIONS_KIND_VHOST_USER);
+    return s->vhost_net;
+}
+
+int net_init_vhost_user(const NetClientOptions *opts, const char *name,
+                        VLANState *vlan)
+{
+    const NetdevVhostUserOptions *vhost_user;
+    VLANClientState *nc;
+    VhostUserState *s;
+    int fd;
+
+    assert(opts->kind == NET_CLIENT_OPTIONS_KIND_VHOST_USER);
+    vhost_user = opts->vhost_user;
+
+    if (vlan) {
+        error_report("vhost-user requires -netdev");
+        return -1;
+    }
+
+    fd = unix_connect(vhost_user->path);
+    if (fd < 0) {
+        return -1;
+    }
+
+    nc = qemu_new_net_client(&net_vhost_user_info, vlan, NULL, "vhost-user",
+                             name);
+    snprintf(nc->info_str, sizeof(nc->info_str), "path=%s",
+             vhost_user->path);
+    s = DO_UPCAST(VhostUserState, nc, nc);
+
+    s->vhost_net = vhost_net_init(nc, fd, vhost_user->has_vhostforce &&
+                                  vhost_user->vhostforce);
+    if (!s->vhost_net) {
+        error_report("vhost-user backend at %s could not be initialized",
+                     vhost_user->path);
+        qemu_del_vlan_client(nc);
+        return -1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,32 @@
+/*
+ * Export the generated code layout to host profilers, for hosts without
+ * Linux perf
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu-common.h"
+#include "exec-all.h"
+
+void perf_enable_perfmap(void)
+{
+    fprintf(stderr, "qemu: warning: -perfmap is only supported on Linux\n");
+}
+
+void perf_enable_jitdump(void)
+{
+    fprintf(stderr, "qemu: warning: -jitdump is only supported on Linux\n");
+}
+
+void perf_report_code(TranslationBlock *tb, size_t size)
+{
+}
+
+void perf_report_flush(void)
+{
+}
+
+void perf_exit(void)
+{
+}
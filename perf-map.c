@@ -0,0 +1,230 @@
+/*
+ * Export the generated code layout to host profilers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Two formats understood by Linux perf are supported:
+ *
+ * - /tmp/perf-<pid>.map, one "start size name" text line per TB.  perf
+ *   reads it at report time, so a TB flush truncates the file: the map
+ *   then describes the current contents of the translation buffer.
+ *
+ * - /tmp/jit-<pid>.dump, the jitdump format of tools/perf/util/jitdump.h.
+ *   Every record is timestamped and carries a copy of the host code, so
+ *   "perf inject --jit" attributes samples correctly across flushes and
+ *   "perf annotate" can disassemble the generated code.  Requires
+ *   "perf record -k 1" so that perf uses the same clock.
+ */
+
+#include <sys/mman.h>
+
+#include "config.h"
+#include "cpu.h"
+#include "exec-all.h"
+#include "disas.h"
+#include "tcg.h"
+#include "elf.h"
+
+#define JITDUMP_MAGIC    0x4A695444
+#define JITDUMP_VERSION  1
+#define JIT_CODE_LOAD    0
+
+struct jitheader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_size;
+    uint32_t elf_mach;
+    uint32_t pad1;
+    uint32_t pid;
+    uint64_t timestamp;
+    uint64_t flags;
+};
+
+struct jr_code_load {
+    uint32_t id;
+    uint32_t total_size;
+    uint64_t timestamp;
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t vma;
+    uint64_t code_addr;
+    uint64_t code_size;
+    uint64_t code_index;
+};
+
+#if defined(__x86_64__)
+#define PERF_ELF_MACHINE EM_X86_64
+#elif defined(__i386__)
+#define PERF_ELF_MACHINE EM_386
+#elif defined(__powerpc64__)
+#define PERF_ELF_MACHINE EM_PPC64
+#elif defined(_ARCH_PPC)
+#define PERF_ELF_MACHINE EM_PPC
+#elif defined(__s390__)
+#define PERF_ELF_MACHINE EM_S390
+#elif defined(__sparc__) && defined(__arch64__)
+#define PERF_ELF_MACHINE EM_SPARCV9
+#elif defined(__sparc__)
+#define PERF_ELF_MACHINE EM_SPARC
+#elif defined(__arm__)
+#define PERF_ELF_MACHINE EM_ARM
+#elif defined(__mips__)
+#define PERF_ELF_MACHINE EM_MIPS
+#elif defined(__ia64__)
+#define PERF_ELF_MACHINE EM_IA_64
+#else
+#define PERF_ELF_MACHINE EM_NONE
+#endif
+
+static FILE *perfmap;
+static FILE *jitdump;
+static void *jitdump_marker;
+static uint64_t jitdump_index;
+static bool prologue_reported;
+
+static uint64_t perf_timestamp(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+void perf_enable_perfmap(void)
+{
+    char name[64];
+
+    snprintf(name, sizeof(name), "/tmp/perf-%d.map", getpid());
+    perfmap = fopen(name, "w+");
+    if (!perfmap) {
+        fprintf(stderr, "qemu: could not open %s: %s\n",
+                name, strerror(errno));
+    }
+}
+
+void perf_enable_jitdump(void)
+{
+    struct jitheader header;
+    char name[64];
+    int fd;
+
+    snprintf(name, sizeof(name), "/tmp/jit-%d.dump", getpid());
+    fd = open(name, O_CREAT | O_TRUNC | O_RDWR, 0666);
+    if (fd < 0) {
+        fprintf(stderr, "qemu: could not open %s: %s\n",
+                name, strerror(errno));
+        return;
+    }
+
+    /* perf finds the dump through the executable mapping of the file
+       recorded in the trace.  */
+    jitdump_marker = mmap(NULL, getpagesize(), PROT_READ | PROT_EXEC,
+                          MAP_PRIVATE, fd, 0);
+    if (jitdump_marker == MAP_FAILED) {
+        fprintf(stderr, "qemu: could not map %s: %s\n",
+                name, strerror(errno));
+        jitdump_marker = NULL;
+        close(fd);
+        return;
+    }
+
+    jitdump = fdopen(fd, "w");
+    if (!jitdump) {
+        munmap(jitdump_marker, getpagesize());
+        jitdump_marker = NULL;
+        close(fd);
+        return;
+    }
+
+    memset(&header, 0, sizeof(header));
+    header.magic = JITDUMP_MAGIC;
+    header.version = JITDUMP_VERSION;
+    header.total_size = sizeof(header);
+    header.elf_mach = PERF_ELF_MACHINE;
+    header.pid = getpid();
+    header.timestamp = perf_timestamp();
+    fwrite(&header, sizeof(header), 1, jitdump);
+}
+
+static void perf_map_write(const void *start, size_t size, const char *name)
+{
+    fprintf(perfmap, "%" PRIxPTR " %zx %s\n", (uintptr_t)start, size, name);
+}
+
+static void perf_report(const void *start, size_t size, const char *name)
+{
+    if (perfmap) {
+        perf_map_write(start, size, name);
+    }
+    if (jitdump) {
+        struct jr_code_load record;
+        size_t len = strlen(name) + 1;
+
+        record.id = JIT_CODE_LOAD;
+        record.total_size = sizeof(record) + len + size;
+        record.timestamp = perf_timestamp();
+        record.pid = getpid();
+        record.tid = qemu_get_thread_id();
+        record.vma = (uintptr_t)start;
+        record.code_addr = (uintptr_t)start;
+        record.code_size = size;
+        record.code_index = jitdump_index++;
+        fwrite(&record, sizeof(record), 1, jitdump);
+        fwrite(name, len, 1, jitdump);
+        fwrite(start, size, 1, jitdump);
+    }
+}
+
+/* Describe the host code of 'tb', 'size' bytes at tb->tc_ptr.  */
+void perf_report_code(TranslationBlock *tb, size_t size)
+{
+    const char *symbol;
+    char name[128];
+
+    if (!perfmap && !jitdump) {
+        return;
+    }
+    if (!prologue_reported) {
+        perf_report(code_gen_prologue, CODE_GEN_PROLOGUE_SIZE,
+                    "qemu-prologue");
+        prologue_reported = true;
+    }
+
+    symbol = lookup_symbol(tb->pc);
+    snprintf(name, sizeof(name), "guest-0x" TARGET_FMT_lx "%s%s",
+             tb->pc, symbol[0] ? " " : "", symbol);
+    perf_report(tb->tc_ptr, size, name);
+}
+
+/* Called when the translation buffer is flushed.  */
+void perf_report_flush(void)
+{
+    if (perfmap) {
+        fflush(perfmap);
+        if (ftruncate(fileno(perfmap), 0) == 0) {
+            rewind(perfmap);
+        }
+        if (prologue_reported) {
+            perf_map_write(code_gen_prologue, CODE_GEN_PROLOGUE_SIZE,
+                           "qemu-prologue");
+        }
+    }
+    if (jitdump) {
+        fflush(jitdump);
+    }
+}
+
+void perf_exit(void)
+{
+    if (perfmap) {
+        fclose(perfmap);
+        perfmap = NULL;
+    }
+    if (jitdump) {
+        fclose(jitdump);
+        jitdump = NULL;
+        munmap(jitdump_marker, getpagesize());
+        jitdump_marker = NULL;
+    }
+}
@@ -284,6 +284,16 @@ typedef struct PCIHostDeviceAddress {
 void tcg_exec_init(unsigned long tb_size);
 bool tcg_enabled(void);
 
+/* Number of executions after which a TB is retranslated with all
+   optimizations, 0 to always optimize.  */
+extern int tb_hot_threshold;
+int tb_set_hot_threshold(const char *str);
+
+/* Describe the generated code to Linux perf, see perf-map.c.  */
+void perf_enable_perfmap(void);
+void perf_enable_jitdump(void);
+void perf_exit(void);
+
 void cpu_exec_init_all(void);
 
 /* CPU save/load.  */
@@ -571,6 +571,26 @@ static QemuOptsList qemu_machine_opts = {
             .name = "kvm_shadow_mem",
             .type = QEMU_OPT_SIZE,
             .help = "KVM shadow MMU size",
+        }, {
+            .name = "lockless_io",
+            .type = QEMU_OPT_BOOL,
+            .help = "handle KVM I/O exits without the global mutex",
+        }, {
+            .name = "msi_direct",
+            .type = QEMU_OPT_BOOL,
+            .help = "deliver MSIs to the KVM irqchip without a memory write",
+        }, {
+            .name = "halt_poll_ns",
+            .type = QEMU_OPT_NUMBER,
+            .help = "maximum time a halted vCPU polls before sleeping",
+        }, {
+            .name = "halt_poll_grow",
+            .type = QEMU_OPT_NUMBER,
+            .help = "factor by which the halt polling window grows",
+        }, {
+            .name = "halt_poll_shrink",
+            .type = QEMU_OPT_NUMBER,
+            .help = "divisor by which the halt polling window shrinks",
         }, {
             .name = "kernel",
             .type = QEMU_OPT_STRING,
@@ -33,7 +33,11 @@ DEF("machine", HAS_ARG, QEMU_OPTION_machine, \
     "                property accel=accel1[:accel2[:...]] selects accelerator\n"
     "                supported accelerators are kvm, xen, tcg (default: tcg)\n"
     "                kernel_irqchip=on|off controls accelerated irqchip support\n"
-    "                kvm_shadow_mem=size of KVM shadow MMU\n",
+    "                kvm_shadow_mem=size of KVM shadow MMU\n"
+    "                lockless_io=on|off handles KVM I/O exits without the global mutex\n"
+    "                msi_direct=on|off delivers MSIs to the KVM irqchip directly\n"
+    "                halt_poll_ns=n polls up to n ns before a halted vCPU sleeps\n"
+    "                halt_poll_grow=n,halt_poll_shrink=n adapt the polling window\n",
     QEMU_ARCH_ALL)
 STEXI
 @item -machine [type=]@var{name}[,prop=@var{value}[,...]]
@@ -50,6 +54,30 @@ to initialize.
 Enables in-kernel irqchip support for the chosen accelerator when available.
 @item kvm_shadow_mem=size
 Defines the size of the KVM shadow MMU.
+@item lockless_io=on|off
+Lets KVM vCPU threads complete MMIO and PIO exits to devices that do their
+own locking without taking the global mutex (default: on).  Requires the
+in-kernel irqchip.
+@item msi_direct=on|off
+Hands MSI and MSI-X messages from emulated devices straight to the KVM
+in-kernel irqchip instead of writing them to the APIC window through the
+memory core, and lets devices raise vectors through KVM irqfds (default:
+on).  @code{info msi} counts the messages sent through each path, and
+@code{msi_timing} measures their latency.
+@item halt_poll_ns=@var{n}
+With KVM and the irqchip in userspace (@code{kernel_irqchip=off}), lets a
+halted vCPU thread spin for up to @var{n} nanoseconds before it sleeps, so
+that an interrupt arriving soon after HLT does not have to wake it through
+the host scheduler.  Polling burns host CPU time and is disabled by
+default.
+@item halt_poll_grow=@var{n}
+Multiplies a vCPU's polling window by @var{n} when the wakeup came shortly
+after the window expired, at least 2 (default: 2).
+@item halt_poll_shrink=@var{n}
+Divides a vCPU's polling window by @var{n} when it stayed halted for longer
+than @code{halt_poll_ns}; 0 resets the window (default: 0).
+@code{info halt-poll} shows each vCPU's window and how often polling saw the
+wakeup.
 @end table
 ETEXI
 
@@ -87,12 +115,24 @@ specifies the maximum number of hotpluggable CPUs.
 ETEXI
 
 DEF("numa", HAS_ARG, QEMU_OPTION_numa,
-    "-numa node[,mem=size][,cpus=cpu[-cpu]][,nodeid=node]\n", QEMU_ARCH_ALL)
+    "-numa node[,mem=size][,cpus=cpu[-cpu]][,nodeid=node]\n"
+    "      [,host-nodes=node[-node]][,policy=default|preferred|bind|interleave]\n",
+    QEMU_ARCH_ALL)
 STEXI
 @item -numa @var{opts}
 @findex -numa
 Simulate a multi node NUMA system. If mem and cpus are omitted, resources
 are split equally.
+
+@option{host-nodes} and @option{policy} place the memory of the guest node
+on the given host nodes: @code{bind} (the default when @option{host-nodes}
+is given) allocates only from them, @code{preferred} tries the first one
+before falling back to other nodes, and @code{interleave} spreads the
+memory across them.  @code{default} cannot be combined with
+@option{host-nodes}.  When a host policy is given, the guest RAM of each
+node is allocated as a separate RAM block, so the source and destination
+of a migration must use the same @option{-numa} options.  @code{info numa}
+shows where the memory actually is.
 ETEXI
 
 DEF("fda", HAS_ARG, QEMU_OPTION_fda,
@@ -399,13 +439,35 @@ STEXI
 Allocate guest RAM from a temporarily created file in @var{path}.
 ETEXI
 
+DEF("mem-shared", 0, QEMU_OPTION_mem_shared,
+    "-mem-shared     map the -mem-path files shared\n", QEMU_ARCH_ALL)
+STEXI
+@item -mem-shared
+Map the files created for @option{-mem-path} with @code{MAP_SHARED}, so
+that other processes can access guest RAM through them.  This is needed by
+@option{-netdev vhost-user}, whose backend receives the file descriptors.
+ETEXI
+
 #ifdef MAP_POPULATE
 DEF("mem-prealloc", 0, QEMU_OPTION_mem_prealloc,
     "-mem-prealloc   preallocate guest memory (use with -mem-path)\n",
     QEMU_ARCH_ALL)
 STEXI
 @item -mem-prealloc
-Preallocate memory when using -mem-path.
+Preallocate memory when using -mem-path.  The memory is touched by
+several threads, with the threads of a NUMA node bound to its host nodes
+running on the CPUs of those nodes.  QEMU exits with an error if there are
+not enough free (huge)pages.
+ETEXI
+
+DEF("mem-prealloc-threads", HAS_ARG, QEMU_OPTION_mem_prealloc_threads,
+    "-mem-prealloc-threads n\n"
+    "                preallocate memory with n threads\n",
+    QEMU_ARCH_ALL)
+STEXI
+@item -mem-prealloc-threads @var{n}
+Use @var{n} threads for @option{-mem-prealloc}.  The default is one thread
+per host CPU, up to 64.
 ETEXI
 #endif
 
@@ -1250,7 +1312,7 @@ DEF("net", HAS_ARG, QEMU_OPTION_net,
 #ifdef CONFIG_SLIRP
     "-net user[,vlan=n][,name=str][,net=addr[/mask]][,host=addr][,restrict=on|off]\n"
     "         [,hostname=host][,dhcpstart=addr][,dns=addr][,tftp=dir][,bootfile=f]\n"
-    "         [,hostfwd=rule][,guestfwd=rule]"
+    "         [,hostfwd=rule][,guestfwd=rule][,vnet_hdr=on|off]"
 #ifndef _WIN32
                                              "[,smb=dir[,smbserver=addr]]\n"
 #endif
@@ -1290,6 +1352,8 @@ DEF("net", HAS_ARG, QEMU_OPTION_net,
     "                use 'localaddr=addr' to specify the host address to send packets from\n"
     "-net socket[,vlan=n][,name=str][,fd=h][,udp=host:port][,localaddr=host:port]\n"
     "                connect the vlan 'n' to another VLAN using an UDP tunnel\n"
+    "                use 'vnet_hdr=on' on both ends of any of these sockets to pass\n"
+    "                checksum offload and TCP segmentation offload (TSO) frames\n"
 #ifdef CONFIG_VDE
     "-net vde[,vlan=n][,name=str][,sock=socketpath][,port=n][,group=groupname][,mode=octalmode]\n"
     "                connect the vlan 'n' to port 'n' of a vde switch running\n"
@@ -1297,8 +1361,11 @@ DEF("net", HAS_ARG, QEMU_OPTION_net,
     "                Use group 'groupname' and mode 'octalmode' to change default\n"
     "                ownership and permissions for communication port.\n"
 #endif
-    "-net dump[,vlan=n][,file=f][,len=n]\n"
+    "-net dump[,vlan=n][,file=f][,len=n][,filter=expr][,file-size=n]\n"
+    "         [,file-count=n][,buffer-size=n]\n"
     "                dump traffic on vlan 'n' to file 'f' (max n bytes per packet)\n"
+    "                only packets matching 'expr' are stored, files are\n"
+    "                rotated every 'file-size' bytes\n"
     "-net none       use it alone to have zero network devices. If no -net option\n"
     "                is provided, the default is '-net nic -net user'\n", QEMU_ARCH_ALL)
 DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
@@ -1310,6 +1377,9 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "bridge|"
 #ifdef CONFIG_VDE
     "vde|"
+#endif
+#ifdef CONFIG_LINUX
+    "vhost-user|"
 #endif
     "socket],id=str[,option][,option][,...]\n", QEMU_ARCH_ALL)
 STEXI
@@ -1403,6 +1473,11 @@ Note that a SAMBA server must be installed on the host OS.
 QEMU was tested successfully with smbd versions from Red Hat 9,
 Fedora Core 3 and OpenSUSE 11.x.
 
+@item vnet_hdr=on|off
+Exchange frames with a virtio_net_hdr, so that a virtio-net NIC offers
+checksum offload and TSO to the guest.  The NIC then cannot be migrated
+to a QEMU version that does not support this option.  Default is off.
+
 @item hostfwd=[tcp|udp]:[@var{hostaddr}]:@var{hostport}-[@var{guestaddr}]:@var{guestport}
 Redirect incoming TCP or UDP connections to the host port @var{hostport} to
 the guest IP address @var{guestaddr} on guest port @var{guestport}. If
@@ -1547,6 +1622,25 @@ qemu-system-i386 linux.img \
                  -net socket,connect=127.0.0.1:1234
 @end example
 
+With @option{vnet_hdr=on}, every frame on the socket is preceded by the
+header of a virtio-net frame, so that guests using virtio-net on both ends
+can exchange frames of up to 64k with checksums left to the receiver.  Any
+other NIC gets the checksums completed and the frames segmented by QEMU.
+Both ends of the socket must use the same setting.  This applies to all
+kinds of socket connections.
+
+Example:
+@example
+# launch a first QEMU instance
+qemu-system-i386 linux.img \
+                 -device virtio-net-pci,netdev=n0 \
+                 -netdev socket,id=n0,listen=:1234,vnet_hdr=on
+# connect to it, with TSO from one guest to the other
+qemu-system-i386 linux.img \
+                 -device virtio-net-pci,netdev=n0,mac=52:54:00:12:34:57 \
+                 -netdev socket,id=n0,connect=127.0.0.1:1234,vnet_hdr=on
+@end example
+
 @item -net socket[,vlan=@var{n}][,name=@var{name}][,fd=@var{h}][,mcast=@var{maddr}:@var{port}[,localaddr=@var{addr}]]
 
 Create a VLAN @var{n} shared with another QEMU virtual
@@ -1613,11 +1707,49 @@ vde_switch -F -sock /tmp/myswitch
 qemu-system-i386 linux.img -net nic -net vde,sock=/tmp/myswitch
 @end example
 
-@item -net dump[,vlan=@var{n}][,file=@var{file}][,len=@var{len}]
+@item -net dump[,vlan=@var{n}][,file=@var{file}][,len=@var{len}][,filter=@var{expr}][,file-size=@var{size}][,file-count=@var{count}][,buffer-size=@var{size}]
 Dump network traffic on VLAN @var{n} to file @var{file} (@file{qemu-vlan0.pcap} by default).
 At most @var{len} bytes (64k by default) per packet are stored. The file format is
 libpcap, so it can be analyzed with tools such as tcpdump or Wireshark.
 
+Packets are copied to a memory buffer of @var{buffer-size} bytes (4M by
+default) and written to the file by a separate thread; packets that find the
+buffer full are left out of the dump.  With @option{filter}, only the packets
+that match @var{expr} are stored.  The expression is made of @code{ip},
+@code{ip6}, @code{arp}, @code{tcp}, @code{udp}, @code{icmp},
+@code{ether proto @var{n}}, @code{[src|dst] host @var{a.b.c.d}} and
+@code{[src|dst] port @var{n}}, combined with @code{and}, @code{or},
+@code{not} and parentheses.  With @option{file-size}, a new file is started
+whenever the current one would grow beyond @var{size} bytes; the files are
+called @file{@var{file}.0}, @file{@var{file}.1} and so on, and with
+@option{file-count} the oldest of @var{count} files is overwritten.
+
+The traffic of a @option{-netdev} can be captured the same way with the
+@code{net_capture_start} monitor command, while the guest runs.
+
+@item -netdev vhost-user,id=@var{id},path=@var{path}[,vhostforce=on|off]
+Hand the rings of the virtio-net device connected to this netdev to the
+process listening on the unix socket @var{path}.  That process moves the
+packets itself, QEMU only tells it where guest memory and the rings are and
+passes it the eventfds used for notifications.  Guest RAM must be
+allocated with @option{-mem-path} and @option{-mem-shared}.  As with
+@option{-net tap,vhost=on}, the rings are handed over only for guests that
+use MSI-X unless @option{vhostforce=on} is given.  Migration is not
+supported.
+
+@file{tests/vhost-user-bridge} is a backend that sends every packet of the
+guest back to it, to measure the throughput of the device.
+
+Example:
+@example
+# start the loopback backend
+tests/vhost-user-bridge /tmp/vhost.sock
+# launch a QEMU instance with hugepage-backed RAM
+qemu-system-x86_64 linux.img -m 1024 -mem-path /dev/hugepages -mem-shared \
+        -netdev vhost-user,id=vu0,path=/tmp/vhost.sock \
+        -device virtio-net-pci,netdev=vu0
+@end example
+
 @item -net none
 Indicate that no network devices should be configured. It is used to
 override the default configuration (@option{-net nic -net user}) which
@@ -2312,6 +2444,31 @@ STEXI
 Run the emulation in single step mode.
 ETEXI
 
+DEF("perfmap", 0, QEMU_OPTION_perfmap, \
+    "-perfmap        generate a /tmp/perf-${pid}.map file for perf\n",
+    QEMU_ARCH_ALL)
+STEXI
+@item -perfmap
+@findex -perfmap
+Write the address, size and guest address of every translated block to
+@file{/tmp/perf-<pid>.map}, so that @command{perf report} can attribute
+samples in generated code to guest code.  The file is truncated when the
+translation buffer is flushed.  Linux hosts only.
+ETEXI
+
+DEF("jitdump", 0, QEMU_OPTION_jitdump, \
+    "-jitdump        generate a /tmp/jit-${pid}.dump file for perf\n",
+    QEMU_ARCH_ALL)
+STEXI
+@item -jitdump
+@findex -jitdump
+Write every translated block, including its host code, to
+@file{/tmp/jit-<pid>.dump} in the jitdump format.  Record with
+@code{perf record -k 1} and merge the dump with @code{perf inject --jit}.
+Unlike @option{-perfmap}, this attributes samples correctly across
+translation buffer flushes.  Linux hosts only.
+ETEXI
+
 DEF("S", 0, QEMU_OPTION_S, \
     "-S              freeze CPU at startup (use 'c' to start execution)\n",
     QEMU_ARCH_ALL)
@@ -2640,6 +2797,21 @@ STEXI
 Set TB size.
 ETEXI
 
+DEF("tb-hot-threshold", HAS_ARG, QEMU_OPTION_tb_hot_threshold, \
+    "-tb-hot-threshold n\n"
+    "                translate blocks quickly and optimize them after n executions\n",
+    QEMU_ARCH_ALL)
+STEXI
+@item -tb-hot-threshold @var{n}
+@findex -tb-hot-threshold
+Translate code without running the TCG optimizer at first, and translate
+each block again with all optimizations once it has been executed @var{n}
+times.  On x86 guests, the optimized translation also continues across
+forward direct jumps.  This shortens boot time when most code runs only a
+few times.  The default, 0, optimizes every block from the start.
+Statistics are shown by @code{info jit}.
+ETEXI
+
 DEF("incoming", HAS_ARG, QEMU_OPTION_incoming, \
     "-incoming p     prepare for incoming migration, listen on port p\n",
     QEMU_ARCH_ALL)
@@ -605,8 +605,10 @@ EQMP
 
     {
         .name       = "dump-guest-memory",
-        .args_type  = "paging:b,protocol:s,begin:i?,end:i?",
-        .params     = "-p protocol [begin] [length]",
+        .args_type  = "paging:b,protocol:s,begin:i?,end:i?,format:s?,"
+                      "detach:b?,threads:i?",
+        .params     = "-p protocol [begin] [length] [format] [detach] "
+                      "[threads]",
         .help       = "dump guest memory to file",
         .user_print = monitor_user_noop,
         .mhandler.cmd_new = qmp_marshal_input_dump_guest_memory,
@@ -627,16 +629,189 @@ Arguments:
            with length together (json-int)
 - "length": the memory size, in bytes. It's optional, and should be specified
             with begin together (json-int)
+- "format": "elf" (default), "kdump-zlib", "kdump-lzo" or "kdump-snappy".
+            The kdump formats cannot be combined with paging, begin or
+            length (json-string, optional)
+- "detach": return immediately and write the dump in the background; see
+            query-dump.  Until it completes, the guest stays stopped and
+            cont, system_reset, device_add, device_del, migrate and quit
+            fail (json-bool, optional)
+- "threads": number of compression threads for the kdump formats, default
+             is the number of host CPUs (json-int, optional)
 
 Example:
 
 -> { "execute": "dump-guest-memory", "arguments": { "protocol": "fd:dump" } }
 <- { "return": {} }
 
+-> { "execute": "dump-guest-memory",
+     "arguments": { "paging": false, "protocol": "file:/tmp/vmcore",
+                    "format": "kdump-zlib", "detach": true } }
+<- { "return": {} }
+
 Notes:
 
 (1) All boolean arguments default to false
 
+EQMP
+
+    {
+        .name       = "query-dump",
+        .args_type  = "",
+        .mhandler.cmd_new = qmp_marshal_input_query_dump,
+    },
+
+SQMP
+query-dump
+----------
+
+Show the progress of the last guest memory dump.
+
+Return a json-object with the following information:
+
+- "status": "none", "active", "completed" or "failed" (json-string)
+- "completed": bytes of guest memory written so far (json-int)
+- "total": bytes of guest memory to write (json-int)
+
+Example:
+
+-> { "execute": "query-dump" }
+<- { "return": { "status": "active", "completed": 536870912,
+                 "total": 2147483648 } }
+
+EQMP
+
+    {
+        .name       = "jit-profile",
+        .args_type  = "enable:b",
+        .mhandler.cmd_new = qmp_marshal_input_jit_profile,
+    },
+
+SQMP
+jit-profile
+-----------
+
+Enable or disable the profiling of translated code. The translation buffer
+is flushed and all counters are reset.
+
+Arguments:
+
+- "enable": true to start profiling, false to stop (json-bool)
+
+Example:
+
+-> { "execute": "jit-profile", "arguments": { "enable": true } }
+<- { "return": {} }
+
+EQMP
+
+    {
+        .name       = "query-numa-memory",
+        .args_type  = "",
+        .mhandler.cmd_new = qmp_marshal_input_query_numa_memory,
+    },
+
+SQMP
+query-numa-memory
+-----------------
+
+Show the host memory policy and placement of each guest NUMA node.
+
+Return a json-array of json-objects, one per guest node, with:
+
+- "node": guest node (json-int)
+- "size": memory size of the node in bytes (json-int)
+- "policy": host policy, one of "default", "preferred", "bind" or
+            "interleave" (json-string)
+- "host-nodes": host nodes of the policy, bit N for host node N (json-int)
+- "placement": json-array of json-objects with "host-node" (json-int) and
+               the estimated number of bytes on that node "size" (json-int)
+- "unallocated": estimated number of bytes not allocated yet (json-int)
+
+Example:
+
+-> { "execute": "query-numa-memory" }
+<- { "return": [ { "node": 0, "size": 1073741824, "policy": "bind",
+                   "host-nodes": 1,
+                   "placement": [ { "host-node": 0, "size": 268435456 } ],
+                   "unallocated": 805306368 } ] }
+
+EQMP
+
+    {
+        .name       = "query-jit-profile",
+        .args_type  = "count:i?",
+        .mhandler.cmd_new = qmp_marshal_input_query_jit_profile,
+    },
+
+SQMP
+query-jit-profile
+-----------------
+
+Show the dynamic translator profile.
+
+Arguments:
+
+- "count": number of blocks to return, default 20 (json-int, optional)
+
+Return a json-object with the following information:
+
+- "enabled": true if block profiling is enabled (json-bool)
+- "code-size": bytes of generated code (json-int)
+- "code-max-size": size of the translation buffer (json-int)
+- "dead-code-size": bytes of generated code of invalidated blocks (json-int)
+- "tb-count": number of translated blocks (json-int)
+- "tb-max-count": maximum number of translated blocks (json-int)
+- "flush-count": number of translation buffer flushes (json-int)
+- "invalidate-count": number of invalidated blocks (json-int)
+- "executions": total number of block executions (json-int)
+- "main-loop-entries": executions started from the main loop (json-int)
+- "chained-executions": executions reached through direct jumps (json-int)
+- "blocks": json-array of the most executed blocks, each a json-object with
+  "pc", "cs-base", "flags", "size", "host-addr", "host-size", "exec-count"
+  and "exit-count" (json-int)
+- "helpers": json-array of json-objects with the helper "name" (json-string)
+  and its call "count" (json-int)
+
+Example:
+
+-> { "execute": "query-jit-profile", "arguments": { "count": 1 } }
+<- { "return": { "enabled": true, "code-size": 1048576,
+                 "code-max-size": 33161216, "dead-code-size": 4096,
+                 "tb-count": 5120, "tb-max-count": 262144,
+                 "flush-count": 0, "invalidate-count": 42,
+                 "executions": 9000000, "main-loop-entries": 100000,
+                 "chained-executions": 8900000,
+                 "blocks": [ { "pc": 1048832, "cs-base": 0, "flags": 176,
+                               "size": 12, "host-addr": 140000000000,
+                               "host-size": 96, "exec-count": 500000,
+                               "exit-count": 10 } ],
+                 "helpers": [ { "name": "cc_compute_all", "count": 7000 } ] } }
+
+EQMP
+
+    {
+        .name       = "jit-profile-dump",
+        .args_type  = "filename:F",
+        .mhandler.cmd_new = qmp_marshal_input_jit_profile_dump,
+    },
+
+SQMP
+jit-profile-dump
+----------------
+
+Write the block and helper execution counts to a file, one
+"frame;frame;... count" line each, suitable for flame graph tools.
+
+Arguments:
+
+- "filename": the file to write (json-string)
+
+Example:
+
+-> { "execute": "jit-profile-dump", "arguments": { "filename": "/tmp/jit" } }
+<- { "return": {} }
+
 EQMP
 
     {
@@ -690,6 +865,175 @@ Example:
 <- { "return": {} }
 
 
+EQMP
+
+    {
+        .name       = "net-capture-start",
+        .args_type  = "netdev:s,file:s,snaplen:i?,filter:s?,file-size:i?,"
+                      "file-count:i?,buffer-size:i?",
+        .mhandler.cmd_new = qmp_marshal_input_net_capture_start,
+    },
+
+SQMP
+net-capture-start
+-----------------
+
+Start capturing the traffic of a host network device to libpcap files.
+
+Arguments:
+
+- "netdev": the device's ID (json-string)
+- "file": capture file; with "file-size", the files are called file.0,
+          file.1, ... (json-string)
+- "snaplen": bytes stored per packet, default 65535 (json-int, optional)
+- "filter": only capture packets matching this expression, e.g.
+            "tcp and not port 22" (json-string, optional)
+- "file-size": start a new file when the current one would exceed this
+               many bytes (json-int, optional)
+- "file-count": with "file-size", overwrite the oldest file after this many
+                files (json-int, optional)
+- "buffer-size": bytes of memory buffer, default 4M (json-int, optional)
+
+Example:
+
+-> { "execute": "net-capture-start",
+     "arguments": { "netdev": "netdev1", "file": "/tmp/net.pcap",
+                    "filter": "udp and port 53" } }
+<- { "return": {} }
+
+EQMP
+
+    {
+        .name       = "net-capture-stop",
+        .args_type  = "netdev:s",
+        .mhandler.cmd_new = qmp_marshal_input_net_capture_stop,
+    },
+
+SQMP
+net-capture-stop
+----------------
+
+Stop a capture started with net-capture-start.
+
+Arguments:
+
+- "netdev": the device's ID (json-string)
+
+Example:
+
+-> { "execute": "net-capture-stop", "arguments": { "netdev": "netdev1" } }
+<- { "return": {} }
+
+EQMP
+
+    {
+        .name       = "netdev_set_throttle",
+        .args_type  = "id:s,bps:l,pps:l,bps_burst:l?,pps_burst:l?",
+        .mhandler.cmd_new = qmp_marshal_input_netdev_set_throttle,
+    },
+
+SQMP
+netdev_set_throttle
+-------------------
+
+Limit the traffic of a host network device, in each direction.
+
+Arguments:
+
+- "id": the device's ID (json-string)
+- "bps": bytes per second, 0 for no limit (json-int)
+- "pps": packets per second, 0 for no limit (json-int)
+- "bps_burst": bytes that may pass at once, default bps/10 (json-int,
+               optional)
+- "pps_burst": packets that may pass at once, default pps/10 (json-int,
+               optional)
+
+Example:
+
+-> { "execute": "netdev_set_throttle", "arguments": { "id": "netdev1",
+                                                     "bps": 12500000,
+                                                     "pps": 0 } }
+<- { "return": {} }
+
+EQMP
+
+    {
+        .name       = "query-netdev-throttle",
+        .args_type  = "",
+        .mhandler.cmd_new = qmp_marshal_input_query_netdev_throttle,
+    },
+
+SQMP
+query-netdev-throttle
+---------------------
+
+Show the limits of the host network devices that have some, and how often
+packets were delayed or dropped because of them.
+
+Example:
+
+-> { "execute": "query-netdev-throttle" }
+<- { "return": [ { "id": "netdev1", "bps": 12500000, "pps": 0,
+                   "bps_burst": 1250000, "pps_burst": 1,
+                   "tx_delayed": 1523, "tx_dropped": 0,
+                   "rx_delayed": 12, "rx_dropped": 0 } ] }
+
+EQMP
+
+    {
+        .name       = "netdev_set_rss",
+        .args_type  = "id:s,queues:l,key:s?,table:s?",
+        .mhandler.cmd_new = qmp_marshal_input_netdev_set_rss,
+    },
+
+SQMP
+netdev_set_rss
+--------------
+
+Steer the frames received by a tap device to receive queues by the Toeplitz
+hash of their addresses and ports, through a table of 128 queues.
+
+Arguments:
+
+- "id": the device's ID (json-string)
+- "queues": the number of queues, up to 16, 0 to stop (json-int)
+- "key": the hash key as 80 hexadecimal digits (json-string, optional)
+- "table": comma-separated queues, repeated to fill the 128 entries
+           (json-string, optional)
+
+Example:
+
+-> { "execute": "netdev_set_rss", "arguments": { "id": "netdev1",
+                                                "queues": 2,
+                                                "table": "0,0,0,1" } }
+<- { "return": {} }
+
+EQMP
+
+    {
+        .name       = "query-netdev-rss",
+        .args_type  = "",
+        .mhandler.cmd_new = qmp_marshal_input_query_netdev_rss,
+    },
+
+SQMP
+query-netdev-rss
+----------------
+
+Show the steering of the host network devices that have some, with the
+frames and bytes received on each queue.
+
+Example:
+
+-> { "execute": "query-netdev-rss" }
+<- { "return": [ { "id": "netdev1",
+                   "key": "6d5a56da255b0ec24167253d43a38fb0d0ca2bcb...",
+                   "table": "0,1,0,1,...", "unhashed": 3,
+                   "queues": [ { "queue": 0, "rx_packets": 1201,
+                                 "rx_bytes": 1719832 },
+                               { "queue": 1, "rx_packets": 877,
+                                 "rx_bytes": 1253064 } ] } ] }
+
 EQMP
 
     {
@@ -2076,6 +2420,8 @@ The main json-object contains the following:
          - "transferred": amount transferred (json-int)
          - "remaining": amount remaining (json-int)
          - "total": total (json-int)
+         - "skipped": amount not transferred because the guest reported it
+           free through the balloon device (json-int)
 - "disk": only present if "status" is "active" and it is a block migration,
   it is a json-object with the following disk information (in bytes):
          - "transferred": amount transferred (json-int)
@@ -2157,6 +2503,10 @@ json-object will be returned containing the following data:
 - "free_mem": Total amount of free and unused memory in
               bytes (json-int, optional)
 - "total_mem": Total amount of available memory in bytes (json-int, optional)
+- "free_page_reported": Memory reported as freed by the guest, in
+                        bytes (json-int, optional)
+- "free_page_reclaimed": Reported memory returned to the host, in
+                         bytes (json-int, optional)
 
 Example:
 
@@ -79,6 +79,10 @@ UuidInfo *qmp_query_uuid(Error **errp)
 
 void qmp_quit(Error **err)
 {
+    if (dump_in_progress()) {
+        error_set(err, QERR_DEVICE_IN_USE, "dump");
+        return;
+    }
     no_shutdown = 0;
     qemu_system_shutdown_request();
 }
@@ -90,6 +94,10 @@ void qmp_stop(Error **errp)
 
 void qmp_system_reset(Error **errp)
 {
+    if (dump_in_progress()) {
+        error_set(errp, QERR_DEVICE_IN_USE, "dump");
+        return;
+    }
     qemu_system_reset_request();
 }
 
@@ -153,6 +161,9 @@ void qmp_cont(Error **errp)
         return;
     } else if (runstate_check(RUN_STATE_SUSPENDED)) {
         return;
+    } else if (dump_in_progress()) {
+        error_set(errp, QERR_DEVICE_IN_USE, "dump");
+        return;
     }
 
     bdrv_iterate(iostatus_bdrv_it, NULL);
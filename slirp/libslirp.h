@@ -24,9 +24,18 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds,
 
 void slirp_input(Slirp *slirp, const uint8_t *pkt, int pkt_len);
 
+/* the TCP or UDP checksum of the frame is not filled in yet */
+#define SLIRP_INPUT_CSUM_PARTIAL    1
+
+/* Input the frame that starts 'offset' bytes into 'iov'.  The IP datagram
+ * in it may be larger than the MTU. */
+void slirp_input_iov(Slirp *slirp, const struct iovec *iov, int iovcnt,
+                     size_t offset, int flags);
+
 /* you must provide the following functions: */
 int slirp_can_output(void *opaque);
 void slirp_output(void *opaque, const uint8_t *pkt, int pkt_len);
+void slirp_output_iov(void *opaque, const struct iovec *iov, int iovcnt);
 
 int slirp_add_hostfwd(Slirp *slirp, int is_udp,
                       struct in_addr host_addr, int host_port,
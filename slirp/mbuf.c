@@ -25,11 +25,68 @@
  */
 #define SLIRP_MSIZE (IF_MTU + IF_MAXLINKHDR + offsetof(struct mbuf, m_dat) + 6)
 
+/*
+ * External data comes in a second size class, big enough for a whole
+ * IP datagram plus the link header: a guest with TCP segmentation offload
+ * hands over such frames at full rate.  Up to M_EXTPOOL_MAX of them are
+ * kept around instead of going back to malloc.
+ */
+#define M_EXTPOOL_SIZE (IP_MAXPACKET + IF_MAXLINKHDR + 2)
+#define M_EXTPOOL_MAX 16
+
+static char *m_extpool_get(Slirp *slirp)
+{
+    char *ext = slirp->m_extpool;
+
+    if (ext) {
+        slirp->m_extpool = *(char **)ext;
+        slirp->m_extpool_count--;
+    } else {
+        ext = malloc(M_EXTPOOL_SIZE);
+    }
+    return ext;
+}
+
+static void m_extpool_put(Slirp *slirp, char *ext)
+{
+    if (slirp->m_extpool_count >= M_EXTPOOL_MAX) {
+        free(ext);
+        return;
+    }
+    *(char **)ext = slirp->m_extpool;
+    slirp->m_extpool = ext;
+    slirp->m_extpool_count++;
+}
+
+static void m_free_ext(struct mbuf *m)
+{
+    if (m->m_flags & M_EXTPOOL) {
+        m_extpool_put(m->slirp, m->m_ext);
+    } else {
+        free(m->m_ext);
+    }
+}
+
 void
 m_init(Slirp *slirp)
 {
+    struct mbuf *m;
+    int i;
+
     slirp->m_freelist.m_next = slirp->m_freelist.m_prev = &slirp->m_freelist;
     slirp->m_usedlist.m_next = slirp->m_usedlist.m_prev = &slirp->m_usedlist;
+
+    /* fill the free list up front, so that a burst finds it populated */
+    for (i = 0; i < MBUF_THRESH; i++) {
+        m = malloc(SLIRP_MSIZE);
+        if (!m) {
+            break;
+        }
+        m->slirp = slirp;
+        m->m_flags = M_FREELIST;
+        insque(m, &slirp->m_freelist);
+        slirp->mbuf_alloced++;
+    }
 }
 
 void m_cleanup(Slirp *slirp)
@@ -40,7 +97,7 @@ void m_cleanup(Slirp *slirp)
     while (m != &slirp->m_usedlist) {
         next = m->m_next;
         if (m->m_flags & M_EXT) {
-            free(m->m_ext);
+            m_free_ext(m);
         }
         free(m);
         m = next;
@@ -51,6 +108,13 @@ void m_cleanup(Slirp *slirp)
         free(m);
         m = next;
     }
+    while (slirp->m_extpool) {
+        char *ext = slirp->m_extpool;
+
+        slirp->m_extpool = *(char **)ext;
+        free(ext);
+    }
+    slirp->m_extpool_count = 0;
 }
 
 /*
@@ -110,9 +174,9 @@ m_free(struct mbuf *m)
 	if (m->m_flags & M_USEDLIST)
 	   remque(m);
 
-	/* If it's M_EXT, free() it */
+	/* If it's M_EXT, free() it or give it back to the pool */
 	if (m->m_flags & M_EXT)
-	   free(m->m_ext);
+	   m_free_ext(m);
 
 	/*
 	 * Either free() it or put it on the free list
@@ -153,18 +217,34 @@ void
 m_inc(struct mbuf *m, int size)
 {
 	int datasize;
+	char *dat;
 
 	/* some compiles throw up on gotos.  This one we can fake. */
         if(m->m_size>size) return;
 
-        if (m->m_flags & M_EXT) {
+        if (m->m_flags & M_EXTPOOL) {
+	  /* outgrew the pool buffer */
+	  datasize = m->m_data - m->m_ext;
+	  dat = (char *)malloc(size);
+	  memcpy(dat, m->m_ext, m->m_size);
+	  m_extpool_put(m->slirp, m->m_ext);
+
+	  m->m_ext = dat;
+	  m->m_data = m->m_ext + datasize;
+	  m->m_flags &= ~M_EXTPOOL;
+        } else if (m->m_flags & M_EXT) {
 	  datasize = m->m_data - m->m_ext;
 	  m->m_ext = (char *)realloc(m->m_ext,size);
 	  m->m_data = m->m_ext + datasize;
         } else {
-	  char *dat;
 	  datasize = m->m_data - m->m_dat;
-	  dat = (char *)malloc(size);
+	  if (size <= M_EXTPOOL_SIZE) {
+	    dat = m_extpool_get(m->slirp);
+	    m->m_flags |= M_EXTPOOL;
+	    size = M_EXTPOOL_SIZE;
+	  } else {
+	    dat = (char *)malloc(size);
+	  }
 	  memcpy(dat, m->m_dat, m->m_size);
 
 	  m->m_ext = dat;
@@ -114,6 +114,9 @@ struct mbuf {
 #define M_USEDLIST		0x04	/* XXX mbuf is on used list (for dtom()) */
 #define M_DOFREE		0x08	/* when m_free is called on the mbuf, free()
 					 * it rather than putting it on the free list */
+#define M_EXTPOOL		0x10	/* m_ext came from the pool of large buffers */
+#define M_CSUM_PARTIAL		0x20	/* the peer left the TCP/UDP checksum to
+					 * be filled in, it is not verified */
 
 void m_init(Slirp *);
 void m_cleanup(Slirp *slirp);
@@ -24,6 +24,7 @@
 #include "qemu-common.h"
 #include "qemu-timer.h"
 #include "qemu-char.h"
+#include "iov.h"
 #include "slirp.h"
 #include "hw/hw.h"
 
@@ -249,6 +250,7 @@ void slirp_cleanup(Slirp *slirp)
     ip_cleanup(slirp);
     m_cleanup(slirp);
 
+    g_free(slirp->polled);
     g_free(slirp->tftp_prefix);
     g_free(slirp->bootp_filename);
     g_free(slirp);
@@ -265,12 +267,29 @@ void slirp_update_timeout(uint32_t *timeout)
     }
 }
 
+/* Remember that 'so' is in the fd sets, for slirp_select_poll() */
+static void slirp_poll_add(Slirp *slirp, struct socket *so, int proto)
+{
+    struct slirp_pollfd *p;
+
+    if (slirp->polled_count == slirp->polled_size) {
+        slirp->polled_size = MAX(64, slirp->polled_size * 2);
+        slirp->polled = g_renew(struct slirp_pollfd, slirp->polled,
+                                slirp->polled_size);
+    }
+    so->so_poll_idx = slirp->polled_count;
+    p = &slirp->polled[slirp->polled_count++];
+    p->so = so;
+    p->fd = so->s;
+    p->proto = proto;
+}
+
 void slirp_select_fill(int *pnfds,
                        fd_set *readfds, fd_set *writefds, fd_set *xfds)
 {
     Slirp *slirp;
     struct socket *so, *so_next;
-    int nfds;
+    int nfds, polled;
 
     if (QTAILQ_EMPTY(&slirp_instances)) {
         return;
@@ -294,6 +313,7 @@ void slirp_select_fill(int *pnfds,
 		 */
 		do_slowtimo |= ((slirp->tcb.so_next != &slirp->tcb) ||
 		    (&slirp->ipq.ip_link != slirp->ipq.ip_link.next));
+		slirp->polled_count = 0;
 
 		for (so = slirp->tcb.so_next; so != &slirp->tcb;
 		     so = so_next) {
@@ -318,6 +338,7 @@ void slirp_select_fill(int *pnfds,
 			if (so->so_state & SS_FACCEPTCONN) {
                                 FD_SET(so->s, readfds);
 				UPD_NFDS(so->s);
+				slirp_poll_add(slirp, so, IPPROTO_TCP);
 				continue;
 			}
 
@@ -327,9 +348,12 @@ void slirp_select_fill(int *pnfds,
 			if (so->so_state & SS_ISFCONNECTING) {
 				FD_SET(so->s, writefds);
 				UPD_NFDS(so->s);
+				slirp_poll_add(slirp, so, IPPROTO_TCP);
 				continue;
 			}
 
+			polled = 0;
+
 			/*
 			 * Set for writing if we are connected, can send more, and
 			 * we have something to send
@@ -337,6 +361,7 @@ void slirp_select_fill(int *pnfds,
 			if (CONN_CANFSEND(so) && so->so_rcv.sb_cc) {
 				FD_SET(so->s, writefds);
 				UPD_NFDS(so->s);
+				polled = 1;
 			}
 
 			/*
@@ -347,6 +372,11 @@ void slirp_select_fill(int *pnfds,
 				FD_SET(so->s, readfds);
 				FD_SET(so->s, xfds);
 				UPD_NFDS(so->s);
+				polled = 1;
+			}
+
+			if (polled) {
+				slirp_poll_add(slirp, so, IPPROTO_TCP);
 			}
 		}
 
@@ -381,6 +411,7 @@ void slirp_select_fill(int *pnfds,
 			if ((so->so_state & SS_ISFCONNECTED) && so->so_queued <= 4) {
 				FD_SET(so->s, readfds);
 				UPD_NFDS(so->s);
+				slirp_poll_add(slirp, so, IPPROTO_UDP);
 			}
 		}
 
@@ -406,6 +437,7 @@ void slirp_select_fill(int *pnfds,
                     if (so->so_state & SS_ISFCONNECTED) {
                         FD_SET(so->s, readfds);
                         UPD_NFDS(so->s);
+                        slirp_poll_add(slirp, so, IPPROTO_ICMP);
                     }
                 }
 	}
@@ -413,12 +445,126 @@ void slirp_select_fill(int *pnfds,
         *pnfds = nfds;
 }
 
+static void slirp_poll_tcp(struct socket *so, fd_set *readfds,
+                           fd_set *writefds, fd_set *xfds)
+{
+	int ret;
+
+	/*
+	 * FD_ISSET is meaningless on these sockets
+	 * (and they can crash the program)
+	 */
+	if (so->so_state & SS_NOFDREF || so->s == -1)
+	   return;
+
+	/*
+	 * Check for URG data
+	 * This will soread as well, so no need to
+	 * test for readfds below if this succeeds
+	 */
+	if (FD_ISSET(so->s, xfds))
+	   sorecvoob(so);
+	/*
+	 * Check sockets for reading
+	 */
+	else if (FD_ISSET(so->s, readfds)) {
+		/*
+		 * Check for incoming connections
+		 */
+		if (so->so_state & SS_FACCEPTCONN) {
+			tcp_connect(so);
+			return;
+		} /* else */
+		ret = soread(so);
+
+		/* Output it if we read something */
+		if (ret > 0)
+		   tcp_output(sototcpcb(so));
+	}
+
+	/*
+	 * Check sockets for writing
+	 */
+	if (FD_ISSET(so->s, writefds)) {
+	  /*
+	   * Check for non-blocking, still-connecting sockets
+	   */
+	  if (so->so_state & SS_ISFCONNECTING) {
+	    /* Connected */
+	    so->so_state &= ~SS_ISFCONNECTING;
+
+	    ret = send(so->s, (const void *) &ret, 0, 0);
+	    if (ret < 0) {
+	      /* XXXXX Must fix, zero bytes is a NOP */
+	      if (errno == EAGAIN || errno == EWOULDBLOCK ||
+		  errno == EINPROGRESS || errno == ENOTCONN)
+		return;
+
+	      /* else failed */
+	      so->so_state &= SS_PERSISTENT_MASK;
+	      so->so_state |= SS_NOFDREF;
+	    }
+	    /* else so->so_state &= ~SS_ISFCONNECTING; */
+
+	    /*
+	     * Continue tcp_input
+	     */
+	    tcp_input((struct mbuf *)NULL, sizeof(struct ip), so);
+	    /* continue; */
+	  } else
+	    ret = sowrite(so);
+	  /*
+	   * XXXXX If we wrote something (a lot), there
+	   * could be a need for a window update.
+	   * In the worst case, the remote will send
+	   * a window probe to get things going again
+	   */
+	}
+
+	/*
+	 * Probe a still-connecting, non-blocking socket
+	 * to check if it's still alive
+	 */
+#ifdef PROBE_CONN
+	if (so->so_state & SS_ISFCONNECTING) {
+                          ret = qemu_recv(so->s, &ret, 0,0);
+
+	  if (ret < 0) {
+	    /* XXX */
+	    if (errno == EAGAIN || errno == EWOULDBLOCK ||
+		errno == EINPROGRESS || errno == ENOTCONN)
+	      return; /* Still connecting */
+
+	    /* else failed */
+	    so->so_state &= SS_PERSISTENT_MASK;
+	    so->so_state |= SS_NOFDREF;
+
+	    /* tcp_input will take care of it */
+	  } else {
+	    ret = send(so->s, &ret, 0,0);
+	    if (ret < 0) {
+	      /* XXX */
+	      if (errno == EAGAIN || errno == EWOULDBLOCK ||
+		  errno == EINPROGRESS || errno == ENOTCONN)
+		return;
+	      /* else failed */
+	      so->so_state &= SS_PERSISTENT_MASK;
+	      so->so_state |= SS_NOFDREF;
+	    } else
+	      so->so_state &= ~SS_ISFCONNECTING;
+
+	  }
+	  tcp_input((struct mbuf *)NULL, sizeof(struct ip),so);
+	} /* SS_ISFCONNECTING */
+#endif
+}
+
 void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds,
                        int select_error)
 {
     Slirp *slirp;
-    struct socket *so, *so_next;
-    int ret;
+    struct socket *so;
+    int i;
 
     if (QTAILQ_EMPTY(&slirp_instances)) {
         return;
@@ -449,146 +595,43 @@ void slirp_select_poll(fd_set *readfds, fd_set *writefds, fd_set *xfds,
 	 */
 	if (!select_error) {
 		/*
-		 * Check TCP sockets
+		 * Check the sockets that slirp_select_fill() set; only
+		 * those that are ready are looked at.  Sockets freed
+		 * meanwhile have a NULL entry.
 		 */
-		for (so = slirp->tcb.so_next; so != &slirp->tcb;
-		     so = so_next) {
-			so_next = so->so_next;
+		for (i = 0; i < slirp->polled_count; i++) {
+			struct slirp_pollfd *p = &slirp->polled[i];
 
-			/*
-			 * FD_ISSET is meaningless on these sockets
-			 * (and they can crash the program)
-			 */
-			if (so->so_state & SS_NOFDREF || so->s == -1)
-			   continue;
-
-			/*
-			 * Check for URG data
-			 * This will soread as well, so no need to
-			 * test for readfds below if this succeeds
-			 */
-			if (FD_ISSET(so->s, xfds))
-			   sorecvoob(so);
-			/*
-			 * Check sockets for reading
-			 */
-			else if (FD_ISSET(so->s, readfds)) {
-				/*
-				 * Check for incoming connections
-				 */
-				if (so->so_state & SS_FACCEPTCONN) {
-					tcp_connect(so);
-					continue;
-				} /* else */
-				ret = soread(so);
-
-				/* Output it if we read something */
-				if (ret > 0)
-				   tcp_output(sototcpcb(so));
+			if (!FD_ISSET(p->fd, readfds) &&
+			    !FD_ISSET(p->fd, writefds) &&
+			    !FD_ISSET(p->fd, xfds)) {
+				continue;
 			}
-
-			/*
-			 * Check sockets for writing
-			 */
-			if (FD_ISSET(so->s, writefds)) {
-			  /*
-			   * Check for non-blocking, still-connecting sockets
-			   */
-			  if (so->so_state & SS_ISFCONNECTING) {
-			    /* Connected */
-			    so->so_state &= ~SS_ISFCONNECTING;
-
-			    ret = send(so->s, (const void *) &ret, 0, 0);
-			    if (ret < 0) {
-			      /* XXXXX Must fix, zero bytes is a NOP */
-			      if (errno == EAGAIN || errno == EWOULDBLOCK ||
-				  errno == EINPROGRESS || errno == ENOTCONN)
+			so = p->so;
+			if (!so || so->s != p->fd) {
 				continue;
-
-			      /* else failed */
-			      so->so_state &= SS_PERSISTENT_MASK;
-			      so->so_state |= SS_NOFDREF;
-			    }
-			    /* else so->so_state &= ~SS_ISFCONNECTING; */
-
-			    /*
-			     * Continue tcp_input
-			     */
-			    tcp_input((struct mbuf *)NULL, sizeof(struct ip), so);
-			    /* continue; */
-			  } else
-			    ret = sowrite(so);
-			  /*
-			   * XXXXX If we wrote something (a lot), there
-			   * could be a need for a window update.
-			   * In the worst case, the remote will send
-			   * a window probe to get things going again
-			   */
 			}
 
+			switch (p->proto) {
+			case IPPROTO_TCP:
+				slirp_poll_tcp(so, readfds, writefds, xfds);
+				break;
 			/*
-			 * Probe a still-connecting, non-blocking socket
-			 * to check if it's still alive
-	 	 	 */
-#ifdef PROBE_CONN
-			if (so->so_state & SS_ISFCONNECTING) {
-                          ret = qemu_recv(so->s, &ret, 0,0);
-
-			  if (ret < 0) {
-			    /* XXX */
-			    if (errno == EAGAIN || errno == EWOULDBLOCK ||
-				errno == EINPROGRESS || errno == ENOTCONN)
-			      continue; /* Still connecting, continue */
-
-			    /* else failed */
-			    so->so_state &= SS_PERSISTENT_MASK;
-			    so->so_state |= SS_NOFDREF;
-
-			    /* tcp_input will take care of it */
-			  } else {
-			    ret = send(so->s, &ret, 0,0);
-			    if (ret < 0) {
-			      /* XXX */
-			      if (errno == EAGAIN || errno == EWOULDBLOCK ||
-				  errno == EINPROGRESS || errno == ENOTCONN)
-				continue;
-			      /* else failed */
-			      so->so_state &= SS_PERSISTENT_MASK;
-			      so->so_state |= SS_NOFDREF;
-			    } else
-			      so->so_state &= ~SS_ISFCONNECTING;
-
-			  }
-			  tcp_input((struct mbuf *)NULL, sizeof(struct ip),so);
-			} /* SS_ISFCONNECTING */
-#endif
-		}
-
-		/*
-		 * Now UDP sockets.
-		 * Incoming packets are sent straight away, they're not buffered.
-		 * Incoming UDP data isn't buffered either.
-		 */
-		for (so = slirp->udb.so_next; so != &slirp->udb;
-		     so = so_next) {
-			so_next = so->so_next;
-
-			if (so->s != -1 && FD_ISSET(so->s, readfds)) {
-                            sorecvfrom(so);
-                        }
+			 * Incoming UDP packets are sent straight away, they're
+			 * not buffered.  Incoming UDP data isn't buffered either.
+			 */
+			case IPPROTO_UDP:
+				if (FD_ISSET(so->s, readfds)) {
+					sorecvfrom(so);
+				}
+				break;
+			case IPPROTO_ICMP:
+				if (FD_ISSET(so->s, readfds)) {
+					icmp_receive(so);
+				}
+				break;
+			}
 		}
-
-                /*
-                 * Check incoming ICMP relies.
-                 */
-                for (so = slirp->icmp.so_next; so != &slirp->icmp;
-                     so = so_next) {
-                     so_next = so->so_next;
-
-                    if (so->s != -1 && FD_ISSET(so->s, readfds)) {
-                        icmp_receive(so);
-                    }
-                }
 	}
 
         if_start(slirp);
@@ -663,18 +706,25 @@ static void arp_input(Slirp *slirp, const uint8_t *pkt, int pkt_len)
     }
 }
 
-void slirp_input(Slirp *slirp, const uint8_t *pkt, int pkt_len)
+void slirp_input_iov(Slirp *slirp, const struct iovec *iov, int iovcnt,
+                     size_t offset, int flags)
 {
+    uint8_t arp_pkt[ETH_HLEN + sizeof(struct arphdr)];
+    uint16_t proto;
     struct mbuf *m;
-    int proto;
+    size_t pkt_len;
 
-    if (pkt_len < ETH_HLEN)
+    pkt_len = iov_size(iov, iovcnt);
+    if (pkt_len < offset + ETH_HLEN)
         return;
+    pkt_len -= offset;
 
-    proto = ntohs(*(uint16_t *)(pkt + 12));
-    switch(proto) {
+    iov_to_buf(iov, iovcnt, offset + 12, &proto, sizeof(proto));
+    switch(ntohs(proto)) {
     case ETH_P_ARP:
-        arp_input(slirp, pkt, pkt_len);
+        memset(arp_pkt, 0, sizeof(arp_pkt));
+        iov_to_buf(iov, iovcnt, offset, arp_pkt, sizeof(arp_pkt));
+        arp_input(slirp, arp_pkt, MIN(pkt_len, sizeof(arp_pkt)));
         break;
     case ETH_P_IP:
         m = m_get(slirp);
@@ -685,7 +735,10 @@ void slirp_input(Slirp *slirp, const uint8_t *pkt, int pkt_len)
             m_inc(m, pkt_len + 2);
         }
         m->m_len = pkt_len + 2;
-        memcpy(m->m_data + 2, pkt, pkt_len);
+        iov_to_buf(iov, iovcnt, offset, m->m_data + 2, pkt_len);
+        if (flags & SLIRP_INPUT_CSUM_PARTIAL) {
+            m->m_flags |= M_CSUM_PARTIAL;
+        }
 
         m->m_data += 2 + ETH_HLEN;
         m->m_len -= 2 + ETH_HLEN;
@@ -697,20 +750,26 @@ void slirp_input(Slirp *slirp, const uint8_t *pkt, int pkt_len)
     }
 }
 
+void slirp_input(Slirp *slirp, const uint8_t *pkt, int pkt_len)
+{
+    struct iovec iov = {
+        .iov_base = (uint8_t *)pkt,
+        .iov_len = pkt_len,
+    };
+
+    slirp_input_iov(slirp, &iov, 1, 0, 0);
+}
+
 /* Output the IP packet to the ethernet device. Returns 0 if the packet must be
  * re-queued.
  */
 int if_encap(Slirp *slirp, struct mbuf *ifm)
 {
-    uint8_t buf[1600];
-    struct ethhdr *eh = (struct ethhdr *)buf;
+    struct ethhdr eh;
+    struct iovec iov[2];
     uint8_t ethaddr[ETH_ALEN];
     const struct ip *iph = (const struct ip *)ifm->m_data;
 
-    if (ifm->m_len + ETH_HLEN > sizeof(buf)) {
-        return 1;
-    }
-
     if (!arp_table_search(slirp, iph->ip_dst.s_addr, ethaddr)) {
         uint8_t arp_req[ETH_HLEN + sizeof(struct arphdr)];
         struct ethhdr *reh = (struct ethhdr *)arp_req;
@@ -749,13 +808,18 @@ int if_encap(Slirp *slirp, struct mbuf *ifm)
         }
         return 0;
     } else {
-        memcpy(eh->h_dest, ethaddr, ETH_ALEN);
-        memcpy(eh->h_source, special_ethaddr, ETH_ALEN - 4);
+        memcpy(eh.h_dest, ethaddr, ETH_ALEN);
+        memcpy(eh.h_source, special_ethaddr, ETH_ALEN - 4);
         /* XXX: not correct */
-        memcpy(&eh->h_source[2], &slirp->vhost_addr, 4);
-        eh->h_proto = htons(ETH_P_IP);
-        memcpy(buf + sizeof(struct ethhdr), ifm->m_data, ifm->m_len);
-        slirp_output(slirp->opaque, buf, ifm->m_len + ETH_HLEN);
+        memcpy(&eh.h_source[2], &slirp->vhost_addr, 4);
+        eh.h_proto = htons(ETH_P_IP);
+
+        /* the datagram goes out straight from the mbuf */
+        iov[0].iov_base = &eh;
+        iov[0].iov_len = ETH_HLEN;
+        iov[1].iov_base = ifm->m_data;
+        iov[1].iov_len = ifm->m_len;
+        slirp_output_iov(slirp->opaque, iov, 2);
         return 1;
     }
 }
@@ -1075,6 +1139,7 @@ static int slirp_socket_load(QEMUFile *f, struct socket *so)
     if (slirp_sbuf_load(f, &so->so_snd) < 0)
         return -ENOMEM;
     slirp_tcp_load(f, so->so_tcpcb);
+    sohash_insert(&so->slirp->tcp_hash, so);
 
     return 0;
 }
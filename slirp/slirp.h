@@ -201,6 +201,13 @@ void arp_table_add(Slirp *slirp, uint32_t ip_addr, uint8_t ethaddr[ETH_ALEN]);
 bool arp_table_search(Slirp *slirp, uint32_t ip_addr,
                       uint8_t out_ethaddr[ETH_ALEN]);
 
+/* A socket that slirp_select_fill() put in the fd sets */
+struct slirp_pollfd {
+    struct socket *so;      /* NULL once the socket is freed */
+    int fd;
+    uint8_t proto;          /* IPPROTO_TCP, IPPROTO_UDP or IPPROTO_ICMP */
+};
+
 struct Slirp {
     QTAILQ_ENTRY(Slirp) entry;
 
@@ -221,6 +228,8 @@ struct Slirp {
     /* mbuf states */
     struct mbuf m_freelist, m_usedlist;
     int mbuf_alloced;
+    char *m_extpool;        /* free M_EXTPOOL buffers, linked through */
+    int m_extpool_count;    /* their first bytes */
 
     /* if states */
     struct mbuf if_fastq;   /* fast queue (for interactive data) */
@@ -239,17 +248,24 @@ struct Slirp {
     /* tcp states */
     struct socket tcb;
     struct socket *tcp_last_so;
+    struct sohash tcp_hash;
     tcp_seq tcp_iss;        /* tcp initial send seq # */
     uint32_t tcp_now;       /* for RFC 1323 timestamps */
 
     /* udp states */
     struct socket udb;
     struct socket *udp_last_so;
+    struct sohash udp_hash;
 
     /* icmp states */
     struct socket icmp;
     struct socket *icmp_last_so;
 
+    /* sockets to check in slirp_select_poll() */
+    struct slirp_pollfd *polled;
+    int polled_count;
+    int polled_size;
+
     /* tftp states */
     char *tftp_prefix;
     struct tftp_session tftp_sessions[TFTP_SESSIONS_MAX];
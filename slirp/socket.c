@@ -15,24 +15,120 @@
 static void sofcantrcvmore(struct socket *so);
 static void sofcantsendmore(struct socket *so);
 
-struct socket *
-solookup(struct socket *head, struct in_addr laddr, u_int lport,
-         struct in_addr faddr, u_int fport)
+#define SOHASH_MIN_SIZE 64
+
+static uint32_t
+sohash_val(struct sohash *h, struct in_addr laddr, u_int lport,
+           struct in_addr faddr, u_int fport)
 {
-	struct socket *so;
+    uint32_t v = laddr.s_addr ^ lport;
+
+    if (h->foreign) {
+        v = (v * 0x9e3779b1) ^ faddr.s_addr ^ (fport << 16);
+    }
+    v ^= v >> 16;
+    v *= 0x85ebca6b;
+    v ^= v >> 13;
+    return v;
+}
 
-	for (so = head->so_next; so != head; so = so->so_next) {
-		if (so->so_lport == lport &&
-		    so->so_laddr.s_addr == laddr.s_addr &&
-		    so->so_faddr.s_addr == faddr.s_addr &&
-		    so->so_fport == fport)
-		   break;
-	}
+void
+sohash_init(struct sohash *h, bool foreign)
+{
+    h->size = SOHASH_MIN_SIZE;
+    h->count = 0;
+    h->foreign = foreign;
+    h->buckets = g_new0(struct socket *, h->size);
+}
 
-	if (so == head)
-	   return (struct socket *)NULL;
-	return so;
+void
+sohash_cleanup(struct sohash *h)
+{
+    g_free(h->buckets);
+    h->buckets = NULL;
+}
+
+/* Double the number of buckets once there are two sockets per bucket */
+static void
+sohash_grow(struct sohash *h)
+{
+    uint32_t size = h->size * 2;
+    struct socket **buckets = g_new0(struct socket *, size);
+    struct socket *so, *next;
+    uint32_t i;
+
+    for (i = 0; i < h->size; i++) {
+        for (so = h->buckets[i]; so; so = next) {
+            next = so->so_hash_next;
+            so->so_hash_next = buckets[so->so_hash_val & (size - 1)];
+            buckets[so->so_hash_val & (size - 1)] = so;
+        }
+    }
+    g_free(h->buckets);
+    h->buckets = buckets;
+    h->size = size;
+}
 
+void
+sohash_insert(struct sohash *h, struct socket *so)
+{
+    struct socket **b;
+
+    sohash_remove(so);
+    if (h->count >= h->size * 2) {
+        sohash_grow(h);
+    }
+    so->so_hash_val = sohash_val(h, so->so_laddr, so->so_lport,
+                                 so->so_faddr, so->so_fport);
+    b = &h->buckets[so->so_hash_val & (h->size - 1)];
+    so->so_hash_next = *b;
+    *b = so;
+    so->so_hash = h;
+    h->count++;
+}
+
+void
+sohash_remove(struct socket *so)
+{
+    struct sohash *h = so->so_hash;
+    struct socket **p;
+
+    if (!h) {
+        return;
+    }
+    for (p = &h->buckets[so->so_hash_val & (h->size - 1)]; *p;
+         p = &(*p)->so_hash_next) {
+        if (*p == so) {
+            *p = so->so_hash_next;
+            break;
+        }
+    }
+    so->so_hash = NULL;
+    so->so_hash_next = NULL;
+    h->count--;
+}
+
+/*
+ * Find the socket with the given address; the foreign end is ignored
+ * if the table does not hash it.
+ */
+struct socket *
+solookup(struct sohash *h, struct in_addr laddr, u_int lport,
+         struct in_addr faddr, u_int fport)
+{
+    uint32_t v = sohash_val(h, laddr, lport, faddr, fport);
+    struct socket *so;
+
+    for (so = h->buckets[v & (h->size - 1)]; so; so = so->so_hash_next) {
+        if (so->so_hash_val == v &&
+            so->so_lport == lport &&
+            so->so_laddr.s_addr == laddr.s_addr &&
+            (!h->foreign || (so->so_faddr.s_addr == faddr.s_addr &&
+                             so->so_fport == fport))) {
+            return so;
+        }
+    }
+    return NULL;
 }
 
 /*
@@ -74,6 +170,12 @@ sofree(struct socket *so)
   } else if (so == slirp->icmp_last_so) {
       slirp->icmp_last_so = &slirp->icmp;
   }
+  if (so->so_poll_idx < slirp->polled_count &&
+      slirp->polled[so->so_poll_idx].so == so) {
+      /* Don't let slirp_select_poll() look at it */
+      slirp->polled[so->so_poll_idx].so = NULL;
+  }
+  sohash_remove(so);
   m_free(so->so_m);
 
   if(so->so_next && so->so_prev)
@@ -649,6 +751,7 @@ tcp_listen(Slirp *slirp, uint32_t haddr, u_int hport, uint32_t laddr,
 	   so->so_faddr = slirp->vhost_addr;
 	else
 	   so->so_faddr = addr.sin_addr;
+	sohash_insert(&slirp->tcp_hash, so);
 
 	so->s = s;
 	return so;
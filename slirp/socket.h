@@ -51,6 +51,25 @@ struct socket {
   struct sbuf so_rcv;		/* Receive buffer */
   struct sbuf so_snd;		/* Send buffer */
   void * extra;			/* Extra pointer */
+
+  struct socket *so_hash_next;	/* Next socket in the same hash bucket */
+  struct sohash *so_hash;	/* Hash table holding the socket, or NULL */
+  uint32_t so_hash_val;		/* Hash of the address when inserted */
+  int so_poll_idx;		/* Slot in slirp->polled, see slirp_select_fill */
+};
+
+/*
+ * Hash table of sockets, for lookups by address in O(1) however many
+ * connections the guest has open.  TCP sockets are hashed by both ends of
+ * the connection; UDP sockets only by the local (guest) address and port,
+ * since their foreign end changes with every datagram.  The address must
+ * be complete before the socket is inserted.
+ */
+struct sohash {
+  struct socket **buckets;
+  uint32_t size;		/* Number of buckets, a power of two */
+  uint32_t count;		/* Number of sockets */
+  bool foreign;			/* Key includes the foreign address and port */
 };
 
 
@@ -74,7 +93,11 @@ struct socket {
 #define SS_HOSTFWD		0x1000	/* Socket describes host->guest forwarding */
 #define SS_INCOMING		0x2000	/* Connection was initiated by a host on the internet */
 
-struct socket * solookup(struct socket *, struct in_addr, u_int, struct in_addr, u_int);
+void sohash_init(struct sohash *, bool);
+void sohash_cleanup(struct sohash *);
+void sohash_insert(struct sohash *, struct socket *);
+void sohash_remove(struct socket *);
+struct socket * solookup(struct sohash *, struct in_addr, u_int, struct in_addr, u_int);
 struct socket * socreate(Slirp *);
 void sofree(struct socket *);
 int soread(struct socket *);
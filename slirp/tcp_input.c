@@ -282,7 +282,7 @@ tcp_input(struct mbuf *m, int iphlen, struct socket *inso)
 	ti->ti_x1 = 0;
 	ti->ti_len = htons((uint16_t)tlen);
 	len = sizeof(struct ip ) + tlen;
-	if(cksum(m, len)) {
+	if (!(m->m_flags & M_CSUM_PARTIAL) && cksum(m, len)) {
 	  goto drop;
 	}
 
@@ -335,7 +335,7 @@ findso:
 	    so->so_lport != ti->ti_sport ||
 	    so->so_laddr.s_addr != ti->ti_src.s_addr ||
 	    so->so_faddr.s_addr != ti->ti_dst.s_addr) {
-		so = solookup(&slirp->tcb, ti->ti_src, ti->ti_sport,
+		so = solookup(&slirp->tcp_hash, ti->ti_src, ti->ti_sport,
 			       ti->ti_dst, ti->ti_dport);
 		if (so)
 			slirp->tcp_last_so = so;
@@ -372,6 +372,7 @@ findso:
 	  so->so_lport = ti->ti_sport;
 	  so->so_faddr = ti->ti_dst;
 	  so->so_fport = ti->ti_dport;
+	  sohash_insert(&slirp->tcp_hash, so);
 
 	  if ((so->so_iptos = tcp_tos(so)) == 0)
 	    so->so_iptos = ((struct ip *)ti)->ip_tos;
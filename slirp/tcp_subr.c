@@ -53,6 +53,7 @@ tcp_init(Slirp *slirp)
     slirp->tcp_iss = 1;		/* wrong */
     slirp->tcb.so_next = slirp->tcb.so_prev = &slirp->tcb;
     slirp->tcp_last_so = &slirp->tcb;
+    sohash_init(&slirp->tcp_hash, true);
 }
 
 void tcp_cleanup(Slirp *slirp)
@@ -60,6 +61,7 @@ void tcp_cleanup(Slirp *slirp)
     while (slirp->tcb.so_next != &slirp->tcb) {
         tcp_close(sototcpcb(slirp->tcb.so_next));
     }
+    sohash_cleanup(&slirp->tcp_hash);
 }
 
 /*
@@ -437,6 +439,7 @@ tcp_connect(struct socket *inso)
 	/* Translate connections from localhost to the real hostname */
 	if (so->so_faddr.s_addr == 0 || so->so_faddr.s_addr == loopback_addr.s_addr)
 	   so->so_faddr = slirp->vhost_addr;
+	sohash_insert(&slirp->tcp_hash, so);
 
 	/* Close the accept() socket, set right state */
 	if (inso->so_state & SS_FACCEPTONCE) {
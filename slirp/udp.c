@@ -48,6 +48,7 @@ udp_init(Slirp *slirp)
 {
     slirp->udb.so_next = slirp->udb.so_prev = &slirp->udb;
     slirp->udp_last_so = &slirp->udb;
+    sohash_init(&slirp->udp_hash, false);
 }
 
 void udp_cleanup(Slirp *slirp)
@@ -55,6 +56,7 @@ void udp_cleanup(Slirp *slirp)
     while (slirp->udb.so_next != &slirp->udb) {
         udp_detach(slirp->udb.so_next);
     }
+    sohash_cleanup(&slirp->udp_hash);
 }
 
 /* m->m_data  points at ip packet header
@@ -116,7 +118,7 @@ udp_input(register struct mbuf *m, int iphlen)
 	/*
 	 * Checksum extended UDP header and data.
 	 */
-	if (uh->uh_sum) {
+	if (uh->uh_sum && !(m->m_flags & M_CSUM_PARTIAL)) {
       memset(&((struct ipovly *)ip)->ih_mbuf, 0, sizeof(struct mbuf_ptr));
 	  ((struct ipovly *)ip)->ih_x1 = 0;
 	  ((struct ipovly *)ip)->ih_len = uh->uh_ulen;
@@ -154,21 +156,10 @@ udp_input(register struct mbuf *m, int iphlen)
 	so = slirp->udp_last_so;
 	if (so->so_lport != uh->uh_sport ||
 	    so->so_laddr.s_addr != ip->ip_src.s_addr) {
-		struct socket *tmp;
-
-		for (tmp = slirp->udb.so_next; tmp != &slirp->udb;
-		     tmp = tmp->so_next) {
-			if (tmp->so_lport == uh->uh_sport &&
-			    tmp->so_laddr.s_addr == ip->ip_src.s_addr) {
-				so = tmp;
-				break;
-			}
-		}
-		if (tmp == &slirp->udb) {
-		  so = NULL;
-		} else {
-		  slirp->udp_last_so = so;
-		}
+		so = solookup(&slirp->udp_hash, ip->ip_src, uh->uh_sport,
+			      ip->ip_dst, uh->uh_dport);
+		if (so)
+			slirp->udp_last_so = so;
 	}
 
 	if (so == NULL) {
@@ -192,6 +183,7 @@ udp_input(register struct mbuf *m, int iphlen)
 	   */
 	  so->so_laddr = ip->ip_src;
 	  so->so_lport = uh->uh_sport;
+	  sohash_insert(&slirp->udp_hash, so);
 
 	  if ((so->so_iptos = udp_tos(so)) == 0)
 	    so->so_iptos = ip->ip_tos;
@@ -385,6 +377,7 @@ udp_listen(Slirp *slirp, uint32_t haddr, u_int hport, uint32_t laddr,
 	}
 	so->so_lport = lport;
 	so->so_laddr.s_addr = laddr;
+	sohash_insert(&slirp->udp_hash, so);
 	if (flags != SS_FACCEPTONCE)
 	   so->so_expire = 0;
 
@@ -84,6 +84,9 @@ int qemu_savevm_state_complete(QEMUFile *f);
 void qemu_savevm_state_cancel(QEMUFile *f);
 int qemu_loadvm_state(QEMUFile *f);
 
+/* dump.c */
+bool dump_in_progress(void);
+
 /* SLIRP */
 void do_info_slirp(Monitor *mon);
 
@@ -137,6 +140,8 @@ extern QEMUClock *rtc_clock;
 extern int nb_numa_nodes;
 extern uint64_t node_mem[MAX_NODES];
 extern uint64_t node_cpumask[MAX_NODES];
+extern uint64_t node_host_nodes[MAX_NODES];
+extern NumaHostPolicy node_host_policy[MAX_NODES];
 
 #define MAX_OPTION_ROMS 16
 typedef struct QEMUOptionRom {
@@ -6252,6 +6252,7 @@ static int disas_coproc_insn(CPUARMState * env, DisasContext *s, uint32_t insn)
                     TCGv_ptr tmpptr;
                     gen_set_pc_im(s->pc);
                     tmp64 = tcg_temp_new_i64();
+                    tb_cache_mark_uncacheable();
                     tmpptr = tcg_const_ptr(ri);
                     gen_helper_get_cp_reg64(tmp64, cpu_env, tmpptr);
                     tcg_temp_free_ptr(tmpptr);
@@ -6275,6 +6276,7 @@ static int disas_coproc_insn(CPUARMState * env, DisasContext *s, uint32_t insn)
                     TCGv_ptr tmpptr;
                     gen_set_pc_im(s->pc);
                     tmp = tcg_temp_new_i32();
+                    tb_cache_mark_uncacheable();
                     tmpptr = tcg_const_ptr(ri);
                     gen_helper_get_cp_reg(tmp, cpu_env, tmpptr);
                     tcg_temp_free_ptr(tmpptr);
@@ -6307,7 +6309,9 @@ static int disas_coproc_insn(CPUARMState * env, DisasContext *s, uint32_t insn)
                 tcg_temp_free_i32(tmplo);
                 tcg_temp_free_i32(tmphi);
                 if (ri->writefn) {
-                    TCGv_ptr tmpptr = tcg_const_ptr(ri);
+                    TCGv_ptr tmpptr;
+                    tb_cache_mark_uncacheable();
+                    tmpptr = tcg_const_ptr(ri);
                     gen_set_pc_im(s->pc);
                     gen_helper_set_cp_reg64(cpu_env, tmpptr, tmp64);
                     tcg_temp_free_ptr(tmpptr);
@@ -6321,6 +6325,7 @@ static int disas_coproc_insn(CPUARMState * env, DisasContext *s, uint32_t insn)
                     TCGv_ptr tmpptr;
                     gen_set_pc_im(s->pc);
                     tmp = load_reg(s, rt);
+                    tb_cache_mark_uncacheable();
                     tmpptr = tcg_const_ptr(ri);
                     gen_helper_set_cp_reg(cpu_env, tmpptr, tmp);
                     tcg_temp_free_ptr(tmpptr);
@@ -9725,7 +9730,7 @@ static inline void gen_intermediate_code_internal(CPUARMState *env,
     if (max_insns == 0)
         max_insns = CF_COUNT_MASK;
 
-    gen_icount_start();
+    gen_tb_start(tb);
 
     tcg_clear_temp_count();
 
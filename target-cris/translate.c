@@ -3257,7 +3257,7 @@ gen_intermediate_code_internal(CPUCRISState *env, TranslationBlock *tb,
         if (max_insns == 0)
             max_insns = CF_COUNT_MASK;
 
-        gen_icount_start();
+        gen_tb_start(tb);
 	do
 	{
 		check_breakpoint(env, dc);
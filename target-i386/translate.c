@@ -2736,6 +2736,21 @@ static void gen_jmp(DisasContext *s, target_ulong eip)
     gen_jmp_tb(s, eip, 0);
 }
 
+/* Hot TBs are translated as superblocks: translation continues at the
+   target of forward direct jumps as long as the TB still covers at most
+   two consecutive pages.  Returns true if the jump was followed.  */
+static int gen_jmp_follow(DisasContext *s, target_ulong eip)
+{
+    target_ulong pc = eip + s->cs_base;
+
+    if (!(s->tb->cflags & CF_TIER_HOT) || !s->jmp_opt ||
+        pc <= s->pc || pc - s->tb->pc >= TARGET_PAGE_SIZE - 32) {
+        return 0;
+    }
+    s->pc = pc;
+    return 1;
+}
+
 static inline void gen_ldq_env_A0(int idx, int offset)
 {
     int mem_index = (idx >> 2) - 1;
@@ -6349,7 +6364,9 @@ static target_ulong disas_insn(DisasContext *s, target_ulong pc_start)
             tval &= 0xffff;
         else if(!CODE64(s))
             tval &= 0xffffffff;
-        gen_jmp(s, tval);
+        if (!gen_jmp_follow(s, tval)) {
+            gen_jmp(s, tval);
+        }
         break;
     case 0xea: /* ljmp im */
         {
@@ -6370,7 +6387,9 @@ static target_ulong disas_insn(DisasContext *s, target_ulong pc_start)
         tval += s->pc - s->cs_base;
         if (s->dflag == 0)
             tval &= 0xffff;
-        gen_jmp(s, tval);
+        if (!gen_jmp_follow(s, tval)) {
+            gen_jmp(s, tval);
+        }
         break;
     case 0x70 ... 0x7f: /* jcc Jb */
         tval = (int8_t)insn_get(s, OT_BYTE);
@@ -7863,7 +7882,7 @@ static inline void gen_intermediate_code_internal(CPUX86State *env,
     if (max_insns == 0)
         max_insns = CF_COUNT_MASK;
 
-    gen_icount_start();
+    gen_tb_start(tb);
     for(;;) {
         if (unlikely(!QTAILQ_EMPTY(&env->breakpoints))) {
             QTAILQ_FOREACH(bp, &env->breakpoints, entry) {
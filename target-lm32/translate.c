@@ -1044,7 +1044,7 @@ static void gen_intermediate_code_internal(CPULM32State *env,
         max_insns = CF_COUNT_MASK;
     }
 
-    gen_icount_start();
+    gen_tb_start(tb);
     do {
         check_breakpoint(env, dc);
 
@@ -389,6 +389,9 @@ static inline void tcg_gen_helperN(void *func, int flags, int sizemask,
                                    TCGArg ret, int nargs, TCGArg *args)
 {
     TCGv_ptr fn;
+    if (unlikely(tcg_ctx.helper_profile)) {
+        tcg_gen_count_helper(func);
+    }
     fn = tcg_const_ptr(func);
     tcg_gen_callN(&tcg_ctx, fn, flags, sizemask, ret,
                   nargs, args);
@@ -859,6 +859,56 @@ static TCGHelperInfo *tcg_find_helper(TCGContext *s, tcg_target_ulong val)
     return NULL;
 }
 
+/* Start or stop counting helper calls in the code generated from now on.
+   The counters are never freed, because code generated earlier may still
+   refer to them.  */
+void tcg_profile_helpers(TCGContext *s, int enable)
+{
+    if (enable) {
+        /* Sort now so that helper indexes do not change any more.  */
+        tcg_find_helper(s, 0);
+        if (!s->helper_counts) {
+            s->helper_counts = g_malloc0(s->nb_helpers * sizeof(uint64_t));
+        } else {
+            memset(s->helper_counts, 0, s->nb_helpers * sizeof(uint64_t));
+        }
+    }
+    s->helper_profile = enable;
+}
+
+void tcg_gen_count_helper(void *func)
+{
+    TCGContext *s = &tcg_ctx;
+    TCGHelperInfo *th;
+    TCGv_ptr ptr;
+    TCGv_i64 count;
+
+    th = tcg_find_helper(s, (tcg_target_ulong)func);
+    if (!th) {
+        return;
+    }
+    ptr = tcg_const_ptr(&s->helper_counts[th - s->helpers]);
+    count = tcg_temp_new_i64();
+    tcg_gen_ld_i64(count, ptr, 0);
+    tcg_gen_addi_i64(count, count, 1);
+    tcg_gen_st_i64(count, ptr, 0);
+    tcg_temp_free_i64(count);
+    tcg_temp_free_ptr(ptr);
+}
+
+/* Return the name and call count of helper 'index', or 0 if there is no
+   such helper.  */
+int tcg_get_helper_count(TCGContext *s, int index, const char **name,
+                         uint64_t *count)
+{
+    if (!s->helper_counts || index >= s->nb_helpers) {
+        return 0;
+    }
+    *name = s->helpers[index].name;
+    *count = s->helper_counts[index];
+    return 1;
+}
+
 static const char * const cond_name[] =
 {
     [TCG_COND_EQ] = "eq",
@@ -2060,8 +2110,10 @@ static inline int tcg_gen_code_common(TCGContext *s, uint8_t *gen_code_buf,
 #endif
 
 #ifdef USE_TCG_OPTIMIZATIONS
-    gen_opparam_ptr =
-        tcg_optimize(s, gen_opc_ptr, gen_opparam_buf, tcg_op_defs);
+    if (!s->no_optimize) {
+        gen_opparam_ptr =
+            tcg_optimize(s, gen_opc_ptr, gen_opparam_buf, tcg_op_defs);
+    }
 #endif
 
 #ifdef CONFIG_PROFILER
@@ -367,6 +367,12 @@ struct TCGContext {
     int nb_helpers;
     int allocated_helpers;
     int helpers_sorted;
+    /* per helper call counters, indexed like the sorted helpers array */
+    uint64_t *helper_counts;
+    int helper_profile;
+
+    /* skip tcg_optimize() for the function being generated */
+    int no_optimize;
 
 #ifdef CONFIG_PROFILER
     /* profiling info */
@@ -570,6 +576,10 @@ TCGArg *tcg_optimize(TCGContext *s, uint16_t *tcg_opc_ptr, TCGArg *args,
 
 /* only used for debugging purposes */
 void tcg_register_helper(void *func, const char *name);
+void tcg_profile_helpers(TCGContext *s, int enable);
+void tcg_gen_count_helper(void *func);
+int tcg_get_helper_count(TCGContext *s, int index, const char **name,
+                         uint64_t *count);
 const char *tcg_helper_get_name(TCGContext *s, void *func);
 void tcg_dump_ops(TCGContext *s);
 
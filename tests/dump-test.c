@@ -0,0 +1,170 @@
+/*
+ * QTest testcase for the kdump-compressed guest memory dump
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * A 64 MB guest is dumped to a file with format=kdump-zlib.  The disk
+ * dump header must describe 4 KB blocks and 16384 page frames, and the
+ * bitmaps that follow the sub header must have a bit set for each page
+ * of guest RAM and clear for the VGA window between 640 KB and 768 KB.
+ * The kdump sub header must point to the ELF notes of the vCPUs.
+ */
+#include "libqtest.h"
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define RAM_MB                  64
+#define BLOCK_SIZE              4096
+#define MAX_MAPNR               (RAM_MB * 1024 * 1024 / BLOCK_SIZE)
+
+/* DiskDumpHeader32 of makedumpfile, the guest is not in long mode */
+#define KDUMP_SIGNATURE         "KDUMP   "
+#define KDUMP_HEADER_VERSION    6
+#define DH_VERSION              8
+#define DH_BLOCK_SIZE           416
+#define DH_SUB_HDR_SIZE         420
+#define DH_BITMAP_BLOCKS        424
+#define DH_MAX_MAPNR            428
+
+/* KdumpSubHeader32: the sizes are 32-bit, the offsets 64-bit */
+#define KH_OFFSET_NOTE          32
+#define KH_SIZE_NOTE            40
+#define KH_SIZE                 80
+
+#define NT_PRSTATUS             1
+
+static char dump_file[] = "/tmp/qtest-dump.XXXXXX";
+
+static uint32_t get_le32(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get_le64(const uint8_t *p)
+{
+    return get_le32(p) | ((uint64_t)get_le32(p + 4) << 32);
+}
+
+static bool bit_set(const uint8_t *bitmap, uint32_t pfn)
+{
+    return bitmap[pfn / 8] & (1 << (pfn % 8));
+}
+
+static void check_bitmap(const uint8_t *bitmap)
+{
+    uint32_t pfn;
+
+    for (pfn = 0; pfn < 0xa0; pfn++) {
+        g_assert(bit_set(bitmap, pfn));
+    }
+    for (pfn = 0xa0; pfn < 0xc0; pfn++) {
+        g_assert(!bit_set(bitmap, pfn));
+    }
+    for (pfn = 0x100; pfn < MAX_MAPNR; pfn++) {
+        g_assert(bit_set(bitmap, pfn));
+    }
+}
+
+static void test_kdump_header(void)
+{
+    uint8_t header[BLOCK_SIZE];
+    uint8_t *bitmap;
+    uint32_t sub_hdr_size, bitmap_blocks;
+    size_t bitmap_size;
+    char *reply;
+    int fd;
+
+    reply = qmp_reply("{ 'execute': 'dump-guest-memory',"
+                      "  'arguments': { 'paging': false,"
+                      "                 'protocol': 'file:%s',"
+                      "                 'format': 'kdump-zlib' } }",
+                      dump_file);
+    g_assert(strstr(reply, "\"return\""));
+    g_free(reply);
+
+    fd = open(dump_file, O_RDONLY);
+    g_assert(fd >= 0);
+    g_assert_cmpint(pread(fd, header, sizeof(header), 0), ==, sizeof(header));
+
+    g_assert(memcmp(header, KDUMP_SIGNATURE, strlen(KDUMP_SIGNATURE)) == 0);
+    g_assert_cmpint(get_le32(header + DH_VERSION), ==, KDUMP_HEADER_VERSION);
+    g_assert_cmpint(get_le32(header + DH_BLOCK_SIZE), ==, BLOCK_SIZE);
+    g_assert_cmpint(get_le32(header + DH_MAX_MAPNR), ==, MAX_MAPNR);
+
+    /* both bitmaps, one bit per page frame, rounded up to whole blocks */
+    sub_hdr_size = get_le32(header + DH_SUB_HDR_SIZE);
+    bitmap_blocks = get_le32(header + DH_BITMAP_BLOCKS);
+    g_assert_cmpint(sub_hdr_size, >=, 1);
+    g_assert_cmpint(bitmap_blocks, ==,
+                    2 * ((MAX_MAPNR / 8 + BLOCK_SIZE - 1) / BLOCK_SIZE));
+
+    bitmap_size = bitmap_blocks / 2 * BLOCK_SIZE;
+    bitmap = g_malloc(2 * bitmap_size);
+    g_assert_cmpint(pread(fd, bitmap, 2 * bitmap_size,
+                          (1 + sub_hdr_size) * BLOCK_SIZE),
+                    ==, 2 * bitmap_size);
+    check_bitmap(bitmap);
+    check_bitmap(bitmap + bitmap_size);
+
+    g_free(bitmap);
+    close(fd);
+}
+
+static void test_kdump_notes(void)
+{
+    uint8_t sub_header[BLOCK_SIZE];
+    uint64_t offset_note;
+    uint32_t size_note;
+    int fd;
+
+    fd = open(dump_file, O_RDONLY);
+    g_assert(fd >= 0);
+    g_assert_cmpint(pread(fd, sub_header, sizeof(sub_header), BLOCK_SIZE),
+                    ==, sizeof(sub_header));
+    close(fd);
+
+    /* the notes follow the sub header in the same block */
+    offset_note = get_le64(sub_header + KH_OFFSET_NOTE);
+    size_note = get_le32(sub_header + KH_SIZE_NOTE);
+    g_assert_cmpint(offset_note, ==, BLOCK_SIZE + KH_SIZE);
+    g_assert_cmpint(size_note, >, 12);
+    g_assert_cmpint(KH_SIZE + size_note, <=, BLOCK_SIZE);
+
+    /* Elf32_Nhdr of the first vCPU's NT_PRSTATUS */
+    g_assert_cmpint(get_le32(sub_header + KH_SIZE), ==, strlen("CORE") + 1);
+    g_assert_cmpint(get_le32(sub_header + KH_SIZE + 4), >, 0);
+    g_assert_cmpint(get_le32(sub_header + KH_SIZE + 8), ==, NT_PRSTATUS);
+    g_assert(memcmp(sub_header + KH_SIZE + 12, "CORE", 5) == 0);
+}
+
+int main(int argc, char **argv)
+{
+    char *cmdline;
+    int fd;
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    fd = mkstemp(dump_file);
+    g_assert(fd >= 0);
+    close(fd);
+
+    cmdline = g_strdup_printf("-m %d", RAM_MB);
+    qtest_start(cmdline);
+    g_free(cmdline);
+
+    qtest_add_func("/dump/kdump-header", test_kdump_header);
+    qtest_add_func("/dump/kdump-notes", test_kdump_notes);
+
+    ret = g_test_run();
+
+    qtest_quit(global_qtest);
+    unlink(dump_file);
+    return ret;
+}
@@ -0,0 +1,144 @@
+/*
+ * QTest testcase for e1000 interrupt moderation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * The libqos e1000 driver transmits frames into the void and the test
+ * checks when the transmit interrupt becomes pending: after TIDV for
+ * descriptors with the IDE bit, and no sooner than ITR after the previous
+ * interrupt.
+ */
+#include "libqos.h"
+
+#include <glib.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define E1000_SLOT              4
+
+/* guest physical layout used by the driver */
+#define TX_RING_ADDR            0x100000
+#define TX_RING_SIZE            16
+#define TX_BUF_ADDR             0x200000
+
+/* pending causes, without clearing them as an ICR read would */
+static uint32_t e1000_pending(void)
+{
+    return e1000_readl(E1000_ICS);
+}
+
+static void e1000_ack(void)
+{
+    e1000_readl(E1000_ICR);
+}
+
+static void e1000_send(uint32_t cmd)
+{
+    qe1000_send(TX_BUF_ADDR, cmd | E1000_TXD_CMD_RS | 64);
+}
+
+static int64_t e1000_stat(const char *name)
+{
+    char *reply = qmp_reply("{ 'execute': 'qom-get', 'arguments': {"
+                            "  'path': '/machine/peripheral/nic0',"
+                            "  'property': '%s' } }", name);
+    char *p = strstr(reply, "\"return\"");
+    int64_t val;
+
+    g_assert(p);
+    p = strchr(p, ':');
+    g_assert(p);
+    val = strtoll(p + 1, NULL, 10);
+    g_free(reply);
+
+    return val;
+}
+
+static void e1000_driver_init(void)
+{
+    qe1000_init_tx(E1000_SLOT, TX_RING_ADDR, TX_RING_SIZE);
+    e1000_writel(E1000_IMS, E1000_ICR_TXDW);
+}
+
+static void tx_delay(void)
+{
+    e1000_writel(E1000_TIDV, 100);     /* 102.4 us */
+    e1000_writel(E1000_TADV, 0);
+
+    /* without IDE the interrupt is immediate */
+    e1000_send(0);
+    g_assert(e1000_pending() & E1000_ICR_TXDW);
+    e1000_ack();
+
+    e1000_send(E1000_TXD_CMD_IDE);
+    g_assert(!(e1000_pending() & E1000_ICR_TXDW));
+    clock_step(50000);
+    e1000_send(E1000_TXD_CMD_IDE);
+    /* the second frame restarted the packet timer */
+    clock_step(80000);
+    g_assert(!(e1000_pending() & E1000_ICR_TXDW));
+    clock_step(30000);
+    g_assert(e1000_pending() & E1000_ICR_TXDW);
+    e1000_ack();
+
+    /* the absolute timer bounds the delay of a steady stream */
+    e1000_writel(E1000_TADV, 150);     /* 153.6 us */
+    e1000_send(E1000_TXD_CMD_IDE);
+    clock_step(80000);
+    e1000_send(E1000_TXD_CMD_IDE);
+    clock_step(80000);
+    g_assert(e1000_pending() & E1000_ICR_TXDW);
+    e1000_ack();
+
+    e1000_writel(E1000_TIDV, 0);
+    e1000_writel(E1000_TADV, 0);
+}
+
+static void itr(void)
+{
+    int64_t raised, coalesced;
+
+    e1000_writel(E1000_ITR, 1000);     /* 256 us between interrupts */
+    clock_step(1000000);
+
+    raised = e1000_stat("interrupts");
+    coalesced = e1000_stat("interrupts-coalesced");
+
+    e1000_send(0);
+    g_assert_cmpint(e1000_stat("interrupts"), ==, raised + 1);
+    e1000_ack();
+
+    /* two more frames within the interval make a single interrupt */
+    e1000_send(0);
+    e1000_send(0);
+    g_assert_cmpint(e1000_stat("interrupts"), ==, raised + 1);
+    clock_step(300000);
+    g_assert_cmpint(e1000_stat("interrupts"), ==, raised + 2);
+    g_assert_cmpint(e1000_stat("interrupts-coalesced"), ==, coalesced + 1);
+    e1000_ack();
+
+    e1000_writel(E1000_ITR, 0);
+}
+
+int main(int argc, char **argv)
+{
+    QTestState *s = NULL;
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    s = qtest_start("-display none -m 64 -net none "
+                    "-device e1000,id=nic0,addr=04.0");
+    e1000_driver_init();
+
+    qtest_add_func("/e1000/tx-delay", tx_delay);
+    qtest_add_func("/e1000/itr", itr);
+    ret = g_test_run();
+
+    if (s) {
+        qtest_quit(s);
+    }
+
+    return ret;
+}
@@ -0,0 +1,259 @@
+/*
+ * QTest guest drivers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+#include "libqos.h"
+
+#include <glib.h>
+#include <string.h>
+#include <netinet/in.h>
+
+static void pci_config_select(int slot, int reg)
+{
+    outl(PCI_CONFIG_ADDR, 0x80000000 | (slot << 11) | reg);
+}
+
+uint32_t pci_config_readl(int slot, int reg)
+{
+    pci_config_select(slot, reg);
+    return inl(PCI_CONFIG_DATA);
+}
+
+void pci_config_writel(int slot, int reg, uint32_t val)
+{
+    pci_config_select(slot, reg);
+    outl(PCI_CONFIG_DATA, val);
+}
+
+uint16_t readw_le(uint64_t addr)
+{
+    uint16_t val;
+
+    memread(addr, &val, sizeof(val));
+    return GUINT16_FROM_LE(val);
+}
+
+uint32_t readl_le(uint64_t addr)
+{
+    uint32_t val;
+
+    memread(addr, &val, sizeof(val));
+    return GUINT32_FROM_LE(val);
+}
+
+void writew_le(uint64_t addr, uint16_t val)
+{
+    val = GUINT16_TO_LE(val);
+    memwrite(addr, &val, sizeof(val));
+}
+
+void writel_le(uint64_t addr, uint32_t val)
+{
+    val = GUINT32_TO_LE(val);
+    memwrite(addr, &val, sizeof(val));
+}
+
+void writeq_le(uint64_t addr, uint64_t val)
+{
+    val = GUINT64_TO_LE(val);
+    memwrite(addr, &val, sizeof(val));
+}
+
+void qvirtio_pci_init(int slot, uint16_t io_base)
+{
+    pci_config_writel(slot, 0x10, io_base | 1);
+    pci_config_writel(slot, 0x04, 0x5);     /* I/O space, bus master */
+
+    outb(io_base + VIRTIO_PCI_STATUS,
+         VIRTIO_CONFIG_S_ACKNOWLEDGE | VIRTIO_CONFIG_S_DRIVER);
+}
+
+void qvirtio_pci_driver_ok(uint16_t io_base)
+{
+    outb(io_base + VIRTIO_PCI_STATUS,
+         VIRTIO_CONFIG_S_ACKNOWLEDGE | VIRTIO_CONFIG_S_DRIVER |
+         VIRTIO_CONFIG_S_DRIVER_OK);
+}
+
+void qvirtqueue_init(QVirtQueue *vq)
+{
+    outw(vq->io_base + VIRTIO_PCI_QUEUE_SEL, vq->index);
+    vq->num = inw(vq->io_base + VIRTIO_PCI_QUEUE_NUM);
+    g_assert_cmpint(vq->num, >, 0);
+    outl(vq->io_base + VIRTIO_PCI_QUEUE_PFN, vq->addr >> 12);
+    vq->avail_idx = 0;
+}
+
+uint64_t qvring_avail(QVirtQueue *vq)
+{
+    return vq->addr + vq->num * VRING_DESC_SIZE;
+}
+
+uint64_t qvring_used(QVirtQueue *vq)
+{
+    return (qvring_avail(vq) + 4 + vq->num * 2 + 2 + 4095) & ~4095ULL;
+}
+
+uint16_t qvring_used_idx(QVirtQueue *vq)
+{
+    return readw_le(qvring_used(vq) + 2);
+}
+
+void qvring_set_desc(void *table, int i, uint64_t addr, uint32_t len,
+                     uint16_t flags, uint16_t next)
+{
+    uint8_t *desc = (uint8_t *)table + i * VRING_DESC_SIZE;
+
+    addr = GUINT64_TO_LE(addr);
+    len = GUINT32_TO_LE(len);
+    flags = GUINT16_TO_LE(flags);
+    next = GUINT16_TO_LE(next);
+    memcpy(desc, &addr, 8);
+    memcpy(desc + 8, &len, 4);
+    memcpy(desc + 12, &flags, 2);
+    memcpy(desc + 14, &next, 2);
+}
+
+void qvring_write_desc(uint64_t table, int i, uint64_t addr, uint32_t len,
+                       uint16_t flags, uint16_t next)
+{
+    uint8_t desc[VRING_DESC_SIZE];
+
+    qvring_set_desc(desc, 0, addr, len, flags, next);
+    memwrite(table + i * VRING_DESC_SIZE, desc, sizeof(desc));
+}
+
+void qvirtqueue_kick(QVirtQueue *vq, int count)
+{
+    vq->avail_idx += count;
+    writew_le(qvring_avail(vq) + 2, vq->avail_idx);
+    outw(vq->io_base + VIRTIO_PCI_QUEUE_NOTIFY, vq->index);
+}
+
+void qvirtqueue_add(QVirtQueue *vq, uint64_t addr, uint32_t len,
+                    uint16_t flags)
+{
+    uint16_t head = vq->avail_idx % vq->num;
+
+    qvring_write_desc(vq->addr, head, addr, len, flags, 0);
+    writew_le(qvring_avail(vq) + 4 + head * 2, head);
+    qvirtqueue_kick(vq, 1);
+}
+
+static uint64_t e1000_tx_ring;
+static int e1000_tx_size;
+static uint32_t e1000_tdt;
+
+uint32_t e1000_readl(uint32_t reg)
+{
+    return readl_le(E1000_MMIO_BASE + reg);
+}
+
+void e1000_writel(uint32_t reg, uint32_t val)
+{
+    writel_le(E1000_MMIO_BASE + reg, val);
+}
+
+void qe1000_init_tx(int slot, uint64_t ring, int size)
+{
+    pci_config_writel(slot, 0x10, E1000_MMIO_BASE);
+    pci_config_writel(slot, 0x04, 0x6);     /* memory space, bus master */
+
+    e1000_tx_ring = ring;
+    e1000_tx_size = size;
+    e1000_tdt = 0;
+    e1000_writel(E1000_TDBAL, ring);
+    e1000_writel(E1000_TDBAH, ring >> 32);
+    e1000_writel(E1000_TDLEN, size * E1000_DESC_SIZE);
+    e1000_writel(E1000_TDH, 0);
+    e1000_writel(E1000_TDT, 0);
+    e1000_writel(E1000_TCTL, E1000_TCTL_EN);
+}
+
+void qe1000_send_batch(const uint64_t *addr, int count, uint32_t cmd)
+{
+    uint32_t *desc = g_new0(uint32_t, count * 4);
+    int i, n;
+
+    g_assert_cmpint(count, <, e1000_tx_size);
+    for (i = 0; i < count; i++) {
+        uint64_t addr_le = GUINT64_TO_LE(addr[i]);
+
+        memcpy(desc + i * 4, &addr_le, 8);
+        desc[i * 4 + 2] = GUINT32_TO_LE(cmd | E1000_TXD_CMD_EOP |
+                                        E1000_TXD_CMD_IFCS);
+    }
+
+    /* at most two writes, before and after the end of the ring */
+    n = MIN(count, e1000_tx_size - e1000_tdt);
+    memwrite(e1000_tx_ring + e1000_tdt * E1000_DESC_SIZE, desc,
+             n * E1000_DESC_SIZE);
+    if (n < count) {
+        memwrite(e1000_tx_ring, desc + n * 4, (count - n) * E1000_DESC_SIZE);
+    }
+    g_free(desc);
+
+    e1000_tdt = (e1000_tdt + count) % e1000_tx_size;
+    e1000_writel(E1000_TDT, e1000_tdt);
+}
+
+void qe1000_send(uint64_t addr, uint32_t cmd)
+{
+    qe1000_send_batch(&addr, 1, cmd);
+}
+
+static uint16_t ip_checksum(const uint8_t *p, int len)
+{
+    uint32_t sum = 0;
+    int i;
+
+    for (i = 0; i < len; i += 2) {
+        sum += (p[i] << 8) | p[i + 1];
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return ~sum;
+}
+
+void qslirp_write_udp(uint64_t addr, uint16_t sport, uint16_t dport,
+                      const void *payload, int len)
+{
+    static const uint8_t eth[14] = {
+        0x52, 0x55, 0x0a, 0x00, 0x02, 0x02,     /* slirp's host */
+        0x52, 0x54, 0x00, 0x12, 0x34, 0x56,
+        0x08, 0x00,
+    };
+    int frame_len = UDP_FRAME_LEN(len);
+    uint8_t *pkt = g_malloc0(frame_len);
+    uint8_t *ip = pkt + 14, *udp = ip + 20;
+    uint16_t csum;
+
+    memcpy(pkt, eth, sizeof(eth));
+
+    ip[0] = 0x45;
+    ip[2] = (frame_len - 14) >> 8;
+    ip[3] = frame_len - 14;
+    ip[8] = 64;                                 /* TTL */
+    ip[9] = IPPROTO_UDP;
+    memcpy(ip + 12, (uint8_t[]) { 10, 0, 2, 15 }, 4);
+    memcpy(ip + 16, (uint8_t[]) { 10, 0, 2, 2 }, 4);
+    csum = ip_checksum(ip, 20);
+    ip[10] = csum >> 8;
+    ip[11] = csum;
+
+    udp[0] = sport >> 8;
+    udp[1] = sport;
+    udp[2] = dport >> 8;
+    udp[3] = dport;
+    udp[4] = (8 + len) >> 8;
+    udp[5] = 8 + len;
+    if (payload) {
+        memcpy(udp + 8, payload, len);
+    }
+
+    memwrite(addr, pkt, frame_len);
+    g_free(pkt);
+}
@@ -0,0 +1,221 @@
+/*
+ * QTest guest drivers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Minimal guest drivers, written with qtest accesses, for the testcases
+ * that need a device to move data.  They drive the global_qtest instance
+ * of a pc machine and know nothing of interrupts: the testcases poll the
+ * rings, or step the clock and look at them.
+ */
+#ifndef LIBQOS_H
+#define LIBQOS_H
+
+#include "libqtest.h"
+
+#define PCI_CONFIG_ADDR         0xcf8
+#define PCI_CONFIG_DATA         0xcfc
+
+/**
+ * pci_config_readl:
+ * @slot: PCI slot of the device on bus 0, function 0.
+ * @reg: Offset in the configuration space.
+ */
+uint32_t pci_config_readl(int slot, int reg);
+
+/**
+ * pci_config_writel:
+ * @slot: PCI slot of the device on bus 0, function 0.
+ * @reg: Offset in the configuration space.
+ * @val: Value to write.
+ */
+void pci_config_writel(int slot, int reg, uint32_t val);
+
+/* little endian accesses to guest memory */
+uint16_t readw_le(uint64_t addr);
+uint32_t readl_le(uint64_t addr);
+void writew_le(uint64_t addr, uint16_t val);
+void writel_le(uint64_t addr, uint32_t val);
+void writeq_le(uint64_t addr, uint64_t val);
+
+/* legacy virtio-pci registers, MSI-X disabled */
+#define VIRTIO_PCI_HOST_FEATURES    0
+#define VIRTIO_PCI_GUEST_FEATURES   4
+#define VIRTIO_PCI_QUEUE_PFN        8
+#define VIRTIO_PCI_QUEUE_NUM        12
+#define VIRTIO_PCI_QUEUE_SEL        14
+#define VIRTIO_PCI_QUEUE_NOTIFY     16
+#define VIRTIO_PCI_STATUS           18
+#define VIRTIO_PCI_CONFIG           20
+
+#define VIRTIO_CONFIG_S_ACKNOWLEDGE 1
+#define VIRTIO_CONFIG_S_DRIVER      2
+#define VIRTIO_CONFIG_S_DRIVER_OK   4
+
+#define VRING_DESC_F_NEXT       1
+#define VRING_DESC_F_WRITE      2
+#define VRING_DESC_F_INDIRECT   4
+
+#define VRING_DESC_SIZE         16
+
+typedef struct QVirtQueue {
+    uint16_t io_base;
+    int index;
+    uint64_t addr;              /* page aligned */
+    uint16_t num;
+    uint16_t avail_idx;
+} QVirtQueue;
+
+/**
+ * qvirtio_pci_init:
+ * @slot: PCI slot of the device.
+ * @io_base: I/O port to map the virtio-pci registers at.
+ *
+ * Enables the device and acknowledges it, up to the feature negotiation.
+ */
+void qvirtio_pci_init(int slot, uint16_t io_base);
+
+/**
+ * qvirtio_pci_driver_ok:
+ * @io_base: I/O port of the virtio-pci registers.
+ */
+void qvirtio_pci_driver_ok(uint16_t io_base);
+
+/**
+ * qvirtqueue_init:
+ * @vq: Queue to set up, @io_base, @index and @addr filled in.
+ *
+ * Reads the size of the queue into @vq->num and places the ring at
+ * @vq->addr.
+ */
+void qvirtqueue_init(QVirtQueue *vq);
+
+/* guest addresses of the parts of the ring of @vq */
+uint64_t qvring_avail(QVirtQueue *vq);
+uint64_t qvring_used(QVirtQueue *vq);
+uint16_t qvring_used_idx(QVirtQueue *vq);
+
+/**
+ * qvring_set_desc:
+ * @table: Host copy of a descriptor table.
+ * @i: Index of the descriptor in @table.
+ *
+ * Fills in descriptor @i of @table, in guest byte order, so that a whole
+ * table can be written with a single memwrite.
+ */
+void qvring_set_desc(void *table, int i, uint64_t addr, uint32_t len,
+                     uint16_t flags, uint16_t next);
+
+/**
+ * qvring_write_desc:
+ * @table: Guest address of a descriptor table.
+ * @i: Index of the descriptor in @table.
+ */
+void qvring_write_desc(uint64_t table, int i, uint64_t addr, uint32_t len,
+                       uint16_t flags, uint16_t next);
+
+/**
+ * qvirtqueue_kick:
+ * @vq: Queue to kick.
+ * @count: Number of elements to make available.
+ *
+ * The avail ring must already point to the elements.
+ */
+void qvirtqueue_kick(QVirtQueue *vq, int count);
+
+/**
+ * qvirtqueue_add:
+ * @vq: Queue to add a buffer to.
+ *
+ * Queues a single-descriptor buffer and kicks the device.
+ */
+void qvirtqueue_add(QVirtQueue *vq, uint64_t addr, uint32_t len,
+                    uint16_t flags);
+
+/* e1000, BAR 0 at E1000_MMIO_BASE */
+#define E1000_MMIO_BASE         0xe0000000
+
+#define E1000_ICR       0x000c0
+#define E1000_ITR       0x000c4
+#define E1000_ICS       0x000c8
+#define E1000_IMS       0x000d0
+#define E1000_RCTL      0x00100
+#define E1000_TCTL      0x00400
+#define E1000_RDBAL     0x02800
+#define E1000_RDBAH     0x02804
+#define E1000_RDLEN     0x02808
+#define E1000_RDH       0x02810
+#define E1000_RDT       0x02818
+#define E1000_TDBAL     0x03800
+#define E1000_TDBAH     0x03804
+#define E1000_TDLEN     0x03808
+#define E1000_TDH       0x03810
+#define E1000_TDT       0x03818
+#define E1000_TIDV      0x03820
+#define E1000_TADV      0x0382c
+#define E1000_RAL       0x05400
+#define E1000_RAH       0x05404
+
+#define E1000_RCTL_EN           0x00000002
+#define E1000_RCTL_UPE          0x00000008
+#define E1000_RCTL_SECRC        0x04000000
+#define E1000_TCTL_EN           0x00000002
+#define E1000_RAH_AV            0x80000000
+#define E1000_ICR_TXDW          0x00000001
+#define E1000_RXD_STAT_DD       0x01
+#define E1000_TXD_CMD_EOP       0x01000000
+#define E1000_TXD_CMD_IFCS      0x02000000
+#define E1000_TXD_CMD_RS        0x08000000
+#define E1000_TXD_CMD_IDE       0x80000000
+
+#define E1000_DESC_SIZE         16
+
+uint32_t e1000_readl(uint32_t reg);
+void e1000_writel(uint32_t reg, uint32_t val);
+
+/**
+ * qe1000_init_tx:
+ * @slot: PCI slot of the device.
+ * @ring: Guest address of the transmit descriptor ring.
+ * @size: Number of descriptors in the ring.
+ *
+ * Enables the device and its transmitter.
+ */
+void qe1000_init_tx(int slot, uint64_t ring, int size);
+
+/**
+ * qe1000_send_batch:
+ * @addr: Guest addresses of the frames.
+ * @count: Number of frames, less than the size of the ring.
+ * @cmd: Length of the frames and commands besides EOP and IFCS.
+ *
+ * Posts a legacy descriptor for each frame and moves the tail once.
+ */
+void qe1000_send_batch(const uint64_t *addr, int count, uint32_t cmd);
+
+/**
+ * qe1000_send:
+ * @addr: Guest address of the frame.
+ * @cmd: Length of the frame and commands besides EOP and IFCS.
+ */
+void qe1000_send(uint64_t addr, uint32_t cmd);
+
+/* a UDP datagram in an Ethernet frame, without options or UDP checksum */
+#define UDP_FRAME_LEN(payload)  (14 + 20 + 8 + (payload))
+
+/**
+ * qslirp_write_udp:
+ * @addr: Guest address to write the frame to.
+ * @sport: UDP source port.
+ * @dport: UDP destination port.
+ * @payload: Payload of the datagram, or NULL for zeroes.
+ * @len: Length of the payload.
+ *
+ * Writes a frame from the guest of user networking, 10.0.2.15, to the
+ * host, 10.0.2.2, which slirp forwards to the loopback interface.
+ */
+void qslirp_write_udp(uint64_t addr, uint16_t sport, uint16_t dport,
+                      const void *payload, int len);
+
+#endif
@@ -139,23 +139,32 @@ QTestState *qtest_init(const char *extra_args)
     return s;
 }
 
-void qtest_quit(QTestState *s)
+pid_t qtest_get_pid(QTestState *s)
 {
     FILE *f;
     char buffer[1024];
+    pid_t pid = -1;
 
     f = fopen(s->pid_file, "r");
     if (f) {
         if (fgets(buffer, sizeof(buffer), f)) {
-            pid_t pid = atoi(buffer);
-            int status = 0;
-
-            kill(pid, SIGTERM);
-            waitpid(pid, &status, 0);
+            pid = atoi(buffer);
         }
-
         fclose(f);
     }
+    return pid;
+}
+
+void qtest_quit(QTestState *s)
+{
+    pid_t pid = qtest_get_pid(s);
+
+    if (pid != -1) {
+        int status = 0;
+
+        kill(pid, SIGTERM);
+        waitpid(pid, &status, 0);
+    }
 
     unlink(s->pid_file);
     unlink(s->socket_path);
@@ -273,18 +282,13 @@ redo:
     return words;
 }
 
-void qtest_qmp(QTestState *s, const char *fmt, ...)
+/* Receive one JSON object from the QMP socket */
+static GString *qtest_qmp_receive(QTestState *s)
 {
-    va_list ap;
+    GString *obj = g_string_new("");
     bool has_reply = false;
     int nesting = 0;
 
-    /* Send QMP request */
-    va_start(ap, fmt);
-    socket_sendf(s->qmp_fd, fmt, ap);
-    va_end(ap);
-
-    /* Receive reply */
     while (!has_reply || nesting > 0) {
         ssize_t len;
         char c;
@@ -308,6 +312,44 @@ void qtest_qmp(QTestState *s, const char *fmt, ...)
             nesting--;
             break;
         }
+        if (has_reply) {
+            g_string_append_c(obj, c);
+        }
+    }
+
+    return obj;
+}
+
+void qtest_qmp(QTestState *s, const char *fmt, ...)
+{
+    va_list ap;
+
+    /* Send QMP request */
+    va_start(ap, fmt);
+    socket_sendf(s->qmp_fd, fmt, ap);
+    va_end(ap);
+
+    /* Receive reply */
+    g_string_free(qtest_qmp_receive(s), true);
+}
+
+char *qtest_qmp_reply(QTestState *s, const char *fmt, ...)
+{
+    va_list ap;
+    GString *obj;
+
+    va_start(ap, fmt);
+    socket_sendf(s->qmp_fd, fmt, ap);
+    va_end(ap);
+
+    /* Skip asynchronous events */
+    for (;;) {
+        obj = qtest_qmp_receive(s);
+        if (strstr(obj->str, "\"return\"") ||
+            strstr(obj->str, "\"error\"")) {
+            return g_string_free(obj, false);
+        }
+        g_string_free(obj, true);
     }
 }
 
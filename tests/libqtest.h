@@ -37,6 +37,14 @@ QTestState *qtest_init(const char *extra_args);
  */
 void qtest_quit(QTestState *s);
 
+/**
+ * qtest_get_pid:
+ * @s: QTestState instance to operate on.
+ *
+ * Returns the process id of the QEMU process associated to @s, or -1.
+ */
+pid_t qtest_get_pid(QTestState *s);
+
 /**
  * qtest_qmp:
  * @s: QTestState instance to operate on.
@@ -46,6 +54,17 @@ void qtest_quit(QTestState *s);
  */
 void qtest_qmp(QTestState *s, const char *fmt, ...);
 
+/**
+ * qtest_qmp_reply:
+ * @s: QTestState instance to operate on.
+ * @fmt...: QMP message to send to qemu
+ *
+ * Sends a QMP message to QEMU and returns the text of the reply, which
+ * the caller must free with g_free().  Events received in the meantime
+ * are discarded.
+ */
+char *qtest_qmp_reply(QTestState *s, const char *fmt, ...);
+
 /**
  * qtest_get_irq:
  * @s: QTestState instance to operate on.
@@ -223,6 +242,8 @@ void qtest_add_func(const char *str, void (*fn));
  */
 #define qmp(fmt, ...) qtest_qmp(global_qtest, fmt, ## __VA_ARGS__)
 
+#define qmp_reply(fmt, ...) qtest_qmp_reply(global_qtest, fmt, ## __VA_ARGS__)
+
 /**
  * get_irq:
  * @num: Interrupt to observe.
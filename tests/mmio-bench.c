@@ -0,0 +1,155 @@
+/*
+ * MMIO/PIO exit throughput benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Runs inside an x86 Linux guest, as root, and measures how many device
+ * accesses per second the vCPUs complete when they all hit the same
+ * device at once.  Every access is an exit to QEMU; comparing runs with
+ * "-machine lockless_io=on" and "lockless_io=off" shows the cost of the
+ * global mutex on the exit path.
+ *
+ *   gcc -O2 -pthread -o mmio-bench mmio-bench.c
+ *   ./mmio-bench [-t threads] [-s seconds] [hpet|vapic]
+ *
+ * hpet:  32-bit reads of the HPET main counter (MMIO)
+ * vapic: 32-bit writes to the kvmvapic port 0x7e (PIO), which is present
+ *        on PC machines with KVM
+ */
+
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/io.h>
+#include <sys/mman.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define HPET_BASE     0xfed00000
+#define HPET_COUNTER  0xf0
+#define VAPIC_PORT    0x7e
+
+typedef struct BenchThread {
+    pthread_t thread;
+    int cpu;
+    unsigned long ops;
+} BenchThread;
+
+static volatile int stop;
+static volatile uint32_t *hpet;
+static int use_pio;
+
+static void *bench_thread(void *opaque)
+{
+    BenchThread *t = opaque;
+    cpu_set_t cpus;
+    unsigned long ops = 0;
+    int i;
+
+    CPU_ZERO(&cpus);
+    CPU_SET(t->cpu, &cpus);
+    pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+
+    while (!stop) {
+        for (i = 0; i < 64; i++) {
+            if (use_pio) {
+                outl(0, VAPIC_PORT);
+            } else {
+                (void)hpet[HPET_COUNTER / 4];
+            }
+        }
+        ops += 64;
+    }
+    t->ops = ops;
+    return NULL;
+}
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+int main(int argc, char **argv)
+{
+    int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    int seconds = 10;
+    unsigned long total = 0;
+    BenchThread *threads;
+    double start, elapsed;
+    int c, i, fd;
+
+    while ((c = getopt(argc, argv, "t:s:")) != -1) {
+        switch (c) {
+        case 't':
+            nthreads = atoi(optarg);
+            break;
+        case 's':
+            seconds = atoi(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: %s [-t threads] [-s seconds] "
+                    "[hpet|vapic]\n", argv[0]);
+            return 1;
+        }
+    }
+    if (optind < argc && !strcmp(argv[optind], "vapic")) {
+        use_pio = 1;
+    }
+    if (nthreads < 1) {
+        nthreads = 1;
+    }
+
+    if (use_pio) {
+        if (iopl(3) < 0) {
+            perror("iopl");
+            return 1;
+        }
+    } else {
+        fd = open("/dev/mem", O_RDONLY | O_SYNC);
+        if (fd < 0) {
+            perror("/dev/mem");
+            return 1;
+        }
+        hpet = mmap(NULL, 4096, PROT_READ, MAP_SHARED, fd, HPET_BASE);
+        if (hpet == MAP_FAILED) {
+            perror("mmap");
+            return 1;
+        }
+    }
+
+    threads = calloc(nthreads, sizeof(*threads));
+    start = now();
+    for (i = 0; i < nthreads; i++) {
+        threads[i].cpu = i % sysconf(_SC_NPROCESSORS_ONLN);
+        if (pthread_create(&threads[i].thread, NULL, bench_thread,
+                           &threads[i])) {
+            fprintf(stderr, "pthread_create: %s\n", strerror(errno));
+            return 1;
+        }
+    }
+    sleep(seconds);
+    stop = 1;
+    for (i = 0; i < nthreads; i++) {
+        pthread_join(threads[i].thread, NULL);
+        total += threads[i].ops;
+    }
+    elapsed = now() - start;
+
+    for (i = 0; i < nthreads; i++) {
+        printf("thread %d (cpu %d): %.0f exits/s\n", i, threads[i].cpu,
+               threads[i].ops / elapsed);
+    }
+    printf("%s, %d threads: %.0f exits/s total\n",
+           use_pio ? "vapic pio" : "hpet mmio", nthreads, total / elapsed);
+    return 0;
+}
@@ -0,0 +1,148 @@
+/*
+ * QTest testcase for net-capture-start/net-capture-stop
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * The libqos e1000 driver transmits UDP datagrams to user networking
+ * while the netdev is being captured.  The pcap files written by the
+ * capture are then read back: the filter, the snaplen and the rotation by
+ * size must all show there.
+ */
+#include "libqos.h"
+
+#include <glib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define E1000_SLOT              4
+
+/* guest physical layout used by the driver */
+#define TX_RING_ADDR            0x100000
+#define TX_RING_SIZE            16
+#define PKT_ADDR                0x200000
+#define PKT_STRIDE              128
+
+#define PAYLOAD_LEN             32
+#define PKT_LEN                 UDP_FRAME_LEN(PAYLOAD_LEN)
+
+#define PCAP_HDR_LEN            24
+#define PCAP_REC_HDR_LEN        16
+
+static char capture_file[] = "/tmp/qtest-net-capture.XXXXXX";
+
+/* write a datagram from 10.0.2.15 to port 'dport' of slirp's host */
+static void write_packet(int slot, uint16_t dport)
+{
+    qslirp_write_udp(PKT_ADDR + slot * PKT_STRIDE, 40000, dport, NULL,
+                     PAYLOAD_LEN);
+}
+
+static void send_packet(int slot)
+{
+    qe1000_send(PKT_ADDR + slot * PKT_STRIDE, PKT_LEN);
+}
+
+/* number of records in the pcap file 'name', checking their caplen */
+static int count_records(const char *name, uint32_t snaplen)
+{
+    uint8_t hdr[PCAP_HDR_LEN], rec[PCAP_REC_HDR_LEN];
+    uint32_t caplen, len;
+    FILE *f = fopen(name, "rb");
+    int n = 0;
+
+    g_assert(f);
+    g_assert(fread(hdr, sizeof(hdr), 1, f) == 1);
+    g_assert_cmphex(*(uint32_t *)hdr, ==, 0xa1b2c3d4);
+    g_assert_cmpint(*(uint32_t *)(hdr + 16), ==, snaplen);
+
+    while (fread(rec, sizeof(rec), 1, f) == 1) {
+        memcpy(&caplen, rec + 8, 4);
+        memcpy(&len, rec + 12, 4);
+        g_assert_cmpint(len, ==, PKT_LEN);
+        g_assert_cmpint(caplen, ==, MIN(snaplen, PKT_LEN));
+        g_assert(fseek(f, caplen, SEEK_CUR) == 0);
+        n++;
+    }
+    fclose(f);
+    return n;
+}
+
+static void test_filter(void)
+{
+    int i;
+
+    qmp("{ 'execute': 'net-capture-start', 'arguments': {"
+        "  'netdev': 'n0', 'file': '%s',"
+        "  'filter': 'udp and (dst port 9 or dst port 13)' } }",
+        capture_file);
+
+    for (i = 0; i < 12; i++) {
+        send_packet(i % 3);
+    }
+
+    qmp("{ 'execute': 'net-capture-stop', 'arguments': {"
+        "  'netdev': 'n0' } }");
+
+    /* ports 9 and 13 are captured, 10 is not */
+    g_assert_cmpint(count_records(capture_file, 65535), ==, 8);
+    unlink(capture_file);
+}
+
+static void test_rotate(void)
+{
+    char *name;
+    int i;
+
+    /* four records of 16 + 20 bytes per file */
+    qmp("{ 'execute': 'net-capture-start', 'arguments': {"
+        "  'netdev': 'n0', 'file': '%s', 'snaplen': 20,"
+        "  'file-size': %d } }",
+        capture_file, PCAP_HDR_LEN + 4 * (PCAP_REC_HDR_LEN + 20));
+
+    for (i = 0; i < 10; i++) {
+        send_packet(0);
+    }
+
+    qmp("{ 'execute': 'net-capture-stop', 'arguments': {"
+        "  'netdev': 'n0' } }");
+
+    for (i = 0; i < 3; i++) {
+        name = g_strdup_printf("%s.%d", capture_file, i);
+        g_assert_cmpint(count_records(name, 20), ==, i < 2 ? 4 : 2);
+        unlink(name);
+        g_free(name);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    QTestState *s = NULL;
+    int fd, ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    fd = mkstemp(capture_file);
+    g_assert(fd >= 0);
+    close(fd);
+
+    s = qtest_start("-display none -m 64 -netdev user,id=n0 "
+                    "-device e1000,netdev=n0,addr=04.0");
+    qe1000_init_tx(E1000_SLOT, TX_RING_ADDR, TX_RING_SIZE);
+    write_packet(0, 9);
+    write_packet(1, 10);
+    write_packet(2, 13);
+
+    qtest_add_func("/net-capture/filter", test_filter);
+    qtest_add_func("/net-capture/rotate", test_rotate);
+    ret = g_test_run();
+
+    if (s) {
+        qtest_quit(s);
+    }
+    unlink(capture_file);
+
+    return ret;
+}
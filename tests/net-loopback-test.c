@@ -0,0 +1,661 @@
+/*
+ * QTest testcase and benchmark for NIC models on a loopback netdev
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Each NIC is attached to a UDP socket netdev that sends to its own
+ * address, so every frame the NIC transmits comes back to its receive
+ * ring.  Minimal guest drivers, written with qtest accesses, post the
+ * transmit descriptors of a batch, wait for the frames in the receive
+ * ring and give the buffers back.  The frames are addressed to the NIC,
+ * which must let them through its unicast filter.
+ *
+ * With "-m perf" the packet rate and the CPU time of QEMU per packet are
+ * reported for several frame sizes.  Both include the qtest round trips of
+ * the drivers, a handful per batch, so compare runs rather than devices.
+ */
+#include "libqos.h"
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define E1000_SLOT              4
+#define RTL8139_SLOT            5
+#define RTL8139_IO_BASE         0xc000
+#define VIRTIO_NET_SLOT         6
+#define VIRTIO_NET_IO_BASE      0xc100
+#define VIRTIO_NET_ADAPTIVE_SLOT        7
+#define VIRTIO_NET_ADAPTIVE_IO_BASE     0xc200
+
+#define RTL8139_TXADDR0         0x20
+#define RTL8139_CHIPCMD         0x37
+#define RTL8139_RXCONFIG        0x44
+#define RTL8139_TXPOLL          0xd9
+#define RTL8139_CPCMD           0xe0
+#define RTL8139_RXRINGADDR_LO   0xe4
+#define RTL8139_RXRINGADDR_HI   0xe8
+
+#define RTL8139_CMD_RESET       0x10
+#define RTL8139_CMD_RX_ENB      0x08
+#define RTL8139_CMD_TX_ENB      0x04
+#define RTL8139_CPCMD_RX_ENB    0x0002
+#define RTL8139_CPCMD_TX_ENB    0x0001
+#define RTL8139_ACCEPT_MY_PHYS  0x02
+#define RTL8139_TXPOLL_NPQ      0x40
+#define RTL8139_DESC_OWN        (1u << 31)
+#define RTL8139_DESC_EOR        (1u << 30)
+#define RTL8139_DESC_FS         (1u << 29)
+#define RTL8139_DESC_LS         (1u << 28)
+#define RTL8139_DESC_SIZE_MASK  0x1fff
+#define RTL8139_RING_SIZE       64
+
+#define VIRTIO_NET_RX_VQ        0
+#define VIRTIO_NET_TX_VQ        1
+#define VIRTIO_NET_CTRL_VQ      2
+#define VIRTIO_NET_HDR_LEN      10
+#define VIRTIO_NET_CTRL_RX_MODE 0
+#define VIRTIO_NET_CTRL_RX_MODE_PROMISC 0
+
+/* guest physical layout used by each fake driver, from its base */
+#define TX_RING                 0x000000
+#define RX_RING                 0x010000
+#define CTRL_RING               0x020000
+#define FRAME_ADDR              0x030000
+#define SCRATCH_ADDR            0x031000
+#define RX_BUF                  0x100000
+#define RX_BUF_SIZE             2048
+
+#define BATCH                   32
+#define PERF_PACKETS            (1024 * BATCH)
+
+typedef struct NicDriver NicDriver;
+
+struct NicDriver {
+    const char *name;
+    const char *device;
+    int slot;
+    uint16_t io_base;
+    uint64_t base;
+
+    void (*init)(NicDriver *d);
+    /* set up the transmit descriptors for frames of @len bytes */
+    void (*prepare)(NicDriver *d, int len);
+    /* transmit @count frames from FRAME_ADDR */
+    void (*send)(NicDriver *d, int count);
+    /* wait for @count frames, recycle their buffers and return the length
+     * of the last one, whose address is left in @last */
+    int (*wait)(NicDriver *d, int count);
+
+    uint64_t last;
+    uint32_t tx, rx;
+    int len;
+    QVirtQueue vq[3];
+};
+
+static const int frame_sizes[] = { 60, 512, 1514 };
+static pid_t qemu_pid;
+
+/* a frame from another station to the NIC in @slot */
+static void build_frame(uint8_t *frame, int len, int slot)
+{
+    static const uint8_t src[6] = { 0x52, 0x54, 0x00, 0x00, 0x00, 0x01 };
+    int i;
+
+    frame[0] = 0x52;
+    frame[1] = 0x54;
+    frame[2] = 0x00;
+    frame[3] = 0x12;
+    frame[4] = 0x34;
+    frame[5] = slot;
+    memcpy(frame + 6, src, sizeof(src));
+    frame[12] = 0x88;                           /* local experimental */
+    frame[13] = 0xb5;
+    for (i = 14; i < len; i++) {
+        frame[i] = i + len;
+    }
+}
+
+/* e1000: legacy descriptors, frames of at most RX_BUF_SIZE bytes */
+
+#define E1000_RING_SIZE         64
+
+static void e1000_init(NicDriver *d)
+{
+    uint64_t desc[E1000_RING_SIZE * 2];
+    int i;
+
+    qe1000_init_tx(d->slot, d->base + TX_RING, E1000_RING_SIZE);
+
+    memset(desc, 0, sizeof(desc));
+    for (i = 0; i < E1000_RING_SIZE; i++) {
+        desc[i * 2] = GUINT64_TO_LE(d->base + RX_BUF + i * RX_BUF_SIZE);
+    }
+    memwrite(d->base + RX_RING, desc, sizeof(desc));
+    e1000_writel(E1000_RDBAL, d->base + RX_RING);
+    e1000_writel(E1000_RDBAH, 0);
+    e1000_writel(E1000_RDLEN, E1000_RING_SIZE * 16);
+    e1000_writel(E1000_RDH, 0);
+    e1000_writel(E1000_RDT, E1000_RING_SIZE - 1);
+
+    /* the driver programs the station address, no promiscuous mode */
+    e1000_writel(E1000_RAL, 0x12005452);
+    e1000_writel(E1000_RAH, E1000_RAH_AV | d->slot << 8 | 0x34);
+    e1000_writel(E1000_RCTL, E1000_RCTL_EN | E1000_RCTL_SECRC);
+}
+
+static void e1000_prepare(NicDriver *d, int len)
+{
+    uint32_t desc[E1000_RING_SIZE * 4];
+    int i;
+
+    /* without RS the descriptors are not written back, so set them once */
+    memset(desc, 0, sizeof(desc));
+    for (i = 0; i < E1000_RING_SIZE; i++) {
+        desc[i * 4] = GUINT32_TO_LE(d->base + FRAME_ADDR);
+        desc[i * 4 + 2] = GUINT32_TO_LE(E1000_TXD_CMD_EOP |
+                                        E1000_TXD_CMD_IFCS | len);
+    }
+    memwrite(d->base + TX_RING, desc, sizeof(desc));
+}
+
+static void e1000_send(NicDriver *d, int count)
+{
+    d->tx += count;
+    e1000_writel(E1000_TDT, d->tx % E1000_RING_SIZE);
+}
+
+static int e1000_wait(NicDriver *d, int count)
+{
+    int i, tries;
+
+    d->rx += count;
+    for (tries = 0; e1000_readl(E1000_RDH) != d->rx % E1000_RING_SIZE;
+         tries++) {
+        g_assert_cmpint(tries, <, 100000);
+    }
+
+    i = (d->rx - 1) % E1000_RING_SIZE;
+    d->last = d->base + RX_BUF + i * RX_BUF_SIZE;
+    e1000_writel(E1000_RDT, (d->rx + E1000_RING_SIZE - 1) % E1000_RING_SIZE);
+    return readw_le(d->base + RX_RING + i * 16 + 8);
+}
+
+/* rtl8139: C+ mode descriptor rings */
+
+static void rtl8139_write_desc(uint64_t ring, int first, int count,
+                               uint32_t dw0, uint64_t addr, int stride)
+{
+    uint32_t desc[RTL8139_RING_SIZE * 4];
+    int i, n, pos;
+
+    while (count > 0) {
+        n = MIN(count, RTL8139_RING_SIZE - first);
+        memset(desc, 0, n * 16);
+        for (i = 0; i < n; i++) {
+            pos = first + i;
+            desc[i * 4] = GUINT32_TO_LE(dw0 | (pos == RTL8139_RING_SIZE - 1 ?
+                                               RTL8139_DESC_EOR : 0));
+            desc[i * 4 + 2] = GUINT32_TO_LE(addr + pos * stride);
+        }
+        memwrite(ring + first * 16, desc, n * 16);
+        count -= n;
+        first = 0;
+    }
+}
+
+static void rtl8139_init(NicDriver *d)
+{
+    pci_config_writel(d->slot, 0x10, d->io_base | 1);
+    pci_config_writel(d->slot, 0x04, 0x5);  /* I/O space, bus master */
+
+    outb(d->io_base + RTL8139_CHIPCMD, RTL8139_CMD_RESET);
+    outw(d->io_base + RTL8139_CPCMD,
+         RTL8139_CPCMD_RX_ENB | RTL8139_CPCMD_TX_ENB);
+
+    rtl8139_write_desc(d->base + RX_RING, 0, RTL8139_RING_SIZE,
+                       RTL8139_DESC_OWN | RX_BUF_SIZE, d->base + RX_BUF,
+                       RX_BUF_SIZE);
+    outl(d->io_base + RTL8139_TXADDR0, d->base + TX_RING);
+    outl(d->io_base + RTL8139_TXADDR0 + 4, 0);
+    outl(d->io_base + RTL8139_RXRINGADDR_LO, d->base + RX_RING);
+    outl(d->io_base + RTL8139_RXRINGADDR_HI, 0);
+
+    outb(d->io_base + RTL8139_CHIPCMD,
+         RTL8139_CMD_RX_ENB | RTL8139_CMD_TX_ENB);
+    outl(d->io_base + RTL8139_RXCONFIG, RTL8139_ACCEPT_MY_PHYS);
+}
+
+static void rtl8139_prepare(NicDriver *d, int len)
+{
+    d->len = len;
+}
+
+static void rtl8139_send(NicDriver *d, int count)
+{
+    /* the NIC clears OWN, so the descriptors are written for every batch */
+    rtl8139_write_desc(d->base + TX_RING, d->tx % RTL8139_RING_SIZE,
+                       count, RTL8139_DESC_OWN | RTL8139_DESC_FS |
+                       RTL8139_DESC_LS | d->len, d->base + FRAME_ADDR, 0);
+    d->tx += count;
+    outb(d->io_base + RTL8139_TXPOLL, RTL8139_TXPOLL_NPQ);
+}
+
+static int rtl8139_wait(NicDriver *d, int count)
+{
+    int i = (d->rx + count - 1) % RTL8139_RING_SIZE;
+    uint32_t dw0;
+    int tries;
+
+    for (tries = 0; (dw0 = readl_le(d->base + RX_RING + i * 16)) &
+                    RTL8139_DESC_OWN; tries++) {
+        g_assert_cmpint(tries, <, 100000);
+    }
+
+    rtl8139_write_desc(d->base + RX_RING, d->rx % RTL8139_RING_SIZE,
+                       count, RTL8139_DESC_OWN | RX_BUF_SIZE,
+                       d->base + RX_BUF, RX_BUF_SIZE);
+    d->rx += count;
+    d->last = d->base + RX_BUF + i * RX_BUF_SIZE;
+
+    /* the size includes the CRC */
+    return (dw0 & RTL8139_DESC_SIZE_MASK) - 4;
+}
+
+/*
+ * virtio-net: no features, so every element is a virtio_net_hdr followed
+ * by the frame.  Half of each ring is used, with two descriptors per
+ * element at fixed places, so the avail rings never change either.
+ */
+
+/* avail ring slot k holds the element at descriptor 2 * (k % (num / 2)) */
+static void vring_fill_avail(QVirtQueue *vq)
+{
+    uint16_t *avail = g_new0(uint16_t, 2 + vq->num);
+    int k;
+
+    for (k = 0; k < vq->num; k++) {
+        avail[2 + k] = GUINT16_TO_LE((k % (vq->num / 2)) * 2);
+    }
+    memwrite(qvring_avail(vq), avail, (2 + vq->num) * 2);
+    g_free(avail);
+}
+
+static void virtio_net_setup_vq(NicDriver *d, int index, uint64_t ring)
+{
+    QVirtQueue *vq = &d->vq[index];
+
+    vq->io_base = d->io_base;
+    vq->index = index;
+    vq->addr = ring;
+    qvirtqueue_init(vq);
+    g_assert_cmpint(vq->num, >=, 2 * BATCH);
+}
+
+/* turn off promiscuous mode, which the device starts in */
+static void virtio_net_set_promisc(NicDriver *d, uint8_t on)
+{
+    QVirtQueue *vq = &d->vq[VIRTIO_NET_CTRL_VQ];
+    uint64_t cmd = d->base + SCRATCH_ADDR + 16;
+    uint16_t desc[3 * 8];
+    uint8_t buf[4] = { VIRTIO_NET_CTRL_RX_MODE,
+                       VIRTIO_NET_CTRL_RX_MODE_PROMISC, on, 0xff };
+
+    qvring_set_desc(desc, 0, cmd, 2, VRING_DESC_F_NEXT, 1);
+    qvring_set_desc(desc, 1, cmd + 2, 1, VRING_DESC_F_NEXT, 2);
+    qvring_set_desc(desc, 2, cmd + 3, 1, VRING_DESC_F_WRITE, 0);
+    memwrite(vq->addr, desc, sizeof(desc));
+    memwrite(cmd, buf, sizeof(buf));
+
+    writew_le(qvring_avail(vq) + 4, 0);
+    qvirtqueue_kick(vq, 1);
+    g_assert_cmpint(qvring_used_idx(vq), ==, 1);
+    memread(cmd + 3, buf, 1);
+    g_assert_cmpint(buf[0], ==, 0);             /* VIRTIO_NET_OK */
+}
+
+static void virtio_net_init(NicDriver *d)
+{
+    QVirtQueue *rx = &d->vq[VIRTIO_NET_RX_VQ];
+    uint16_t *desc;
+    int i;
+
+    qvirtio_pci_init(d->slot, d->io_base);
+    outl(d->io_base + VIRTIO_PCI_GUEST_FEATURES, 0);
+    virtio_net_setup_vq(d, VIRTIO_NET_RX_VQ, d->base + RX_RING);
+    virtio_net_setup_vq(d, VIRTIO_NET_TX_VQ, d->base + TX_RING);
+    virtio_net_setup_vq(d, VIRTIO_NET_CTRL_VQ, d->base + CTRL_RING);
+
+    desc = g_new0(uint16_t, rx->num * 8);
+    for (i = 0; i < rx->num / 2; i++) {
+        uint64_t buf = d->base + RX_BUF + i * RX_BUF_SIZE;
+
+        qvring_set_desc(desc, i * 2, buf, VIRTIO_NET_HDR_LEN,
+                        VRING_DESC_F_WRITE | VRING_DESC_F_NEXT, i * 2 + 1);
+        qvring_set_desc(desc, i * 2 + 1, buf + 16, RX_BUF_SIZE - 16,
+                        VRING_DESC_F_WRITE, 0);
+    }
+    memwrite(rx->addr, desc, rx->num * VRING_DESC_SIZE);
+    g_free(desc);
+    vring_fill_avail(rx);
+    rx->avail_idx = rx->num / 2;
+    writew_le(qvring_avail(rx) + 2, rx->avail_idx);
+    vring_fill_avail(&d->vq[VIRTIO_NET_TX_VQ]);
+
+    qvirtio_pci_driver_ok(d->io_base);
+
+    virtio_net_set_promisc(d, 0);
+}
+
+static void virtio_net_prepare(NicDriver *d, int len)
+{
+    int num = d->vq[VIRTIO_NET_TX_VQ].num;
+    uint16_t *desc = g_new0(uint16_t, num * 8);
+    uint8_t hdr[VIRTIO_NET_HDR_LEN];
+    int i;
+
+    for (i = 0; i < num / 2; i++) {
+        qvring_set_desc(desc, i * 2, d->base + SCRATCH_ADDR, sizeof(hdr),
+                        VRING_DESC_F_NEXT, i * 2 + 1);
+        qvring_set_desc(desc, i * 2 + 1, d->base + FRAME_ADDR, len, 0, 0);
+    }
+    memwrite(d->base + TX_RING, desc, num * VRING_DESC_SIZE);
+    g_free(desc);
+
+    memset(hdr, 0, sizeof(hdr));
+    memwrite(d->base + SCRATCH_ADDR, hdr, sizeof(hdr));
+}
+
+static void virtio_net_send(NicDriver *d, int count)
+{
+    qvirtqueue_kick(&d->vq[VIRTIO_NET_TX_VQ], count);
+}
+
+static int virtio_net_wait(NicDriver *d, int count)
+{
+    QVirtQueue *rx = &d->vq[VIRTIO_NET_RX_VQ];
+    uint64_t used = qvring_used(rx);
+    int num = rx->num;
+    uint32_t elem[2];
+    int tries;
+
+    d->rx += count;
+    for (tries = 0; readw_le(used + 2) != (uint16_t)d->rx; tries++) {
+        g_assert_cmpint(tries, <, 100000);
+    }
+
+    memread(used + 4 + ((d->rx - 1) % num) * 8, elem, sizeof(elem));
+    d->last = d->base + RX_BUF + GUINT32_FROM_LE(elem[0]) / 2 * RX_BUF_SIZE +
+              16;
+
+    qvirtqueue_kick(rx, count);
+    return GUINT32_FROM_LE(elem[1]) - VIRTIO_NET_HDR_LEN;
+}
+
+static NicDriver nics[] = {
+    {
+        .name = "e1000",
+        .device = "e1000",
+        .slot = E1000_SLOT,
+        .base = 0x1000000,
+        .init = e1000_init,
+        .prepare = e1000_prepare,
+        .send = e1000_send,
+        .wait = e1000_wait,
+    }, {
+        .name = "rtl8139",
+        .device = "rtl8139",
+        .slot = RTL8139_SLOT,
+        .io_base = RTL8139_IO_BASE,
+        .base = 0x1800000,
+        .init = rtl8139_init,
+        .prepare = rtl8139_prepare,
+        .send = rtl8139_send,
+        .wait = rtl8139_wait,
+    }, {
+        .name = "virtio-net",
+        .device = "virtio-net-pci",
+        .slot = VIRTIO_NET_SLOT,
+        .io_base = VIRTIO_NET_IO_BASE,
+        .base = 0x2000000,
+        .init = virtio_net_init,
+        .prepare = virtio_net_prepare,
+        .send = virtio_net_send,
+        .wait = virtio_net_wait,
+    }, {
+        .name = "virtio-net-adaptive",
+        .device = "virtio-net-pci,tx=adaptive",
+        .slot = VIRTIO_NET_ADAPTIVE_SLOT,
+        .io_base = VIRTIO_NET_ADAPTIVE_IO_BASE,
+        .base = 0x2800000,
+        .init = virtio_net_init,
+        .prepare = virtio_net_prepare,
+        .send = virtio_net_send,
+        .wait = virtio_net_wait,
+    },
+};
+
+static void prepare_frame(NicDriver *d, uint8_t *frame, int len)
+{
+    build_frame(frame, len, d->slot);
+    memwrite(d->base + FRAME_ADDR, frame, len);
+    d->prepare(d, len);
+}
+
+static void test_loopback(gconstpointer opaque)
+{
+    NicDriver *d = (NicDriver *)opaque;
+    uint8_t frame[1514], buf[1514];
+    int i, j, len;
+
+    for (i = 0; i < G_N_ELEMENTS(frame_sizes); i++) {
+        prepare_frame(d, frame, frame_sizes[i]);
+
+        d->send(d, 1);
+        len = d->wait(d, 1);
+        g_assert_cmpint(len, ==, frame_sizes[i]);
+        memread(d->last, buf, len);
+        g_assert(memcmp(buf, frame, len) == 0);
+
+        /* whole batches, so that the rings wrap around */
+        for (j = 0; j < 4; j++) {
+            d->send(d, BATCH);
+            g_assert_cmpint(d->wait(d, BATCH), ==, frame_sizes[i]);
+        }
+        memread(d->last, buf, len);
+        g_assert(memcmp(buf, frame, len) == 0);
+    }
+}
+
+static int64_t nic_stat(NicDriver *d, const char *name)
+{
+    char *reply = qmp_reply("{ 'execute': 'qom-get', 'arguments': {"
+                            "  'path': '/machine/peripheral/nic%d',"
+                            "  'property': '%s' } }",
+                            (int)(d - nics), name);
+    char *p = strstr(reply, "\"return\"");
+    int64_t val;
+
+    g_assert(p);
+    p = strchr(p, ':');
+    g_assert(p);
+    val = strtoll(p + 1, NULL, 10);
+    g_free(reply);
+
+    return val;
+}
+
+/* A notify that finds a whole batch sends part of it inline and leaves
+ * the rest to the bottom half */
+static void test_adaptive_stats(gconstpointer opaque)
+{
+    NicDriver *d = (NicDriver *)opaque;
+    int64_t packets, notifications, inline_bursts, bursts;
+    uint8_t frame[1514];
+    int i;
+
+    packets = nic_stat(d, "tx-packets");
+    notifications = nic_stat(d, "tx-notifications");
+    inline_bursts = nic_stat(d, "tx-inline-bursts");
+    bursts = nic_stat(d, "tx-bursts");
+
+    prepare_frame(d, frame, frame_sizes[0]);
+    for (i = 0; i < 4; i++) {
+        d->send(d, BATCH);
+        g_assert_cmpint(d->wait(d, BATCH), ==, frame_sizes[0]);
+    }
+
+    packets = nic_stat(d, "tx-packets") - packets;
+    notifications = nic_stat(d, "tx-notifications") - notifications;
+    inline_bursts = nic_stat(d, "tx-inline-bursts") - inline_bursts;
+    bursts = nic_stat(d, "tx-bursts") - bursts;
+    g_assert_cmpint(packets, ==, 4 * BATCH);
+    g_assert_cmpint(inline_bursts, >, 0);
+    g_assert_cmpint(bursts, >, inline_bursts);
+    g_assert_cmpint(notifications, >=, inline_bursts);
+    g_assert_cmpint(nic_stat(d, "tx-inline-burst"), >=, 8);
+    g_assert_cmpint(nic_stat(d, "tx-inline-burst"), <=, 64);
+}
+
+/* user and system time of QEMU so far, in seconds, or -1 */
+static double qemu_cpu_time(void)
+{
+    gchar *path = g_strdup_printf("/proc/%d/stat", (int)qemu_pid);
+    gchar *stat = NULL, *p;
+    unsigned long utime, stime;
+    double ret = -1;
+
+    /* the fields after the command name, which may contain spaces */
+    if (g_file_get_contents(path, &stat, NULL, NULL) &&
+        (p = strrchr(stat, ')')) &&
+        sscanf(p + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu",
+               &utime, &stime) == 2) {
+        ret = (double)(utime + stime) / sysconf(_SC_CLK_TCK);
+    }
+    g_free(stat);
+    g_free(path);
+    return ret;
+}
+
+static void test_perf(gconstpointer opaque)
+{
+    NicDriver *d = (NicDriver *)opaque;
+    uint8_t frame[1514];
+    double elapsed, cpu;
+    int i, n;
+
+    for (i = 0; i < G_N_ELEMENTS(frame_sizes); i++) {
+        prepare_frame(d, frame, frame_sizes[i]);
+
+        cpu = qemu_cpu_time();
+        g_test_timer_start();
+        for (n = 0; n < PERF_PACKETS; n += BATCH) {
+            d->send(d, BATCH);
+            d->wait(d, BATCH);
+        }
+        elapsed = g_test_timer_elapsed();
+
+        if (cpu >= 0) {
+            cpu = qemu_cpu_time() - cpu;
+            g_test_maximized_result(PERF_PACKETS / elapsed,
+                                    "%s, %d bytes: %.0f packets/s, "
+                                    "%.2f us CPU per packet",
+                                    d->name, frame_sizes[i],
+                                    PERF_PACKETS / elapsed,
+                                    cpu * 1e6 / PERF_PACKETS);
+        } else {
+            g_test_maximized_result(PERF_PACKETS / elapsed,
+                                    "%s, %d bytes: %.0f packets/s",
+                                    d->name, frame_sizes[i],
+                                    PERF_PACKETS / elapsed);
+        }
+    }
+}
+
+/*
+ * Reserve a port for a netdev to bind to and send to.  The socket stays
+ * bound until QEMU has bound the port as well, which SO_REUSEADDR allows,
+ * so that the port cannot be handed out to another socket in between; a
+ * netdev that fails to bind would make QEMU exit before libqtest gets to
+ * talk to it.
+ */
+static int udp_port_reserve(uint16_t *port)
+{
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    int fd, val = 1;
+
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    g_assert(fd >= 0);
+    g_assert(setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &val,
+                        sizeof(val)) == 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    g_assert(bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    g_assert(getsockname(fd, (struct sockaddr *)&addr, &addrlen) == 0);
+    *port = ntohs(addr.sin_port);
+    return fd;
+}
+
+int main(int argc, char **argv)
+{
+    QTestState *s = NULL;
+    GString *args;
+    gchar *path;
+    int fds[G_N_ELEMENTS(nics)];
+    uint16_t port;
+    int i, ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    args = g_string_new("-display none -m 64");
+    for (i = 0; i < G_N_ELEMENTS(nics); i++) {
+        fds[i] = udp_port_reserve(&port);
+        g_string_append_printf(args, " -netdev socket,id=n%d,"
+                               "udp=127.0.0.1:%d,localaddr=127.0.0.1:%d"
+                               " -device %s,netdev=n%d,id=nic%d,addr=%02x.0,"
+                               "mac=52:54:00:12:34:%02x",
+                               i, port, port, nics[i].device, i, i,
+                               nics[i].slot, nics[i].slot);
+    }
+    s = qtest_start(args->str);
+    g_string_free(args, TRUE);
+    for (i = 0; i < G_N_ELEMENTS(nics); i++) {
+        close(fds[i]);
+    }
+    qemu_pid = qtest_get_pid(s);
+
+    for (i = 0; i < G_N_ELEMENTS(nics); i++) {
+        nics[i].init(&nics[i]);
+
+        path = g_strdup_printf("/%s/net/loopback/%s", qtest_get_arch(),
+                               nics[i].name);
+        g_test_add_data_func(path, &nics[i], test_loopback);
+        g_free(path);
+        if (strstr(nics[i].device, "tx=adaptive")) {
+            path = g_strdup_printf("/%s/net/loopback/%s/stats",
+                                   qtest_get_arch(), nics[i].name);
+            g_test_add_data_func(path, &nics[i], test_adaptive_stats);
+            g_free(path);
+        }
+        if (g_test_perf()) {
+            path = g_strdup_printf("/%s/net/loopback/%s/perf",
+                                   qtest_get_arch(), nics[i].name);
+            g_test_add_data_func(path, &nics[i], test_perf);
+            g_free(path);
+        }
+    }
+    ret = g_test_run();
+
+    if (s) {
+        qtest_quit(s);
+    }
+
+    return ret;
+}
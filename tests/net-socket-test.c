@@ -0,0 +1,300 @@
+/*
+ * QTest testcase for the socket backend with vnet_hdr=on
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * The test plays the other end of a -netdev socket connection whose frames
+ * carry a virtio_net_hdr.  A 64k-style TSO frame written to the socket must
+ * reach the e1000 of the guest, which knows nothing of offloads, as MSS-sized
+ * frames with valid checksums; frames of the e1000 must come out of the
+ * socket behind an empty header.  A frame split across two writes, after
+ * an empty one, must arrive whole.
+ */
+#include "libqos.h"
+
+#include <glib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define E1000_SLOT              4
+
+/* guest physical layout used by the driver */
+#define TX_RING_ADDR            0x100000
+#define TX_RING_SIZE            16
+#define RX_RING_ADDR            0x110000
+#define RX_RING_SIZE            16
+#define RX_BUF_ADDR             0x200000
+#define RX_BUF_SIZE             2048
+#define TX_BUF_ADDR             0x300000
+
+/* struct virtio_net_hdr */
+#define VNET_HDR_LEN            10
+#define VNET_F_NEEDS_CSUM       1
+#define VNET_GSO_TCPV4          1
+
+#define HDR_LEN                 (14 + 20 + 20)
+#define MSS                     100
+#define SEGS                    3
+#define SEQ                     1000
+
+static int listen_fd, conn_fd;
+static uint16_t listen_port;
+
+typedef struct {
+    uint64_t buffer_addr;
+    uint16_t length;
+    uint16_t csum;
+    uint8_t status;
+    uint8_t errors;
+    uint16_t special;
+} RxDesc;
+
+static void e1000_driver_init(void)
+{
+    RxDesc desc;
+    int i;
+
+    qe1000_init_tx(E1000_SLOT, TX_RING_ADDR, TX_RING_SIZE);
+
+    for (i = 0; i < RX_RING_SIZE; i++) {
+        memset(&desc, 0, sizeof(desc));
+        desc.buffer_addr = GUINT64_TO_LE(RX_BUF_ADDR + i * RX_BUF_SIZE);
+        memwrite(RX_RING_ADDR + i * sizeof(desc), &desc, sizeof(desc));
+    }
+    e1000_writel(E1000_RDBAL, RX_RING_ADDR);
+    e1000_writel(E1000_RDBAH, 0);
+    e1000_writel(E1000_RDLEN, RX_RING_SIZE * sizeof(desc));
+    e1000_writel(E1000_RDH, 0);
+    e1000_writel(E1000_RDT, RX_RING_SIZE - 1);
+    e1000_writel(E1000_RCTL, E1000_RCTL_EN | E1000_RCTL_UPE |
+                             E1000_RCTL_SECRC);
+}
+
+static uint32_t checksum_add(const uint8_t *p, int len)
+{
+    uint32_t sum = 0;
+    int i;
+
+    for (i = 0; i < len; i++) {
+        sum += i & 1 ? p[i] : p[i] << 8;
+    }
+    return sum;
+}
+
+static uint16_t checksum_finish(uint32_t sum)
+{
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return ~sum;
+}
+
+/* wait for the e1000 to fill the receive descriptor 'i' */
+static RxDesc rx_wait(int i)
+{
+    RxDesc desc;
+    int tries;
+
+    for (tries = 0; tries < 1000; tries++) {
+        memread(RX_RING_ADDR + i * sizeof(desc), &desc, sizeof(desc));
+        if (desc.status & E1000_RXD_STAT_DD) {
+            return desc;
+        }
+        g_usleep(1000);
+    }
+    g_assert_not_reached();
+}
+
+static void test_gso_fallback(void)
+{
+    uint8_t frame[VNET_HDR_LEN + HDR_LEN + SEGS * MSS];
+    uint8_t *hdr = frame, *eth = frame + VNET_HDR_LEN;
+    uint8_t *ip = eth + 14, *th = ip + 20;
+    uint8_t seg[HDR_LEN + MSS];
+    uint32_t len, seq, sum;
+    uint16_t val;
+    int i;
+
+    memset(frame, 0, sizeof(frame));
+
+    /* flags, gso_type, hdr_len, gso_size, csum_start, csum_offset */
+    hdr[0] = VNET_F_NEEDS_CSUM;
+    hdr[1] = VNET_GSO_TCPV4;
+    val = HDR_LEN;
+    memcpy(hdr + 2, &val, 2);
+    val = MSS;
+    memcpy(hdr + 4, &val, 2);
+    val = 14 + 20;
+    memcpy(hdr + 6, &val, 2);
+    val = 16;
+    memcpy(hdr + 8, &val, 2);
+
+    memcpy(eth, (uint8_t[]) { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56,
+                              0x52, 0x54, 0x00, 0x12, 0x34, 0x57,
+                              0x08, 0x00 }, 14);
+    ip[0] = 0x45;
+    ip[2] = (sizeof(frame) - VNET_HDR_LEN - 14) >> 8;
+    ip[3] = (sizeof(frame) - VNET_HDR_LEN - 14) & 0xff;
+    ip[8] = 64;
+    ip[9] = IPPROTO_TCP;
+    memcpy(ip + 12, (uint8_t[]) { 10, 0, 0, 1, 10, 0, 0, 2 }, 8);
+    th[0] = 1234 >> 8;
+    th[1] = 1234 & 0xff;
+    th[3] = 80;
+    th[4] = SEQ >> 24;
+    th[5] = SEQ >> 16;
+    th[6] = SEQ >> 8;
+    th[7] = SEQ & 0xff;
+    th[12] = 5 << 4;
+    th[13] = 0x18;                              /* ACK, PSH */
+    th[14] = 0xff;
+    for (i = 0; i < SEGS * MSS; i++) {
+        th[20 + i] = i;
+    }
+
+    len = htonl(sizeof(frame));
+    g_assert(write(conn_fd, &len, sizeof(len)) == sizeof(len));
+    g_assert(write(conn_fd, frame, sizeof(frame)) == sizeof(frame));
+
+    for (i = 0; i < SEGS; i++) {
+        RxDesc desc = rx_wait(i);
+
+        g_assert_cmpint(GUINT16_FROM_LE(desc.length), ==, sizeof(seg));
+        memread(RX_BUF_ADDR + i * RX_BUF_SIZE, seg, sizeof(seg));
+        ip = seg + 14;
+        th = ip + 20;
+
+        g_assert_cmpint(ip[2] << 8 | ip[3], ==, 20 + 20 + MSS);
+        g_assert_cmpint(checksum_finish(checksum_add(ip, 20)), ==, 0);
+
+        seq = th[4] << 24 | th[5] << 16 | th[6] << 8 | th[7];
+        g_assert_cmpint(seq, ==, SEQ + i * MSS);
+        g_assert_cmpint(th[13], ==, i == SEGS - 1 ? 0x18 : 0x10);
+
+        sum = checksum_add(ip + 12, 8) + IPPROTO_TCP + 20 + MSS;
+        sum += checksum_add(th, 20 + MSS);
+        g_assert_cmpint(checksum_finish(sum), ==, 0);
+
+        g_assert_cmpint(th[20], ==, (uint8_t)(i * MSS));
+        g_assert_cmpint(th[20 + MSS - 1], ==, (uint8_t)(i * MSS + MSS - 1));
+    }
+}
+
+static void test_tx_header(void)
+{
+    uint8_t pkt[64], buf[4 + VNET_HDR_LEN + sizeof(pkt)];
+    uint32_t len;
+    size_t got = 0;
+    ssize_t ret;
+    int i;
+
+    for (i = 0; i < sizeof(pkt); i++) {
+        pkt[i] = i;
+    }
+    memwrite(TX_BUF_ADDR, pkt, sizeof(pkt));
+    qe1000_send(TX_BUF_ADDR, sizeof(pkt));
+
+    while (got < sizeof(buf)) {
+        ret = read(conn_fd, buf + got, sizeof(buf) - got);
+        g_assert(ret > 0 || (ret < 0 && errno == EINTR));
+        got += MAX(ret, 0);
+    }
+
+    memcpy(&len, buf, sizeof(len));
+    g_assert_cmpint(ntohl(len), ==, VNET_HDR_LEN + sizeof(pkt));
+    for (i = 0; i < VNET_HDR_LEN; i++) {
+        g_assert_cmpint(buf[4 + i], ==, 0);
+    }
+    g_assert(memcmp(buf + 4 + VNET_HDR_LEN, pkt, sizeof(pkt)) == 0);
+}
+
+static void test_split_frame(void)
+{
+    uint8_t buf[4 + VNET_HDR_LEN + 200], pkt[200];
+    uint8_t *eth = buf + 4 + VNET_HDR_LEN;
+    uint32_t len;
+    RxDesc desc;
+    int i, half = 4 + VNET_HDR_LEN + 50;
+
+    /* an empty frame must not be taken for the end of the connection */
+    len = 0;
+    g_assert(write(conn_fd, &len, sizeof(len)) == sizeof(len));
+    g_usleep(50000);
+
+    memset(buf, 0, sizeof(buf));
+    len = htonl(sizeof(buf) - 4);
+    memcpy(buf, &len, sizeof(len));
+    memcpy(eth, (uint8_t[]) { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56,
+                              0x52, 0x54, 0x00, 0x12, 0x34, 0x57,
+                              0x08, 0x00 }, 14);
+    for (i = 14; i < sizeof(pkt); i++) {
+        eth[i] = i;
+    }
+
+    /* QEMU reads the rest of the frame in place once it knows its length */
+    g_assert(write(conn_fd, buf, half) == half);
+    g_usleep(50000);
+    g_assert(write(conn_fd, buf + half, sizeof(buf) - half) ==
+             sizeof(buf) - half);
+
+    /* the receive descriptors after those of test_gso_fallback */
+    desc = rx_wait(SEGS);
+    g_assert_cmpint(GUINT16_FROM_LE(desc.length), ==, sizeof(pkt));
+    memread(RX_BUF_ADDR + SEGS * RX_BUF_SIZE, pkt, sizeof(pkt));
+    g_assert(memcmp(pkt, eth, sizeof(pkt)) == 0);
+}
+
+static void listen_socket_init(void)
+{
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    g_assert(listen_fd >= 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    g_assert(bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    g_assert(getsockname(listen_fd, (struct sockaddr *)&addr, &addrlen) == 0);
+    g_assert(listen(listen_fd, 1) == 0);
+    listen_port = ntohs(addr.sin_port);
+}
+
+int main(int argc, char **argv)
+{
+    QTestState *s = NULL;
+    char *args;
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    listen_socket_init();
+    args = g_strdup_printf("-display none -m 64 "
+                           "-netdev socket,id=n0,connect=127.0.0.1:%d,"
+                           "vnet_hdr=on -device e1000,netdev=n0,addr=04.0",
+                           listen_port);
+    s = qtest_start(args);
+    g_free(args);
+
+    conn_fd = accept(listen_fd, NULL, NULL);
+    g_assert(conn_fd >= 0);
+    e1000_driver_init();
+
+    qtest_add_func("/net-socket/gso-fallback", test_gso_fallback);
+    qtest_add_func("/net-socket/tx-header", test_tx_header);
+    qtest_add_func("/net-socket/split-frame", test_split_frame);
+    ret = g_test_run();
+
+    if (s) {
+        qtest_quit(s);
+    }
+    close(conn_fd);
+    close(listen_fd);
+
+    return ret;
+}
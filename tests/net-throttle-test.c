@@ -0,0 +1,146 @@
+/*
+ * QTest testcase for netdev_set_throttle
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * The libqos e1000 driver transmits UDP datagrams to user networking,
+ * whose packet rate is limited.  The datagrams that slirp forwards to a
+ * socket of the test show how many packets passed the limit as the
+ * virtual clock advances.
+ */
+#include "libqos.h"
+
+#include <glib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define E1000_SLOT              4
+
+/* guest physical layout used by the driver */
+#define TX_RING_ADDR            0x100000
+#define TX_RING_SIZE            16
+#define PKT_ADDR                0x200000
+
+#define PAYLOAD_LEN             16
+#define PKT_LEN                 UDP_FRAME_LEN(PAYLOAD_LEN)
+
+static int host_fd;
+static uint16_t host_port;
+
+static void send_packet(void)
+{
+    qe1000_send(PKT_ADDR, PKT_LEN);
+}
+
+/* number of datagrams that reached the host socket */
+static int drain(void)
+{
+    uint8_t buf[PAYLOAD_LEN];
+    int n = 0;
+
+    while (recv(host_fd, buf, sizeof(buf), 0) == sizeof(buf)) {
+        n++;
+    }
+    g_assert(errno == EAGAIN || errno == EWOULDBLOCK);
+    return n;
+}
+
+static int64_t throttle_stat(const char *name)
+{
+    char *reply = qmp_reply("{ 'execute': 'query-netdev-throttle' }");
+    char *key = g_strdup_printf("\"%s\":", name);
+    char *p = strstr(reply, key);
+    int64_t val;
+
+    g_assert(p);
+    val = strtoll(p + strlen(key), NULL, 10);
+    g_free(key);
+    g_free(reply);
+
+    return val;
+}
+
+static void test_pps(void)
+{
+    char *reply;
+    int i;
+
+    qmp("{ 'execute': 'netdev_set_throttle', 'arguments': {"
+        "  'id': 'n0', 'bps': 0, 'pps': 10, 'pps_burst': 2 } }");
+
+    /* the burst goes through at once, the rest waits in the queue */
+    for (i = 0; i < 6; i++) {
+        send_packet();
+    }
+    g_assert_cmpint(drain(), ==, 2);
+    g_assert_cmpint(throttle_stat("tx_delayed"), ==, 4);
+    g_assert_cmpint(throttle_stat("tx_dropped"), ==, 0);
+
+    /* then one packet every 100 ms */
+    clock_step(50 * 1000 * 1000);
+    g_assert_cmpint(drain(), ==, 0);
+    clock_step(60 * 1000 * 1000);
+    g_assert_cmpint(drain(), ==, 1);
+    clock_step(1000 * 1000 * 1000);
+    g_assert_cmpint(drain(), ==, 3);
+
+    /* each packet was counted once, however often the queue was flushed */
+    g_assert_cmpint(throttle_stat("tx_delayed"), ==, 4);
+
+    qmp("{ 'execute': 'netdev_set_throttle', 'arguments': {"
+        "  'id': 'n0', 'bps': 0, 'pps': 0 } }");
+    reply = qmp_reply("{ 'execute': 'query-netdev-throttle' }");
+    g_assert(strstr(reply, "\"return\": []"));
+    g_free(reply);
+
+    for (i = 0; i < 6; i++) {
+        send_packet();
+    }
+    g_assert_cmpint(drain(), ==, 6);
+}
+
+static void host_socket_init(void)
+{
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+
+    host_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    g_assert(host_fd >= 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    g_assert(bind(host_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    g_assert(getsockname(host_fd, (struct sockaddr *)&addr, &addrlen) == 0);
+    host_port = ntohs(addr.sin_port);
+    fcntl(host_fd, F_SETFL, O_NONBLOCK);
+}
+
+int main(int argc, char **argv)
+{
+    QTestState *s = NULL;
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    host_socket_init();
+    s = qtest_start("-display none -m 64 -netdev user,id=n0 "
+                    "-device e1000,netdev=n0,addr=04.0");
+    qe1000_init_tx(E1000_SLOT, TX_RING_ADDR, TX_RING_SIZE);
+    qslirp_write_udp(PKT_ADDR, 40000, host_port, NULL, PAYLOAD_LEN);
+
+    qtest_add_func("/net-throttle/pps", test_pps);
+    ret = g_test_run();
+
+    if (s) {
+        qtest_quit(s);
+    }
+    close(host_fd);
+
+    return ret;
+}
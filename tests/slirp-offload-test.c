@@ -0,0 +1,376 @@
+/*
+ * QTest testcase for the offloads of user networking with vnet_hdr=on
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * The libqos virtio driver opens a TCP connection from the guest to a
+ * socket of the test through slirp's host address, 10.0.2.2, and sends
+ * data as a single TSO frame larger than the MTU, whose TCP checksum is
+ * left to the host (VIRTIO_NET_HDR_F_NEEDS_CSUM).  slirp must take it up
+ * the stack as one segment and the whole payload must reach the socket.
+ */
+#include "libqos.h"
+
+#include <glib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define VIRTIO_NET_SLOT         4
+#define VIRTIO_NET_IO_BASE      0xc000
+
+#define VIRTIO_NET_F_CSUM       0
+#define VIRTIO_NET_F_HOST_TSO4  11
+
+/* guest physical layout used by the driver */
+#define RX_VRING_ADDR           0x100000
+#define TX_VRING_ADDR           0x110000
+#define RX_HDR_ADDR             0x200000
+#define RX_BUF_ADDR             0x210000
+#define RX_BUF_SIZE             2048
+#define RX_BUFS                 8
+#define TX_HDR_ADDR             0x300000
+#define TX_FRAME_ADDR           0x310000
+#define TX_FRAME_STRIDE         0x2000
+
+/* struct virtio_net_hdr */
+#define VNET_HDR_LEN            10
+#define VNET_F_NEEDS_CSUM       1
+#define VNET_GSO_NONE           0
+#define VNET_GSO_TCPV4          1
+
+#define TH_SYN                  0x02
+#define TH_PUSH                 0x08
+#define TH_ACK                  0x10
+
+#define HDR_LEN                 (14 + 20 + 20)
+#define MSS                     1460
+#define PAYLOAD_LEN             4000    /* within slirp's receive window */
+#define GUEST_PORT              20000
+#define GUEST_ISS               1000
+
+static const uint8_t guest_mac[6] = { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 };
+static const uint8_t slirp_mac[6] = { 0x52, 0x55, 0x0a, 0x00, 0x02, 0x02 };
+
+static QVirtQueue rx = {
+    .io_base = VIRTIO_NET_IO_BASE,
+    .index = 0,
+    .addr = RX_VRING_ADDR,
+};
+static QVirtQueue tx = {
+    .io_base = VIRTIO_NET_IO_BASE,
+    .index = 1,
+    .addr = TX_VRING_ADDR,
+};
+static uint16_t rx_used;
+static int tx_count;
+
+static int listen_fd;
+static uint16_t host_port;
+
+static uint32_t checksum_add(uint32_t sum, const uint8_t *p, int len)
+{
+    int i;
+
+    for (i = 0; i + 1 < len; i += 2) {
+        sum += (p[i] << 8) | p[i + 1];
+    }
+    if (len & 1) {
+        sum += p[len - 1] << 8;
+    }
+    return sum;
+}
+
+static uint16_t checksum_fold(uint32_t sum)
+{
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return sum;
+}
+
+static void put_be16(uint8_t *p, uint16_t val)
+{
+    p[0] = val >> 8;
+    p[1] = val;
+}
+
+static void put_be32(uint8_t *p, uint32_t val)
+{
+    put_be16(p, val >> 16);
+    put_be16(p + 2, val);
+}
+
+static uint32_t get_be32(const uint8_t *p)
+{
+    return (p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+}
+
+/* wait for the used index of 'vq' to reach 'idx' */
+static void used_wait(QVirtQueue *vq, uint16_t idx)
+{
+    int tries;
+
+    for (tries = 0; tries < 5000; tries++) {
+        if ((int16_t)(qvring_used_idx(vq) - idx) >= 0) {
+            return;
+        }
+        g_usleep(1000);
+    }
+    g_assert_not_reached();
+}
+
+/*
+ * Transmit 'len' bytes at 'frame' behind a virtio_net_hdr, in a chain of
+ * two descriptors, and wait for the device to take them.
+ */
+static void send_frame(const uint8_t *frame, int len, uint8_t flags,
+                       uint8_t gso_type, uint16_t gso_size)
+{
+    uint8_t hdr[VNET_HDR_LEN];
+    uint64_t hdr_addr = TX_HDR_ADDR + (tx_count % 8) * 16;
+    uint64_t frame_addr = TX_FRAME_ADDR + (tx_count % 8) * TX_FRAME_STRIDE;
+    uint16_t head = (tx_count * 2) % tx.num;
+    uint16_t val;
+
+    g_assert_cmpint(len, <=, TX_FRAME_STRIDE);
+
+    /* flags, gso_type, hdr_len, gso_size, csum_start, csum_offset */
+    memset(hdr, 0, sizeof(hdr));
+    hdr[0] = flags;
+    hdr[1] = gso_type;
+    if (gso_type != VNET_GSO_NONE) {
+        val = GUINT16_TO_LE(HDR_LEN);
+        memcpy(hdr + 2, &val, 2);
+        val = GUINT16_TO_LE(gso_size);
+        memcpy(hdr + 4, &val, 2);
+    }
+    if (flags & VNET_F_NEEDS_CSUM) {
+        val = GUINT16_TO_LE(14 + 20);
+        memcpy(hdr + 6, &val, 2);
+        val = GUINT16_TO_LE(16);
+        memcpy(hdr + 8, &val, 2);
+    }
+    memwrite(hdr_addr, hdr, sizeof(hdr));
+    memwrite(frame_addr, frame, len);
+
+    qvring_write_desc(tx.addr, head, hdr_addr, sizeof(hdr),
+                      VRING_DESC_F_NEXT, head + 1);
+    qvring_write_desc(tx.addr, head + 1, frame_addr, len, 0, 0);
+    writew_le(qvring_avail(&tx) + 4 + (tx.avail_idx % tx.num) * 2, head);
+    qvirtqueue_kick(&tx, 1);
+
+    tx_count++;
+    used_wait(&tx, tx.avail_idx);
+}
+
+/* an ARP request for 10.0.2.2, from which slirp learns the guest MAC */
+static void send_arp(void)
+{
+    uint8_t frame[14 + 28];
+
+    memset(frame, 0, sizeof(frame));
+    memset(frame, 0xff, 6);
+    memcpy(frame + 6, guest_mac, 6);
+    put_be16(frame + 12, 0x0806);
+    put_be16(frame + 14, 1);                    /* Ethernet */
+    put_be16(frame + 16, 0x0800);               /* IPv4 */
+    frame[18] = 6;
+    frame[19] = 4;
+    put_be16(frame + 20, 1);                    /* request */
+    memcpy(frame + 22, guest_mac, 6);
+    memcpy(frame + 28, (uint8_t[]) { 10, 0, 2, 15 }, 4);
+    memcpy(frame + 38, (uint8_t[]) { 10, 0, 2, 2 }, 4);
+    send_frame(frame, sizeof(frame), 0, VNET_GSO_NONE, 0);
+}
+
+/*
+ * Write the Ethernet, IP and TCP headers of a segment from 10.0.2.15 to
+ * the host socket, carrying 'len' bytes of payload after them.  With
+ * 'partial', the TCP checksum field only holds the pseudo-header sum, as
+ * a guest that offloads it leaves it.
+ */
+static void build_tcp(uint8_t *frame, uint32_t seq, uint32_t ack,
+                      uint8_t th_flags, int len, bool partial)
+{
+    uint8_t *ip = frame + 14, *th = ip + 20;
+    uint32_t sum;
+
+    memcpy(frame, slirp_mac, 6);
+    memcpy(frame + 6, guest_mac, 6);
+    put_be16(frame + 12, 0x0800);
+
+    memset(ip, 0, 20);
+    ip[0] = 0x45;
+    put_be16(ip + 2, 20 + 20 + len);
+    ip[8] = 64;                                 /* TTL */
+    ip[9] = IPPROTO_TCP;
+    memcpy(ip + 12, (uint8_t[]) { 10, 0, 2, 15 }, 4);
+    memcpy(ip + 16, (uint8_t[]) { 10, 0, 2, 2 }, 4);
+    put_be16(ip + 10, ~checksum_fold(checksum_add(0, ip, 20)));
+
+    memset(th, 0, 20);
+    put_be16(th, GUEST_PORT);
+    put_be16(th + 2, host_port);
+    put_be32(th + 4, seq);
+    put_be32(th + 8, ack);
+    th[12] = 5 << 4;
+    th[13] = th_flags;
+    put_be16(th + 14, 65535);
+
+    /* pseudo-header */
+    sum = checksum_add(0, ip + 12, 8) + IPPROTO_TCP + 20 + len;
+    if (partial) {
+        put_be16(th + 16, checksum_fold(sum));
+    } else {
+        sum = checksum_add(sum, th, 20 + len);
+        put_be16(th + 16, ~checksum_fold(sum));
+    }
+}
+
+static void rx_init(void)
+{
+    int i;
+
+    /* the header in a descriptor of its own, as without MRG_RXBUF */
+    for (i = 0; i < RX_BUFS; i++) {
+        qvring_write_desc(rx.addr, 2 * i, RX_HDR_ADDR + i * 16, VNET_HDR_LEN,
+                          VRING_DESC_F_WRITE | VRING_DESC_F_NEXT, 2 * i + 1);
+        qvring_write_desc(rx.addr, 2 * i + 1, RX_BUF_ADDR + i * RX_BUF_SIZE,
+                          RX_BUF_SIZE, VRING_DESC_F_WRITE, 0);
+        writew_le(qvring_avail(&rx) + 4 + i * 2, 2 * i);
+    }
+    qvirtqueue_kick(&rx, RX_BUFS);
+}
+
+/*
+ * Wait for slirp to answer the SYN, skipping the ARP reply, and return
+ * its initial sequence number and window.
+ */
+static void rx_wait_syn_ack(uint32_t *iss, uint16_t *win)
+{
+    uint8_t frame[HDR_LEN];
+    uint32_t id;
+
+    for (;;) {
+        g_assert_cmpint(rx_used, <, RX_BUFS);
+        used_wait(&rx, rx_used + 1);
+        id = readl_le(qvring_used(&rx) + 4 + rx_used * 8);
+        rx_used++;
+
+        memread(RX_BUF_ADDR + (id / 2) * RX_BUF_SIZE, frame, sizeof(frame));
+        if (frame[12] == 0x08 && frame[13] == 0x00 &&
+            frame[14 + 9] == IPPROTO_TCP &&
+            (frame[14 + 20 + 13] & (TH_SYN | TH_ACK)) == (TH_SYN | TH_ACK)) {
+            break;
+        }
+    }
+
+    /* no IP options from slirp */
+    g_assert_cmphex(frame[14], ==, 0x45);
+    g_assert_cmpuint(get_be32(frame + 14 + 20 + 8), ==, GUEST_ISS + 1);
+    *iss = get_be32(frame + 14 + 20 + 4);
+    *win = (frame[14 + 20 + 14] << 8) | frame[14 + 20 + 15];
+}
+
+static void test_tso(void)
+{
+    uint8_t *frame = g_malloc(HDR_LEN + PAYLOAD_LEN);
+    uint8_t *payload = frame + HDR_LEN;
+    uint8_t *buf = g_malloc(PAYLOAD_LEN);
+    struct timeval tv = { .tv_sec = 5 };
+    uint32_t iss;
+    uint16_t win;
+    int fd, i;
+
+    send_arp();
+
+    build_tcp(frame, GUEST_ISS, 0, TH_SYN, 0, false);
+    send_frame(frame, HDR_LEN, 0, VNET_GSO_NONE, 0);
+    rx_wait_syn_ack(&iss, &win);
+    g_assert_cmpint(win, >=, PAYLOAD_LEN);
+
+    fd = accept(listen_fd, NULL, NULL);
+    g_assert_cmpint(fd, >=, 0);
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    /* the ACK of the handshake carries the data, as one TSO frame */
+    for (i = 0; i < PAYLOAD_LEN; i++) {
+        payload[i] = i * 7;
+    }
+    build_tcp(frame, GUEST_ISS + 1, iss + 1, TH_ACK | TH_PUSH,
+              PAYLOAD_LEN, true);
+    send_frame(frame, HDR_LEN + PAYLOAD_LEN, VNET_F_NEEDS_CSUM,
+               VNET_GSO_TCPV4, MSS);
+
+    g_assert_cmpint(recv(fd, buf, PAYLOAD_LEN, MSG_WAITALL), ==,
+                    PAYLOAD_LEN);
+    g_assert(memcmp(buf, payload, PAYLOAD_LEN) == 0);
+
+    close(fd);
+    g_free(buf);
+    g_free(frame);
+}
+
+static void host_socket_init(void)
+{
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+
+    listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    g_assert_cmpint(listen_fd, >=, 0);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    g_assert_cmpint(bind(listen_fd, (struct sockaddr *)&addr,
+                         sizeof(addr)), ==, 0);
+    g_assert_cmpint(listen(listen_fd, 1), ==, 0);
+    g_assert_cmpint(getsockname(listen_fd, (struct sockaddr *)&addr,
+                                &len), ==, 0);
+    host_port = ntohs(addr.sin_port);
+}
+
+static void virtio_net_driver_init(void)
+{
+    uint32_t features;
+
+    qvirtio_pci_init(VIRTIO_NET_SLOT, VIRTIO_NET_IO_BASE);
+    features = inl(VIRTIO_NET_IO_BASE + VIRTIO_PCI_HOST_FEATURES);
+    g_assert(features & (1 << VIRTIO_NET_F_CSUM));
+    g_assert(features & (1 << VIRTIO_NET_F_HOST_TSO4));
+    outl(VIRTIO_NET_IO_BASE + VIRTIO_PCI_GUEST_FEATURES,
+         (1 << VIRTIO_NET_F_CSUM) | (1 << VIRTIO_NET_F_HOST_TSO4));
+    qvirtqueue_init(&rx);
+    qvirtqueue_init(&tx);
+    qvirtio_pci_driver_ok(VIRTIO_NET_IO_BASE);
+    rx_init();
+}
+
+int main(int argc, char **argv)
+{
+    QTestState *s = NULL;
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    host_socket_init();
+    s = qtest_start("-display none -m 64 "
+                    "-netdev user,id=n0,vnet_hdr=on "
+                    "-device virtio-net-pci,netdev=n0,addr=04.0");
+    virtio_net_driver_init();
+
+    qtest_add_func("/slirp/offload/tso", test_tso);
+    ret = g_test_run();
+
+    if (s) {
+        qtest_quit(s);
+    }
+    close(listen_fd);
+
+    return ret;
+}
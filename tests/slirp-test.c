@@ -0,0 +1,181 @@
+/*
+ * QTest testcase and benchmark for the slirp socket tables
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * The libqos e1000 driver transmits UDP datagrams to user networking.
+ * Every guest source port is a flow of its own, for which slirp opens a
+ * host socket; the datagrams arrive at a socket of the test, whose source
+ * port tells the flows apart.  With "-m perf" the datagrams of many flows
+ * are interleaved and the cost per datagram is reported as the number of
+ * flows grows.
+ */
+#include "libqos.h"
+
+#include <glib.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#define E1000_SLOT              4
+
+/* guest physical layout used by the driver */
+#define TX_RING_ADDR            0x100000
+#define TX_RING_SIZE            256
+#define TX_BATCH                (TX_RING_SIZE / 2)
+#define PKT_ADDR                0x200000
+#define PKT_STRIDE              128
+
+#define GUEST_PORT_BASE         10000
+#define PAYLOAD_LEN             16
+#define PKT_LEN                 UDP_FRAME_LEN(PAYLOAD_LEN)
+
+#define MAX_FLOWS               512
+#define PERF_PACKETS            (64 * TX_BATCH)
+
+static int host_fd;
+static uint16_t host_port;
+
+/* write the frame of flow 'flow', from 10.0.2.15 to the host socket */
+static void write_packet(int flow)
+{
+    uint8_t payload[PAYLOAD_LEN];
+
+    memset(payload, 0, sizeof(payload));
+    memcpy(payload, &flow, sizeof(flow));
+    qslirp_write_udp(PKT_ADDR + flow * PKT_STRIDE, GUEST_PORT_BASE + flow,
+                     host_port, payload, sizeof(payload));
+}
+
+/* transmit one batch, the i-th datagram from flow (first + i) % flows */
+static void send_batch(int first, int flows)
+{
+    uint64_t addr[TX_BATCH];
+    int i;
+
+    for (i = 0; i < TX_BATCH; i++) {
+        addr[i] = PKT_ADDR + ((first + i) % flows) * PKT_STRIDE;
+    }
+    qe1000_send_batch(addr, TX_BATCH, PKT_LEN);
+}
+
+/* the host port of the slirp socket for each flow that sent something */
+static int drain(uint16_t *ports, int flows)
+{
+    struct sockaddr_in addr;
+    socklen_t addrlen;
+    int flow, n = 0;
+
+    for (;;) {
+        addrlen = sizeof(addr);
+        if (recvfrom(host_fd, &flow, sizeof(flow), 0,
+                     (struct sockaddr *)&addr, &addrlen) != sizeof(flow)) {
+            g_assert(errno == EAGAIN || errno == EWOULDBLOCK);
+            return n;
+        }
+        g_assert_cmpint(flow, >=, 0);
+        g_assert_cmpint(flow, <, flows);
+        ports[flow] = ntohs(addr.sin_port);
+        n++;
+    }
+}
+
+static void test_flows(void)
+{
+    uint16_t first[TX_BATCH], again[TX_BATCH];
+    int flows = 8, i, j;
+
+    send_batch(0, flows);
+    g_assert_cmpint(drain(first, flows), ==, TX_BATCH);
+    send_batch(0, flows);
+    g_assert_cmpint(drain(again, flows), ==, TX_BATCH);
+
+    /* one host socket per flow, found again by the second batch */
+    for (i = 0; i < flows; i++) {
+        g_assert_cmpint(first[i], ==, again[i]);
+        for (j = 0; j < i; j++) {
+            g_assert_cmpint(first[i], !=, first[j]);
+        }
+    }
+}
+
+static void bench_flows(int flows)
+{
+    double elapsed;
+    int i;
+
+    /* let slirp open the sockets first */
+    send_batch(0, flows);
+    for (i = TX_BATCH; i < flows; i += TX_BATCH) {
+        send_batch(i, flows);
+    }
+
+    g_test_timer_start();
+    for (i = 0; i < PERF_PACKETS; i += TX_BATCH) {
+        send_batch(i, flows);
+    }
+    elapsed = g_test_timer_elapsed();
+
+    g_test_minimized_result(elapsed * 1e6 / PERF_PACKETS,
+                            "%d flows: %.2f us per datagram",
+                            flows, elapsed * 1e6 / PERF_PACKETS);
+}
+
+static void test_perf(void)
+{
+    int flows;
+
+    for (flows = 1; flows <= MAX_FLOWS; flows *= 8) {
+        bench_flows(flows);
+    }
+}
+
+static void host_socket_init(void)
+{
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+
+    host_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    g_assert(host_fd >= 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    g_assert(bind(host_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0);
+    g_assert(getsockname(host_fd, (struct sockaddr *)&addr, &addrlen) == 0);
+    host_port = ntohs(addr.sin_port);
+    fcntl(host_fd, F_SETFL, O_NONBLOCK);
+}
+
+int main(int argc, char **argv)
+{
+    QTestState *s = NULL;
+    int i, ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    host_socket_init();
+    s = qtest_start("-display none -m 64 -netdev user,id=n0 "
+                    "-device e1000,netdev=n0,addr=04.0");
+    qe1000_init_tx(E1000_SLOT, TX_RING_ADDR, TX_RING_SIZE);
+    for (i = 0; i < MAX_FLOWS; i++) {
+        write_packet(i);
+    }
+
+    qtest_add_func("/slirp/flows", test_flows);
+    if (g_test_perf()) {
+        qtest_add_func("/slirp/perf", test_perf);
+    }
+    ret = g_test_run();
+
+    if (s) {
+        qtest_quit(s);
+    }
+    close(host_fd);
+
+    return ret;
+}
@@ -0,0 +1,182 @@
+/*
+ * Receive-side scaling hash and steering
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * The expected hashes are the verification suite of the Microsoft RSS
+ * specification, which uses the default key.
+ */
+#include <glib.h>
+#include "qemu-common.h"
+#include "net/rss.h"
+
+typedef struct {
+    uint8_t src[4], dst[4];
+    uint16_t sport, dport;
+    uint32_t hash_ip, hash_tcp;
+} RssIPv4Vector;
+
+static const RssIPv4Vector ipv4_vectors[] = {
+    { { 66, 9, 149, 187 }, { 161, 142, 100, 80 }, 2794, 1766,
+      0x323e8fc2, 0x51ccc178 },
+    { { 199, 92, 111, 2 }, { 65, 69, 140, 83 }, 14230, 4739,
+      0xd718262a, 0xc626b0ea },
+    { { 24, 19, 198, 95 }, { 12, 22, 207, 184 }, 12898, 38024,
+      0xd2d0a5de, 0x5c2b394a },
+    { { 38, 27, 205, 30 }, { 209, 142, 163, 6 }, 48228, 2217,
+      0x82989176, 0xafc7327f },
+    { { 153, 39, 163, 191 }, { 202, 188, 127, 2 }, 44251, 1303,
+      0x5d1809c5, 0x10e828a2 },
+};
+
+/* an Ethernet frame with an IPv4 header and the first bytes of TCP */
+static size_t ipv4_frame(uint8_t *frame, const RssIPv4Vector *v,
+                         uint8_t proto)
+{
+    uint8_t *ip = frame + 14, *th = ip + 20;
+
+    memset(frame, 0, 14 + 20 + 20);
+    frame[12] = 0x08;
+    ip[0] = 0x45;
+    ip[9] = proto;
+    memcpy(ip + 12, v->src, 4);
+    memcpy(ip + 16, v->dst, 4);
+    th[0] = v->sport >> 8;
+    th[1] = v->sport;
+    th[2] = v->dport >> 8;
+    th[3] = v->dport;
+    return 14 + 20 + 20;
+}
+
+static void test_toeplitz(void)
+{
+    uint8_t input[12];
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(ipv4_vectors); i++) {
+        const RssIPv4Vector *v = &ipv4_vectors[i];
+
+        memcpy(input, v->src, 4);
+        memcpy(input + 4, v->dst, 4);
+        input[8] = v->sport >> 8;
+        input[9] = v->sport;
+        input[10] = v->dport >> 8;
+        input[11] = v->dport;
+        g_assert_cmphex(net_rss_toeplitz(net_rss_default_key, input, 8), ==,
+                        v->hash_ip);
+        g_assert_cmphex(net_rss_toeplitz(net_rss_default_key, input, 12), ==,
+                        v->hash_tcp);
+    }
+}
+
+static void test_hash_ipv4(void)
+{
+    uint8_t frame[64];
+    uint32_t hash;
+    size_t size;
+    int i;
+
+    for (i = 0; i < ARRAY_SIZE(ipv4_vectors); i++) {
+        const RssIPv4Vector *v = &ipv4_vectors[i];
+
+        size = ipv4_frame(frame, v, 6);
+        g_assert(net_rss_hash(net_rss_default_key, frame, size, &hash));
+        g_assert_cmphex(hash, ==, v->hash_tcp);
+
+        /* ICMP and fragments only hash the addresses */
+        size = ipv4_frame(frame, v, 1);
+        g_assert(net_rss_hash(net_rss_default_key, frame, size, &hash));
+        g_assert_cmphex(hash, ==, v->hash_ip);
+
+        size = ipv4_frame(frame, v, 6);
+        frame[14 + 6] = 0x20;
+        g_assert(net_rss_hash(net_rss_default_key, frame, size, &hash));
+        g_assert_cmphex(hash, ==, v->hash_ip);
+    }
+
+    /* ARP is not hashed */
+    frame[12] = 0x08;
+    frame[13] = 0x06;
+    g_assert(!net_rss_hash(net_rss_default_key, frame, size, &hash));
+}
+
+static void test_hash_ipv6(void)
+{
+    static const uint8_t src[16] = {
+        0x3f, 0xfe, 0x25, 0x01, 0x02, 0x00, 0x1f, 0xff,
+        0, 0, 0, 0, 0, 0, 0, 7,
+    };
+    static const uint8_t dst[16] = {
+        0x3f, 0xfe, 0x25, 0x01, 0x02, 0x00, 0x00, 0x03,
+        0, 0, 0, 0, 0, 0, 0, 1,
+    };
+    uint8_t frame[14 + 40 + 20];
+    uint8_t *ip = frame + 14, *th = ip + 40;
+    uint32_t hash;
+
+    memset(frame, 0, sizeof(frame));
+    frame[12] = 0x86;
+    frame[13] = 0xdd;
+    ip[0] = 0x60;
+    ip[6] = 6;
+    memcpy(ip + 8, src, 16);
+    memcpy(ip + 24, dst, 16);
+    th[0] = 2794 >> 8;
+    th[1] = 2794 & 0xff;
+    th[2] = 1766 >> 8;
+    th[3] = 1766 & 0xff;
+
+    g_assert(net_rss_hash(net_rss_default_key, frame, sizeof(frame), &hash));
+    g_assert_cmphex(hash, ==, 0x40207d3d);
+
+    ip[6] = 58;                                 /* ICMPv6 */
+    g_assert(net_rss_hash(net_rss_default_key, frame, sizeof(frame), &hash));
+    g_assert_cmphex(hash, ==, 0x2cc18cd5);
+}
+
+static void test_steer(void)
+{
+    uint8_t frame[64], table[NET_RSS_TABLE_SIZE];
+    NetRss *rss;
+    size_t size;
+    int i, queue;
+
+    /* queue 3 for the entry of the first flow, 0 elsewhere */
+    memset(table, 0, sizeof(table));
+    table[ipv4_vectors[0].hash_tcp % NET_RSS_TABLE_SIZE] = 3;
+    rss = net_rss_new(4, NULL, table);
+
+    for (i = 0; i < ARRAY_SIZE(ipv4_vectors); i++) {
+        size = ipv4_frame(frame, &ipv4_vectors[i], 6);
+        queue = net_rss_steer(rss, frame, size);
+        g_assert_cmpint(queue, ==, rss->table[rss->hash % 128]);
+        g_assert_cmphex(rss->hash, ==, ipv4_vectors[i].hash_tcp);
+    }
+    g_assert_cmpint(rss->stats[3].packets, ==, 1);
+    g_assert_cmpint(rss->stats[0].packets, ==, ARRAY_SIZE(ipv4_vectors) - 1);
+    g_assert_cmpint(rss->stats[0].bytes, ==,
+                    (ARRAY_SIZE(ipv4_vectors) - 1) * size);
+
+    frame[13] = 0x06;
+    g_assert_cmpint(net_rss_steer(rss, frame, size), ==, rss->table[0]);
+    g_assert_cmpint(rss->unhashed, ==, 1);
+    net_rss_free(rss);
+
+    /* the default table spreads the entries round robin */
+    rss = net_rss_new(3, NULL, NULL);
+    for (i = 0; i < NET_RSS_TABLE_SIZE; i++) {
+        g_assert_cmpint(rss->table[i], ==, i % 3);
+    }
+    net_rss_free(rss);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/rss/toeplitz", test_toeplitz);
+    g_test_add_func("/rss/hash-ipv4", test_hash_ipv4);
+    g_test_add_func("/rss/hash-ipv6", test_hash_ipv6);
+    g_test_add_func("/rss/steer", test_steer);
+    return g_test_run();
+}
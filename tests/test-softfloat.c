@@ -0,0 +1,315 @@
+/*
+ * softfloat host FPU fast path unit-tests.
+ *
+ * This work is licensed under the terms of the GNU LGPL, version 2 or later.
+ * See the COPYING.LIB file in the top-level directory.
+ *
+ * Every operation is computed twice, once with the host FPU fast path
+ * enabled and once in software only, and both the result and the
+ * exception flags must be identical.
+ */
+
+#include <glib.h>
+#include "qemu-common.h"
+
+/* Build softfloat with its default (non target-specific) NaN handling.  */
+#define SOFTFLOAT_TEST
+#include "fpu/softfloat.c"
+
+#define RANDOM_ITERATIONS 200000
+#define PERF_ITERATIONS   20000000
+
+enum {
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_MULADD,
+    OP_SQRT,
+    OP_COUNT
+};
+
+static const char *op_names[OP_COUNT] = {
+    "add", "sub", "mul", "div", "muladd", "sqrt"
+};
+
+static const uint32_t f32_edge[] = {
+    0x00000000, 0x80000000,                 /* zeros */
+    0x00000001, 0x807fffff,                 /* denormals */
+    0x00800000, 0x80800000, 0x00800001,     /* smallest normals */
+    0x3f800000, 0xbf800000, 0x3f800001,     /* +-1 and next */
+    0x40490fdb, 0x3eaaaaab,                 /* pi, 1/3 */
+    0x7f7fffff, 0xff7fffff, 0x7f000000,     /* largest normals */
+    0x7f800000, 0xff800000,                 /* infinities */
+    0x7fc00000, 0x7fa00000,                 /* quiet and signaling NaN */
+    0x1f800000, 0x5f800000,                 /* 2^-64, 2^64 */
+};
+
+static const uint64_t f64_edge[] = {
+    0x0000000000000000ULL, 0x8000000000000000ULL,
+    0x0000000000000001ULL, 0x800fffffffffffffULL,
+    0x0010000000000000ULL, 0x8010000000000000ULL, 0x0010000000000001ULL,
+    0x3ff0000000000000ULL, 0xbff0000000000000ULL, 0x3ff0000000000001ULL,
+    0x400921fb54442d18ULL, 0x3fd5555555555555ULL,
+    0x7fefffffffffffffULL, 0xffefffffffffffffULL, 0x7fe0000000000000ULL,
+    0x7ff0000000000000ULL, 0xfff0000000000000ULL,
+    0x7ff8000000000000ULL, 0x7ff4000000000000ULL,
+    0x1ff0000000000000ULL, 0x5ff0000000000000ULL,
+};
+
+static const int initial_flags[] = {
+    0,
+    float_flag_inexact,
+    float_flag_inexact | float_flag_underflow,
+};
+
+static float32 f32_op(int op, float32 a, float32 b, float32 c,
+                      float_status *s)
+{
+    switch (op) {
+    case OP_ADD:
+        return float32_add(a, b, s);
+    case OP_SUB:
+        return float32_sub(a, b, s);
+    case OP_MUL:
+        return float32_mul(a, b, s);
+    case OP_DIV:
+        return float32_div(a, b, s);
+    case OP_MULADD:
+        return float32_muladd(a, b, c, 0, s);
+    case OP_SQRT:
+        return float32_sqrt(a, s);
+    }
+    g_assert_not_reached();
+}
+
+static float64 f64_op(int op, float64 a, float64 b, float64 c,
+                      float_status *s)
+{
+    switch (op) {
+    case OP_ADD:
+        return float64_add(a, b, s);
+    case OP_SUB:
+        return float64_sub(a, b, s);
+    case OP_MUL:
+        return float64_mul(a, b, s);
+    case OP_DIV:
+        return float64_div(a, b, s);
+    case OP_MULADD:
+        return float64_muladd(a, b, c, 0, s);
+    case OP_SQRT:
+        return float64_sqrt(a, s);
+    }
+    g_assert_not_reached();
+}
+
+static void init_status(float_status *s, int rounding, int flags, flag ftz)
+{
+    memset(s, 0, sizeof(*s));
+    set_float_rounding_mode(rounding, s);
+    set_float_exception_flags(flags, s);
+    set_flush_to_zero(ftz, s);
+}
+
+static void check_f32(int op, uint32_t a, uint32_t b, uint32_t c)
+{
+    float_status hs, ss;
+    float32 hr, sr;
+    int i, ftz;
+
+    for (i = 0; i < ARRAY_SIZE(initial_flags); i++) {
+        for (ftz = 0; ftz < 2; ftz++) {
+            init_status(&hs, float_round_nearest_even, initial_flags[i], ftz);
+            init_status(&ss, float_round_nearest_even, initial_flags[i], ftz);
+
+            float_host_fpu_enabled = 1;
+            hr = f32_op(op, make_float32(a), make_float32(b),
+                        make_float32(c), &hs);
+            float_host_fpu_enabled = 0;
+            sr = f32_op(op, make_float32(a), make_float32(b),
+                        make_float32(c), &ss);
+
+            if (float32_val(hr) != float32_val(sr) ||
+                get_float_exception_flags(&hs) !=
+                get_float_exception_flags(&ss)) {
+                g_test_message("float32_%s(%08x, %08x, %08x): "
+                               "host %08x/%02x soft %08x/%02x",
+                               op_names[op], a, b, c,
+                               float32_val(hr), get_float_exception_flags(&hs),
+                               float32_val(sr), get_float_exception_flags(&ss));
+                g_assert_not_reached();
+            }
+        }
+    }
+}
+
+static void check_f64(int op, uint64_t a, uint64_t b, uint64_t c)
+{
+    float_status hs, ss;
+    float64 hr, sr;
+    int i, ftz;
+
+    for (i = 0; i < ARRAY_SIZE(initial_flags); i++) {
+        for (ftz = 0; ftz < 2; ftz++) {
+            init_status(&hs, float_round_nearest_even, initial_flags[i], ftz);
+            init_status(&ss, float_round_nearest_even, initial_flags[i], ftz);
+
+            float_host_fpu_enabled = 1;
+            hr = f64_op(op, make_float64(a), make_float64(b),
+                        make_float64(c), &hs);
+            float_host_fpu_enabled = 0;
+            sr = f64_op(op, make_float64(a), make_float64(b),
+                        make_float64(c), &ss);
+
+            if (float64_val(hr) != float64_val(sr) ||
+                get_float_exception_flags(&hs) !=
+                get_float_exception_flags(&ss)) {
+                g_test_message("float64_%s(%016" PRIx64 ", %016" PRIx64
+                               ", %016" PRIx64 "): host %016" PRIx64
+                               "/%02x soft %016" PRIx64 "/%02x",
+                               op_names[op], a, b, c,
+                               float64_val(hr), get_float_exception_flags(&hs),
+                               float64_val(sr), get_float_exception_flags(&ss));
+                g_assert_not_reached();
+            }
+        }
+    }
+}
+
+/* Random operands biased towards exponents that overflow or underflow.  */
+static uint32_t f32_random(void)
+{
+    uint32_t v = g_test_rand_int();
+
+    switch (g_test_rand_int_range(0, 4)) {
+    case 0:
+        return (v & 0x807fffff) | (g_test_rand_int_range(0, 8) << 23);
+    case 1:
+        return (v & 0x807fffff) | (g_test_rand_int_range(0xf6, 0xff) << 23);
+    default:
+        return v;
+    }
+}
+
+static uint64_t f64_random(void)
+{
+    uint64_t v = ((uint64_t)g_test_rand_int() << 32) | g_test_rand_int();
+
+    switch (g_test_rand_int_range(0, 4)) {
+    case 0:
+        return (v & 0x800fffffffffffffULL) |
+               ((uint64_t)g_test_rand_int_range(0, 0x40) << 52);
+    case 1:
+        return (v & 0x800fffffffffffffULL) |
+               ((uint64_t)g_test_rand_int_range(0x7c0, 0x7ff) << 52);
+    default:
+        return v;
+    }
+}
+
+static void test_float32_edge(void)
+{
+    int op, i, j, k;
+
+    for (op = 0; op < OP_COUNT; op++) {
+        for (i = 0; i < ARRAY_SIZE(f32_edge); i++) {
+            for (j = 0; j < ARRAY_SIZE(f32_edge); j++) {
+                for (k = 0; k < ARRAY_SIZE(f32_edge); k++) {
+                    check_f32(op, f32_edge[i], f32_edge[j], f32_edge[k]);
+                }
+            }
+        }
+    }
+}
+
+static void test_float64_edge(void)
+{
+    int op, i, j, k;
+
+    for (op = 0; op < OP_COUNT; op++) {
+        for (i = 0; i < ARRAY_SIZE(f64_edge); i++) {
+            for (j = 0; j < ARRAY_SIZE(f64_edge); j++) {
+                for (k = 0; k < ARRAY_SIZE(f64_edge); k++) {
+                    check_f64(op, f64_edge[i], f64_edge[j], f64_edge[k]);
+                }
+            }
+        }
+    }
+}
+
+static void test_float32_random(void)
+{
+    int op, i;
+
+    for (op = 0; op < OP_COUNT; op++) {
+        for (i = 0; i < RANDOM_ITERATIONS; i++) {
+            check_f32(op, f32_random(), f32_random(), f32_random());
+        }
+    }
+}
+
+static void test_float64_random(void)
+{
+    int op, i;
+
+    for (op = 0; op < OP_COUNT; op++) {
+        for (i = 0; i < RANDOM_ITERATIONS; i++) {
+            check_f64(op, f64_random(), f64_random(), f64_random());
+        }
+    }
+}
+
+/* Sustained throughput of both paths on normal operands.  */
+static void test_perf(void)
+{
+    float_status s;
+    float64 a64 = make_float64(0x3ff0000000000001ULL);
+    float64 b64 = make_float64(0x3fefffffffffffffULL);
+    float32 a32 = make_float32(0x3f800001);
+    float32 b32 = make_float32(0x3f7fffff);
+    int op, host, i;
+
+    for (host = 0; host < 2; host++) {
+        float_host_fpu_enabled = host;
+        for (op = 0; op < OP_COUNT; op++) {
+            float32 r32 = a32;
+            float64 r64 = a64;
+            double t32, t64;
+
+            init_status(&s, float_round_nearest_even, float_flag_inexact, 0);
+            g_test_timer_start();
+            for (i = 0; i < PERF_ITERATIONS; i++) {
+                r32 = f32_op(op, r32, b32, a32, &s);
+                r32 = f32_op(op, r32, a32, b32, &s);
+            }
+            t32 = g_test_timer_elapsed();
+
+            g_test_timer_start();
+            for (i = 0; i < PERF_ITERATIONS; i++) {
+                r64 = f64_op(op, r64, b64, a64, &s);
+                r64 = f64_op(op, r64, a64, b64, &s);
+            }
+            t64 = g_test_timer_elapsed();
+
+            g_test_minimized_result(t32 + t64, "%s %s: float32 %.1f Mops/s, "
+                                    "float64 %.1f Mops/s",
+                                    host ? "host" : "soft", op_names[op],
+                                    2 * PERF_ITERATIONS / t32 / 1e6,
+                                    2 * PERF_ITERATIONS / t64 / 1e6);
+        }
+    }
+    float_host_fpu_enabled = 1;
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/softfloat/float32/edge", test_float32_edge);
+    g_test_add_func("/softfloat/float64/edge", test_float64_edge);
+    g_test_add_func("/softfloat/float32/random", test_float32_random);
+    g_test_add_func("/softfloat/float64/random", test_float64_random);
+    if (g_test_perf()) {
+        g_test_add_func("/softfloat/perf", test_perf);
+    }
+    return g_test_run();
+}
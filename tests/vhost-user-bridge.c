@@ -0,0 +1,605 @@
+/*
+ * vhost-user loopback backend
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * Listens on a unix socket for one QEMU started with
+ * "-netdev vhost-user,path=..." and sends every packet the guest
+ * transmits back to its receive queue, so that the throughput of the
+ * virtio-net rings can be measured without a host network stack: run a
+ * packet generator in the guest and count what comes back.  The packet
+ * and byte rates are printed every second.
+ *
+ *   make tests/vhost-user-bridge
+ *   tests/vhost-user-bridge /tmp/vhost.sock
+ *
+ * No offloads or optional ring features are negotiated: every packet is
+ * a 10-byte virtio_net_hdr followed by the frame, in direct descriptors.
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define VHOST_MEMORY_MAX_NREGIONS   8
+
+enum {
+    VHOST_USER_GET_FEATURES = 1,
+    VHOST_USER_SET_FEATURES = 2,
+    VHOST_USER_SET_OWNER = 3,
+    VHOST_USER_RESET_OWNER = 4,
+    VHOST_USER_SET_MEM_TABLE = 5,
+    VHOST_USER_SET_LOG_BASE = 6,
+    VHOST_USER_SET_LOG_FD = 7,
+    VHOST_USER_SET_VRING_NUM = 8,
+    VHOST_USER_SET_VRING_ADDR = 9,
+    VHOST_USER_SET_VRING_BASE = 10,
+    VHOST_USER_GET_VRING_BASE = 11,
+    VHOST_USER_SET_VRING_KICK = 12,
+    VHOST_USER_SET_VRING_CALL = 13,
+    VHOST_USER_SET_VRING_ERR = 14,
+};
+
+#define VHOST_USER_VERSION          0x1
+#define VHOST_USER_REPLY_MASK       (0x1 << 2)
+#define VHOST_USER_VRING_IDX_MASK   0xff
+#define VHOST_USER_VRING_NOFD_MASK  (0x1 << 8)
+
+typedef struct VhostUserMemoryRegion {
+    uint64_t guest_phys_addr;
+    uint64_t memory_size;
+    uint64_t userspace_addr;
+    uint64_t mmap_offset;
+} VhostUserMemoryRegion;
+
+typedef struct VhostUserMsg {
+    uint32_t request;
+    uint32_t flags;
+    uint32_t size;
+    union {
+        uint64_t u64;
+        struct {
+            uint32_t index;
+            uint32_t num;
+        } state;
+        struct {
+            uint32_t index;
+            uint32_t flags;
+            uint64_t desc_user_addr;
+            uint64_t used_user_addr;
+            uint64_t avail_user_addr;
+            uint64_t log_guest_addr;
+        } addr;
+        struct {
+            uint32_t nregions;
+            uint32_t padding;
+            VhostUserMemoryRegion regions[VHOST_MEMORY_MAX_NREGIONS];
+        } memory;
+    } payload;
+} __attribute__((packed)) VhostUserMsg;
+
+#define VHOST_USER_HDR_SIZE     offsetof(VhostUserMsg, payload)
+
+/* split virtqueue layout, in guest (little endian) byte order */
+#define VRING_DESC_F_NEXT           1
+#define VRING_DESC_F_WRITE          2
+#define VRING_AVAIL_F_NO_INTERRUPT  1
+
+typedef struct VRingDesc {
+    uint64_t addr;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} VRingDesc;
+
+typedef struct VRingAvail {
+    uint16_t flags;
+    uint16_t idx;
+    uint16_t ring[];
+} VRingAvail;
+
+typedef struct VRingUsedElem {
+    uint32_t id;
+    uint32_t len;
+} VRingUsedElem;
+
+typedef struct VRingUsed {
+    uint16_t flags;
+    uint16_t idx;
+    VRingUsedElem ring[];
+} VRingUsed;
+
+#define VIRTIO_NET_HDR_LEN      10
+#define MAX_PACKET              (VIRTIO_NET_HDR_LEN + 65536)
+
+#define RX_VQ                   0
+#define TX_VQ                   1
+
+typedef struct MemRegion {
+    uint64_t gpa;
+    uint64_t size;
+    uint64_t qemu_addr;
+    uint8_t *mmap_addr;         /* start of the file mapping */
+    uint64_t mmap_size;
+    uint64_t mmap_offset;
+} MemRegion;
+
+typedef struct VirtQueue {
+    unsigned num;
+    uint64_t desc_addr;         /* QEMU's addresses of the ring */
+    uint64_t avail_addr;
+    uint64_t used_addr;
+    VRingDesc *desc;
+    VRingAvail *avail;
+    VRingUsed *used;
+    uint16_t last_avail_idx;
+    int kick_fd;
+    int call_fd;
+} VirtQueue;
+
+static MemRegion regions[VHOST_MEMORY_MAX_NREGIONS];
+static int nregions;
+static VirtQueue vqs[2];
+
+static uint64_t packets, bytes, dropped;
+
+static void *gpa_to_va(uint64_t gpa, uint32_t len)
+{
+    int i;
+
+    for (i = 0; i < nregions; i++) {
+        MemRegion *r = &regions[i];
+        if (gpa >= r->gpa && gpa - r->gpa + len <= r->size) {
+            return r->mmap_addr + r->mmap_offset + (gpa - r->gpa);
+        }
+    }
+    return NULL;
+}
+
+static void *qemu_va_to_va(uint64_t addr)
+{
+    int i;
+
+    for (i = 0; i < nregions; i++) {
+        MemRegion *r = &regions[i];
+        if (addr >= r->qemu_addr && addr - r->qemu_addr < r->size) {
+            return r->mmap_addr + r->mmap_offset + (addr - r->qemu_addr);
+        }
+    }
+    return NULL;
+}
+
+static void unmap_regions(void)
+{
+    int i;
+
+    for (i = 0; i < nregions; i++) {
+        munmap(regions[i].mmap_addr, regions[i].mmap_size);
+    }
+    nregions = 0;
+}
+
+static void vq_map(VirtQueue *vq)
+{
+    if (!vq->desc_addr) {
+        return;
+    }
+    vq->desc = qemu_va_to_va(vq->desc_addr);
+    vq->avail = qemu_va_to_va(vq->avail_addr);
+    vq->used = qemu_va_to_va(vq->used_addr);
+}
+
+static void vq_reset(VirtQueue *vq)
+{
+    if (vq->kick_fd >= 0) {
+        close(vq->kick_fd);
+    }
+    if (vq->call_fd >= 0) {
+        close(vq->call_fd);
+    }
+    memset(vq, 0, sizeof(*vq));
+    vq->kick_fd = vq->call_fd = -1;
+}
+
+static int vq_ready(VirtQueue *vq)
+{
+    return vq->desc && vq->avail && vq->used;
+}
+
+static void vq_signal(VirtQueue *vq)
+{
+    uint64_t one = 1;
+
+    __sync_synchronize();
+    if (vq->call_fd >= 0 && !(vq->avail->flags & VRING_AVAIL_F_NO_INTERRUPT)) {
+        if (write(vq->call_fd, &one, sizeof(one)) < 0) {
+            perror("call");
+        }
+    }
+}
+
+static void vq_push(VirtQueue *vq, uint16_t head, uint32_t len)
+{
+    VRingUsedElem *elem = &vq->used->ring[vq->used->idx % vq->num];
+
+    elem->id = head;
+    elem->len = len;
+    __sync_synchronize();
+    vq->used->idx++;
+}
+
+/* Pop the next buffer chain; returns its head or -1 if the ring is empty. */
+static int vq_pop(VirtQueue *vq)
+{
+    int head;
+
+    if (vq->last_avail_idx == vq->avail->idx) {
+        return -1;
+    }
+    __sync_synchronize();
+    head = vq->avail->ring[vq->last_avail_idx % vq->num];
+    vq->last_avail_idx++;
+    return head;
+}
+
+/* Copy the chain at 'head' to or from 'buf'; returns the bytes copied. */
+static uint32_t vq_copy(VirtQueue *vq, int head, uint8_t *buf, uint32_t len,
+                        int to_guest)
+{
+    unsigned i = head, n = 0;
+    uint32_t done = 0;
+
+    for (;;) {
+        VRingDesc *d = &vq->desc[i];
+        uint32_t chunk = d->len;
+        uint8_t *va;
+
+        if (to_guest && chunk > len - done) {
+            chunk = len - done;
+        }
+        if (!to_guest && chunk > MAX_PACKET - done) {
+            chunk = MAX_PACKET - done;
+        }
+        va = gpa_to_va(d->addr, chunk);
+        if (!va) {
+            fprintf(stderr, "descriptor out of guest memory\n");
+            exit(1);
+        }
+        if (to_guest) {
+            memcpy(va, buf + done, chunk);
+        } else {
+            memcpy(buf + done, va, chunk);
+        }
+        done += chunk;
+        if (!(d->flags & VRING_DESC_F_NEXT) || ++n == vq->num) {
+            break;
+        }
+        i = d->next % vq->num;
+    }
+    return done;
+}
+
+/* Send every packet on the TX queue back through the RX queue. */
+static void loop_packets(void)
+{
+    static uint8_t buf[MAX_PACKET];
+    VirtQueue *tx = &vqs[TX_VQ], *rx = &vqs[RX_VQ];
+    int head, rx_head, tx_done = 0, rx_done = 0;
+    uint32_t len;
+
+    if (!vq_ready(tx) || !vq_ready(rx)) {
+        return;
+    }
+    while ((head = vq_pop(tx)) >= 0) {
+        len = vq_copy(tx, head, buf, 0, 0);
+        vq_push(tx, head, 0);
+        tx_done++;
+        if (len < VIRTIO_NET_HDR_LEN) {
+            continue;
+        }
+
+        rx_head = vq_pop(rx);
+        if (rx_head < 0) {
+            dropped++;
+            continue;
+        }
+        /* no offloads were negotiated, the header is all zeroes */
+        memset(buf, 0, VIRTIO_NET_HDR_LEN);
+        len = vq_copy(rx, rx_head, buf, len, 1);
+        vq_push(rx, rx_head, len);
+        rx_done++;
+        packets++;
+        bytes += len - VIRTIO_NET_HDR_LEN;
+    }
+    if (tx_done) {
+        vq_signal(tx);
+    }
+    if (rx_done) {
+        vq_signal(rx);
+    }
+}
+
+static int read_msg(int sock, VhostUserMsg *msg, int *fds, int *fd_num)
+{
+    char control[CMSG_SPACE(VHOST_MEMORY_MAX_NREGIONS * sizeof(int))];
+    struct iovec iov = {
+        .iov_base = msg,
+        .iov_len = VHOST_USER_HDR_SIZE,
+    };
+    struct msghdr msgh;
+    struct cmsghdr *cmsg;
+    ssize_t r;
+
+    memset(&msgh, 0, sizeof(msgh));
+    msgh.msg_iov = &iov;
+    msgh.msg_iovlen = 1;
+    msgh.msg_control = control;
+    msgh.msg_controllen = sizeof(control);
+
+    r = recvmsg(sock, &msgh, 0);
+    if (r <= 0) {
+        return -1;
+    }
+    if (r != VHOST_USER_HDR_SIZE || msg->size > sizeof(msg->payload)) {
+        fprintf(stderr, "bad message header\n");
+        return -1;
+    }
+
+    *fd_num = 0;
+    for (cmsg = CMSG_FIRSTHDR(&msgh); cmsg; cmsg = CMSG_NXTHDR(&msgh, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            *fd_num = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds, CMSG_DATA(cmsg), *fd_num * sizeof(int));
+        }
+    }
+
+    if (msg->size &&
+        recv(sock, &msg->payload, msg->size, MSG_WAITALL) != msg->size) {
+        fprintf(stderr, "short message\n");
+        return -1;
+    }
+    return 0;
+}
+
+static void reply(int sock, VhostUserMsg *msg, uint32_t size)
+{
+    msg->flags = VHOST_USER_VERSION | VHOST_USER_REPLY_MASK;
+    msg->size = size;
+    if (write(sock, msg, VHOST_USER_HDR_SIZE + size) < 0) {
+        perror("reply");
+    }
+}
+
+static void set_mem_table(VhostUserMsg *msg, int *fds, int fd_num)
+{
+    int i;
+
+    unmap_regions();
+    for (i = 0; i < msg->payload.memory.nregions && i < fd_num; i++) {
+        VhostUserMemoryRegion ureg = msg->payload.memory.regions[i];
+        MemRegion *r = &regions[i];
+
+        r->gpa = ureg.guest_phys_addr;
+        r->size = ureg.memory_size;
+        r->qemu_addr = ureg.userspace_addr;
+        r->mmap_offset = ureg.mmap_offset;
+        r->mmap_size = ureg.memory_size + ureg.mmap_offset;
+        r->mmap_addr = mmap(NULL, r->mmap_size, PROT_READ | PROT_WRITE,
+                            MAP_SHARED, fds[i], 0);
+        close(fds[i]);
+        if (r->mmap_addr == MAP_FAILED) {
+            perror("mmap");
+            exit(1);
+        }
+        nregions++;
+    }
+    vq_map(&vqs[RX_VQ]);
+    vq_map(&vqs[TX_VQ]);
+}
+
+/* Returns -1 when QEMU goes away. */
+static int handle_msg(int sock)
+{
+    VhostUserMsg msg;
+    int fds[VHOST_MEMORY_MAX_NREGIONS];
+    int fd_num, fd, i;
+    VirtQueue *vq;
+
+    if (read_msg(sock, &msg, fds, &fd_num) < 0) {
+        return -1;
+    }
+
+    switch (msg.request) {
+    case VHOST_USER_GET_FEATURES:
+        msg.payload.u64 = 0;
+        reply(sock, &msg, sizeof(msg.payload.u64));
+        break;
+    case VHOST_USER_SET_FEATURES:
+    case VHOST_USER_SET_OWNER:
+        break;
+    case VHOST_USER_RESET_OWNER:
+        vq_reset(&vqs[RX_VQ]);
+        vq_reset(&vqs[TX_VQ]);
+        break;
+    case VHOST_USER_SET_MEM_TABLE:
+        set_mem_table(&msg, fds, fd_num);
+        fd_num = 0;
+        break;
+    case VHOST_USER_SET_VRING_NUM:
+        vqs[msg.payload.state.index & 1].num = msg.payload.state.num;
+        break;
+    case VHOST_USER_SET_VRING_BASE:
+        vqs[msg.payload.state.index & 1].last_avail_idx =
+            msg.payload.state.num;
+        break;
+    case VHOST_USER_GET_VRING_BASE:
+        /* QEMU takes the ring back */
+        vq = &vqs[msg.payload.state.index & 1];
+        msg.payload.state.num = vq->last_avail_idx;
+        if (vq->kick_fd >= 0) {
+            close(vq->kick_fd);
+        }
+        vq->kick_fd = -1;
+        vq->desc_addr = 0;
+        vq->desc = NULL;
+        reply(sock, &msg, sizeof(msg.payload.state));
+        break;
+    case VHOST_USER_SET_VRING_ADDR:
+        vq = &vqs[msg.payload.addr.index & 1];
+        vq->desc_addr = msg.payload.addr.desc_user_addr;
+        vq->avail_addr = msg.payload.addr.avail_user_addr;
+        vq->used_addr = msg.payload.addr.used_user_addr;
+        vq_map(vq);
+        break;
+    case VHOST_USER_SET_VRING_KICK:
+    case VHOST_USER_SET_VRING_CALL:
+        vq = &vqs[msg.payload.u64 & 1];
+        fd = -1;
+        if (!(msg.payload.u64 & VHOST_USER_VRING_NOFD_MASK) && fd_num) {
+            fd = fds[0];
+            fd_num = 0;
+        }
+        if (msg.request == VHOST_USER_SET_VRING_KICK) {
+            if (vq->kick_fd >= 0) {
+                close(vq->kick_fd);
+            }
+            vq->kick_fd = fd;
+        } else {
+            if (vq->call_fd >= 0) {
+                close(vq->call_fd);
+            }
+            vq->call_fd = fd;
+        }
+        break;
+    default:
+        fprintf(stderr, "unsupported request %d\n", msg.request);
+        break;
+    }
+
+    for (i = 0; i < fd_num; i++) {
+        close(fds[i]);
+    }
+    return 0;
+}
+
+static double now(void)
+{
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec / 1e6;
+}
+
+static int serve(int sock)
+{
+    double last = now();
+    uint64_t last_packets = 0, last_bytes = 0;
+
+    for (;;) {
+        struct pollfd pfd[3];
+        int i, n = 1;
+        double t;
+
+        pfd[0].fd = sock;
+        pfd[0].events = POLLIN;
+        for (i = 0; i < 2; i++) {
+            if (vqs[i].kick_fd >= 0) {
+                pfd[n].fd = vqs[i].kick_fd;
+                pfd[n].events = POLLIN;
+                n++;
+            }
+        }
+        if (poll(pfd, n, 1000) < 0 && errno != EINTR) {
+            perror("poll");
+            return 1;
+        }
+        if (pfd[0].revents & (POLLIN | POLLHUP)) {
+            if (handle_msg(sock) < 0) {
+                return 0;
+            }
+            continue;
+        }
+        for (i = 1; i < n; i++) {
+            uint64_t count;
+            if ((pfd[i].revents & POLLIN) &&
+                read(pfd[i].fd, &count, sizeof(count)) < 0) {
+                perror("kick");
+            }
+        }
+        loop_packets();
+
+        t = now();
+        if (t - last >= 1) {
+            if (packets != last_packets) {
+                printf("%.0f packets/s, %.1f Mbit/s, %" PRIu64 " dropped\n",
+                       (packets - last_packets) / (t - last),
+                       (bytes - last_bytes) * 8 / (t - last) / 1e6, dropped);
+                fflush(stdout);
+            }
+            last = t;
+            last_packets = packets;
+            last_bytes = bytes;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    struct sockaddr_un un;
+    int listen_fd, sock;
+
+    if (argc != 2) {
+        fprintf(stderr, "usage: %s socket-path\n", argv[0]);
+        return 1;
+    }
+
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        perror("socket");
+        return 1;
+    }
+    memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    snprintf(un.sun_path, sizeof(un.sun_path), "%s", argv[1]);
+    unlink(un.sun_path);
+    if (bind(listen_fd, (struct sockaddr *)&un, sizeof(un)) < 0 ||
+        listen(listen_fd, 1) < 0) {
+        perror(argv[1]);
+        return 1;
+    }
+
+    vqs[RX_VQ].kick_fd = vqs[RX_VQ].call_fd = -1;
+    vqs[TX_VQ].kick_fd = vqs[TX_VQ].call_fd = -1;
+    for (;;) {
+        sock = accept(listen_fd, NULL, NULL);
+        if (sock < 0) {
+            perror("accept");
+            return 1;
+        }
+        printf("QEMU connected\n");
+        fflush(stdout);
+        serve(sock);
+        printf("QEMU disconnected: %" PRIu64 " packets looped, "
+               "%" PRIu64 " dropped\n", packets, dropped);
+        fflush(stdout);
+        close(sock);
+        unmap_regions();
+        vq_reset(&vqs[RX_VQ]);
+        vq_reset(&vqs[TX_VQ]);
+        packets = bytes = dropped = 0;
+    }
+}
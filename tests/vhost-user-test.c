@@ -0,0 +1,311 @@
+/*
+ * QTest testcase for the vhost-user network backend
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * A thread of the test plays the backend process at the other end of
+ * "-netdev vhost-user".  It offers MRG_RXBUF but not EVENT_IDX, so the
+ * guest must only see the former, and it checks that the memory table it
+ * receives once the guest driver is ready maps the guest RAM: a pattern
+ * written by the guest must be readable through the file descriptors.
+ */
+#include "libqos.h"
+
+#include <glib.h>
+#include <pthread.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define VIRTIO_NET_SLOT         4
+#define VIRTIO_NET_IO_BASE      0xc000
+
+#define VIRTIO_NET_F_MRG_RXBUF  15
+#define VIRTIO_RING_F_EVENT_IDX 29
+
+/* guest physical layout used by the driver */
+#define RX_VRING_ADDR           0x100000
+#define TX_VRING_ADDR           0x110000
+#define PATTERN_ADDR            0x200000
+#define PATTERN_LEN             64
+
+#define VHOST_MEMORY_MAX_NREGIONS   8
+
+enum {
+    VHOST_USER_GET_FEATURES = 1,
+    VHOST_USER_SET_FEATURES = 2,
+    VHOST_USER_SET_MEM_TABLE = 5,
+    VHOST_USER_GET_VRING_BASE = 11,
+};
+
+#define VHOST_USER_VERSION          0x1
+#define VHOST_USER_REPLY_MASK       (0x1 << 2)
+
+typedef struct VhostUserMemoryRegion {
+    uint64_t guest_phys_addr;
+    uint64_t memory_size;
+    uint64_t userspace_addr;
+    uint64_t mmap_offset;
+} VhostUserMemoryRegion;
+
+typedef struct VhostUserMsg {
+    uint32_t request;
+    uint32_t flags;
+    uint32_t size;
+    union {
+        uint64_t u64;
+        struct {
+            uint32_t index;
+            uint32_t num;
+        } state;
+        struct {
+            uint32_t nregions;
+            uint32_t padding;
+            VhostUserMemoryRegion regions[VHOST_MEMORY_MAX_NREGIONS];
+        } memory;
+    } payload;
+} __attribute__((packed)) VhostUserMsg;
+
+#define VHOST_USER_HDR_SIZE     offsetof(VhostUserMsg, payload)
+
+static char tmp_dir[] = "/tmp/vhost-user-test-XXXXXX";
+static char *socket_path;
+static int listen_fd;
+static pthread_t backend_thread;
+
+/* what the backend saw, under backend_lock */
+static pthread_mutex_t backend_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t backend_cond = PTHREAD_COND_INITIALIZER;
+static bool got_features;
+static bool got_mem_table;
+static uint64_t acked_features;
+static int mem_nregions;
+static uint8_t mem_pattern[PATTERN_LEN];
+static bool mem_pattern_found;
+
+static int read_msg(int sock, VhostUserMsg *msg, int *fds, int *fd_num)
+{
+    char control[CMSG_SPACE(VHOST_MEMORY_MAX_NREGIONS * sizeof(int))];
+    struct iovec iov = {
+        .iov_base = msg,
+        .iov_len = VHOST_USER_HDR_SIZE,
+    };
+    struct msghdr msgh;
+    struct cmsghdr *cmsg;
+
+    memset(&msgh, 0, sizeof(msgh));
+    msgh.msg_iov = &iov;
+    msgh.msg_iovlen = 1;
+    msgh.msg_control = control;
+    msgh.msg_controllen = sizeof(control);
+
+    if (recvmsg(sock, &msgh, 0) != VHOST_USER_HDR_SIZE ||
+        msg->size > sizeof(msg->payload)) {
+        return -1;
+    }
+
+    *fd_num = 0;
+    for (cmsg = CMSG_FIRSTHDR(&msgh); cmsg; cmsg = CMSG_NXTHDR(&msgh, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            *fd_num = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            memcpy(fds, CMSG_DATA(cmsg), *fd_num * sizeof(int));
+        }
+    }
+
+    if (msg->size &&
+        recv(sock, &msg->payload, msg->size, MSG_WAITALL) != msg->size) {
+        return -1;
+    }
+    return 0;
+}
+
+static void reply(int sock, VhostUserMsg *msg, uint32_t size)
+{
+    msg->flags = VHOST_USER_VERSION | VHOST_USER_REPLY_MASK;
+    msg->size = size;
+    g_assert_cmpint(write(sock, msg, VHOST_USER_HDR_SIZE + size), ==,
+                    VHOST_USER_HDR_SIZE + size);
+}
+
+/* copies PATTERN_LEN bytes at PATTERN_ADDR out of the region mapping it */
+static void read_pattern(VhostUserMsg *msg, int *fds, int fd_num)
+{
+    int i;
+
+    mem_nregions = msg->payload.memory.nregions;
+    for (i = 0; i < mem_nregions && i < fd_num; i++) {
+        VhostUserMemoryRegion reg = msg->payload.memory.regions[i];
+        size_t size = reg.memory_size + reg.mmap_offset;
+        uint8_t *p;
+
+        if (PATTERN_ADDR < reg.guest_phys_addr ||
+            PATTERN_ADDR + PATTERN_LEN >
+            reg.guest_phys_addr + reg.memory_size) {
+            continue;
+        }
+        p = mmap(NULL, size, PROT_READ, MAP_SHARED, fds[i], 0);
+        g_assert(p != MAP_FAILED);
+        memcpy(mem_pattern, p + reg.mmap_offset +
+               (PATTERN_ADDR - reg.guest_phys_addr), PATTERN_LEN);
+        munmap(p, size);
+        mem_pattern_found = true;
+    }
+}
+
+static void *backend_run(void *opaque)
+{
+    VhostUserMsg msg;
+    int fds[VHOST_MEMORY_MAX_NREGIONS];
+    int sock, fd_num, i;
+
+    sock = accept(listen_fd, NULL, NULL);
+    g_assert_cmpint(sock, >=, 0);
+
+    /* until QEMU goes away */
+    while (read_msg(sock, &msg, fds, &fd_num) == 0) {
+        pthread_mutex_lock(&backend_lock);
+        switch (msg.request) {
+        case VHOST_USER_GET_FEATURES:
+            msg.payload.u64 = 1ULL << VIRTIO_NET_F_MRG_RXBUF;
+            reply(sock, &msg, sizeof(msg.payload.u64));
+            break;
+        case VHOST_USER_SET_FEATURES:
+            acked_features = msg.payload.u64;
+            got_features = true;
+            break;
+        case VHOST_USER_SET_MEM_TABLE:
+            read_pattern(&msg, fds, fd_num);
+            got_mem_table = true;
+            break;
+        case VHOST_USER_GET_VRING_BASE:
+            msg.payload.state.num = 0;
+            reply(sock, &msg, sizeof(msg.payload.state));
+            break;
+        default:
+            break;
+        }
+        pthread_cond_broadcast(&backend_cond);
+        pthread_mutex_unlock(&backend_lock);
+
+        for (i = 0; i < fd_num; i++) {
+            close(fds[i]);
+        }
+    }
+
+    close(sock);
+    return NULL;
+}
+
+/* waits up to 5 seconds for *flag, with backend_lock held */
+static void wait_for(bool *flag)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += 5;
+    while (!*flag &&
+           pthread_cond_timedwait(&backend_cond, &backend_lock, &ts) == 0) {
+        /* nothing */
+    }
+}
+
+static void test_negotiate(void)
+{
+    uint8_t pattern[PATTERN_LEN];
+    uint32_t features;
+    QVirtQueue rx = {
+        .io_base = VIRTIO_NET_IO_BASE,
+        .index = 0,
+        .addr = RX_VRING_ADDR,
+    };
+    QVirtQueue tx = {
+        .io_base = VIRTIO_NET_IO_BASE,
+        .index = 1,
+        .addr = TX_VRING_ADDR,
+    };
+    int i;
+
+    for (i = 0; i < PATTERN_LEN; i++) {
+        pattern[i] = 0xa5 ^ i;
+    }
+    memwrite(PATTERN_ADDR, pattern, PATTERN_LEN);
+
+    qvirtio_pci_init(VIRTIO_NET_SLOT, VIRTIO_NET_IO_BASE);
+    features = inl(VIRTIO_NET_IO_BASE + VIRTIO_PCI_HOST_FEATURES);
+    g_assert(features & (1 << VIRTIO_NET_F_MRG_RXBUF));
+    g_assert(!(features & (1 << VIRTIO_RING_F_EVENT_IDX)));
+    outl(VIRTIO_NET_IO_BASE + VIRTIO_PCI_GUEST_FEATURES,
+         features & (1 << VIRTIO_NET_F_MRG_RXBUF));
+    qvirtqueue_init(&rx);
+    qvirtqueue_init(&tx);
+
+    /* starts vhost */
+    qvirtio_pci_driver_ok(VIRTIO_NET_IO_BASE);
+
+    pthread_mutex_lock(&backend_lock);
+    wait_for(&got_features);
+    wait_for(&got_mem_table);
+    g_assert(got_features);
+    g_assert_cmphex(acked_features, ==, 1ULL << VIRTIO_NET_F_MRG_RXBUF);
+    g_assert(got_mem_table);
+    g_assert_cmpint(mem_nregions, >=, 1);
+    g_assert(mem_pattern_found);
+    g_assert(memcmp(mem_pattern, pattern, PATTERN_LEN) == 0);
+    pthread_mutex_unlock(&backend_lock);
+}
+
+int main(int argc, char **argv)
+{
+    QTestState *s = NULL;
+    struct sockaddr_un addr;
+    char *args;
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    g_assert(mkdtemp(tmp_dir));
+    socket_path = g_strdup_printf("%s/vhost.sock", tmp_dir);
+
+    /* QEMU connects while it starts, and waits for the features */
+    listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    g_assert_cmpint(listen_fd, >=, 0);
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    g_strlcpy(addr.sun_path, socket_path, sizeof(addr.sun_path));
+    g_assert_cmpint(bind(listen_fd, (struct sockaddr *)&addr,
+                         sizeof(addr)), ==, 0);
+    g_assert_cmpint(listen(listen_fd, 1), ==, 0);
+    g_assert_cmpint(pthread_create(&backend_thread, NULL, backend_run,
+                                   NULL), ==, 0);
+
+    /* the guest RAM goes to a shared file in tmp_dir, that the backend
+     * maps; vhostforce because the driver does not enable MSI-X
+     */
+    args = g_strdup_printf("-display none -vga none -m 64 "
+                           "-mem-path %s -mem-shared "
+                           "-netdev vhost-user,id=n0,path=%s,vhostforce=on "
+                           "-device virtio-net-pci,netdev=n0,addr=04.0",
+                           tmp_dir, socket_path);
+    s = qtest_start(args);
+    g_free(args);
+
+    qtest_add_func("/vhost-user/negotiate", test_negotiate);
+    ret = g_test_run();
+
+    if (s) {
+        qtest_quit(s);
+    }
+    pthread_join(backend_thread, NULL);
+    close(listen_fd);
+    unlink(socket_path);
+    rmdir(tmp_dir);
+    g_free(socket_path);
+
+    return ret;
+}
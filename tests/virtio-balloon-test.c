@@ -0,0 +1,205 @@
+/*
+ * QTest testcase for virtio-balloon free page hinting and reporting
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * The libqos virtio driver negotiates the free page hint feature and
+ * reports a range of guest memory as free while a migration is in its
+ * first pass.  The pages of the range must then show up as skipped in
+ * query-migrate.  The same range is then passed to the free page
+ * reporting queue and must show up in query-balloon.  The reporting rate
+ * is limited to 10 MB/s, 1 MB per 100 ms slice of vm_clock, so that later
+ * chunks are held back until the clock is stepped.
+ */
+#include "libqos.h"
+
+#include <glib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+
+#define BALLOON_SLOT            4
+#define BALLOON_IO_BASE         0xc000
+
+#define VIRTIO_BALLOON_F_FREE_PAGE_HINT 3
+#define VIRTIO_BALLOON_F_REPORTING      5
+#define VIRTIO_BALLOON_FREE_PAGE_VQ     3
+#define VIRTIO_BALLOON_REPORTING_VQ     4
+#define VIRTIO_BALLOON_CMD_ID_DONE      1
+#define BALLOON_CONFIG_CMD_ID           8
+
+/* guest physical layout used by the driver */
+#define VRING_ADDR              0x100000
+#define REPORT_VRING_ADDR       0x180000
+#define CMD_ID_ADDR             0x200000
+#define FREE_ADDR               0x1000000
+#define FREE_SIZE               (2 * 1024 * 1024)
+
+#define REPORT_SLICE_NS         (100 * 1000 * 1000LL)
+
+static QVirtQueue free_page_vq = {
+    .io_base = BALLOON_IO_BASE,
+    .index = VIRTIO_BALLOON_FREE_PAGE_VQ,
+    .addr = VRING_ADDR,
+};
+
+static QVirtQueue reporting_vq = {
+    .io_base = BALLOON_IO_BASE,
+    .index = VIRTIO_BALLOON_REPORTING_VQ,
+    .addr = REPORT_VRING_ADDR,
+};
+
+/* report the free range, introduced by command id 'id' */
+static void send_hint(uint32_t id)
+{
+    writel_le(CMD_ID_ADDR, id);
+    qvirtqueue_add(&free_page_vq, CMD_ID_ADDR, 4, 0);
+    qvirtqueue_add(&free_page_vq, FREE_ADDR, FREE_SIZE, VRING_DESC_F_WRITE);
+}
+
+static uint32_t config_cmd_id(void)
+{
+    return inl(BALLOON_IO_BASE + VIRTIO_PCI_CONFIG + BALLOON_CONFIG_CMD_ID);
+}
+
+/* integer member 'name' of the reply to 'cmd' */
+static int64_t qmp_get_int(const char *cmd, const char *name)
+{
+    char *reply = qmp_reply(cmd);
+    char *key = g_strdup_printf("\"%s\"", name);
+    char *p = strstr(reply, key);
+    int64_t val;
+
+    g_assert(p);
+    p = strchr(p, ':');
+    g_assert(p);
+    val = strtoll(p + 1, NULL, 10);
+    g_free(key);
+    g_free(reply);
+
+    return val;
+}
+
+static int64_t migrate_skipped(void)
+{
+    return qmp_get_int("{ 'execute': 'query-migrate' }", "skipped");
+}
+
+static void balloon_driver_init(void)
+{
+    uint32_t features;
+
+    g_assert_cmphex(pci_config_readl(BALLOON_SLOT, 0), ==, 0x10021af4);
+    qvirtio_pci_init(BALLOON_SLOT, BALLOON_IO_BASE);
+
+    features = inl(BALLOON_IO_BASE + VIRTIO_PCI_HOST_FEATURES);
+    g_assert(features & (1 << VIRTIO_BALLOON_F_FREE_PAGE_HINT));
+    g_assert(features & (1 << VIRTIO_BALLOON_F_REPORTING));
+    outl(BALLOON_IO_BASE + VIRTIO_PCI_GUEST_FEATURES,
+         (1 << VIRTIO_BALLOON_F_FREE_PAGE_HINT) |
+         (1 << VIRTIO_BALLOON_F_REPORTING));
+
+    qvirtqueue_init(&free_page_vq);
+    qvirtqueue_init(&reporting_vq);
+
+    qvirtio_pci_driver_ok(BALLOON_IO_BASE);
+}
+
+static void free_page_hint(void)
+{
+    uint32_t id;
+
+    balloon_driver_init();
+
+    /* no migration, no hinting */
+    g_assert_cmpint(config_cmd_id(), ==, 0);
+
+    /* Throttle the migration so that the first pass does not get to the
+       free range before the hint.  */
+    g_free(qmp_reply("{ 'execute': 'migrate_set_speed',"
+                     "  'arguments': { 'value': 1 } }"));
+    g_free(qmp_reply("{ 'execute': 'migrate',"
+                     "  'arguments': { 'uri': 'exec:cat > /dev/null' } }"));
+
+    id = config_cmd_id();
+    g_assert_cmpint(id, >, VIRTIO_BALLOON_CMD_ID_DONE);
+
+    /* hints for a stale command are ignored */
+    send_hint(id + 1);
+    g_assert_cmpint(qvring_used_idx(&free_page_vq), ==, 2);
+    g_assert_cmpint(migrate_skipped(), ==, 0);
+
+    send_hint(id);
+    g_assert_cmpint(qvring_used_idx(&free_page_vq), ==, 4);
+    g_assert_cmpint(migrate_skipped(), ==, FREE_SIZE);
+
+    /* the pages were already cleared, a second report skips nothing more */
+    send_hint(id);
+    g_assert_cmpint(migrate_skipped(), ==, FREE_SIZE);
+
+    /* the end of the migration releases the free pages */
+    g_free(qmp_reply("{ 'execute': 'migrate_cancel' }"));
+    g_assert_cmpint(config_cmd_id(), ==, VIRTIO_BALLOON_CMD_ID_DONE);
+}
+
+static void free_page_report(void)
+{
+    const char *cmd = "{ 'execute': 'query-balloon' }";
+
+    g_assert_cmpint(qmp_get_int(cmd, "free_page_reported"), ==, 0);
+
+    /* one chunk well below the rate limit, returned at once */
+    qvirtqueue_add(&reporting_vq, FREE_ADDR, FREE_SIZE, VRING_DESC_F_WRITE);
+    g_assert_cmpint(qvring_used_idx(&reporting_vq), ==, 1);
+    g_assert_cmpint(qmp_get_int(cmd, "free_page_reported"), ==, FREE_SIZE);
+    g_assert_cmpint(qmp_get_int(cmd, "free_page_reclaimed"), <=, FREE_SIZE);
+}
+
+static void free_page_report_throttle(void)
+{
+    const char *cmd = "{ 'execute': 'query-balloon' }";
+
+    /* the first chunk used up the slice, the next one waits for the timer */
+    qvirtqueue_add(&reporting_vq, FREE_ADDR, FREE_SIZE, VRING_DESC_F_WRITE);
+    g_assert_cmpint(qvring_used_idx(&reporting_vq), ==, 1);
+    g_assert_cmpint(qmp_get_int(cmd, "free_page_reported"), ==, FREE_SIZE);
+
+    clock_step(REPORT_SLICE_NS);
+    g_assert_cmpint(qvring_used_idx(&reporting_vq), ==, 2);
+    g_assert_cmpint(qmp_get_int(cmd, "free_page_reported"), ==,
+                    2 * FREE_SIZE);
+
+    /* a chunk held back at reset is dropped with the ring */
+    qvirtqueue_add(&reporting_vq, FREE_ADDR, FREE_SIZE, VRING_DESC_F_WRITE);
+    g_assert_cmpint(qvring_used_idx(&reporting_vq), ==, 2);
+    outb(BALLOON_IO_BASE + VIRTIO_PCI_STATUS, 0);
+    clock_step(2 * REPORT_SLICE_NS);
+    g_assert_cmpint(qvring_used_idx(&reporting_vq), ==, 2);
+    g_assert_cmpint(qmp_get_int(cmd, "free_page_reported"), ==,
+                    2 * FREE_SIZE);
+}
+
+int main(int argc, char **argv)
+{
+    QTestState *s = NULL;
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    s = qtest_start("-display none -m 64 "
+                    "-device virtio-balloon-pci,addr=04.0,"
+                    "free-page-report-rate=10");
+
+    qtest_add_func("/virtio-balloon/free-page-hint", free_page_hint);
+    qtest_add_func("/virtio-balloon/free-page-report", free_page_report);
+    qtest_add_func("/virtio-balloon/free-page-report-throttle",
+                   free_page_report_throttle);
+    ret = g_test_run();
+
+    if (s) {
+        qtest_quit(s);
+    }
+
+    return ret;
+}
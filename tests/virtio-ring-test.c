@@ -0,0 +1,175 @@
+/*
+ * QTest testcase and benchmark for the virtqueue ring access code
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * The libqos virtio driver fills the free page hint queue of a
+ * virtio-balloon device with chained or indirect buffers.  Without a
+ * migration the device only pops and pushes them back, so one kick
+ * measures virtqueue_pop()/virtqueue_push() for a whole ring.  The
+ * throughput is reported with "-m perf".
+ */
+#include "libqos.h"
+
+#include <glib.h>
+#include <string.h>
+
+#define BALLOON_SLOT            4
+#define BALLOON_IO_BASE         0xc000
+
+#define VIRTIO_BALLOON_FREE_PAGE_VQ 3
+
+/* guest physical layout used by the driver */
+#define VRING_ADDR              0x100000
+#define CMD_ID_ADDR             0x200000
+#define DATA_ADDR               0x300000
+#define INDIRECT_ADDR           0x400000
+
+/* descriptors per element: the command id, then INDIRECT_IN free ranges */
+#define INDIRECT_IN             3
+#define INDIRECT_NUM            (1 + INDIRECT_IN)
+
+#define PERF_ROUNDS             2000
+
+static QVirtQueue vq = {
+    .io_base = BALLOON_IO_BASE,
+    .index = VIRTIO_BALLOON_FREE_PAGE_VQ,
+    .addr = VRING_ADDR,
+};
+
+/* every avail ring slot points to head (slot % heads) * stride */
+static void fill_avail_ring(int heads, int stride)
+{
+    uint16_t *ring = g_new(uint16_t, vq.num);
+    int i;
+
+    for (i = 0; i < vq.num; i++) {
+        ring[i] = GUINT16_TO_LE((i % heads) * stride);
+    }
+    memwrite(qvring_avail(&vq) + 4, ring, vq.num * sizeof(*ring));
+    g_free(ring);
+}
+
+/* elements of two chained descriptors, the command id and a free range */
+static int setup_chained(void)
+{
+    int i;
+
+    for (i = 0; i < vq.num; i += 2) {
+        qvring_write_desc(VRING_ADDR, i, CMD_ID_ADDR, 4, VRING_DESC_F_NEXT,
+                          i + 1);
+        qvring_write_desc(VRING_ADDR, i + 1, DATA_ADDR + i * 4096, 4096,
+                          VRING_DESC_F_WRITE, 0);
+    }
+    fill_avail_ring(vq.num / 2, 2);
+    return vq.num / 2;
+}
+
+/* elements of one indirect descriptor each */
+static int setup_indirect(void)
+{
+    int i, j;
+
+    for (i = 0; i < vq.num; i++) {
+        uint64_t table = INDIRECT_ADDR + i * INDIRECT_NUM * VRING_DESC_SIZE;
+
+        qvring_write_desc(VRING_ADDR, i, table, INDIRECT_NUM * VRING_DESC_SIZE,
+                          VRING_DESC_F_INDIRECT, 0);
+        qvring_write_desc(table, 0, CMD_ID_ADDR, 4, VRING_DESC_F_NEXT, 1);
+        for (j = 1; j <= INDIRECT_IN; j++) {
+            qvring_write_desc(table, j, DATA_ADDR + j * 4096, 4096,
+                              VRING_DESC_F_WRITE |
+                              (j < INDIRECT_IN ? VRING_DESC_F_NEXT : 0),
+                              j + 1);
+        }
+    }
+    fill_avail_ring(vq.num, 1);
+    return vq.num;
+}
+
+static void balloon_driver_init(void)
+{
+    qvirtio_pci_init(BALLOON_SLOT, BALLOON_IO_BASE);
+    qvirtqueue_init(&vq);
+    qvirtio_pci_driver_ok(BALLOON_IO_BASE);
+}
+
+static void check_ring(int (*setup)(void), int stride)
+{
+    uint16_t first = vq.avail_idx;
+    int count = setup();
+    int i;
+
+    qvirtqueue_kick(&vq, count);
+    g_assert_cmpint(qvring_used_idx(&vq), ==, vq.avail_idx);
+
+    /* the device returns the elements in order, with nothing written */
+    for (i = 0; i < count; i++) {
+        uint64_t elem = qvring_used(&vq) + 4 + ((first + i) % vq.num) * 8;
+
+        g_assert_cmpint(readl_le(elem), ==, ((first + i) % count) * stride);
+        g_assert_cmpint(readl_le(elem + 4), ==, 0);
+    }
+}
+
+static void test_chained(void)
+{
+    check_ring(setup_chained, 2);
+}
+
+static void test_indirect(void)
+{
+    check_ring(setup_indirect, 1);
+}
+
+static void bench_ring(const char *name, int (*setup)(void))
+{
+    int count = setup();
+    double elapsed;
+    int i;
+
+    g_test_timer_start();
+    for (i = 0; i < PERF_ROUNDS; i++) {
+        qvirtqueue_kick(&vq, count);
+    }
+    elapsed = g_test_timer_elapsed();
+    g_assert_cmpint(qvring_used_idx(&vq), ==, vq.avail_idx);
+
+    g_test_maximized_result(PERF_ROUNDS * count / elapsed,
+                            "%s: %.0f pop/push per second, "
+                            "%.1f us per kick of %d elements",
+                            name, PERF_ROUNDS * count / elapsed,
+                            elapsed * 1e6 / PERF_ROUNDS, count);
+}
+
+static void test_perf(void)
+{
+    bench_ring("chained", setup_chained);
+    bench_ring("indirect", setup_indirect);
+}
+
+int main(int argc, char **argv)
+{
+    QTestState *s = NULL;
+    int ret;
+
+    g_test_init(&argc, &argv, NULL);
+
+    s = qtest_start("-display none -m 64 "
+                    "-device virtio-balloon-pci,addr=04.0");
+    balloon_driver_init();
+
+    qtest_add_func("/virtio/ring/chained", test_chained);
+    qtest_add_func("/virtio/ring/indirect", test_indirect);
+    if (g_test_perf()) {
+        qtest_add_func("/virtio/ring/perf", test_perf);
+    }
+    ret = g_test_run();
+
+    if (s) {
+        qtest_quit(s);
+    }
+
+    return ret;
+}
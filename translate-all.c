@@ -66,6 +66,7 @@ int cpu_gen_code(CPUArchState *env, TranslationBlock *tb, int *gen_code_size_ptr
     ti = profile_getclock();
 #endif
     tcg_func_start(s);
+    s->no_optimize = (tb->cflags & CF_TIER_COLD) != 0;
 
     gen_intermediate_code(env, tb);
 
@@ -122,6 +123,7 @@ int cpu_restore_state(TranslationBlock *tb,
     ti = profile_getclock();
 #endif
     tcg_func_start(s);
+    s->no_optimize = (tb->cflags & CF_TIER_COLD) != 0;
 
     gen_intermediate_code_pc(env, tb);
 
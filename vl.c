@@ -179,7 +179,9 @@ ram_addr_t ram_size;
 const char *mem_path = NULL;
 #ifdef MAP_POPULATE
 int mem_prealloc = 0; /* force preallocation of physical target memory */
+int mem_prealloc_threads; /* 0 = one per host CPU */
 #endif
+int mem_shared = 0; /* map -mem-path files shared */
 int nb_nics;
 NICInfo nd_table[MAX_NICS];
 int autostart;
@@ -241,6 +243,8 @@ QTAILQ_HEAD(, FWBootEntry) fw_boot_order = QTAILQ_HEAD_INITIALIZER(fw_boot_order
 int nb_numa_nodes;
 uint64_t node_mem[MAX_NODES];
 uint64_t node_cpumask[MAX_NODES];
+uint64_t node_host_nodes[MAX_NODES];
+NumaHostPolicy node_host_policy[MAX_NODES];
 
 uint8_t qemu_uuid[16];
 
@@ -992,6 +996,41 @@ static void numa_add(const char *optarg)
             }
             node_cpumask[nodenr] = value;
         }
+        if (get_param_value(option, 128, "host-nodes", optarg) != 0) {
+            value = strtoull(option, &endptr, 10);
+            endvalue = value;
+            if (*endptr == '-') {
+                endvalue = strtoull(endptr + 1, &endptr, 10);
+            }
+            if (*endptr || value > endvalue || endvalue >= 64) {
+                fprintf(stderr, "qemu: invalid numa host-nodes: %s\n",
+                        option);
+                exit(1);
+            }
+            node_host_nodes[nodenr] = (2ULL << endvalue) - (1ULL << value);
+            node_host_policy[nodenr] = NUMA_HOST_POLICY_BIND;
+        }
+        if (get_param_value(option, 128, "policy", optarg) != 0) {
+            int i;
+
+            for (i = 0; i < NUMA_HOST_POLICY_MAX; i++) {
+                if (!strcmp(option, NumaHostPolicy_lookup[i])) {
+                    break;
+                }
+            }
+            if (i == NUMA_HOST_POLICY_MAX) {
+                fprintf(stderr, "qemu: invalid numa policy: %s\n", option);
+                exit(1);
+            }
+            /* MPOL_DEFAULT takes no nodes, the others need some */
+            if ((i == NUMA_HOST_POLICY_DEFAULT) != !node_host_nodes[nodenr]) {
+                fprintf(stderr, "qemu: numa policy %s %s host-nodes\n",
+                        option, node_host_nodes[nodenr] ? "does not take" :
+                        "needs");
+                exit(1);
+            }
+            node_host_policy[nodenr] = i;
+        }
         nb_numa_nodes++;
     }
     return;
@@ -1269,6 +1308,10 @@ void vm_state_notify(int running, RunState state)
 
 void vm_start(void)
 {
+    /* a detached dump is reading guest memory */
+    if (dump_in_progress()) {
+        return;
+    }
     if (!runstate_is_running()) {
         cpu_enable_ticks();
         runstate_set(RUN_STATE_RUNNING);
@@ -2331,6 +2374,8 @@ int main(int argc, char **argv, char **envp)
     for (i = 0; i < MAX_NODES; i++) {
         node_mem[i] = 0;
         node_cpumask[i] = 0;
+        node_host_nodes[i] = 0;
+        node_host_policy[i] = NUMA_HOST_POLICY_DEFAULT;
     }
 
     nb_numa_nodes = 0;
@@ -2670,10 +2715,21 @@ int main(int argc, char **argv, char **envp)
             case QEMU_OPTION_mempath:
                 mem_path = optarg;
                 break;
+            case QEMU_OPTION_mem_shared:
+                mem_shared = 1;
+                break;
 #ifdef MAP_POPULATE
             case QEMU_OPTION_mem_prealloc:
                 mem_prealloc = 1;
                 break;
+            case QEMU_OPTION_mem_prealloc_threads:
+                mem_prealloc_threads = strtol(optarg, NULL, 0);
+                if (mem_prealloc_threads <= 0) {
+                    fprintf(stderr, "qemu: invalid number of preallocation "
+                            "threads: %s\n", optarg);
+                    exit(1);
+                }
+                break;
 #endif
             case QEMU_OPTION_d:
                 log_mask = optarg;
@@ -2696,6 +2752,12 @@ int main(int argc, char **argv, char **envp)
             case QEMU_OPTION_singlestep:
                 singlestep = 1;
                 break;
+            case QEMU_OPTION_perfmap:
+                perf_enable_perfmap();
+                break;
+            case QEMU_OPTION_jitdump:
+                perf_enable_jitdump();
+                break;
             case QEMU_OPTION_S:
                 autostart = 0;
                 break;
@@ -3140,6 +3202,13 @@ int main(int argc, char **argv, char **envp)
                     tcg_tb_size = 0;
                 }
                 break;
+            case QEMU_OPTION_tb_hot_threshold:
+                if (tb_set_hot_threshold(optarg) < 0) {
+                    fprintf(stderr, "qemu: invalid -tb-hot-threshold value "
+                            "'%s', expected a non-negative integer\n", optarg);
+                    exit(1);
+                }
+                break;
             case QEMU_OPTION_icount:
                 icount_option = optarg;
                 break;
@@ -3554,6 +3623,8 @@ int main(int argc, char **argv, char **envp)
     machine->init(ram_size, boot_devices,
                   kernel_filename, kernel_cmdline, initrd_filename, cpu_model);
 
+    qemu_ram_prealloc_all();
+
     cpu_synchronize_all_post_init();
 
     set_numa_modes();